@@ -1,14 +1,5 @@
 #include "wireless_simu.h"
 
-static const struct ce_attr ce_ring_configs[] = {
-    {
-        .flags = 0,
-        .dest_nentries = 32,
-        .src_sz_max = 2048, // 在dest_ring中，该参数指定了每个包的最长大小
-        .src_nentries = 0,
-    },
-};
-
 static struct wireless_simu_ce_ring *hal_srng_alloc_ring(struct wireless_simu_device_state *wd, int nentries, int desc_sz)
 {
     struct wireless_simu_ce_ring *ring;
@@ -58,6 +49,13 @@ static int ce_alloc_pipe(struct copy_engine *ce, int pipe_num)
         }
         pipe->dst_ring = ring;
 
+        pipe->posts = calloc(nentries, sizeof(struct wireless_simu_ce_post));
+        if (!pipe->posts)
+        {
+            printf("%s : ce alloc posts err \n", WIRELESS_SIMU_DEVICE_NAME);
+            return -ENOMEM;
+        }
+
         /* status_ring */
         desc_sz = sizeof(struct hal_test_dst_status);
         ring = hal_srng_alloc_ring(ce->wd, 0, desc_sz); // nentries 置零表示不去分配skb数组空间
@@ -78,47 +76,70 @@ static int ce_alloc_pipe(struct copy_engine *ce, int pipe_num)
     return ret;
 }
 
-void ce_dst_ring_handler(void *user_data)
-{
-    // printf("%s : ce dst handler in \n", WIRELESS_SIMU_DEVICE_NAME);
+static void ce_backlog_replay(struct wireless_simu_device_state *wd, struct wireless_simu_ce_backlog *backlog);
 
-    struct wireless_simu_ce_pipe *pipe = (struct wireless_simu_ce_pipe *)user_data;
-    struct wireless_simu_device_state *wd = pipe->wd;
+/* 从 dst ring 中取出驱动补充的 buffer, 只取设备还能记录下的数量, 其余留在 ring 中, 返回取出的数量 */
+static uint32_t ce_dst_ring_refill(struct wireless_simu_device_state *wd, struct wireless_simu_ce_pipe *pipe)
+{
     struct wireless_simu_ce_ring *dst_ring = pipe->dst_ring;
-    if (!dst_ring)
-    {
-        printf("%s : ce dst ring no dst \n", WIRELESS_SIMU_DEVICE_NAME);
-        return;
-    }
-    pthread_mutex_lock(&pipe->pipe_lock);
     struct hal_srng *srng = &wd->hal.srng_list[dst_ring->hal_ring_id];
-    uint32_t *desc;
+    struct hal_srng_src_batch batch;
     struct hal_test_dst *entry;
     struct sk_buff *skb;
     dma_addr_t paddr;
-    uint32_t index;
+    uint32_t index, room;
+    uint32_t count = 0;
 
+    pthread_mutex_lock(&pipe->pipe_lock);
     qemu_mutex_lock(&srng->lock);
 
-    while (wireless_hal_srng_read_src_ring(wd, srng, &desc) == 0)
+    /* 还没有发布的 buffer 不能被覆盖, 全部记录之后再回写一次 tp */
+    while ((room = dst_ring->nentries - (dst_ring->sw_index - qatomic_load_acquire(&pipe->post_tail))) > 0 &&
+           wireless_hal_srng_src_batch_fill_max(wd, srng, &batch, room) > 0)
     {
-        entry = (struct hal_test_dst *)desc;
-        index = dst_ring->sw_index;
-        skb = &dst_ring->skb[index];
-        paddr = entry->buffer_addr_low +
-                (((uint64_t)entry->buffer_addr_info & 0xff) << 32);
-        WIRELESS_SIMU_SKB_CB(skb)->paddr = paddr;
-        printf("%s : dst ring %08x skb %08x paddr %016lx \n",
-               WIRELESS_SIMU_DEVICE_NAME, dst_ring->hal_ring_id, index, WIRELESS_SIMU_SKB_CB(skb)->paddr);
-        index = (index + 1) & dst_ring->nentries_mask;
-        dst_ring->sw_index = index;
-        free(desc);
+        for (uint32_t i = 0; i < batch.count; i++)
+        {
+            /* hal_test_dst 和 hal_ce_srng_dest_desc 的地址部分相同, 两种 dst ring 都可以这样取 */
+            entry = (struct hal_test_dst *)batch.desc[i];
+            index = dst_ring->sw_index;
+
+            skb = &dst_ring->skb[index & dst_ring->nentries_mask];
+            paddr = entry->buffer_addr_low +
+                    (((uint64_t)entry->buffer_addr_info & 0xff) << 32);
+            WIRELESS_SIMU_SKB_CB(skb)->paddr = paddr;
+
+            /* paddr 写好之后生产者才能预留到该 buffer */
+            qatomic_store_release(&dst_ring->sw_index, index + 1);
+        }
+
+        wireless_hal_srng_shadow_update(wd, srng, batch.tp[batch.count - 1]);
+        count += batch.count;
     }
 
     qemu_mutex_unlock(&srng->lock);
-
     pthread_mutex_unlock(&pipe->pipe_lock);
 
+    return count;
+}
+
+void ce_dst_ring_handler(void *user_data)
+{
+    // printf("%s : ce dst handler in \n", WIRELESS_SIMU_DEVICE_NAME);
+
+    struct wireless_simu_ce_pipe *pipe = (struct wireless_simu_ce_pipe *)user_data;
+    struct wireless_simu_device_state *wd = pipe->wd;
+    if (!pipe->dst_ring)
+    {
+        printf("%s : ce dst ring no dst \n", WIRELESS_SIMU_DEVICE_NAME);
+        return;
+    }
+
+    ce_dst_ring_refill(wd, pipe);
+
+    /* 驱动补充了 buffer, 重放暂存的事件和数据 */
+    ce_backlog_replay(wd, &wd->evt_backlog);
+    ce_backlog_replay(wd, &wd->rx_backlog);
+
     return;
 }
 
@@ -143,28 +164,117 @@ static int ce_init_ring(struct wireless_simu_ce_pipe *pipe, struct wireless_simu
     return 0;
 }
 
+/* 将 ce pipe 与实际的 ring 对应
+ * 所有 ce 的 pipe 统一编号, 编号 0 使用 test dst ring, 编号 n 使用 CE(n - 1) 的 dst / dst status ring */
+static int ce_bind_pipe(struct wireless_simu_ce_pipe *pipe, uint32_t index)
+{
+    int ret;
+
+    if (index == 0)
+    {
+        pipe->status_type = HAL_TEST_SRNG_DST_STATUS;
+        pipe->irq_statu = WIRELESS_SIMU_IRQ_STATU_SRNG_DST_DMA_TEST_RING_0;
+        ret = ce_init_ring(pipe, pipe->dst_ring, 0, HAL_TEST_SRNG_DST);
+        if (ret)
+            return ret;
+        return ce_init_ring(pipe, pipe->status_ring, 0, HAL_TEST_SRNG_DST_STATUS);
+    }
+
+    pipe->status_type = HAL_CE_DST_STATUS;
+    pipe->irq_statu = WIRELESS_SIMU_IRQ_STATUS_CE_DST + index - 1;
+    ret = ce_init_ring(pipe, pipe->dst_ring, index - 1, HAL_CE_DST);
+    if (ret)
+        return ret;
+    return ce_init_ring(pipe, pipe->status_ring, index - 1, HAL_CE_DST_STATUS);
+}
+
+bool wireless_simu_ce_topology_check(struct wireless_simu_device_state *wd, Error **errp)
+{
+    struct wireless_simu_ce_topology *topo = &wd->ce_topo;
+
+    if (topo->ce_count == 0 || topo->pipes_per_ce == 0)
+    {
+        error_setg(errp, "ce-count and ce-pipes must be at least 1");
+        return false;
+    }
+
+    if ((uint64_t)topo->ce_count * topo->pipes_per_ce > WIRELESS_SIMU_CE_PIPE_MAX)
+    {
+        error_setg(errp, "ce-count * ce-pipes must not exceed %d", WIRELESS_SIMU_CE_PIPE_MAX);
+        return false;
+    }
+
+    if (topo->dst_entries == 0 || topo->dst_entries > HAL_CE_DST_RING_BASE_MSB_RING_SIZE)
+    {
+        error_setg(errp, "ce-dst-entries must be between 1 and %d", HAL_CE_DST_RING_BASE_MSB_RING_SIZE);
+        return false;
+    }
+
+    /* status 中的长度字段只有 16 位 */
+    if (topo->buf_size == 0 || topo->buf_size > 0xffff)
+    {
+        error_setg(errp, "ce-buf-size must be between 1 and %d", 0xffff);
+        return false;
+    }
+
+    /* 数据至少还要留下一个 pipe */
+    if (topo->wmi_pipe != WIRELESS_SIMU_CE_PIPE_NONE &&
+        (topo->wmi_pipe >= topo->ce_count * topo->pipes_per_ce || topo->ce_count * topo->pipes_per_ce < 2))
+    {
+        error_setg(errp, "wmi-pipe must be less than ce-count * ce-pipes, which must be at least 2");
+        return false;
+    }
+
+    return true;
+}
+
+static void ce_backlog_init(struct wireless_simu_ce_backlog *backlog, struct wireless_simu_ce_stats *stats, bool hold)
+{
+    qemu_mutex_init(&backlog->lock);
+    QSIMPLEQ_INIT(&backlog->frames);
+    backlog->len = 0;
+    backlog->pipe = NULL;
+    backlog->ce_num = 0;
+    backlog->hold = hold;
+    backlog->stats = stats;
+}
+
 int wireless_simu_ce_init(struct wireless_simu_device_state *wd)
 {
     if (!wd)
         return -EINVAL;
 
     int ret = 0;
+    struct wireless_simu_ce_topology *topo = &wd->ce_topo;
     struct copy_engine *ce;
     struct wireless_simu_ce_pipe *pipe;
-    wd->ce_count_num = WIRELESS_SIMU_CE_COUNT;
+    uint32_t index = 0;
+
+    ce_backlog_init(&wd->rx_backlog, &wd->rx_stats, false);
+    ce_backlog_init(&wd->evt_backlog, &wd->evt_stats, true);
+
+    wd->ce_group = calloc(topo->ce_count, sizeof(struct copy_engine));
+    if (!wd->ce_group)
+        return -ENOMEM;
+    wd->ce_count_num = topo->ce_count;
 
     for (int ce_num = 0; ce_num < wd->ce_count_num; ce_num++)
     {
         ce = &wd->ce_group[ce_num];
-        ce->pipes_count = SRNG_TEST_PIPE_COUNT_MAX;
+        ce->ce_num = ce_num;
         ce->wd = wd;
 
-        ce->host_config = ce_ring_configs; // todo : 这个应该使用复制操作，一定要改
-
-        pthread_mutex_init(&ce->ce_lock, NULL);
+        ce->pipes = calloc(topo->pipes_per_ce, sizeof(struct wireless_simu_ce_pipe));
+        ce->host_config = calloc(topo->pipes_per_ce, sizeof(struct ce_attr));
+        if (!ce->pipes || !ce->host_config)
+            return -ENOMEM;
+        ce->pipes_count = topo->pipes_per_ce;
 
         for (int pipe_num = 0; pipe_num < ce->pipes_count; pipe_num++)
         {
+            ce->host_config[pipe_num].dest_nentries = topo->dst_entries;
+            ce->host_config[pipe_num].src_sz_max = topo->buf_size; // 在dest_ring中，该参数指定了每个包的最长大小
+
             /* 为dst_ring申请 skb 数组
              */
             ret = ce_alloc_pipe(ce, pipe_num);
@@ -175,109 +285,415 @@ int wireless_simu_ce_init(struct wireless_simu_device_state *wd)
                 return ret;
             }
 
-            /* 将ce pipe与实际的ring对应
-             */
             pipe = &ce->pipes[pipe_num];
-            if (pipe->dst_ring)
-            {
-                ret = ce_init_ring(pipe, pipe->dst_ring, pipe_num, HAL_TEST_SRNG_DST);
-                ret = ce_init_ring(pipe, pipe->status_ring, pipe_num, HAL_TEST_SRNG_DST_STATUS);
-            }
-            else
+            ret = ce_bind_pipe(pipe, index++);
+            if (ret)
             {
-                printf("%s : ce pipe dst ring err \n", WIRELESS_SIMU_DEVICE_NAME);
-                return -EINVAL;
+                printf("%s : ce pipe bind err %d ce id %d pipe id %d \n",
+                       WIRELESS_SIMU_DEVICE_NAME, ret, ce_num, pipe_num);
+                return ret;
             }
         }
     }
 
+    if (topo->wmi_pipe != WIRELESS_SIMU_CE_PIPE_NONE)
+    {
+        wd->evt_backlog.ce_num = topo->wmi_pipe / topo->pipes_per_ce;
+        wd->evt_backlog.pipe = &wd->ce_group[wd->evt_backlog.ce_num].pipes[topo->wmi_pipe % topo->pipes_per_ce];
+    }
+
     return ret;
 }
 
-void wireless_simu_ce_post_data(struct wireless_simu_device_state *wd, void *data, size_t data_size)
+/* status ring 中还能放下的 entry 数量, ring 参数不合法时为 0 */
+static uint32_t ce_status_ring_space(struct hal_srng *status_srng)
+{
+    return wireless_hal_srng_dst_space(status_srng, qatomic_read(&status_srng->u.dst_ring.hp));
+}
+
+/* 预留 dst ring 中连续的 count 个 buffer, 返回预留的第一个序号
+ *
+ * 多个生产者通过 cmpxchg 竞争 write_index, 不需要加锁
+ * 已预留但还没发布的数量也要计入 status ring 的占用, 保证发布时不会套圈驱动的 tp */
+static int ce_pipe_reserve(struct wireless_simu_ce_pipe *pipe, struct hal_srng *status_srng,
+                           uint32_t count, uint32_t *seq)
+{
+    struct wireless_simu_ce_ring *dst_ring = pipe->dst_ring;
+    uint32_t head;
+    uint32_t inflight;
+
+    do
+    {
+        head = qatomic_read(&dst_ring->write_index);
+        if (qatomic_load_acquire(&dst_ring->sw_index) - head < count)
+        {
+            return -ENOBUFS;
+        }
+
+        inflight = head - qatomic_load_acquire(&pipe->post_tail);
+        if (inflight + count > ce_status_ring_space(status_srng))
+        {
+            return -EOVERFLOW;
+        }
+    } while (qatomic_cmpxchg(&dst_ring->write_index, head, head + count) != head);
+
+    *seq = head;
+    return 0;
+}
+
+/* 把一个 buffer 的 status 写入 status ring 的 hp 处
+ * 一帧占用多个 buffer 时每个 buffer 一个 status, 除最后一个之外都置位 MORE */
+static void ce_status_put(struct wireless_simu_device_state *wd, struct wireless_simu_ce_pipe *pipe,
+                          struct hal_srng *status_srng, uint32_t hp, const struct wireless_simu_ce_post *post)
+{
+    struct hal_test_dst_status test_desc = {0};
+    struct hal_ce_srng_dst_status_desc ce_desc = {0};
+
+    if (pipe->status_type == HAL_TEST_SRNG_DST_STATUS)
+    {
+        test_desc.buffer_length = post->len;
+        test_desc.flag = post->more ? HAL_TEST_DST_STATUS_FLAG_MORE : 0;
+        test_desc.flag |= post->err ? HAL_TEST_DST_STATUS_FLAG_ERR : 0;
+        wireless_hal_srng_desc_put(wd, status_srng, hp, &test_desc, sizeof(test_desc));
+        return;
+    }
+
+    ce_desc.flags = (post->len << 16) & HAL_CE_DST_STATUS_DESC_FLAGS_LEN;
+    ce_desc.flags |= post->more ? HAL_CE_DST_STATUS_DESC_FLAGS_GATHER : 0;
+    ce_desc.flags |= post->err ? HAL_CE_DST_STATUS_DESC_FLAGS_ERR : 0;
+    ce_desc.toeplitz_hash0 = post->hash;
+    wireless_hal_srng_desc_put(wd, status_srng, hp, &ce_desc, sizeof(ce_desc));
+}
+
+/* 从 post_tail 开始按预留顺序发布已经写好的 buffer, 遇到还没写好的就停下, 返回发布的数量
+ *
+ * 生产者写完数据先登记再调用这里, 排在前面的生产者还没写完时直接返回, 由它写完之后一并发布,
+ * 登记和检查都在 pipe_lock 下, 不会遗漏 */
+static uint32_t ce_pipe_retire(struct wireless_simu_device_state *wd, struct wireless_simu_ce_pipe *pipe,
+                               struct hal_srng *status_srng)
+{
+    struct wireless_simu_ce_post *post;
+    uint32_t count = 0;
+    unsigned int tail;
+    uint32_t hp;
+
+    pthread_mutex_lock(&pipe->pipe_lock);
+
+    /* 预留时已经确认过空间, 不会越过驱动的 tp */
+    tail = pipe->post_tail;
+    hp = status_srng->u.dst_ring.hp;
+    while (qatomic_load_acquire(&(post = &pipe->posts[tail & pipe->dst_ring->nentries_mask])->seq) == tail + 1)
+    {
+        ce_status_put(wd, pipe, status_srng, hp, post);
+        hp = (hp + status_srng->entry_size) % status_srng->ring_size;
+        tail++;
+        count++;
+    }
+
+    if (count)
+    {
+        qatomic_set(&status_srng->u.dst_ring.hp, hp);
+        wireless_hal_srng_shadow_update(wd, status_srng, hp);
+        qatomic_store_release(&pipe->post_tail, tail);
+    }
+
+    pthread_mutex_unlock(&pipe->pipe_lock);
+
+    return count;
+}
+
+/* 尝试通过某个 pipe 将数据交给驱动
+ * 返回 0 表示成功, -ENODEV 表示 ring 未配置, -EMSGSIZE 表示帧比整个 dst ring 还大,
+ * -ENOBUFS / -EOVERFLOW 表示驱动来不及处理 */
+static int ce_pipe_post(struct wireless_simu_device_state *wd, int ce_num, struct wireless_simu_ce_pipe *pipe,
+                        void *data, size_t data_size, uint32_t hash)
 {
-    struct copy_engine *ce;
-    struct wireless_simu_ce_pipe *pipe;
-    unsigned int sw_index;
-    unsigned int write_index;
     struct wireless_simu_ce_ring *dst_ring;
-    struct wireless_simu_ce_ring *status_ring;
+    struct wireless_simu_ce_post *post;
     struct sk_buff *skb;
     struct hal_srng *status_srng;
     dma_addr_t data_paddr;
-    struct hal_test_dst_status desc;
+    size_t offset, len;
+    uint32_t seq, count, retired;
+    bool err;
+    int ret;
+
+    if (!pipe->dst_ring || !pipe->status_ring || !pipe->posts || !pipe->buf_sz)
+        return -ENODEV;
+
+    status_srng = &wd->hal.srng_list[pipe->status_ring->hal_ring_id];
+    if (status_srng->u.dst_ring.hp_paddr == 0 || status_srng->ring_size == 0)
+        return -ENODEV;
+
+    dst_ring = pipe->dst_ring;
+    count = MAX(DIV_ROUND_UP(data_size, pipe->buf_sz), 1);
+    if (count > dst_ring->nentries)
+        return -EMSGSIZE;
+
+    ret = ce_pipe_reserve(pipe, status_srng, count, &seq);
+
+    /* 记录满时留在 dst ring 中的 buffer, 发布之后空出了位置再取 */
+    if (ret == -ENOBUFS && ce_dst_ring_refill(wd, pipe))
+        ret = ce_pipe_reserve(pipe, status_srng, count, &seq);
+    if (ret)
+        return ret;
+
+    /* 对数据的发送分为两个部分:
+     * 1. 将数据按 buf_sz 切分, 拷贝至预留的连续 buffer 内并登记, 各个生产者并行进行
+     * 2. 将登记过的 buffer 按预留顺序放入 status ring */
+
+    /* 1. */
+    for (uint32_t i = 0; i < count; i++)
+    {
+        offset = (size_t)i * pipe->buf_sz;
+        len = MIN(data_size - offset, (size_t)pipe->buf_sz);
+
+        skb = &dst_ring->skb[(seq + i) & dst_ring->nentries_mask];
+        data_paddr = WIRELESS_SIMU_SKB_CB(skb)->paddr;
+        err = pci_dma_write(&wd->parent_obj, data_paddr, data + offset, (uint64_t)len) != MEMTX_OK;
+        if (err)
+        {
+            printf("%s : ce %d pipe %d dma write %016lx err \n", WIRELESS_SIMU_DEVICE_NAME, ce_num, pipe->pipe_num, data_paddr);
+        }
+
+        /* buffer 已经被占用, 写入失败也要把它还给驱动, 只是标记出错 */
+        post = &pipe->posts[(seq + i) & dst_ring->nentries_mask];
+        post->len = err ? 0 : len;
+        post->hash = hash;
+        post->more = i + 1 < count;
+        post->err = err;
+        qatomic_store_release(&post->seq, seq + i + 1);
+    }
+
+    /* 2. */
+    retired = ce_pipe_retire(wd, pipe, status_srng);
+    if (retired)
+        wireless_hal_srng_intr_event(wd, status_srng, retired, pipe->irq_statu);
+    return 0;
+}
+
+/* 开启 rss 时只使用间接表选出的 pipe, 同一条流始终在同一个 pipe 上
+ * 否则依次尝试所有 pipe, 全部失败时返回最能说明原因的错误
+ * 事件 pipe 不承载数据, 两种方式都跳过 */
+static int ce_post(struct wireless_simu_device_state *wd, void *data, size_t data_size)
+{
+    struct copy_engine *ce;
+    uint32_t wmi_pipe = wd->ce_topo.wmi_pipe;
+    uint32_t pipes = wd->ce_count_num * wd->ce_topo.pipes_per_ce;
+    uint32_t hash, index;
+    int err = -ENODEV;
+    int ret;
+
+    if (wmi_pipe != WIRELESS_SIMU_CE_PIPE_NONE)
+        pipes--;
+
+    if (pipes && wireless_simu_rss_hash(&wd->rss, data, data_size, &hash))
+    {
+        index = wireless_simu_rss_queue(&wd->rss, hash, pipes);
+        if (index >= wmi_pipe)
+            index++;
+        ce = &wd->ce_group[index / wd->ce_topo.pipes_per_ce];
+        return ce_pipe_post(wd, ce->ce_num, &ce->pipes[index % wd->ce_topo.pipes_per_ce], data, data_size, hash);
+    }
 
     for (int ce_num = 0; ce_num < wd->ce_count_num; ce_num++)
     {
         ce = &wd->ce_group[ce_num];
-        pthread_mutex_lock(&ce->ce_lock);
 
         for (int pipe_num = 0; pipe_num < ce->pipes_count; pipe_num++)
         {
-            pipe = &ce->pipes[pipe_num];
-            if (!pipe->dst_ring || !pipe->status_ring)
+            if (ce_num * wd->ce_topo.pipes_per_ce + pipe_num == wmi_pipe)
                 continue;
 
-            /* 数据发送 */
-            pthread_mutex_lock(&pipe->pipe_lock);
+            ret = ce_pipe_post(wd, ce_num, &ce->pipes[pipe_num], data, data_size, 0);
+            if (ret == 0)
+                return 0;
 
-            dst_ring = pipe->dst_ring;
-            sw_index = dst_ring->sw_index;
-            write_index = dst_ring->write_index;
+            /* 只要有一个 pipe 是驱动太慢导致的失败, 就值得暂存 */
+            if (ret == -ENOBUFS || ret == -EOVERFLOW || err == -ENODEV)
+                err = ret;
+        }
+    }
 
-            if (sw_index == write_index)
-            {
-                pthread_mutex_unlock(&pipe->pipe_lock);
-                continue;
-            }
+    return err;
+}
 
-            status_ring = pipe->status_ring;
-            status_srng = &wd->hal.srng_list[status_ring->hal_ring_id];
-            if (status_srng->u.dst_ring.hp_paddr == 0)
-            {
-                pthread_mutex_unlock(&pipe->pipe_lock);
-                continue;
-            }
+/* 按暂存队列的 pipe 设置发送一帧 */
+static int ce_backlog_post(struct wireless_simu_device_state *wd, struct wireless_simu_ce_backlog *backlog,
+                           void *data, size_t data_size)
+{
+    int ret;
 
-            skb = &dst_ring->skb[write_index];
-            write_index = (write_index + 1) & dst_ring->nentries_mask;
-            dst_ring->write_index = write_index;
-
-            /* 对数据的发送分为两个部分:
-             * 1. 将数据拷贝至内存区域内
-             * 2. 将数据的描述符放入ring */
-
-            /* 1. */
-            data_paddr = WIRELESS_SIMU_SKB_CB(skb)->paddr;
-            pci_dma_write(&wd->parent_obj, data_paddr, data, (uint64_t)data_size);
-
-            /* 2.
-             * 这一步没考虑驱动超慢导致的头指针套圈 */
-            desc.buffer_length = (uint32_t)data_size;
-            pci_dma_write(&wd->parent_obj,
-                          status_srng->ring_base_paddr + (status_srng->u.dst_ring.hp << 2),
-                          &desc, sizeof(desc));
-            status_srng->u.dst_ring.hp = (status_srng->u.dst_ring.hp + status_srng->entry_size) %
-                                         status_srng->ring_size;
-            pci_dma_write(&wd->parent_obj, status_srng->u.dst_ring.hp_paddr,
-                          &status_srng->u.dst_ring.hp,
-                          sizeof(status_srng->u.dst_ring.hp));
-
-            printf("%s : ce %d pipe %d srng %d hp %08x hp_paddr %016lx data size %016lx \n",
-                   WIRELESS_SIMU_DEVICE_NAME,
-                   ce_num, pipe_num,
-                   status_srng->ring_id, status_srng->u.dst_ring.hp,
-                   status_srng->u.dst_ring.hp_paddr, (uint64_t)data_size);
-
-            pthread_mutex_unlock(&pipe->pipe_lock);
-            pthread_mutex_unlock(&ce->ce_lock);
-            wireless_simu_irq_raise(&wd->ws_irq, WIRELESS_SIMU_IRQ_STATU_SRNG_DST_DMA_TEST_RING_0 + pipe_num);
-            goto end;
-        }
+    if (backlog->pipe)
+        ret = ce_pipe_post(wd, backlog->ce_num, backlog->pipe, data, data_size, 0);
+    else
+        ret = ce_post(wd, data, data_size);
+
+    if (ret == 0)
+        stat64_add(&backlog->stats->posted, 1);
+    return ret;
+}
+
+/* 驱动太慢导致的失败, 值得等下一次补充 */
+static bool ce_backlog_retry(struct wireless_simu_ce_backlog *backlog, int ret)
+{
+    return ret == -ENOBUFS || ret == -EOVERFLOW || (ret == -ENODEV && backlog->hold);
+}
 
-        pthread_mutex_unlock(&ce->ce_lock);
+/* 将暂存队列中的数据按顺序重放, 遇到失败就停止, 剩下的等下一次驱动补充 */
+static void ce_backlog_replay(struct wireless_simu_device_state *wd, struct wireless_simu_ce_backlog *backlog)
+{
+    struct wireless_simu_ce_frame *frame;
+    int ret;
+
+    if (qatomic_read(&backlog->len) == 0)
+        return;
+
+    qemu_mutex_lock(&backlog->lock);
+    while ((frame = QSIMPLEQ_FIRST(&backlog->frames)) != NULL)
+    {
+        ret = ce_backlog_post(wd, backlog, frame->data, frame->len);
+        if (ce_backlog_retry(backlog, ret))
+            break;
+
+        /* 驱动重新配置了 ring 之后可能再也放不下, 不能堵住后面的数据 */
+        QSIMPLEQ_REMOVE_HEAD(&backlog->frames, next);
+        qatomic_set(&backlog->len, backlog->len - 1);
+        stat64_add(ret ? &backlog->stats->dropped : &backlog->stats->replayed, 1);
+        wireless_simu_pool_free(&wd->pool, frame);
     }
+    qemu_mutex_unlock(&backlog->lock);
+}
 
-end:
-    return;
-}
\ No newline at end of file
+/* 将数据放入暂存队列, 队列满时丢弃 */
+static void ce_backlog_push(struct wireless_simu_device_state *wd, struct wireless_simu_ce_backlog *backlog,
+                            void *data, size_t data_size)
+{
+    struct wireless_simu_ce_frame *frame;
+
+    qemu_mutex_lock(&backlog->lock);
+    if (backlog->len >= backlog->max)
+    {
+        qemu_mutex_unlock(&backlog->lock);
+        stat64_add(&backlog->stats->dropped, 1);
+        printf("%s : %s backlog full, drop data size %016lx \n", WIRELESS_SIMU_DEVICE_NAME,
+               backlog->hold ? "event" : "rx", (uint64_t)data_size);
+        return;
+    }
+
+    frame = wireless_simu_pool_alloc(&wd->pool, sizeof(*frame) + data_size);
+    if (!frame)
+    {
+        qemu_mutex_unlock(&backlog->lock);
+        stat64_add(&backlog->stats->dropped, 1);
+        return;
+    }
+    frame->len = data_size;
+    memcpy(frame->data, data, data_size);
+
+    QSIMPLEQ_INSERT_TAIL(&backlog->frames, frame, next);
+    qatomic_set(&backlog->len, backlog->len + 1);
+    stat64_add(&backlog->stats->backlogged, 1);
+    qemu_mutex_unlock(&backlog->lock);
+}
+
+static void ce_backlog_submit(struct wireless_simu_device_state *wd, struct wireless_simu_ce_backlog *backlog,
+                              void *data, size_t data_size)
+{
+    int ret;
+
+    /* 已有暂存的数据时先重放, 保证交给驱动的顺序 */
+    ce_backlog_replay(wd, backlog);
+
+    ret = qatomic_read(&backlog->len) ? -ENOBUFS : ce_backlog_post(wd, backlog, data, data_size);
+    switch (ret)
+    {
+    case 0:
+        return;
+    case -ENODEV:
+        if (backlog->hold)
+            break;
+        /* fallthrough */
+    case -EMSGSIZE:
+        /* 驱动还没有配置 ring 或者 ring 永远放不下这一帧, 暂存也没有意义 */
+        stat64_add(&backlog->stats->dropped, 1);
+        return;
+    case -EOVERFLOW:
+        stat64_add(&backlog->stats->overrun, 1);
+        break;
+    default:
+        stat64_add(&backlog->stats->no_buffer, 1);
+        break;
+    }
+
+    ce_backlog_push(wd, backlog, data, data_size);
+
+    /* 入队期间驱动可能已经补充了 buffer, 再尝试一次避免数据滞留到下一次门铃 */
+    ce_backlog_replay(wd, backlog);
+}
+
+void wireless_simu_ce_post_data(struct wireless_simu_device_state *wd, void *data, size_t data_size)
+{
+    ce_backlog_submit(wd, &wd->rx_backlog, data, data_size);
+}
+
+void wireless_simu_ce_post_event(struct wireless_simu_device_state *wd, void *data, size_t data_size)
+{
+    ce_backlog_submit(wd, &wd->evt_backlog, data, data_size);
+}
+
+void ce_status_ring_handler(void *user_data)
+{
+    struct wireless_simu_ce_pipe *pipe = (struct wireless_simu_ce_pipe *)user_data;
+
+    /* 驱动处理了 status, 之前放不下而留在 dst ring 中的 buffer 现在可以取出 */
+    if (pipe->dst_ring)
+        ce_dst_ring_refill(pipe->wd, pipe);
+
+    ce_backlog_replay(pipe->wd, &pipe->wd->evt_backlog);
+    ce_backlog_replay(pipe->wd, &pipe->wd->rx_backlog);
+}
+
+static void ce_backlog_destroy(struct wireless_simu_device_state *wd, struct wireless_simu_ce_backlog *backlog)
+{
+    struct wireless_simu_ce_frame *frame;
+
+    qemu_mutex_lock(&backlog->lock);
+    while ((frame = QSIMPLEQ_FIRST(&backlog->frames)) != NULL)
+    {
+        QSIMPLEQ_REMOVE_HEAD(&backlog->frames, next);
+        wireless_simu_pool_free(&wd->pool, frame);
+    }
+    backlog->len = 0;
+    backlog->pipe = NULL;
+    qemu_mutex_unlock(&backlog->lock);
+
+    qemu_mutex_destroy(&backlog->lock);
+}
+
+void wireless_simu_ce_deinit(struct wireless_simu_device_state *wd)
+{
+    struct copy_engine *ce;
+    struct wireless_simu_ce_pipe *pipe;
+
+    ce_backlog_destroy(wd, &wd->rx_backlog);
+    ce_backlog_destroy(wd, &wd->evt_backlog);
+
+    for (int ce_num = 0; ce_num < wd->ce_count_num; ce_num++)
+    {
+        ce = &wd->ce_group[ce_num];
+        for (int pipe_num = 0; ce->pipes && pipe_num < ce->pipes_count; pipe_num++)
+        {
+            pipe = &ce->pipes[pipe_num];
+            free(pipe->dst_ring);
+            free(pipe->status_ring);
+            free(pipe->posts);
+            pthread_mutex_destroy(&pipe->pipe_lock);
+        }
+        free(ce->pipes);
+        free(ce->host_config);
+    }
+    free(wd->ce_group);
+    wd->ce_group = NULL;
+    wd->ce_count_num = 0;
+}
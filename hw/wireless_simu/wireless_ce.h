@@ -3,8 +3,34 @@
 
 #include "wireless_simu.h"
 
+/* pipe 总数上限: pipe 0 使用 test dst ring, 其余的依次对应 CE0 ~ CE11 的 dst / dst status ring */
+#define WIRELESS_SIMU_CE_PIPE_MAX (1 + 12)
+
+/* 拓扑的默认值, 可以通过设备属性修改 */
 #define WIRELESS_SIMU_CE_COUNT 1
-#define SRNG_TEST_PIPE_COUNT_MAX 1 // ring（pipes）数量
+#define SRNG_TEST_PIPE_COUNT_MAX 1 // 每个 ce 下 ring（pipes）数量
+#define WIRELESS_SIMU_CE_DST_ENTRIES 32
+#define WIRELESS_SIMU_CE_BUF_SIZE 2048
+
+/* wmi_pipe 的默认值, 事件和数据共用 pipe */
+#define WIRELESS_SIMU_CE_PIPE_NONE UINT32_MAX
+
+/* ce 拓扑, 在 realize 时按此分配 ce 和 pipe */
+struct wireless_simu_ce_topology
+{
+	uint32_t ce_count;
+	uint32_t pipes_per_ce;
+
+	/* 每个 pipe dst ring 的 entry 数量, 向上取整到 2 的幂 */
+	uint32_t dst_entries;
+
+	/* 每个 dst buffer 的大小, 需要和驱动补充的 buffer 一致 */
+	uint32_t buf_size;
+
+	/* 专门承载 HTC / WMI 事件的 pipe 序号, 数据不再使用这个 pipe
+	 * 为 WIRELESS_SIMU_CE_PIPE_NONE 时事件和数据共用 pipe */
+	uint32_t wmi_pipe;
+};
 
 struct wireless_simu_ce_ring
 {
@@ -13,9 +39,11 @@ struct wireless_simu_ce_ring
 	unsigned int nentries_mask;
 
 	/*
-	 * 已填充的dma_addr地址头指针*/
+	 * 已填充的dma_addr地址头指针
+	 * sw_index 和 write_index 都是单调递增的计数, 使用时和 nentries_mask 取与 */
 	unsigned int sw_index;
 
+	/* 已被生产者预留的 buffer 数量 */
 	unsigned int write_index;
 
 	/* 为 entries alloc 的 memory 空间*/
@@ -44,6 +72,19 @@ struct wireless_simu_ce_ring
 	struct sk_buff *skb;
 };
 
+/* 一个写好数据, 等待按预留顺序发布到 status ring 的 buffer */
+struct wireless_simu_ce_post
+{
+	/* 预留序号加一, 和 post_tail + 1 相同时才是写好的 */
+	unsigned int seq;
+	uint32_t len;
+	uint32_t hash;
+	bool more;
+
+	/* 数据写入 buffer 失败, status 中长度为 0 并置位错误 */
+	bool err;
+};
+
 struct wireless_simu_ce_pipe
 {
 	struct wireless_simu_device_state *wd;
@@ -68,7 +109,19 @@ struct wireless_simu_ce_pipe
 
 	uint64_t timestamp;
 
-	/* 访问锁 */
+	/* status ring 的类型, 决定 status desc 的格式 */
+	enum hal_ring_type status_type;
+
+	/* status ring 有数据时拉起的中断状态 */
+	uint32_t irq_statu;
+
+	/* 已按顺序发布到 status ring 的数量, 和 dst_ring->write_index 一起构成预留 / 发布两段 */
+	unsigned int post_tail;
+
+	/* 和 dst ring 的 skb 一一对应, 生产者写完数据后在这里登记 */
+	struct wireless_simu_ce_post *posts;
+
+	/* 补充 buffer 和按序发布 status 时持有, 写数据不需要 */
 	pthread_mutex_t pipe_lock;
 };
 
@@ -102,15 +155,77 @@ struct copy_engine
     /* 下方pipes 的数量 */
     int pipes_count;
     
-	struct wireless_simu_ce_pipe pipes[SRNG_TEST_PIPE_COUNT_MAX];
-	const struct ce_attr *host_config;
-	pthread_mutex_t ce_lock;
+	/* realize 时按拓扑分配 */
+	struct wireless_simu_ce_pipe *pipes;
+
+	/* 每个 pipe 的配置, 从设备属性复制而来, 每个 ce 一份 */
+	struct ce_attr *host_config;
 
     /* 超时处理
      * pipe 的 dst 中空位不足时，使用该数据来保证过一段时间后重试 */
     // struct timer_list rx_replenish_retry;
 };
 
+/* 暂存在设备中等待驱动补充 buffer 的数据帧 */
+struct wireless_simu_ce_frame
+{
+	QSIMPLEQ_ENTRY(wireless_simu_ce_frame) next;
+	size_t len;
+	uint8_t data[];
+};
+
+struct wireless_simu_ce_stats;
+
+/* 有界的暂存队列
+ * dst ring 没有空闲 buffer 或 status ring 已满时数据进入队列,
+ * 驱动补充 buffer / 消费 status ring 之后按顺序重放 */
+struct wireless_simu_ce_backlog
+{
+	QemuMutex lock;
+	QSIMPLEQ_HEAD(, wireless_simu_ce_frame) frames;
+
+	/* 当前队列长度, 无锁读取用于快速判断 */
+	uint32_t len;
+
+	/* 队列上限, 为 0 时不暂存 */
+	uint32_t max;
+
+	/* 固定使用的 pipe, 为 NULL 时使用除事件 pipe 之外的所有 pipe */
+	struct wireless_simu_ce_pipe *pipe;
+	int ce_num;
+
+	/* ring 未配置时也暂存, 等驱动配置之后发出, 事件不能丢 */
+	bool hold;
+
+	struct wireless_simu_ce_stats *stats;
+};
+
+/* rx 统计, 通过 qom-get 读取 */
+struct wireless_simu_ce_stats
+{
+	/* 成功交给驱动的数据帧 */
+	Stat64 posted;
+
+	/* dst ring 中没有驱动补充的空闲 buffer */
+	Stat64 no_buffer;
+
+	/* status ring 中驱动尚未消费, 再写会套圈 */
+	Stat64 overrun;
+
+	/* 进入暂存队列 / 从暂存队列重放成功 */
+	Stat64 backlogged;
+	Stat64 replayed;
+
+	/* 暂存队列已满、ring 未配置或帧大于整个 dst ring 而丢弃 */
+	Stat64 dropped;
+};
+
+/* ce src desc buffer_addr_info 中的位
+ * 置位 GATHER 表示这一帧还没有结束, 数据在下一个 desc 中继续 */
+#define HAL_CE_SRC_DESC_ADDR_INFO_ADDR_HI 0x000000ff // GENMASK(7, 0)
+#define HAL_CE_SRC_DESC_ADDR_INFO_GATHER BIT(11)
+#define HAL_CE_SRC_DESC_ADDR_INFO_LEN 0xffff0000 // GENMASK(31, 16)
+
 /* ce src desc 内容*/
 struct hal_ce_srng_src_desc
 {
@@ -127,6 +242,12 @@ struct hal_ce_srng_dest_desc
     uint32_t buffer_addr_info; /* %HAL_CE_DEST_DESC_ADDR_INFO_ */
 } __attribute__((__packed__));
 
+/* ce dst status flags 中的位, GATHER 和 test status 的 MORE 含义相同 */
+#define HAL_CE_DST_STATUS_DESC_FLAGS_GATHER BIT(11)
+/* 设备没能把数据写入这个 buffer, 驱动应丢弃整帧 */
+#define HAL_CE_DST_STATUS_DESC_FLAGS_ERR BIT(12)
+#define HAL_CE_DST_STATUS_DESC_FLAGS_LEN 0xffff0000 // GENMASK(31, 16)
+
 /* ce dst status 内容*/
 struct hal_ce_srng_dst_status_desc
 {
@@ -143,6 +264,11 @@ struct hal_test_dst{
     uint32_t flag; 
 }__attribute__((__packed__));
 
+/* hal_test_dst_status flag 中的位
+ * 一帧大于一个 dst buffer 时拆到连续的多个 buffer 中, 除最后一个之外都置位 MORE */
+#define HAL_TEST_DST_STATUS_FLAG_MORE BIT(0)
+#define HAL_TEST_DST_STATUS_FLAG_ERR BIT(1)
+
 struct hal_test_dst_status{
     uint32_t buffer_length;
     uint32_t flag;
@@ -153,15 +279,36 @@ struct hal_test_dst_status{
  * 存储 paddr */
 void ce_dst_ring_handler(void *user_data);
 
+/* 对 dst status ring 的处理
+ * 驱动更新 tp 之后 status ring 出现空位, 重放暂存的数据 */
+void ce_status_ring_handler(void *user_data);
+
+/* 检查设备属性给出的 ce 拓扑, 需要在 realize 的最开始调用 */
+bool wireless_simu_ce_topology_check(struct wireless_simu_device_state *wd, Error **errp);
+
 /* 对ce进行初始化
  *
  * 和driver中的初始化不同，hw中对ce的初始化是不需要分配大量的空间的，
  * hw本身也不应该占用大量的内存空间*/
 int wireless_simu_ce_init(struct wireless_simu_device_state *wd);
 
+/* 释放暂存队列中的数据以及 realize 时分配的 ce */
+void wireless_simu_ce_deinit(struct wireless_simu_device_state *wd);
+
 /* 向驱动发送数据 
- * 该发送不用考虑是否成功, 不成功就是驱动方面出了问题, 不能耽误之后的发送操作
+ * 该发送不用考虑是否成功, 驱动来不及补充 buffer 时数据进入有界的暂存队列,
+ * 队列满了才会丢弃, 丢弃和溢出都记录在 rx 统计中
+ *
+ * 大于一个 buffer 的帧拆到连续的多个 buffer 中, 通过 status 的 MORE 标记串起来
+ *
+ * 可以被多个线程同时调用: 各线程原子地预留 dst ring 中的 buffer 并行拷贝数据，
+ * 之后按预留顺序发布 status ring 的 hp
  */
 void wireless_simu_ce_post_data(struct wireless_simu_device_state *wd, void *data, size_t data_size);
 
+/* 向驱动发送 HTC 消息
+ * 设置了 wmi-pipe 时只使用这个 pipe, 和数据分开背压; 驱动还没有配置 ring 时暂存,
+ * 配置之后按顺序发出 */
+void wireless_simu_ce_post_event(struct wireless_simu_device_state *wd, void *data, size_t data_size);
+
 #endif /*WIRELESS_SIMU_CE*/
\ No newline at end of file
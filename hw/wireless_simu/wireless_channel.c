@@ -0,0 +1,289 @@
+#include "wireless_simu.h"
+#include <math.h>
+
+/* 20 MHz 单流, 800 ns GI 的速率, kbit/s */
+static const uint32_t channel_mcs_rate[WIRELESS_CHANNEL_MCS_MAX + 1] = {
+    6500, 13000, 19500, 26000, 39000, 52000,
+    58500, 65000, 78000, 86700, 97500, 108300,
+};
+
+/* CSMA/CA 参数, ns */
+#define CHANNEL_PREAMBLE 20000
+#define CHANNEL_SLOT 9000
+#define CHANNEL_DIFS (16000 + 2 * CHANNEL_SLOT)
+#define CHANNEL_CW_MIN 15
+
+static void channel_timer_cb(void *opaque);
+
+void wireless_channel_init(struct wireless_channel *ch, QemuMutex *lock, void (*deliver)(void *dst, void *frame),
+                           void (*release)(void *frame))
+{
+    ch->base.mcs = WIRELESS_CHANNEL_MCS_NONE;
+    ch->lock = lock;
+    ch->deliver = deliver;
+    ch->release = release;
+    ch->links = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    ch->rand = NULL;
+
+    for (int i = 0; i < WIRELESS_CHANNEL_WHEEL_SLOTS; i++)
+    {
+        QSIMPLEQ_INIT(&ch->wheel[i]);
+        ch->wheel_min[i] = INT64_MAX;
+    }
+    ch->cursor = 0;
+    ch->pending = 0;
+    ch->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, channel_timer_cb, ch);
+
+    stat64_init(&ch->lost, 0);
+    stat64_init(&ch->delayed, 0);
+    stat64_init(&ch->overflow, 0);
+}
+
+void wireless_channel_destroy(struct wireless_channel *ch)
+{
+    struct wireless_channel_event *ev;
+
+    timer_free(ch->timer);
+    ch->timer = NULL;
+
+    for (int i = 0; i < WIRELESS_CHANNEL_WHEEL_SLOTS; i++)
+    {
+        while ((ev = QSIMPLEQ_FIRST(&ch->wheel[i])) != NULL)
+        {
+            QSIMPLEQ_REMOVE_HEAD(&ch->wheel[i], next);
+            ch->release(ev->frame);
+            g_free(ev);
+        }
+        ch->wheel_min[i] = INT64_MAX;
+    }
+    ch->pending = 0;
+
+    g_hash_table_destroy(ch->links);
+    if (ch->rand)
+        g_rand_free(ch->rand);
+}
+
+bool wireless_channel_active(struct wireless_channel *ch)
+{
+    return ch->airtime || ch->base.delay || ch->base.loss || ch->base.ber ||
+           ch->base.mcs != WIRELESS_CHANNEL_MCS_NONE || g_hash_table_size(ch->links);
+}
+
+const struct wireless_channel_params *wireless_channel_link(struct wireless_channel *ch, uint32_t a, uint32_t b)
+{
+    struct wireless_channel_params *params;
+
+    if (g_hash_table_size(ch->links) == 0)
+        return &ch->base;
+
+    params = g_hash_table_lookup(ch->links, GUINT_TO_POINTER(a * WIRELESS_MEDIUM_STATIONS_MAX + b));
+    return params ? params : &ch->base;
+}
+
+void wireless_channel_set_link(struct wireless_channel *ch, uint32_t a, uint32_t b,
+                               const struct wireless_channel_params *params)
+{
+    g_hash_table_insert(ch->links, GUINT_TO_POINTER(a * WIRELESS_MEDIUM_STATIONS_MAX + b),
+                        g_memdup2(params, sizeof(*params)));
+    g_hash_table_insert(ch->links, GUINT_TO_POINTER(b * WIRELESS_MEDIUM_STATIONS_MAX + a),
+                        g_memdup2(params, sizeof(*params)));
+}
+
+static gboolean channel_link_match(gpointer key, gpointer value, gpointer opaque)
+{
+    uint32_t pair = GPOINTER_TO_UINT(key);
+    uint32_t index = GPOINTER_TO_UINT(opaque);
+
+    return pair / WIRELESS_MEDIUM_STATIONS_MAX == index || pair % WIRELESS_MEDIUM_STATIONS_MAX == index;
+}
+
+void wireless_channel_forget(struct wireless_channel *ch, uint32_t index)
+{
+    if (g_hash_table_size(ch->links))
+        g_hash_table_foreach_remove(ch->links, channel_link_match, GUINT_TO_POINTER(index));
+}
+
+/* 第一次使用时按种子创建, 修改 seed 属性之后重新创建 */
+static GRand *channel_rand(struct wireless_channel *ch)
+{
+    if (!ch->rand)
+        ch->rand = g_rand_new_with_seed(ch->seed);
+
+    return ch->rand;
+}
+
+int64_t wireless_channel_transmit(struct wireless_channel *ch, const struct wireless_channel_params *params,
+                                  size_t len, int64_t now, int64_t *tx_busy_until)
+{
+    int64_t *busy_until = ch->airtime ? &ch->busy_until : tx_busy_until;
+    int64_t start = MAX(now, *busy_until);
+    int64_t airtime = 0;
+
+    if (params->mcs <= WIRELESS_CHANNEL_MCS_MAX)
+    {
+        /* kbit/s 换算为 ns: bits * 10^6 / rate */
+        airtime = CHANNEL_PREAMBLE + muldiv64(len * 8, 1000000, channel_mcs_rate[params->mcs]);
+    }
+
+    /* 共享空口时先等 DIFS 和随机退避, 不模拟碰撞 */
+    if (ch->airtime)
+    {
+        start += CHANNEL_DIFS + g_rand_int_range(channel_rand(ch), 0, CHANNEL_CW_MIN + 1) * CHANNEL_SLOT;
+    }
+
+    *busy_until = start + airtime;
+    return *busy_until;
+}
+
+bool wireless_channel_lost(struct wireless_channel *ch, const struct wireless_channel_params *params, size_t len)
+{
+    double success = 1.0;
+
+    if (!params->loss && !params->ber)
+        return false;
+
+    if (params->loss)
+        success *= 1.0 - params->loss / 1e6;
+    if (params->ber)
+        success *= pow(1.0 - params->ber / 1e9, len * 8.0);
+
+    if (g_rand_double(channel_rand(ch)) < success)
+        return false;
+
+    stat64_add(&ch->lost, 1);
+    return true;
+}
+
+/* 指向最早的到达时刻
+ *
+ * 从 cursor 开始逐槽查找, 槽中最早的帧落在该槽本圈的时间内时, 后面的槽和后面的圈都不会更早;
+ * 所有非空槽中都只有后面圈的帧时, 取各槽最早时刻中的最小值 */
+static void channel_timer_arm(struct wireless_channel *ch)
+{
+    int64_t deadline = INT64_MAX;
+
+    if (!ch->pending)
+        return;
+
+    for (int64_t tick = ch->cursor; tick < ch->cursor + WIRELESS_CHANNEL_WHEEL_SLOTS; tick++)
+    {
+        int64_t first = ch->wheel_min[tick % WIRELESS_CHANNEL_WHEEL_SLOTS];
+
+        if (first < (tick + 1) << WIRELESS_CHANNEL_WHEEL_SHIFT)
+        {
+            deadline = first;
+            break;
+        }
+        deadline = MIN(deadline, first);
+    }
+
+    timer_mod(ch->timer, deadline);
+}
+
+bool wireless_channel_schedule(struct wireless_channel *ch, int64_t when, void *dst, void *frame)
+{
+    struct wireless_channel_event *ev;
+    int64_t tick;
+
+    /* 时延很大或者发送太快时时间轮会无限增长, 超过上限的帧直接丢弃 */
+    if (ch->pending >= WIRELESS_CHANNEL_PENDING_MAX)
+    {
+        stat64_add(&ch->overflow, 1);
+        ch->release(frame);
+        return false;
+    }
+
+    ev = g_new(struct wireless_channel_event, 1);
+    ev->when = when;
+    ev->dst = dst;
+    ev->frame = frame;
+
+    /* 时间轮空闲时 cursor 停在过去, 直接跳到当前 */
+    if (!ch->pending)
+        ch->cursor = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) >> WIRELESS_CHANNEL_WHEEL_SHIFT;
+    tick = MAX(when >> WIRELESS_CHANNEL_WHEEL_SHIFT, ch->cursor);
+
+    QSIMPLEQ_INSERT_TAIL(&ch->wheel[tick % WIRELESS_CHANNEL_WHEEL_SLOTS], ev, next);
+    ch->wheel_min[tick % WIRELESS_CHANNEL_WHEEL_SLOTS] = MIN(ch->wheel_min[tick % WIRELESS_CHANNEL_WHEEL_SLOTS], when);
+    ch->pending++;
+    stat64_add(&ch->delayed, 1);
+
+    timer_mod_anticipate(ch->timer, when);
+    return true;
+}
+
+static void channel_timer_cb(void *opaque)
+{
+    struct wireless_channel *ch = opaque;
+    QSIMPLEQ_HEAD(, wireless_channel_event) slot;
+    struct wireless_channel_event *ev;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    int64_t now_tick = now >> WIRELESS_CHANNEL_WHEEL_SHIFT;
+    int64_t ticks;
+
+    qemu_mutex_lock(ch->lock);
+
+    /* 虚拟时钟可能一次跳过很多圈, 最多扫描一圈 */
+    ticks = MIN(now_tick - ch->cursor + 1, WIRELESS_CHANNEL_WHEEL_SLOTS);
+    for (int64_t i = 0; i < ticks && ch->pending; i++)
+    {
+        int index = (ch->cursor + i) % WIRELESS_CHANNEL_WHEEL_SLOTS;
+
+        /* 最早的帧也还没到, 整个槽都不用动 */
+        if (ch->wheel_min[index] > now)
+            continue;
+
+        QSIMPLEQ_INIT(&slot);
+        QSIMPLEQ_CONCAT(&slot, &ch->wheel[index]);
+        ch->wheel_min[index] = INT64_MAX;
+
+        while ((ev = QSIMPLEQ_FIRST(&slot)) != NULL)
+        {
+            QSIMPLEQ_REMOVE_HEAD(&slot, next);
+            if (ev->when > now)
+            {
+                /* 后面圈的帧或者本槽内还没到的帧 */
+                QSIMPLEQ_INSERT_TAIL(&ch->wheel[index], ev, next);
+                ch->wheel_min[index] = MIN(ch->wheel_min[index], ev->when);
+                continue;
+            }
+
+            ch->pending--;
+            ch->deliver(ev->dst, ev->frame);
+            g_free(ev);
+        }
+    }
+    ch->cursor = MAX(ch->cursor, now_tick);
+
+    channel_timer_arm(ch);
+
+    qemu_mutex_unlock(ch->lock);
+}
+
+void wireless_channel_purge(struct wireless_channel *ch, void *dst)
+{
+    QSIMPLEQ_HEAD(, wireless_channel_event) slot;
+    struct wireless_channel_event *ev;
+
+    for (int i = 0; i < WIRELESS_CHANNEL_WHEEL_SLOTS && ch->pending; i++)
+    {
+        QSIMPLEQ_INIT(&slot);
+        QSIMPLEQ_CONCAT(&slot, &ch->wheel[i]);
+        ch->wheel_min[i] = INT64_MAX;
+
+        while ((ev = QSIMPLEQ_FIRST(&slot)) != NULL)
+        {
+            QSIMPLEQ_REMOVE_HEAD(&slot, next);
+            if (ev->dst != dst)
+            {
+                QSIMPLEQ_INSERT_TAIL(&ch->wheel[i], ev, next);
+                ch->wheel_min[i] = MIN(ch->wheel_min[i], ev->when);
+                continue;
+            }
+
+            ch->pending--;
+            ch->release(ev->frame);
+            g_free(ev);
+        }
+    }
+}
@@ -0,0 +1,120 @@
+#ifndef WIRELESS_SIMU_CHANNEL
+#define WIRELESS_SIMU_CHANNEL
+
+#include "wireless_simu.h"
+
+/* hub 介质上的信道模型
+ *
+ * 每条链路有传播时延, 丢包率, 误码率和 mcs 决定的速率. 发送时先按 mcs 计算帧占用的空口时间,
+ * 开启 airtime 时所有设备共享同一个空口, 按 CSMA/CA 的 DIFS + 随机退避排在前一帧之后发送;
+ * 否则每个设备只受自己的速率限制. 帧在发送结束后再经过链路时延到达接收方.
+ *
+ * 所有时间都使用 QEMU_CLOCK_VIRTUAL. 尚未到达的帧放在时间轮中, 整个介质只有一个定时器,
+ * 从 cursor 开始指向第一个在本圈内有帧到达的槽, 属于后面圈的帧在经过时重新放回槽中 */
+
+/* 不限制速率 */
+#define WIRELESS_CHANNEL_MCS_NONE 0xff
+#define WIRELESS_CHANNEL_MCS_MAX 11
+
+/* 时间轮: 每个槽 2^14 ns (约 16 us), 一圈 256 个槽 (约 4 ms), 更远的帧留在槽中等下一圈 */
+#define WIRELESS_CHANNEL_WHEEL_SHIFT 14
+#define WIRELESS_CHANNEL_WHEEL_SLOTS 256
+
+/* 时间轮中最多等待的帧数 */
+#define WIRELESS_CHANNEL_PENDING_MAX 4096
+
+struct wireless_channel_params
+{
+    /* 传播时延 ns */
+    uint64_t delay;
+
+    /* 丢包率, 百万分之一 */
+    uint32_t loss;
+
+    /* 误码率, 十亿分之一 */
+    uint32_t ber;
+
+    /* 速率, WIRELESS_CHANNEL_MCS_NONE 为不限制 */
+    uint8_t mcs;
+};
+
+/* 等待到达的帧, 持有帧的一个引用 */
+struct wireless_channel_event
+{
+    QSIMPLEQ_ENTRY(wireless_channel_event) next;
+    int64_t when;
+    void *dst;
+    void *frame;
+};
+
+struct wireless_channel
+{
+    /* 所有链路的默认参数, 由介质的属性设置 */
+    struct wireless_channel_params base;
+
+    /* 所有设备共享空口 */
+    bool airtime;
+
+    /* 随机数种子, 相同的种子得到相同的丢包和退避 */
+    uint32_t seed;
+    GRand *rand;
+
+    /* 单独配置的链路, key 为 a * WIRELESS_MEDIUM_STATIONS_MAX + b */
+    GHashTable *links;
+
+    /* 空口空闲的时刻 */
+    int64_t busy_until;
+
+    /* 时间轮, 由 lock 保护, 和介质共用一把锁 */
+    QemuMutex *lock;
+    QSIMPLEQ_HEAD(, wireless_channel_event) wheel[WIRELESS_CHANNEL_WHEEL_SLOTS];
+    /* 每个槽中最早的到达时刻, 空槽为 INT64_MAX */
+    int64_t wheel_min[WIRELESS_CHANNEL_WHEEL_SLOTS];
+    int64_t cursor;
+    uint32_t pending;
+    QEMUTimer *timer;
+
+    /* 帧到达时调用, 调用时持有 lock, 帧的引用交给 deliver */
+    void (*deliver)(void *dst, void *frame);
+    /* 帧被丢弃时释放引用 */
+    void (*release)(void *frame);
+
+    /* 丢弃的帧 / 经过时间轮的帧 / 时间轮满时丢弃的帧 */
+    Stat64 lost;
+    Stat64 delayed;
+    Stat64 overflow;
+};
+
+void wireless_channel_init(struct wireless_channel *ch, QemuMutex *lock, void (*deliver)(void *dst, void *frame),
+                           void (*release)(void *frame));
+void wireless_channel_destroy(struct wireless_channel *ch);
+
+/* 是否配置了任何信道参数, 没有时介质直接投递 */
+bool wireless_channel_active(struct wireless_channel *ch);
+
+/* 链路 a -> b 的参数, 没有单独配置时返回默认参数 */
+const struct wireless_channel_params *wireless_channel_link(struct wireless_channel *ch, uint32_t a, uint32_t b);
+
+/* 单独配置链路, 对称生效 */
+void wireless_channel_set_link(struct wireless_channel *ch, uint32_t a, uint32_t b,
+                               const struct wireless_channel_params *params);
+
+/* 删除和设备 index 有关的链路配置, 设备断开时调用 */
+void wireless_channel_forget(struct wireless_channel *ch, uint32_t index);
+
+/* 计算一帧在空口上发送结束的时刻
+ * tx_busy_until 为发送方自己的空闲时刻, 不共享空口时使用 */
+int64_t wireless_channel_transmit(struct wireless_channel *ch, const struct wireless_channel_params *params,
+                                  size_t len, int64_t now, int64_t *tx_busy_until);
+
+/* 按丢包率和误码率判断这一帧是否丢失 */
+bool wireless_channel_lost(struct wireless_channel *ch, const struct wireless_channel_params *params, size_t len);
+
+/* 帧在 when 时刻到达 dst, 调用前已经为这一帧增加了引用
+ * 时间轮已满时释放这个引用并返回 false */
+bool wireless_channel_schedule(struct wireless_channel *ch, int64_t when, void *dst, void *frame);
+
+/* 丢弃所有发往 dst 的帧, 设备断开时调用 */
+void wireless_channel_purge(struct wireless_channel *ch, void *dst);
+
+#endif /* WIRELESS_SIMU_CHANNEL */
@@ -0,0 +1,566 @@
+#include "wireless_simu.h"
+
+/* 802.11 帧头中用到的字段 */
+#define IEEE80211_FCTL_FTYPE 0x000c
+#define IEEE80211_FTYPE_DATA 0x0008
+#define IEEE80211_STYPE_QOS_DATA 0x0080
+#define IEEE80211_FCTL_TODS 0x0100
+#define IEEE80211_FCTL_FROMDS 0x0200
+#define IEEE80211_QOS_CTL_TID_MASK 0x000f
+
+#define IEEE80211_HDR_LEN 24
+#define IEEE80211_ADDR_LEN 6
+#define IEEE80211_SEQ_CTRL_OFFSET 22
+
+/* guest 中的帧最多映射成的段数 */
+#define WIRELESS_DP_TX_IOV_MAX 4
+
+static dma_addr_t dp_buf_paddr(uint32_t addr_low, uint32_t addr_info)
+{
+    return addr_low | ((uint64_t)(addr_info & HAL_DP_BUF_ADDR_INFO_ADDR_HI) << 32);
+}
+
+static uint32_t dp_buf_addr_info(dma_addr_t paddr, uint32_t cookie)
+{
+    return ((paddr >> 32) & HAL_DP_BUF_ADDR_INFO_ADDR_HI) | ((cookie << 8) & HAL_DP_BUF_ADDR_INFO_COOKIE);
+}
+
+/* ring 的 R0 寄存器配置完毕 */
+static bool dp_src_ring_ready(struct hal_srng *srng)
+{
+    return srng->ring_base_paddr && srng->ring_size && srng->entry_size;
+}
+
+static bool dp_dst_ring_ready(struct hal_srng *srng)
+{
+    return srng->u.dst_ring.hp_paddr && srng->ring_size && srng->entry_size;
+}
+
+/* -- tx -- */
+
+/* 发出 tcl data cmd 指向的一帧 */
+static int dp_tcl_send(struct wireless_simu_device_state *wd, const struct hal_tcl_data_cmd *cmd)
+{
+    uint32_t len = cmd->info0 & HAL_TCL_DATA_CMD_INFO0_DATA_LEN;
+    uint32_t offset = (cmd->info0 & HAL_TCL_DATA_CMD_INFO0_DATA_OFFSET) >> 16;
+    dma_addr_t paddr = dp_buf_paddr(cmd->buffer_addr_low, cmd->buffer_addr_info) + offset;
+    struct iovec iov[WIRELESS_DP_TX_IOV_MAX];
+    int iovcnt;
+    void *data;
+    int ret;
+
+    if (len == 0 || len > WIRELESS_TXRX_FRAME_MAX)
+    {
+        printf("%s : tcl data bad frame len %u \n", WIRELESS_SIMU_DEVICE_NAME, len);
+        return -EINVAL;
+    }
+
+    /* 映射 guest 的 buffer, 把 iovec 直接交给介质 */
+    iovcnt = wireless_simu_dma_map_iov(wd, paddr, len, DMA_DIRECTION_TO_DEVICE, iov, WIRELESS_DP_TX_IOV_MAX);
+    if (iovcnt)
+    {
+        ret = wireless_tx_datav(&wd->txrx, iov, iovcnt);
+        wireless_simu_dma_unmap_iov(wd, iov, iovcnt, DMA_DIRECTION_TO_DEVICE);
+        return ret < 0 ? ret : 0;
+    }
+
+    data = wireless_simu_pool_alloc(&wd->pool, len);
+    if (!data)
+        return -ENOMEM;
+
+    if (pci_dma_read(&wd->parent_obj, paddr, data, len))
+    {
+        printf("%s : tcl data dma read %016lx err \n", WIRELESS_SIMU_DEVICE_NAME, paddr);
+        wireless_simu_pool_free(&wd->pool, data);
+        return -EIO;
+    }
+
+    ret = wireless_tx_data(&wd->txrx, data, len);
+    wireless_simu_pool_free(&wd->pool, data);
+
+    return ret < 0 ? ret : 0;
+}
+
+/* 每取出一批 tcl desc 就在 WBM ring 上归还同样数量的 buffer
+ * 一批最多取 WBM ring 的剩余空间, WBM ring 满了就停下, 等驱动消费之后由 WBM ring 的 tp 更新再次拉起 */
+void wireless_dp_tcl_ring_handler(void *user_data)
+{
+    struct wireless_dp_tcl *tcl = (struct wireless_dp_tcl *)user_data;
+    struct wireless_simu_device_state *wd = tcl->wd;
+    struct hal_srng *tcl_srng = &wd->hal.srng_list[tcl->tcl_ring_id];
+    struct hal_srng *wbm_srng = &wd->hal.srng_list[tcl->wbm_ring_id];
+    struct hal_srng_src_batch batch;
+    struct hal_tcl_data_cmd *cmd;
+    struct hal_wbm_release_desc release;
+    uint32_t space, hp, status;
+
+    /* TCL 和 WBM 两个 ring 的处理都可能走到这里, 以 TCL ring 的锁串行 */
+    qemu_mutex_lock(&tcl_srng->lock);
+
+    /* 没有 WBM ring 就无法归还 buffer, 先不消费 */
+    if (!dp_src_ring_ready(tcl_srng) || !dp_dst_ring_ready(wbm_srng))
+    {
+        qemu_mutex_unlock(&tcl_srng->lock);
+        return;
+    }
+
+    hp = wbm_srng->u.dst_ring.hp;
+    while ((space = wireless_hal_srng_dst_space(wbm_srng, hp)) > 0 &&
+           wireless_hal_srng_src_batch_fill_max(wd, tcl_srng, &batch, space) > 0)
+    {
+        for (uint32_t i = 0; i < batch.count; i++)
+        {
+            cmd = (struct hal_tcl_data_cmd *)batch.desc[i];
+
+            status = HAL_WBM_TQM_STATUS_OK;
+            if (dp_tcl_send(wd, cmd))
+            {
+                status = HAL_WBM_TQM_STATUS_DROP;
+                stat64_add(&wd->dp.stats.tx_dropped, 1);
+            }
+            else
+            {
+                stat64_add(&wd->dp.stats.tx_frames, 1);
+            }
+
+            release.buffer_addr_low = cmd->buffer_addr_low;
+            release.buffer_addr_info = cmd->buffer_addr_info;
+            release.info0 = (status & HAL_WBM_RELEASE_INFO0_STATUS) |
+                            ((tcl->ring_num << 4) & HAL_WBM_RELEASE_INFO0_TCL_RING);
+            release.meta_info = cmd->meta_info;
+            wireless_hal_srng_desc_put(wd, wbm_srng, hp, &release, sizeof(release));
+            hp = (hp + wbm_srng->entry_size) % wbm_srng->ring_size;
+        }
+
+        /* 一批只回写一次 tcl 的 tp 和 wbm 的 hp */
+        wireless_hal_srng_shadow_update(wd, tcl_srng, batch.tp[batch.count - 1]);
+        qatomic_set(&wbm_srng->u.dst_ring.hp, hp);
+        wireless_hal_srng_shadow_update(wd, wbm_srng, hp);
+        wireless_hal_srng_intr_event(wd, wbm_srng, batch.count, WIRELESS_SIMU_IRQ_STATUS_WBM_RELEASE + tcl->ring_num);
+    }
+
+    if (space == 0 && qatomic_read(&tcl_srng->u.src_ring.hp) != tcl_srng->u.src_ring.tp)
+    {
+        stat64_add(&wd->dp.stats.tx_stalled, 1);
+    }
+
+    qemu_mutex_unlock(&tcl_srng->lock);
+}
+
+/* -- rx -- */
+
+/* 数据帧的 TID 和序号, 不是数据帧时返回 false */
+static bool dp_rx_classify(const uint8_t *frame, size_t len, uint8_t *tid, uint16_t *seq)
+{
+    size_t hdr_len = IEEE80211_HDR_LEN;
+    uint16_t fc;
+
+    if (len < IEEE80211_HDR_LEN)
+        return false;
+
+    fc = lduw_le_p(frame);
+    if ((fc & IEEE80211_FCTL_FTYPE) != IEEE80211_FTYPE_DATA)
+        return false;
+
+    *seq = lduw_le_p(frame + IEEE80211_SEQ_CTRL_OFFSET) >> 4;
+    *tid = WIRELESS_DP_TID_NON_QOS;
+
+    if ((fc & (IEEE80211_FCTL_TODS | IEEE80211_FCTL_FROMDS)) == (IEEE80211_FCTL_TODS | IEEE80211_FCTL_FROMDS))
+        hdr_len += IEEE80211_ADDR_LEN;
+
+    if ((fc & IEEE80211_STYPE_QOS_DATA) && len >= hdr_len + 2)
+        *tid = lduw_le_p(frame + hdr_len) & IEEE80211_QOS_CTL_TID_MASK;
+
+    return true;
+}
+
+/* 从 RXDMA buf ring 中取出驱动补充的 buffer, 只取设备还能记录下的数量, 需持有 rx_lock */
+static void dp_rx_refill(struct wireless_simu_device_state *wd, struct wireless_simu_dp *dp)
+{
+    struct hal_srng *srng = &wd->hal.srng_list[dp->rxdma_ring_id];
+    struct hal_srng_src_batch batch;
+    struct hal_rxdma_buf_desc *desc;
+    struct wireless_dp_rx_buf *buf;
+    uint32_t room;
+
+    if (!dp_src_ring_ready(srng))
+        return;
+
+    qemu_mutex_lock(&srng->lock);
+    while ((room = WIRELESS_DP_RX_BUF_MAX - (dp->buf_head - dp->buf_tail)) > 0 &&
+           wireless_hal_srng_src_batch_fill_max(wd, srng, &batch, room) > 0)
+    {
+        for (uint32_t i = 0; i < batch.count; i++)
+        {
+            desc = (struct hal_rxdma_buf_desc *)batch.desc[i];
+            buf = &dp->bufs[dp->buf_head % WIRELESS_DP_RX_BUF_MAX];
+            buf->paddr = dp_buf_paddr(desc->buffer_addr_low, desc->buffer_addr_info);
+            buf->cookie = (desc->buffer_addr_info & HAL_DP_BUF_ADDR_INFO_COOKIE) >> 8;
+            dp->buf_head++;
+        }
+
+        wireless_hal_srng_shadow_update(wd, srng, batch.tp[batch.count - 1]);
+    }
+    qemu_mutex_unlock(&srng->lock);
+}
+
+/* 把一帧写入 buffer 并在 REO dst ring 中从 hp 开始放入 desc, 只推进本地的 hp, 需持有 rx_lock
+ * 返回占用的 entry 数量; -ENOBUFS / -EOVERFLOW 表示驱动来不及处理, -EMSGSIZE 表示永远放不下 */
+static int dp_rx_post(struct wireless_simu_device_state *wd, struct wireless_simu_dp *dp, struct hal_srng *reo,
+                      const uint8_t *data, size_t len, uint8_t tid, uint16_t seq, uint16_t holes, uint32_t hash,
+                      uint32_t *hp)
+{
+    struct hal_reo_dst_desc desc = {0};
+    struct wireless_dp_rx_buf *buf;
+    uint32_t count = MAX(DIV_ROUND_UP(len, dp->buf_size), 1);
+    size_t offset = 0;
+    uint32_t n;
+    bool err;
+
+    if (count > WIRELESS_DP_RX_BUF_MAX)
+        return -EMSGSIZE;
+
+    if (dp->buf_head - dp->buf_tail < count)
+        return -ENOBUFS;
+
+    if (wireless_hal_srng_dst_space(reo, *hp) < count)
+        return -EOVERFLOW;
+
+    desc.info1 = (seq & HAL_REO_DST_INFO1_SEQ_NUM) | (((uint32_t)holes << 16) & HAL_REO_DST_INFO1_HOLES);
+    desc.hash = hash;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        buf = &dp->bufs[dp->buf_tail++ % WIRELESS_DP_RX_BUF_MAX];
+        n = (uint32_t)MIN(len - offset, (size_t)dp->buf_size);
+
+        err = pci_dma_write(&wd->parent_obj, buf->paddr, data + offset, n) != MEMTX_OK;
+        if (err)
+        {
+            printf("%s : reo dma write %016lx err \n", WIRELESS_SIMU_DEVICE_NAME, buf->paddr);
+        }
+        offset += n;
+
+        /* buffer 已经从 RXDMA ring 取走, 写入失败也要通过 desc 还给驱动, 只是标记出错 */
+        desc.buffer_addr_low = (uint32_t)buf->paddr;
+        desc.buffer_addr_info = dp_buf_addr_info(buf->paddr, buf->cookie);
+        desc.info0 = ((err ? 0 : n) & HAL_REO_DST_INFO0_MSDU_LEN) | (((uint32_t)tid << 16) & HAL_REO_DST_INFO0_TID);
+        desc.info0 |= i + 1 < count ? HAL_REO_DST_INFO0_MORE : 0;
+        desc.info0 |= err ? HAL_REO_DST_INFO0_ERR : 0;
+        wireless_hal_srng_desc_put(wd, reo, *hp, &desc, sizeof(desc));
+        *hp = (*hp + reo->entry_size) % reo->ring_size;
+    }
+
+    return count;
+}
+
+/* 按 TID 轮询发出队列中的帧, 每个 TID 内保持到达顺序, 遇到驱动来不及处理就停下
+ * 返回写入 REO dst ring 的 entry 数量, 需持有 rx_lock */
+static uint32_t dp_rx_drain(struct wireless_simu_device_state *wd, struct wireless_simu_dp *dp, struct hal_srng *reo,
+                            uint32_t *hp)
+{
+    struct wireless_dp_tid_queue *queue;
+    struct wireless_dp_frame *frame;
+    uint32_t entries = 0;
+    int ret;
+
+    while (dp->queued)
+    {
+        queue = &dp->tids[dp->next_tid];
+        frame = QSIMPLEQ_FIRST(&queue->frames);
+        if (!frame)
+        {
+            dp->next_tid = (dp->next_tid + 1) % WIRELESS_DP_TID_MAX;
+            continue;
+        }
+
+        ret = dp_rx_post(wd, dp, reo, frame->data, frame->len, frame->tid, frame->seq, frame->holes, frame->hash,
+                         hp);
+        if (ret == -ENOBUFS || ret == -EOVERFLOW)
+            break;
+
+        QSIMPLEQ_REMOVE_HEAD(&queue->frames, next);
+        queue->len--;
+        dp->queued--;
+        wireless_simu_pool_free(&wd->pool, frame);
+
+        if (ret < 0)
+        {
+            stat64_add(&dp->stats.rx_dropped, 1);
+            continue;
+        }
+        stat64_add(&dp->stats.rx_frames, 1);
+        entries += ret;
+        dp->next_tid = (dp->next_tid + 1) % WIRELESS_DP_TID_MAX;
+    }
+
+    return entries;
+}
+
+/* 复制一份帧, pool 用完时返回 NULL */
+static struct wireless_dp_frame *dp_rx_frame_alloc(struct wireless_simu_device_state *wd, const uint8_t *data,
+                                                   size_t len, uint8_t tid, uint16_t seq, uint32_t hash)
+{
+    struct wireless_dp_frame *frame;
+
+    frame = wireless_simu_pool_alloc(&wd->pool, sizeof(*frame) + len);
+    if (!frame)
+        return NULL;
+
+    frame->hash = hash;
+    frame->seq = seq;
+    frame->holes = 0;
+    frame->tid = tid;
+    frame->len = len;
+    memcpy(frame->data, data, len);
+
+    return frame;
+}
+
+void wireless_dp_rx_release(struct wireless_simu_device_state *wd, struct wireless_dp_frame *frame)
+{
+    struct wireless_simu_dp *dp = &wd->dp;
+    struct wireless_dp_tid_queue *queue = &dp->tids[frame->tid];
+
+    QSIMPLEQ_INSERT_TAIL(&queue->frames, frame, next);
+    queue->len++;
+    dp->queued++;
+}
+
+/* 放入 TID 队列, 队列满时丢弃, 需持有 rx_lock */
+static void dp_rx_enqueue(struct wireless_simu_device_state *wd, struct wireless_simu_dp *dp,
+                          const uint8_t *data, size_t len, uint8_t tid, uint16_t seq, uint32_t hash)
+{
+    struct wireless_dp_frame *frame;
+
+    if (dp->tids[tid].len >= dp->queue_max)
+    {
+        stat64_add(&dp->stats.rx_dropped, 1);
+        return;
+    }
+
+    frame = dp_rx_frame_alloc(wd, data, len, tid, seq, hash);
+    if (!frame)
+    {
+        stat64_add(&dp->stats.rx_dropped, 1);
+        return;
+    }
+
+    wireless_dp_rx_release(wd, frame);
+    stat64_add(&dp->stats.rx_queued, 1);
+}
+
+/* 一批 entry 写完之后只回写一次 hp, 经过中断合并通知驱动 */
+static void dp_rx_commit(struct wireless_simu_device_state *wd, struct wireless_simu_dp *dp, struct hal_srng *reo,
+                         uint32_t hp, uint32_t entries)
+{
+    if (entries == 0)
+        return;
+
+    qatomic_set(&reo->u.dst_ring.hp, hp);
+    wireless_hal_srng_shadow_update(wd, reo, hp);
+    wireless_hal_srng_intr_event(wd, reo, entries, WIRELESS_SIMU_IRQ_STATUS_REO_DST);
+    stat64_add(&dp->stats.rx_batches, 1);
+}
+
+void wireless_dp_rx_ring_handler(void *user_data)
+{
+    struct wireless_simu_dp *dp = (struct wireless_simu_dp *)user_data;
+    struct wireless_simu_device_state *wd = dp->wd;
+    struct hal_srng *reo = &wd->hal.srng_list[dp->reo_ring_id];
+    uint32_t hp, entries;
+
+    /* deinit 之后 bufs 为 NULL, srng 线程和重排序定时器中迟到的调用直接返回 */
+    qemu_mutex_lock(&dp->rx_lock);
+    if (dp->bufs && dp_dst_ring_ready(reo))
+    {
+        dp_rx_refill(wd, dp);
+        hp = reo->u.dst_ring.hp;
+        entries = dp_rx_drain(wd, dp, reo, &hp);
+        dp_rx_commit(wd, dp, reo, hp, entries);
+    }
+    qemu_mutex_unlock(&dp->rx_lock);
+}
+
+/* 持有 rx_lock, 处理一帧, 返回写入 REO dst ring 的 entry 数量 */
+static uint32_t dp_rx_frame(struct wireless_simu_device_state *wd, struct wireless_simu_dp *dp,
+                            struct hal_srng *reo, const uint8_t *data, size_t len, uint8_t tid, uint16_t seq,
+                            uint32_t *hp)
+{
+    struct wireless_reo_queue *queue;
+    struct wireless_dp_frame *frame;
+    uint32_t hash = 0;
+    int ret;
+
+    wireless_simu_rss_hash(&wd->rss, data, len, &hash);
+
+    /* 乱序到达或者窗口中还有暂存的帧, 交给重排序, 按序交付的帧随后一起发出 */
+    queue = wireless_simu_reo_lookup(wd, data, len, tid);
+    if (queue && !wireless_simu_reo_in_order(queue, seq))
+    {
+        frame = dp_rx_frame_alloc(wd, data, len, tid, seq, hash);
+        if (!frame)
+        {
+            stat64_add(&dp->stats.rx_dropped, 1);
+            return 0;
+        }
+        wireless_simu_reo_rx(wd, queue, frame);
+        return dp_rx_drain(wd, dp, reo, hp);
+    }
+
+    /* 同一个 TID 中还有积压时新帧只能排在后面 */
+    ret = dp->tids[tid].len ? -ENOBUFS : dp_rx_post(wd, dp, reo, data, len, tid, seq, 0, hash, hp);
+    if (ret > 0)
+    {
+        stat64_add(&dp->stats.rx_frames, 1);
+        return ret;
+    }
+
+    if (ret == -EMSGSIZE)
+        stat64_add(&dp->stats.rx_dropped, 1);
+    else
+        dp_rx_enqueue(wd, dp, data, len, tid, seq, hash);
+
+    return 0;
+}
+
+void wireless_simu_dp_rx_batch(struct wireless_simu_device_state *wd, const struct iovec *frames, int n,
+                               bool *taken)
+{
+    struct wireless_simu_dp *dp = &wd->dp;
+    struct hal_srng *reo = &wd->hal.srng_list[dp->reo_ring_id];
+    uint32_t hp, entries;
+    uint16_t seq;
+    uint8_t tid;
+
+    for (int i = 0; i < n; i++)
+    {
+        taken[i] = false;
+    }
+
+    if (!dp->bufs || !dp_dst_ring_ready(reo))
+        return;
+
+    /* 一批帧只取一次锁, 只回写一次 hp 和通知一次中断合并 */
+    qemu_mutex_lock(&dp->rx_lock);
+    if (!dp->bufs)
+    {
+        qemu_mutex_unlock(&dp->rx_lock);
+        return;
+    }
+
+    /* 先把积压的帧发出去 */
+    dp_rx_refill(wd, dp);
+    hp = reo->u.dst_ring.hp;
+    entries = dp_rx_drain(wd, dp, reo, &hp);
+
+    for (int i = 0; i < n; i++)
+    {
+        if (!dp_rx_classify(frames[i].iov_base, frames[i].iov_len, &tid, &seq))
+            continue;
+
+        taken[i] = true;
+        entries += dp_rx_frame(wd, dp, reo, frames[i].iov_base, frames[i].iov_len, tid, seq, &hp);
+    }
+
+    dp_rx_commit(wd, dp, reo, hp, entries);
+
+    qemu_mutex_unlock(&dp->rx_lock);
+}
+
+int wireless_simu_dp_rx(struct wireless_simu_device_state *wd, const uint8_t *data, size_t len)
+{
+    struct iovec frame = {.iov_base = (void *)data, .iov_len = len};
+    bool taken;
+
+    wireless_simu_dp_rx_batch(wd, &frame, 1, &taken);
+    return taken ? 0 : -ENODEV;
+}
+
+/* -- init -- */
+
+bool wireless_simu_dp_check(struct wireless_simu_device_state *wd, Error **errp)
+{
+    /* reo dst 中的长度字段只有 16 位 */
+    if (wd->dp.buf_size == 0 || wd->dp.buf_size > HAL_REO_DST_INFO0_MSDU_LEN)
+    {
+        error_setg(errp, "dp-rx-buf-size must be between 1 and %d", HAL_REO_DST_INFO0_MSDU_LEN);
+        return false;
+    }
+
+    return true;
+}
+
+static int dp_ring_setup(struct wireless_simu_device_state *wd, enum hal_ring_type type, int ring_num, void *user_data)
+{
+    struct hal_srng_params params = {0};
+
+    params.user_data = user_data;
+    return wireless_hal_srng_setup(wd, type, ring_num, 0, &params);
+}
+
+int wireless_simu_dp_init(struct wireless_simu_device_state *wd)
+{
+    struct wireless_simu_dp *dp = &wd->dp;
+    struct wireless_dp_tcl *tcl;
+
+    dp->wd = wd;
+
+    for (int i = 0; i < WIRELESS_DP_TCL_RING_MAX; i++)
+    {
+        tcl = &dp->tcl[i];
+        tcl->wd = wd;
+        tcl->ring_num = i;
+        tcl->tcl_ring_id = dp_ring_setup(wd, HAL_TCL_DATA, i, tcl);
+        tcl->wbm_ring_id = dp_ring_setup(wd, HAL_WBM2SW_RELEASE, i, tcl);
+    }
+
+    qemu_mutex_init(&dp->rx_lock);
+    wireless_simu_reo_init(wd, dp->reo_timeout_ms, wd->ctx);
+    for (int i = 0; i < WIRELESS_DP_TID_MAX; i++)
+    {
+        QSIMPLEQ_INIT(&dp->tids[i].frames);
+        dp->tids[i].len = 0;
+    }
+    dp->next_tid = 0;
+    dp->queued = 0;
+    dp->buf_head = 0;
+    dp->buf_tail = 0;
+
+    dp->bufs = calloc(WIRELESS_DP_RX_BUF_MAX, sizeof(struct wireless_dp_rx_buf));
+    if (!dp->bufs)
+        return -ENOMEM;
+
+    dp->reo_ring_id = dp_ring_setup(wd, HAL_REO_DST, 0, dp);
+    dp->rxdma_ring_id = dp_ring_setup(wd, HAL_RXDMA_BUF, 0, dp);
+
+    return 0;
+}
+
+void wireless_simu_dp_deinit(struct wireless_simu_device_state *wd)
+{
+    struct wireless_simu_dp *dp = &wd->dp;
+    struct wireless_dp_frame *frame;
+
+    if (!dp->wd)
+        return;
+
+    wireless_simu_reo_deinit(wd);
+
+    qemu_mutex_lock(&dp->rx_lock);
+    for (int i = 0; i < WIRELESS_DP_TID_MAX; i++)
+    {
+        while ((frame = QSIMPLEQ_FIRST(&dp->tids[i].frames)) != NULL)
+        {
+            QSIMPLEQ_REMOVE_HEAD(&dp->tids[i].frames, next);
+            wireless_simu_pool_free(&wd->pool, frame);
+        }
+        dp->tids[i].len = 0;
+    }
+    dp->queued = 0;
+
+    free(dp->bufs);
+    dp->bufs = NULL;
+    qemu_mutex_unlock(&dp->rx_lock);
+
+    /* srng 线程和定时器回调可能还在等锁, 锁保留到设备释放 */
+}
@@ -0,0 +1,212 @@
+#ifndef WIRELESS_SIMU_DP
+#define WIRELESS_SIMU_DP
+
+#include "wireless_simu.h"
+
+/* 数据通路, 对应 ath11k 中 htt 管理的 TCL / WBM / RXDMA / REO ring
+ *
+ * 数据帧不再经过 ce 和 wmi:
+ * tx: 驱动把帧放入 SW2TCLn ring, 设备发出之后在 WBM2SWn release ring 上按 cookie 归还 buffer
+ * rx: 驱动在 RXDMA buf ring 上补充 buffer, 收到的数据帧按 TID 排队, 批量写入 buffer 后通过 REO dst ring 交给驱动
+ *
+ * 驱动为 (peer, TID) 建立了重排序队列时, 帧先经过 wireless_reo.h 中的窗口, 按序交付之后才进入 TID 队列
+ *
+ * 驱动没有配置 REO dst ring 时数据帧仍然走 ce, 没有使用 TCL ring 时 ce 上的数据照旧发送 */
+
+/* SW2TCL1 ~ SW2TCL4, 完成分别在 WBM2SW0 ~ WBM2SW3 上 */
+#define WIRELESS_DP_TCL_RING_MAX 4
+#define WIRELESS_DP_REO_RING_MAX 1
+#define WIRELESS_DP_RXDMA_RING_MAX 1
+
+/* TID 0 ~ 15 为 QoS 数据, 非 QoS 数据帧使用 16 */
+#define WIRELESS_DP_TID_NON_QOS 16
+#define WIRELESS_DP_TID_MAX 17
+
+/* 属性的默认值: 驱动补充的 rx buffer 大小, 每个 TID 队列的上限 */
+#define WIRELESS_DP_RX_BUF_SIZE 2048
+#define WIRELESS_DP_RX_QUEUE 64
+
+/* 设备最多记录的 rx buffer 数量, 驱动补充得更多时留在 RXDMA buf ring 中 */
+#define WIRELESS_DP_RX_BUF_MAX 1024
+
+/* buffer_addr_info 中的位, 四种 desc 通用; cookie 由驱动填写, 设备原样带回 */
+#define HAL_DP_BUF_ADDR_INFO_ADDR_HI 0x000000ff // GENMASK(7, 0)
+#define HAL_DP_BUF_ADDR_INFO_COOKIE 0xffffff00  // GENMASK(31, 8)
+
+/* tcl data cmd info0 中的位, 帧从 buffer 的 DATA_OFFSET 处开始 */
+#define HAL_TCL_DATA_CMD_INFO0_DATA_LEN 0x0000ffff    // GENMASK(15, 0)
+#define HAL_TCL_DATA_CMD_INFO0_DATA_OFFSET 0x0fff0000 // GENMASK(27, 16)
+
+/* SW2TCL ring 的 desc */
+struct hal_tcl_data_cmd
+{
+    uint32_t buffer_addr_low;
+    uint32_t buffer_addr_info; /* %HAL_DP_BUF_ADDR_INFO_ */
+    uint32_t info0;            /* %HAL_TCL_DATA_CMD_INFO0_ */
+    uint32_t meta_info;
+} __attribute__((__packed__));
+
+/* wbm release info0 中的位 */
+#define HAL_WBM_RELEASE_INFO0_STATUS 0x0000000f   // GENMASK(3, 0)
+#define HAL_WBM_RELEASE_INFO0_TCL_RING 0x000000f0 // GENMASK(7, 4)
+
+enum hal_wbm_tqm_status
+{
+    HAL_WBM_TQM_STATUS_OK = 0,
+    /* desc 错误或介质发送失败, buffer 同样归还 */
+    HAL_WBM_TQM_STATUS_DROP = 1,
+};
+
+/* WBM2SW release ring 的 desc, meta_info 从 tcl data cmd 中复制 */
+struct hal_wbm_release_desc
+{
+    uint32_t buffer_addr_low;
+    uint32_t buffer_addr_info; /* %HAL_DP_BUF_ADDR_INFO_ */
+    uint32_t info0;            /* %HAL_WBM_RELEASE_INFO0_ */
+    uint32_t meta_info;
+} __attribute__((__packed__));
+
+/* RXDMA buf ring 的 desc */
+struct hal_rxdma_buf_desc
+{
+    uint32_t buffer_addr_low;
+    uint32_t buffer_addr_info; /* %HAL_DP_BUF_ADDR_INFO_ */
+} __attribute__((__packed__));
+
+/* reo dst info0 / info1 中的位
+ * 一帧大于一个 buffer 时拆到连续的多个 buffer 中, 除最后一个之外都置位 MORE */
+#define HAL_REO_DST_INFO0_MSDU_LEN 0x0000ffff // GENMASK(15, 0)
+#define HAL_REO_DST_INFO0_TID 0x001f0000      // GENMASK(20, 16)
+#define HAL_REO_DST_INFO0_MORE BIT(21)
+/* 设备没能把数据写入这个 buffer, MSDU_LEN 为 0, 驱动应丢弃整帧并回收 buffer */
+#define HAL_REO_DST_INFO0_ERR BIT(22)
+#define HAL_REO_DST_INFO1_SEQ_NUM 0x00000fff // GENMASK(11, 0)
+/* 重排序放弃等待而跳过的序号数量, 紧挨在这一帧之前 */
+#define HAL_REO_DST_INFO1_HOLES 0x0fff0000 // GENMASK(27, 16)
+
+/* REO dst ring 的 desc, hash 为 rss 开启时算出的 Toeplitz hash */
+struct hal_reo_dst_desc
+{
+    uint32_t buffer_addr_low;
+    uint32_t buffer_addr_info; /* %HAL_DP_BUF_ADDR_INFO_ */
+    uint32_t info0;            /* %HAL_REO_DST_INFO0_ */
+    uint32_t info1;            /* %HAL_REO_DST_INFO1_ */
+    uint32_t hash;
+} __attribute__((__packed__));
+
+/* 一对 TCL / WBM ring, 作为两个 ring 共同的 user_data */
+struct wireless_dp_tcl
+{
+    struct wireless_simu_device_state *wd;
+    int ring_num;
+    uint32_t tcl_ring_id;
+    uint32_t wbm_ring_id;
+};
+
+/* 驱动补充的 rx buffer */
+struct wireless_dp_rx_buf
+{
+    dma_addr_t paddr;
+    uint32_t cookie;
+};
+
+/* 等待 rx buffer 的数据帧 */
+struct wireless_dp_frame
+{
+    QSIMPLEQ_ENTRY(wireless_dp_frame) next;
+    uint32_t hash;
+    uint16_t seq;
+    uint16_t holes;
+    uint8_t tid;
+    size_t len;
+    uint8_t data[];
+};
+
+struct wireless_dp_tid_queue
+{
+    QSIMPLEQ_HEAD(, wireless_dp_frame) frames;
+    uint32_t len;
+};
+
+/* 数据通路统计, 通过 qom-get 读取 */
+struct wireless_dp_stats
+{
+    /* 从 TCL ring 取出并发出的帧, 以 DROP 状态归还的帧 */
+    Stat64 tx_frames;
+    Stat64 tx_dropped;
+
+    /* WBM ring 已满, TCL ring 暂停消费 */
+    Stat64 tx_stalled;
+
+    /* 通过 REO dst ring 交给驱动的帧, 以及写入的批次, 两者相除为平均批量 */
+    Stat64 rx_frames;
+    Stat64 rx_batches;
+
+    /* 没有 buffer 或 REO ring 已满而进入 TID 队列的帧 */
+    Stat64 rx_queued;
+
+    /* TID 队列已满或帧比所有 buffer 加起来还大而丢弃 */
+    Stat64 rx_dropped;
+};
+
+struct wireless_simu_dp
+{
+    struct wireless_simu_device_state *wd;
+
+    struct wireless_dp_tcl tcl[WIRELESS_DP_TCL_RING_MAX];
+
+    uint32_t reo_ring_id;
+    uint32_t rxdma_ring_id;
+
+    /* 以下的 rx 状态由 rx_lock 保护 */
+    QemuMutex rx_lock;
+
+    /* buffer 记录, buf_head 和 buf_tail 都是单调递增的计数, 使用时对 WIRELESS_DP_RX_BUF_MAX 取模 */
+    struct wireless_dp_rx_buf *bufs;
+    uint32_t buf_head;
+    uint32_t buf_tail;
+
+    /* 按 TID 排队, 轮询发出, next_tid 为下一轮的起点 */
+    struct wireless_dp_tid_queue tids[WIRELESS_DP_TID_MAX];
+    uint32_t next_tid;
+    uint32_t queued;
+
+    /* 由设备属性给出 */
+    uint32_t buf_size;
+    uint32_t queue_max;
+    uint32_t reo_timeout_ms;
+
+    /* 重排序, 同样由 rx_lock 保护 */
+    struct wireless_simu_reo reo;
+
+    struct wireless_dp_stats stats;
+};
+
+/* 检查设备属性给出的数据通路参数 */
+bool wireless_simu_dp_check(struct wireless_simu_device_state *wd, Error **errp);
+
+/* 把数据通路绑定到 hal 中的 ring, 需要在 hal 初始化之后调用 */
+int wireless_simu_dp_init(struct wireless_simu_device_state *wd);
+
+/* 停止重排序定时器, 释放 TID 队列中的数据, 之后 rx 的处理都直接返回 */
+void wireless_simu_dp_deinit(struct wireless_simu_device_state *wd);
+
+/* TCL ring 有新的 desc 或 WBM ring 被驱动消费时的处理 */
+void wireless_dp_tcl_ring_handler(void *user_data);
+
+/* RXDMA buf ring 有新的 buffer 或 REO dst ring 被驱动消费时的处理 */
+void wireless_dp_rx_ring_handler(void *user_data);
+
+/* 重排序按序交付的帧进入 TID 队列, 不受 dp-rx-queue 的限制, 需持有 rx_lock */
+void wireless_dp_rx_release(struct wireless_simu_device_state *wd, struct wireless_dp_frame *frame);
+
+/* 从介质收到的帧, 是数据帧并且驱动配置了 REO dst ring 时由数据通路接管并返回 0，
+ * 否则返回 -ENODEV, 由调用者交给 ce */
+int wireless_simu_dp_rx(struct wireless_simu_device_state *wd, const uint8_t *data, size_t len);
+
+/* 一次处理 n 帧, 只取一次 rx_lock 并只回写一次 hp
+ * taken[i] 为 true 表示第 i 帧由数据通路接管, 其余的由调用者交给 ce */
+void wireless_simu_dp_rx_batch(struct wireless_simu_device_state *wd, const struct iovec *frames, int n,
+                               bool *taken);
+
+#endif /* WIRELESS_SIMU_DP */
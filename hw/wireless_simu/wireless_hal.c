@@ -28,6 +28,7 @@ static const struct hal_srng_config hw_srng_config_template[] = {
         .lmac_ring = false,
         .ring_dir = HAL_SRNG_DIR_DST,
         .max_size = HAL_TEST_SW2HW_SIZE,
+        .hal_srng_handler = ce_status_ring_handler,
     },
     {
         /* CE_SRC */
@@ -46,6 +47,7 @@ static const struct hal_srng_config hw_srng_config_template[] = {
         .lmac_ring = false,
         .ring_dir = HAL_SRNG_DIR_SRC,
         .max_size = HAL_CE_DST_RING_BASE_MSB_RING_SIZE,
+        .hal_srng_handler = ce_dst_ring_handler,
     },
     {
         /* CE_DST_STATUS */
@@ -55,6 +57,47 @@ static const struct hal_srng_config hw_srng_config_template[] = {
         .lmac_ring = false,
         .ring_dir = HAL_SRNG_DIR_DST,
         .max_size = HAL_CE_DST_STATUS_RING_BASE_MSB_RING_SIZE,
+        .hal_srng_handler = ce_status_ring_handler,
+    },
+    {
+        /* REO_DST, 数据通路的接收, 驱动消费之后重放 TID 队列中的数据 */
+        .start_ring_id = HAL_SRNG_RING_ID_REO2SW1,
+        .max_rings = WIRELESS_DP_REO_RING_MAX,
+        .entry_size = sizeof(struct hal_reo_dst_desc) >> 2,
+        .lmac_ring = false,
+        .ring_dir = HAL_SRNG_DIR_DST,
+        .max_size = HAL_REO_REO2SW1_RING_BASE_MSB_RING_SIZE,
+        .hal_srng_handler = wireless_dp_rx_ring_handler,
+    },
+    {
+        /* TCL_DATA, 数据通路的发送 */
+        .start_ring_id = HAL_SRNG_RING_ID_SW2TCL1,
+        .max_rings = WIRELESS_DP_TCL_RING_MAX,
+        .entry_size = sizeof(struct hal_tcl_data_cmd) >> 2,
+        .lmac_ring = false,
+        .ring_dir = HAL_SRNG_DIR_SRC,
+        .max_size = HAL_SW2TCL1_RING_BASE_MSB_RING_SIZE,
+        .hal_srng_handler = wireless_dp_tcl_ring_handler,
+    },
+    {
+        /* WBM2SW_RELEASE, 和 TCL_DATA 一一对应, 驱动消费之后继续处理 TCL ring */
+        .start_ring_id = HAL_SRNG_RING_ID_WBM2SW0_RELEASE,
+        .max_rings = WIRELESS_DP_TCL_RING_MAX,
+        .entry_size = sizeof(struct hal_wbm_release_desc) >> 2,
+        .lmac_ring = false,
+        .ring_dir = HAL_SRNG_DIR_DST,
+        .max_size = HAL_WBM2SW_RELEASE_RING_BASE_MSB_RING_SIZE,
+        .hal_srng_handler = wireless_dp_tcl_ring_handler,
+    },
+    {
+        /* RXDMA_BUF, 驱动补充的接收 buffer */
+        .start_ring_id = HAL_SRNG_RING_ID_WMAC1_SW2RXDMA0_BUF,
+        .max_rings = WIRELESS_DP_RXDMA_RING_MAX,
+        .entry_size = sizeof(struct hal_rxdma_buf_desc) >> 2,
+        .lmac_ring = true,
+        .ring_dir = HAL_SRNG_DIR_SRC,
+        .max_size = HAL_RXDMA_RING_MAX_SIZE,
+        .hal_srng_handler = wireless_dp_rx_ring_handler,
     },
 };
 
@@ -85,12 +128,89 @@ static void wireless_simu_hal_srng_dir_set(int ring_id, struct hal_srng *srng)
     case HAL_SRNG_RING_ID_CE0_DST_STATUS ... HAL_SRNG_RING_ID_CE0_DST_STATUS + 11:
         srng->ring_dir = HAL_SRNG_DIR_DST;
         break;
+    case HAL_SRNG_RING_ID_REO2SW1:
+        srng->ring_dir = HAL_SRNG_DIR_DST;
+        break;
+    case HAL_SRNG_RING_ID_SW2TCL1 ... HAL_SRNG_RING_ID_SW2TCL1 + WIRELESS_DP_TCL_RING_MAX - 1:
+        srng->ring_dir = HAL_SRNG_DIR_SRC;
+        break;
+    case HAL_SRNG_RING_ID_WBM2SW0_RELEASE ... HAL_SRNG_RING_ID_WBM2SW0_RELEASE + WIRELESS_DP_TCL_RING_MAX - 1:
+        srng->ring_dir = HAL_SRNG_DIR_DST;
+        break;
+    case HAL_SRNG_RING_ID_WMAC1_SW2RXDMA0_BUF:
+        srng->ring_dir = HAL_SRNG_DIR_SRC;
+        break;
     default:
         printf("%s : ring id %d err \n", WIRELESS_SIMU_DEVICE_NAME, ring_id);
         break;
     }
 }
 
+/* 门铃只负责唤醒 ring 的处理者, hp 由处理者从 shadow 中读取 */
+static void hal_srng_doorbell_read(EventNotifier *n)
+{
+    struct hal_srng *srng = container_of(n, struct hal_srng, doorbell);
+
+    if (event_notifier_test_and_clear(n))
+    {
+        wireless_hal_srng_kick(srng->wd, srng);
+    }
+}
+
+static hwaddr hal_srng_doorbell_addr(struct hal_srng *srng)
+{
+    /* R2 组 0 号寄存器, 布局见 wireless_hal_reg_handler */
+    return HAL_TEST_SRNG_REG_GRP | (srng->ring_id << 8) | (HAL_SRNG_REG_GRP_R2 << 7);
+}
+
+static void hal_srng_doorbell_teardown(struct wireless_simu_device_state *wd, struct hal_srng *srng)
+{
+    if (!srng->doorbell_registered)
+    {
+        return;
+    }
+
+    if (wd->hal.ctx)
+    {
+        aio_set_event_notifier(wd->hal.ctx, &srng->doorbell, NULL, NULL, NULL);
+    }
+    else
+    {
+        event_notifier_set_handler(&srng->doorbell, NULL);
+    }
+    memory_region_del_eventfd(&wd->mmio, hal_srng_doorbell_addr(srng), 4, false, 0, &srng->doorbell);
+    event_notifier_cleanup(&srng->doorbell);
+    srng->doorbell_registered = false;
+}
+
+/* 驱动提供了 hp shadow 之后, 把该 ring 的 hp 门铃寄存器注册为 ioeventfd, 持有 bql */
+static void hal_srng_doorbell_setup(struct wireless_simu_device_state *wd, struct hal_srng *srng)
+{
+    hal_srng_doorbell_teardown(wd, srng);
+
+    if (srng->u.src_ring.hp_shadow_paddr == 0)
+    {
+        return;
+    }
+
+    if (event_notifier_init(&srng->doorbell, 0))
+    {
+        printf("%s : srng %d doorbell eventfd init err, use mmio \n", WIRELESS_SIMU_DEVICE_NAME, srng->ring_id);
+        return;
+    }
+
+    if (wd->hal.ctx)
+    {
+        aio_set_event_notifier(wd->hal.ctx, &srng->doorbell, hal_srng_doorbell_read, NULL, NULL);
+    }
+    else
+    {
+        event_notifier_set_handler(&srng->doorbell, hal_srng_doorbell_read);
+    }
+    memory_region_add_eventfd(&wd->mmio, hal_srng_doorbell_addr(srng), 4, false, 0, &srng->doorbell);
+    srng->doorbell_registered = true;
+}
+
 int wireless_hal_reg_handler(struct wireless_simu_device_state *wd, hwaddr addr, uint32_t val)
 {
     // srng->hwreg_base 的初始化，该处和硬件设计强相关，需特别注意寄存器的地址和功能的对应
@@ -120,21 +240,27 @@ int wireless_hal_reg_handler(struct wireless_simu_device_state *wd, hwaddr addr,
             srng->ring_base_paddr = val;
             srng->ring_id = ring_id;
             wireless_simu_hal_srng_dir_set(ring_id, srng);
-            qemu_mutex_init(&srng->lock);
+            qatomic_inc(&wd->hal.map_gen);
             printf("%s : srng set %d ring_id %d type \n", WIRELESS_SIMU_DEVICE_NAME, ring_id, srng->ring_dir);
             break;
         case 1:
+            /* ring_size 和 entry_size 一旦非零就不会再变回零, 各处取模时不需要再检查 */
+            if ((val & 0xfffff00) == 0)
+            {
+                return -EINVAL;
+            }
             srng->ring_base_paddr |= (((uint64_t)(val) & 0xff) << 32); // #define HAL_TCL1_RING_BASE_MSB_RING_BASE_ADDR_MSB GENMASK(7, 0)
             srng->ring_size = (((uint64_t)(val) & 0xfffff00) >> 8);    // 单位 32 bit #define HAL_TCL1_RING_BASE_MSB_RING_SIZE GENMASK(27, 8)
+            qatomic_inc(&wd->hal.map_gen);
             printf("%s : srng set %d ring %016lx ring_base_addr %08x ring_size\n",
                    WIRELESS_SIMU_DEVICE_NAME, ring_id, srng->ring_base_paddr, srng->ring_size);
             break;
         case 2:
-            srng->entry_size = (val & 0xff); // #define HAL_REO1_RING_ID_ENTRY_SIZE GENMASK(7, 0)
-            if (srng->entry_size == 0)
+            if ((val & 0xff) == 0)
             {
                 return -EINVAL;
             }
+            srng->entry_size = (val & 0xff); // #define HAL_REO1_RING_ID_ENTRY_SIZE GENMASK(7, 0)
             srng->num_entries = (srng->ring_size / srng->entry_size);
             printf("%s : srng set %d ring %08x entry_size %08x num_entries \n",
                    WIRELESS_SIMU_DEVICE_NAME, ring_id, srng->entry_size, srng->num_entries);
@@ -172,6 +298,7 @@ int wireless_hal_reg_handler(struct wireless_simu_device_state *wd, hwaddr addr,
             {
                 srng->u.dst_ring.hp_paddr = (((uint64_t)val) & 0xffffffff);
             }
+            qatomic_inc(&wd->hal.map_gen);
             break;
         case 6:
             if (srng->ring_dir == HAL_SRNG_DIR_SRC)
@@ -188,11 +315,40 @@ int wireless_hal_reg_handler(struct wireless_simu_device_state *wd, hwaddr addr,
                 printf("%s : srng set %d ring_id dst ring %016lx hp_paddr \n",
                        WIRELESS_SIMU_DEVICE_NAME, ring_id, srng->u.dst_ring.hp_paddr);
             }
+            qatomic_inc(&wd->hal.map_gen);
             break;
         case 7:
             srng->flags = val;
             printf("%s : srng set %d ring_id %08x flag \n", WIRELESS_SIMU_DEVICE_NAME, ring_id, srng->flags);
             break;
+        case 10:
+            srng->msi_addr = (((uint64_t)val) & 0xffffffff);
+            break;
+        case 11:
+            srng->msi_addr |= (((uint64_t)val) << 32);
+            break;
+        case 12:
+            srng->msi_data = val;
+            break;
+        case 8:
+            if (srng->ring_dir != HAL_SRNG_DIR_SRC)
+            {
+                return -EINVAL;
+            }
+            srng->u.src_ring.hp_shadow_paddr = (((uint64_t)val) & 0xffffffff);
+            break;
+        case 9:
+            if (srng->ring_dir != HAL_SRNG_DIR_SRC)
+            {
+                return -EINVAL;
+            }
+            srng->u.src_ring.hp_shadow_paddr |= (((uint64_t)val) << 32);
+            printf("%s : srng set %d ring_id src ring %016lx hp_shadow_paddr \n",
+                   WIRELESS_SIMU_DEVICE_NAME, ring_id, srng->u.src_ring.hp_shadow_paddr);
+            qatomic_inc(&wd->hal.map_gen);
+            srng->wd = wd;
+            hal_srng_doorbell_setup(wd, srng);
+            break;
         default:
             printf("%s : srng set err reg num %d \n", WIRELESS_SIMU_DEVICE_NAME, reg_offset);
             return -EINVAL;
@@ -207,19 +363,20 @@ int wireless_hal_reg_handler(struct wireless_simu_device_state *wd, hwaddr addr,
             // 在src_ring中，0号寄存器用于sw hp的更新
             if (srng->ring_dir == HAL_SRNG_DIR_SRC)
             {
-                srng->u.src_ring.hp = val;
                 srng->wd = wd;
-                printf("%s : srng update %d src ring %d hp count \n",
-                       WIRELESS_SIMU_DEVICE_NAME, ring_id, srng->u.src_ring.hp);
-                g_thread_pool_push(wd->hal_srng_handle_pool, (void *)srng, &wd->hal_srng_handle_err);
+                qatomic_set(&srng->u.src_ring.hp, val);
+                wireless_hal_srng_kick(wd, srng);
             }
             else
             {
-                srng->u.dst_ring.tp = val;
                 srng->wd = wd;
+                qatomic_set(&srng->u.dst_ring.tp, val);
 
-                /* dst 方向的ring更新无需进行处理 */
-                printf("%s : dst ring id %08x tp %08x \n", WIRELESS_SIMU_DEVICE_NAME, srng->ring_id, srng->u.dst_ring.tp);
+                /* 驱动消费了 dst ring, 空出来的位置可以用于重放设备中积压的数据 */
+                if (srng->hal_srng_handler && srng->user_data)
+                {
+                    wireless_hal_srng_kick(wd, srng);
+                }
             }
             break;
         case 1:
@@ -237,9 +394,12 @@ int wireless_hal_reg_handler(struct wireless_simu_device_state *wd, hwaddr addr,
     return 0;
 }
 
-static uint32_t *get_desc_from_mem(PCIDevice *pci_dev, dma_addr_t paddr, size_t size)
+/* 返回的内存来自设备的对象池, 使用完之后通过 wireless_simu_pool_free 释放 */
+static uint32_t *get_desc_from_mem(struct wireless_simu_device_state *wd, dma_addr_t paddr, size_t size)
 {
-    uint32_t *desc = malloc(size);
+    uint32_t *desc = wireless_simu_pool_alloc(&wd->pool, size);
+    if (!desc)
+        return NULL;
 
     // 测试desc地址，非主要日志，需要被注释掉
     /* 经过测试，下方的dma_read函数需要传入一个足够大小的desc来承接数据，因此需要上方的desc进行malloc
@@ -248,10 +408,11 @@ static uint32_t *get_desc_from_mem(PCIDevice *pci_dev, dma_addr_t paddr, size_t
     // printf("%s : dma desc test vaddr %p \n", WIRELESS_SIMU_DEVICE_NAME, desc);
 
     uint32_t ret;
-    ret = pci_dma_read(pci_dev, paddr, desc, size);
+    ret = pci_dma_read(&wd->parent_obj, paddr, desc, size);
     if (ret)
     {
         printf("%s : srng read from mem %d err\n", WIRELESS_SIMU_DEVICE_NAME, ret);
+        wireless_simu_pool_free(&wd->pool, desc);
         return NULL;
     }
 
@@ -261,198 +422,862 @@ static uint32_t *get_desc_from_mem(PCIDevice *pci_dev, dma_addr_t paddr, size_t
     return desc;
 }
 
-static int desc_hal_test_sw2hw_handle(struct wireless_simu_device_state *wd, void *desc)
+static void hal_srng_dma_unmap(PCIDevice *pci_dev, struct hal_srng_dma_map *map)
 {
-    struct hal_test_sw2hw *cmd = (struct hal_test_sw2hw *)desc;
-    dma_addr_t data_paddr = cmd->buffer_addr_low | ((uint64_t)(cmd->buffer_addr_info & 0xff) << 32);
-    size_t data_size = ((cmd->buffer_addr_info & 0xffff0000) >> 16);
-    uint32_t write_index = cmd->write_index;
+    /* 每次写入时已经标记过脏页 */
+    if (map->vaddr)
+    {
+        pci_dma_unmap(pci_dev, map->vaddr, map->len, map->dir, 0);
+    }
+    map->vaddr = NULL;
+    map->mr = NULL;
+    map->fallback = false;
+}
 
-    printf("%s : src read data %016lx paddr %08lx size %08x write_index \n", WIRELESS_SIMU_DEVICE_NAME, data_paddr, data_size, write_index);
+/* 通过映射写入了 [off, off + size) 之后调用, 让迁移能看到这次写入 */
+static void hal_srng_dma_map_dirty(struct hal_srng_dma_map *map, dma_addr_t off, dma_addr_t size)
+{
+    if (map->mr)
+    {
+        memory_region_set_dirty(map->mr, map->offset + off, size);
+    }
+}
 
-    // 数据 loop
-    void *data = (void *)get_desc_from_mem(&wd->parent_obj, data_paddr, data_size);
-    if (!data)
-        return -EIO;
-    uint64_t head = READ_64BIT_FROM_ADDR(data);
-    uint64_t tail = READ_64BIT_FROM_ADDR(data + data_size - 8);
-    printf("%s : src read data %016lx head %016lx tail \n", WIRELESS_SIMU_DEVICE_NAME, head, tail);
+/* 返回 paddr 开始的 len 长度区域的映射, 返回 NULL 时调用者需要回退到 dma 读写 */
+static void *hal_srng_dma_map_get(struct wireless_simu_device_state *wd, struct hal_srng_dma_map *map,
+                                  dma_addr_t paddr, dma_addr_t len, DMADirection dir)
+{
+    uint32_t gen = qatomic_read(&wd->hal.map_gen);
+    dma_addr_t plen = len;
+    ram_addr_t offset;
+    MemoryRegion *mr;
+    void *vaddr;
 
-    wireless_simu_ce_post_data(wd, data, data_size);
+    if (map->gen == gen && map->paddr == paddr && map->len == len && map->dir == dir)
+    {
+        return map->fallback ? NULL : map->vaddr;
+    }
 
-    /* 不管是否成功失败, free掉空间  */
-    free(data);
+    hal_srng_dma_unmap(&wd->parent_obj, map);
+    map->gen = gen;
+    map->paddr = paddr;
+    map->len = len;
+    map->dir = dir;
+
+    if (paddr == 0 || len == 0)
+    {
+        map->fallback = true;
+        return NULL;
+    }
+
+    vaddr = pci_dma_map(&wd->parent_obj, paddr, &plen, dir);
+    if (!vaddr)
+    {
+        map->fallback = true;
+        return NULL;
+    }
+
+    /* 只映射了一部分, 或者拿到的是 bounce buffer, 都不能长期持有 */
+    mr = plen < len ? NULL : memory_region_from_host(vaddr, &offset);
+    if (!mr)
+    {
+        pci_dma_unmap(&wd->parent_obj, vaddr, plen, dir, 0);
+        printf("%s : srng map %016lx len %lx fallback to dma \n", WIRELESS_SIMU_DEVICE_NAME, paddr, len);
+        map->fallback = true;
+        return NULL;
+    }
+
+    map->vaddr = vaddr;
+    map->mr = dir == DMA_DIRECTION_FROM_DEVICE ? mr : NULL;
+    map->offset = offset;
+    return vaddr;
+}
 
+void wireless_simu_dma_unmap_iov(struct wireless_simu_device_state *wd, const struct iovec *iov, int iovcnt,
+                                 DMADirection dir)
+{
+    for (int i = 0; i < iovcnt; i++)
+    {
+        pci_dma_unmap(&wd->parent_obj, iov[i].iov_base, iov[i].iov_len, dir,
+                      dir == DMA_DIRECTION_FROM_DEVICE ? iov[i].iov_len : 0);
+    }
+}
+
+/* 短期映射, 处理完一帧就解除, bounce buffer 也可以使用 */
+int wireless_simu_dma_map_iov(struct wireless_simu_device_state *wd, dma_addr_t paddr, dma_addr_t len,
+                              DMADirection dir, struct iovec *iov, int max)
+{
+    int iovcnt = 0;
+
+    while (len)
+    {
+        dma_addr_t plen = len;
+        void *vaddr;
+
+        if (iovcnt == max)
+            goto fail;
+
+        vaddr = pci_dma_map(&wd->parent_obj, paddr, &plen, dir);
+        if (!vaddr)
+            goto fail;
+
+        iov[iovcnt].iov_base = vaddr;
+        iov[iovcnt].iov_len = plen;
+        iovcnt++;
+        paddr += plen;
+        len -= plen;
+    }
+
+    return iovcnt;
+
+fail:
+    wireless_simu_dma_unmap_iov(wd, iov, iovcnt, dir);
     return 0;
 }
 
-static int hal_srng_ring_ce_src_wmi_handler(struct wireless_simu_device_state *wd, void *desc)
+static void *hal_srng_ring_map(struct wireless_simu_device_state *wd, struct hal_srng *srng)
 {
-    struct hal_ce_srng_src_desc *ce_src_desc = (struct hal_ce_srng_src_desc *)desc;
+    return hal_srng_dma_map_get(wd, &srng->ring_map, srng->ring_base_paddr,
+                                (dma_addr_t)srng->ring_size << 2,
+                                srng->ring_dir == HAL_SRNG_DIR_SRC ? DMA_DIRECTION_TO_DEVICE
+                                                                   : DMA_DIRECTION_FROM_DEVICE);
+}
 
-    /* -- ce ring 数据帧 -- */
-    dma_addr_t data_paddr = ce_src_desc->buffer_addr_low | ((uint64_t)(ce_src_desc->buffer_addr_info & 0xff) << 32);
-    uint32_t data_size = ((ce_src_desc->buffer_addr_info & 0xffff0000) >> 16);
-    printf("%s : ce srng src desc data %016lx paddr %08x size %08x flag \n", WIRELESS_SIMU_DEVICE_NAME, data_paddr, data_size, ce_src_desc->flags);
+uint32_t *wireless_hal_srng_desc_get(struct wireless_simu_device_state *wd, struct hal_srng *srng, uint32_t offset)
+{
+    uint32_t *ring = hal_srng_ring_map(wd, srng);
+    size_t size = srng->entry_size << 2;
 
-    /* -- 从 ce ring 中抽取 skb */
-    void *data = (void *)get_desc_from_mem(&wd->parent_obj, data_paddr, data_size);
-    if (!data)
-        return -EIO;
+    if (offset + srng->entry_size > srng->ring_size)
+    {
+        return NULL;
+    }
 
-    /* -- skb 中 头部先是 htc 部分 */
-    struct wireless_htc_hdr *htc_hdr = (struct wireless_htc_hdr *)data;
-    uint32_t skb_len_no_htc = (htc_hdr->htc_info & 0xffff0000) >> 16;
-    printf("%s : ce srng src htc skb_len_no_htc %08x \n", WIRELESS_SIMU_DEVICE_NAME, skb_len_no_htc);
+    if (ring)
+    {
+        return ring + offset;
+    }
+
+    if (size > sizeof(srng->desc_buf) ||
+        pci_dma_read(&wd->parent_obj, srng->ring_base_paddr + (offset << 2), srng->desc_buf, size))
+    {
+        printf("%s : srng %d read desc from mem err \n", WIRELESS_SIMU_DEVICE_NAME, srng->ring_id);
+        return NULL;
+    }
 
-    /* -- htc 后面是 wmi_cmd 部分 */
-    struct wmi_cmd_hdr *wmi_hdr = (struct wmi_cmd_hdr *)((void *)data + sizeof(struct wireless_htc_hdr));
-    uint32_t wmi_cmd = wmi_hdr->cmd_id;
-    printf("%s : ce srng src wmi cmd %08x \n", WIRELESS_SIMU_DEVICE_NAME, wmi_cmd);
+    return srng->desc_buf;
+}
 
-    switch (wmi_cmd)
+int wireless_hal_srng_desc_put(struct wireless_simu_device_state *wd, struct hal_srng *srng, uint32_t offset,
+                               const void *desc, size_t size)
+{
+    uint32_t *ring = hal_srng_ring_map(wd, srng);
+
+    if ((offset << 2) + size > (srng->ring_size << 2))
     {
-    case WMI_MGMT_TX_SEND_CMDID:
-        printf("%s : ce srng src wmi_mgmt_send_cmd \n", WIRELESS_SIMU_DEVICE_NAME);
-        struct wmi_mgmt_send_cmd *cmd = (struct wmi_mgmt_send_cmd *)((void *)wmi_hdr + sizeof(struct wmi_cmd_hdr));
-        wireless_simu_wmi_mgmt_send(wd, cmd);
-        break;
+        return -EINVAL;
     }
 
-    free(data);
-    return 0;
+    if (ring)
+    {
+        memcpy(ring + offset, desc, size);
+        hal_srng_dma_map_dirty(&srng->ring_map, offset << 2, size);
+        return 0;
+    }
+
+    return pci_dma_write(&wd->parent_obj, srng->ring_base_paddr + (offset << 2), desc, size) ? -EIO : 0;
 }
 
-static int hal_srng_ring_ce_src_handler_default(struct wireless_simu_device_state *wd, void *desc, int ce_id)
+void wireless_hal_srng_shadow_update(struct wireless_simu_device_state *wd, struct hal_srng *srng, uint32_t val)
 {
-    int ret = 0;
+    dma_addr_t paddr = srng->ring_dir == HAL_SRNG_DIR_SRC ? srng->u.src_ring.tp_paddr
+                                                          : srng->u.dst_ring.hp_paddr;
+    uint32_t *shadow = hal_srng_dma_map_get(wd, &srng->shadow_map, paddr, sizeof(uint32_t),
+                                            DMA_DIRECTION_FROM_DEVICE);
 
-    printf("%s : this is openwifi tx code ce_id %d \n", WIRELESS_SIMU_DEVICE_NAME, ce_id);
-    struct hal_ce_srng_src_desc *ce_src_desc = (struct hal_ce_srng_src_desc *)desc;
-    dma_addr_t data_paddr = ce_src_desc->buffer_addr_low | ((uint64_t)(ce_src_desc->buffer_addr_info & 0xff) << 32);
-    uint32_t data_size = ((ce_src_desc->buffer_addr_info & 0xffff0000) >> 16);
+    /* 指针更新之前 desc 的读写必须已经完成 */
+    smp_mb();
+
+    if (shadow)
+    {
+        qatomic_set(shadow, cpu_to_le32(val));
+        hal_srng_dma_map_dirty(&srng->shadow_map, 0, sizeof(uint32_t));
+        return;
+    }
+
+    val = cpu_to_le32(val);
+    pci_dma_write(&wd->parent_obj, paddr, &val, sizeof(val));
+}
+
+static void wireless_hal_map_commit(MemoryListener *listener)
+{
+    struct wireless_simu_hal *hal = container_of(listener, struct wireless_simu_hal, map_listener);
+
+    /* 这里持有 bql, 不能去拿 srng->lock; 只标记失效, 由访问者在自己的锁下重新映射 */
+    qatomic_inc(&hal->map_gen);
+}
+
+static struct hal_srng_worker *hal_srng_worker_of(struct wireless_simu_hal *hal, int ring_id)
+{
+    /* ce 的 src / dst / dst_status ring 各自是连续的 ring_id, 取模后会被均匀地分散到各个线程 */
+    return &hal->workers[ring_id % hal->worker_count];
+}
+
+void wireless_hal_srng_kick(struct wireless_simu_device_state *wd, struct hal_srng *srng)
+{
+    struct hal_srng_worker *worker;
+
+    if (qatomic_read(&wd->hal.stopped))
+        return;
+
+    worker = hal_srng_worker_of(&wd->hal, srng->ring_id);
+    set_bit_atomic(srng->ring_id, worker->pending);
+    if (worker->bh)
+    {
+        qemu_bh_schedule(worker->bh);
+        return;
+    }
+    qemu_event_set(&worker->doorbell);
+}
+
+/* 处理一轮 pending 中的 ring, 返回是否处理过 ring */
+static bool hal_srng_worker_run(struct hal_srng_worker *worker)
+{
+    struct wireless_simu_device_state *wd = worker->wd;
+    struct hal_srng *srng;
+    unsigned long bits;
+    bool busy = false;
+
+    for (int i = 0; i < ARRAY_SIZE(worker->pending); i++)
+    {
+        bits = qatomic_xchg(&worker->pending[i], 0);
+        while (bits)
+        {
+            int bit = ctzl(bits);
+            bits &= bits - 1;
+
+            srng = &wd->hal.srng_list[i * BITS_PER_LONG + bit];
+            busy = true;
+
+            if (srng->hal_srng_handler && srng->user_data)
+            {
+                srng->hal_srng_handler(srng->user_data);
+                continue;
+            }
+            wireless_hal_src_ring_tp(wd, srng);
+        }
+    }
+
+    return busy;
+}
+
+static void *hal_srng_worker_thread(void *opaque)
+{
+    struct hal_srng_worker *worker = opaque;
+
+    while (!qatomic_read(&worker->stop))
+    {
+        /* 先 reset 再检查 pending, 检查之后到来的门铃会重新 set event, 不会丢失 */
+        qemu_event_reset(&worker->doorbell);
+
+        if (!hal_srng_worker_run(worker))
+        {
+            qemu_event_wait(&worker->doorbell);
+        }
+    }
+
+    return NULL;
+}
+
+/* iothread 模式下在 AioContext 中执行 */
+static void hal_srng_worker_bh(void *opaque)
+{
+    struct hal_srng_worker *worker = opaque;
+
+    /* 处理期间到来的门铃会重新调度 bh */
+    hal_srng_worker_run(worker);
+}
+
+void wireless_hal_init(struct wireless_simu_device_state *wd, uint32_t worker_count, AioContext *ctx)
+{
+    struct wireless_simu_hal *hal = &wd->hal;
+    struct hal_srng_worker *worker;
+    struct hal_srng *srng;
+    char name[32];
+
+    for (int i = 0; i < HAL_SRNG_RING_ID_MAX; i++)
+    {
+        srng = &hal->srng_list[i];
+        qemu_mutex_init(&srng->lock);
+
+        /* 中断合并的定时器跟随数据面, 使用虚拟时钟 */
+        qemu_mutex_init(&srng->intr_mod.lock);
+        srng->intr_mod.timer = ctx ? aio_timer_new(ctx, QEMU_CLOCK_VIRTUAL, SCALE_NS, hal_srng_intr_mod_timeout, srng)
+                                   : timer_new_ns(QEMU_CLOCK_VIRTUAL, hal_srng_intr_mod_timeout, srng);
+    }
+
+    /* iothread 中只有一个线程, 所有 ring 都交给同一个 bh */
+    hal->ctx = ctx;
+    hal->stopped = false;
+    hal->worker_count = ctx ? 1 : MIN(MAX(worker_count, 1), HAL_SRNG_WORKER_MAX);
+    for (int i = 0; i < hal->worker_count; i++)
+    {
+        worker = &hal->workers[i];
+        worker->wd = wd;
+        worker->id = i;
+        worker->stop = false;
+        memset(worker->pending, 0, sizeof(worker->pending));
+
+        if (ctx)
+        {
+            worker->bh = aio_bh_new(ctx, hal_srng_worker_bh, worker);
+            continue;
+        }
+
+        worker->bh = NULL;
+        qemu_event_init(&worker->doorbell, false);
+        snprintf(name, sizeof(name), "wsimu-srng%d", i);
+        qemu_thread_create(&worker->thread, name, hal_srng_worker_thread, worker, QEMU_THREAD_JOINABLE);
+    }
+
+    hal->map_gen = 1;
+    hal->map_listener = (MemoryListener){
+        .name = "wireless_simu-srng",
+        .commit = wireless_hal_map_commit,
+    };
+    memory_listener_register(&hal->map_listener, pci_get_address_space(&wd->parent_obj));
+}
 
-    /* -- 从 ce ring 中抽取 skb */
-    void *data = (void *)get_desc_from_mem(&wd->parent_obj, data_paddr, data_size);
+/* 定时器需要在其所属的线程中释放 */
+static void hal_srng_intr_mod_free(struct wireless_simu_hal *hal)
+{
+    for (int i = 0; i < HAL_SRNG_RING_ID_MAX; i++)
+    {
+        if (hal->srng_list[i].intr_mod.timer)
+        {
+            timer_free(hal->srng_list[i].intr_mod.timer);
+            hal->srng_list[i].intr_mod.timer = NULL;
+        }
+    }
+}
+
+static void hal_srng_worker_bh_delete(void *opaque)
+{
+    struct wireless_simu_hal *hal = opaque;
+
+    /* 门铃的 handler 同样挂在 AioContext 中 */
+    for (int i = 0; i < HAL_SRNG_RING_ID_MAX; i++)
+    {
+        if (hal->srng_list[i].doorbell_registered)
+        {
+            aio_set_event_notifier(hal->ctx, &hal->srng_list[i].doorbell, NULL, NULL, NULL);
+        }
+    }
+
+    for (int i = 0; i < hal->worker_count; i++)
+    {
+        qemu_bh_delete(hal->workers[i].bh);
+        hal->workers[i].bh = NULL;
+    }
+}
+
+static void hal_srng_intr_mod_free_bh(void *opaque)
+{
+    hal_srng_intr_mod_free(opaque);
+}
+
+void wireless_hal_stop(struct wireless_simu_device_state *wd)
+{
+    struct wireless_simu_hal *hal = &wd->hal;
+    struct hal_srng_worker *worker;
+
+    if (hal->stopped)
+        return;
+    qatomic_set(&hal->stopped, true);
+
+    if (hal->ctx)
+    {
+        /* 在 AioContext 中删除 bh, 返回之后不会再有 ring 在被处理 */
+        aio_wait_bh_oneshot(hal->ctx, hal_srng_worker_bh_delete, hal);
+        return;
+    }
+
+    for (int i = 0; i < hal->worker_count; i++)
+    {
+        worker = &hal->workers[i];
+        qatomic_set(&worker->stop, true);
+        qemu_event_set(&worker->doorbell);
+        qemu_thread_join(&worker->thread);
+        qemu_event_destroy(&worker->doorbell);
+    }
+}
+
+void wireless_hal_deinit(struct wireless_simu_device_state *wd)
+{
+    struct wireless_simu_hal *hal = &wd->hal;
+    struct hal_srng *srng;
+
+    wireless_hal_stop(wd);
+    hal->worker_count = 0;
+
+    /* 中断合并的定时器在所属的 AioContext 中释放 */
+    if (hal->ctx)
+        aio_wait_bh_oneshot(hal->ctx, hal_srng_intr_mod_free_bh, hal);
+    else
+        hal_srng_intr_mod_free(hal);
+
+    memory_listener_unregister(&hal->map_listener);
+
+    for (int i = 0; i < HAL_SRNG_RING_ID_MAX; i++)
+    {
+        srng = &hal->srng_list[i];
+        hal_srng_doorbell_teardown(wd, srng);
+        qemu_mutex_lock(&srng->lock);
+        hal_srng_dma_unmap(&wd->parent_obj, &srng->ring_map);
+        hal_srng_dma_unmap(&wd->parent_obj, &srng->shadow_map);
+        hal_srng_dma_unmap(&wd->parent_obj, &srng->hp_shadow_map);
+        free(srng->gather.buf);
+        srng->gather.buf = NULL;
+        srng->gather.len = 0;
+        qemu_mutex_unlock(&srng->lock);
+        qemu_mutex_destroy(&srng->lock);
+        qemu_mutex_destroy(&srng->intr_mod.lock);
+    }
+}
+
+static int desc_hal_test_sw2hw_handle(struct wireless_simu_device_state *wd, void *desc)
+{
+    struct hal_test_sw2hw *cmd = (struct hal_test_sw2hw *)desc;
+    dma_addr_t data_paddr = cmd->buffer_addr_low | ((uint64_t)(cmd->buffer_addr_info & 0xff) << 32);
+    size_t data_size = ((cmd->buffer_addr_info & 0xffff0000) >> 16);
+
+    // 数据 loop
+    void *data = (void *)get_desc_from_mem(wd, data_paddr, data_size);
     if (!data)
         return -EIO;
 
-    printf("%s : ce srng src desc data %016lx paddr %08x size %08x flag \n", WIRELESS_SIMU_DEVICE_NAME, data_paddr, data_size, ce_src_desc->flags);
+    wireless_simu_ce_post_data(wd, data, data_size);
+
+    /* 不管是否成功失败, free掉空间  */
+    wireless_simu_pool_free(&wd->pool, data);
+
+    return 0;
+}
+
+static int hal_srng_ring_ce_src_wmi_handler(struct wireless_simu_device_state *wd, void *data, size_t data_size)
+{
+    /* -- skb 中 头部先是 htc 部分 */
+    struct wireless_htc_hdr *htc_hdr = (struct wireless_htc_hdr *)data;
+
+    if (data_size < sizeof(struct wireless_htc_hdr) + sizeof(struct wmi_cmd_hdr))
+    {
+        printf("%s : ce srng src wmi frame too short %016lx \n", WIRELESS_SIMU_DEVICE_NAME, (uint64_t)data_size);
+        return -EINVAL;
+    }
+
+    uint8_t eid = htc_hdr->htc_info & WIRELESS_HTC_HDR_ENDPOINTID;
+    int ret;
 
-    wireless_simu_openwifi_mgmt_send(wd, data, data_size);
+    /* -- endpoint 0 上是 htc 控制消息 */
+    if (eid == WIRELESS_HTC_EP_0)
+        return wireless_simu_htc_ctrl(wd, data + sizeof(struct wireless_htc_hdr),
+                                      data_size - sizeof(struct wireless_htc_hdr));
 
-    free(data);
+    /* -- htc 后面是 wmi_cmd 部分, 按命令 id 查表分发 */
+    ret = wireless_simu_wmi_cmd(wd, data + sizeof(struct wireless_htc_hdr), data_size - sizeof(struct wireless_htc_hdr));
 
+    /* 不管命令是否成功, 这条消息占用的 credit 都要还给驱动 */
+    wireless_simu_htc_credit_return(wd, eid);
     return ret;
 }
 
-static int hal_srng_ring_ce_src_handler(struct wireless_simu_device_state *wd, void *desc, int ce_id)
+/* 数据帧应该走 TCL data ring (见 wireless_dp.h), 这里兼容仍通过 ce 发送数据的驱动 */
+static int hal_srng_ring_ce_src_handler_default(struct wireless_simu_device_state *wd, void *data, size_t data_size, int ce_id)
+{
+    return wireless_simu_openwifi_mgmt_send(wd, data, data_size);
+}
+
+/* 一帧完整的数据, 按 ce 分发 */
+static int hal_srng_ring_ce_src_frame(struct wireless_simu_device_state *wd, void *data, size_t data_size, int ce_id)
 {
     int ret = 0;
     switch (ce_id)
     {
     case 0:
-        ret = hal_srng_ring_ce_src_wmi_handler(wd, desc);
+        ret = hal_srng_ring_ce_src_wmi_handler(wd, data, data_size);
         break;
     default:
-        ret = hal_srng_ring_ce_src_handler_default(wd, desc, ce_id);
+        ret = hal_srng_ring_ce_src_handler_default(wd, data, data_size, ce_id);
     }
 
     return ret;
 }
 
-void wireless_hal_src_ring_tp(gpointer data, gpointer user_data)
+/* 将一个置位了 gather 的 desc 指向的数据追加到 srng 的拼接缓冲中 */
+static void hal_srng_gather_append(struct wireless_simu_device_state *wd, struct hal_srng *srng,
+                                   dma_addr_t data_paddr, uint32_t data_size)
 {
-    /* 该函数中所有的 << 2 和 >> 2 都是为了去对driver中定义的以 32bit 为单位去计算的数据长度等参数 */
+    struct hal_srng_gather *gather = &srng->gather;
 
-    struct wireless_simu_device_state *wd = (struct wireless_simu_device_state *)user_data;
-    struct hal_srng *srng = (struct hal_srng *)data;
-    uint32_t *desc;
+    if (gather->drop)
+        return;
 
-    int ret = 0;
+    if (!gather->buf)
+    {
+        gather->buf = malloc(WIRELESS_TXRX_FRAME_MAX);
+    }
 
-    // printf("%s : hal src ring tp thread \n", WIRELESS_SIMU_DEVICE_NAME);
+    if (!gather->buf || gather->len + data_size > WIRELESS_TXRX_FRAME_MAX)
+    {
+        printf("%s : ce srng %d gather frame too big %016lx \n", WIRELESS_SIMU_DEVICE_NAME, srng->ring_id,
+               (uint64_t)(gather->len + data_size));
+        gather->drop = true;
+        return;
+    }
 
-    if (srng->hal_srng_handler && srng->user_data)
+    if (pci_dma_read(&wd->parent_obj, data_paddr, gather->buf + gather->len, data_size))
     {
-        srng->hal_srng_handler(srng->user_data);
-        // printf("%s : hal srng %d has handler \n", WIRELESS_SIMU_DEVICE_NAME, srng->ring_id);
+        printf("%s : ce srng %d gather read %016lx err \n", WIRELESS_SIMU_DEVICE_NAME, srng->ring_id, data_paddr);
+        gather->drop = true;
         return;
     }
 
-    printf("%s : src ring id %d no srng handler \n", WIRELESS_SIMU_DEVICE_NAME, srng->ring_id);
+    gather->len += data_size;
+}
 
-    // 对srng加锁
-    if(!qemu_mutex_trylock(&srng->lock))
-        return;
-    // qemu_mutex_lock(&srng->lock);
+/* 驱动可以用 gather 位把一帧拆到连续的多个 desc 中, 最后一个 desc 不置位
+ * 拼接的状态保存在 srng 中, 一帧可以跨越多次门铃 */
+static int hal_srng_ring_ce_src_handler(struct wireless_simu_device_state *wd, struct hal_srng *srng, void *desc, int ce_id)
+{
+    struct hal_ce_srng_src_desc *ce_src_desc = (struct hal_ce_srng_src_desc *)desc;
+    struct hal_srng_gather *gather = &srng->gather;
+    int ret = 0;
 
-    if (srng->wd != wd)
+    /* -- ce ring 数据帧 -- */
+    dma_addr_t data_paddr = ce_src_desc->buffer_addr_low |
+                            ((uint64_t)(ce_src_desc->buffer_addr_info & HAL_CE_SRC_DESC_ADDR_INFO_ADDR_HI) << 32);
+    uint32_t data_size = ((ce_src_desc->buffer_addr_info & HAL_CE_SRC_DESC_ADDR_INFO_LEN) >> 16);
+    bool more = ce_src_desc->buffer_addr_info & HAL_CE_SRC_DESC_ADDR_INFO_GATHER;
+
+    /* 单个 desc 的帧, 能映射成一段时直接在 guest 内存中处理, 否则读出一份 */
+    if (!more && gather->len == 0 && !gather->drop)
+    {
+        struct iovec iov;
+
+        if (data_size && wireless_simu_dma_map_iov(wd, data_paddr, data_size, DMA_DIRECTION_TO_DEVICE, &iov, 1))
+        {
+            ret = hal_srng_ring_ce_src_frame(wd, iov.iov_base, data_size, ce_id);
+            wireless_simu_dma_unmap_iov(wd, &iov, 1, DMA_DIRECTION_TO_DEVICE);
+            return ret;
+        }
+
+        void *data = (void *)get_desc_from_mem(wd, data_paddr, data_size);
+        if (!data)
+            return -EIO;
+
+        ret = hal_srng_ring_ce_src_frame(wd, data, data_size, ce_id);
+        wireless_simu_pool_free(&wd->pool, data);
+        return ret;
+    }
+
+    hal_srng_gather_append(wd, srng, data_paddr, data_size);
+    if (more)
+        return 0;
+
+    /* 最后一个 desc, 整帧交给上层 */
+    if (gather->drop)
+    {
+        ret = -EIO;
+    }
+    else
+    {
+        ret = hal_srng_ring_ce_src_frame(wd, gather->buf, gather->len, ce_id);
+    }
+
+    gather->len = 0;
+    gather->drop = false;
+
+    return ret;
+}
+
+void wireless_hal_srng_irq_raise(struct wireless_simu_device_state *wd, struct hal_srng *srng, uint32_t statu)
+{
+    /* 不直接写驱动配置的 msi_addr, 每组 ring 都有自己的 msi-x vector, 屏蔽和 PBA 由 msi-x 处理 */
+    wireless_simu_irq_raise(&wd->ws_irq, statu);
+}
+
+/* 中断合并: 持有 intr_mod.lock, 取走挂起的 entry, 返回需要拉起的中断状态 */
+static uint32_t hal_srng_intr_mod_take(struct hal_srng *srng)
+{
+    uint32_t statu = srng->intr_mod.statu;
+
+    srng->intr_mod.pending = 0;
+    srng->intr_mod.statu = 0;
+    stat64_add(&srng->intr_mod.fired, 1);
+
+    return statu;
+}
+
+static void hal_srng_intr_mod_timeout(void *opaque)
+{
+    struct hal_srng *srng = (struct hal_srng *)opaque;
+    uint32_t statu = 0;
+
+    qemu_mutex_lock(&srng->intr_mod.lock);
+    if (srng->intr_mod.pending)
+    {
+        statu = hal_srng_intr_mod_take(srng);
+    }
+    qemu_mutex_unlock(&srng->intr_mod.lock);
+
+    if (statu)
+    {
+        wireless_hal_srng_irq_raise(srng->wd, srng, statu);
+    }
+}
+
+void wireless_hal_srng_intr_event(struct wireless_simu_device_state *wd, struct hal_srng *srng,
+                                  uint32_t entries, uint32_t statu)
+{
+    struct hal_srng_intr_mod *mod = &srng->intr_mod;
+    uint32_t batch_thres = srng->intr_batch_cntr_thres_entries;
+    uint32_t timer_thres_us = srng->intr_timer_thres_us;
+    uint32_t fire = 0;
+    bool arm = false;
+
+    if (entries == 0)
     {
-        printf("%s : src ring tp update err \n", WIRELESS_SIMU_DEVICE_NAME);
         return;
     }
 
-    while (srng->u.src_ring.tp != srng->u.src_ring.hp)
+    srng->wd = wd;
+
+    qemu_mutex_lock(&mod->lock);
+
+    arm = mod->pending == 0;
+    mod->pending += entries;
+    mod->statu = statu;
+
+    /* 没有定时阈值时无法保证挂起的 entry 最终会被通知, 不做合并 */
+    if (timer_thres_us == 0 || !mod->timer ||
+        (batch_thres && mod->pending >= batch_thres))
+    {
+        fire = hal_srng_intr_mod_take(srng);
+        if (mod->timer)
+        {
+            timer_del(mod->timer);
+        }
+    }
+    else
+    {
+        stat64_add(&mod->coalesced, 1);
+
+        /* 第一个挂起的 entry 开始计时 */
+        if (arm)
+        {
+            timer_mod(mod->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + (int64_t)timer_thres_us * SCALE_US);
+        }
+    }
+
+    qemu_mutex_unlock(&mod->lock);
+
+    if (fire)
+    {
+        wireless_hal_srng_irq_raise(wd, srng, fire);
+    }
+}
+
+void wireless_hal_intr_stats(struct wireless_simu_device_state *wd, uint64_t *fired, uint64_t *coalesced)
+{
+    *fired = 0;
+    *coalesced = 0;
+
+    for (int i = 0; i < HAL_SRNG_RING_ID_MAX; i++)
+    {
+        *fired += stat64_get(&wd->hal.srng_list[i].intr_mod.fired);
+        *coalesced += stat64_get(&wd->hal.srng_list[i].intr_mod.coalesced);
+    }
+}
+
+/* 一批 desc 处理完毕: 回写 tp, ce src ring 额外通知一次发送完成中断 */
+static void hal_srng_src_batch_complete(struct wireless_simu_device_state *wd, struct hal_srng *srng, uint32_t tp,
+                                        uint32_t entries)
+{
+    // 把写ring_buffer的 tp 放在前面, 就能保证中断发出去之前就已经写好数据了
+    wireless_hal_srng_shadow_update(wd, srng, tp);
+
+    switch (srng->ring_id)
+    {
+    case HAL_SRNG_RING_ID_CE0_SRC ... HAL_SRNG_RING_ID_CE0_SRC + 11:
+        /* send 完毕, 该使用中断去通知驱动 */
+        wireless_hal_srng_intr_event(wd, srng, entries,
+                                     WIRELESS_SIMU_IRQ_STATUS_MGMT_TX_END + srng->ring_id - HAL_SRNG_RING_ID_CE0_SRC);
+        break;
+    default:
+        break;
+    }
+}
+
+/* 读取 src ring 最新的 hp, 配置了 hp shadow 时以 shadow 为准 */
+static uint32_t hal_srng_src_hp(struct wireless_simu_device_state *wd, struct hal_srng *srng)
+{
+    dma_addr_t paddr = srng->u.src_ring.hp_shadow_paddr;
+    uint32_t *shadow;
+    uint32_t hp;
+
+    if (paddr == 0)
+    {
+        return qatomic_read(&srng->u.src_ring.hp);
+    }
+
+    shadow = hal_srng_dma_map_get(wd, &srng->hp_shadow_map, paddr, sizeof(uint32_t), DMA_DIRECTION_TO_DEVICE);
+    if (shadow)
+    {
+        hp = le32_to_cpu(qatomic_read(shadow));
+    }
+    else if (pci_dma_read(&wd->parent_obj, paddr, &hp, sizeof(hp)))
+    {
+        return qatomic_read(&srng->u.src_ring.hp);
+    }
+    else
+    {
+        hp = le32_to_cpu(hp);
+    }
+
+    /* shadow 由驱动任意写入, 超出 ring 或者没有按 entry 对齐时忽略, 沿用上一次的 hp */
+    if (srng->entry_size == 0 || hp >= srng->ring_size || hp % srng->entry_size != 0)
+    {
+        return qatomic_read(&srng->u.src_ring.hp);
+    }
+
+    qatomic_set(&srng->u.src_ring.hp, hp);
+    return hp;
+}
+
+int wireless_hal_srng_src_batch_fill(struct wireless_simu_device_state *wd, struct hal_srng *srng,
+                                     struct hal_srng_src_batch *batch)
+{
+    return wireless_hal_srng_src_batch_fill_max(wd, srng, batch, HAL_SRNG_BATCH_MAX);
+}
+
+int wireless_hal_srng_src_batch_fill_max(struct wireless_simu_device_state *wd, struct hal_srng *srng,
+                                         struct hal_srng_src_batch *batch, uint32_t max)
+{
+    uint32_t hp = hal_srng_src_hp(wd, srng);
+    uint32_t limit = MIN(max, HAL_SRNG_BATCH_MAX);
+    uint32_t *desc;
+
+    batch->count = 0;
+
+    /* 参数都由驱动写入, 没有按 entry 对齐时 tp 永远追不上 hp, 当作 ring 为空 */
+    if (srng->entry_size == 0 || srng->entry_size > HAL_SRNG_DESC_MAX_WORDS || srng->ring_size == 0 ||
+        srng->ring_size % srng->entry_size != 0 || hp >= srng->ring_size || hp % srng->entry_size != 0 ||
+        srng->u.src_ring.tp >= srng->ring_size || srng->u.src_ring.tp % srng->entry_size != 0)
+    {
+        return 0;
+    }
+
+    /* hp 读出之后 desc 才可能可见 */
+    smp_rmb();
+
+    while (srng->u.src_ring.tp != hp && batch->count < limit)
     {
-        printf("%s : src ring tp update %d ring id \n", WIRELESS_SIMU_DEVICE_NAME, srng->ring_id);
-        
-        desc = get_desc_from_mem(&wd->parent_obj, srng->ring_base_paddr + (srng->u.src_ring.tp << 2), srng->entry_size << 2);
+        desc = wireless_hal_srng_desc_get(wd, srng, srng->u.src_ring.tp);
         if (desc == NULL)
         {
             printf("%s : src srng read from mem err \n", WIRELESS_SIMU_DEVICE_NAME);
-            return;
+            break;
         }
 
+        /* 拷贝出来, 处理过程中驱动对 ring 的改写不会影响到这一批 */
+        memcpy(batch->desc[batch->count], desc, srng->entry_size << 2);
+
         /* todo : 如果上级模块的ring_size是一个2的指数，即只有一位为 1 其他位全为 0 的数，
          * 那么这里可以去掉取模运算，改为 & (ring_size - 1) */
-
         srng->u.src_ring.tp = (srng->u.src_ring.tp + srng->entry_size) % srng->ring_size;
+        batch->tp[batch->count] = srng->u.src_ring.tp;
+        batch->count++;
+    }
+
+    return batch->count;
+}
+
+uint32_t wireless_hal_srng_dst_space(struct hal_srng *srng, uint32_t hp)
+{
+    uint32_t ring_size = qatomic_read(&srng->ring_size);
+    uint32_t entry_size = qatomic_read(&srng->entry_size);
+    uint32_t tp = qatomic_read(&srng->u.dst_ring.tp);
+    uint32_t entries, used;
+
+    /* tp 和 ring 的参数都由驱动写入, 不合法时当作没有空间, 不能因此套圈 */
+    if (entry_size == 0 || ring_size == 0 || ring_size % entry_size != 0 ||
+        hp >= ring_size || hp % entry_size != 0 || tp >= ring_size || tp % entry_size != 0)
+    {
+        return 0;
+    }
+
+    entries = ring_size / entry_size;
+    used = MIN(((hp + ring_size - tp) % ring_size) / entry_size, entries - 1);
+
+    return entries - used - 1;
+}
+
+void wireless_hal_src_ring_tp(struct wireless_simu_device_state *wd, struct hal_srng *srng)
+{
+    /* 该函数中所有的 << 2 和 >> 2 都是为了去对driver中定义的以 32bit 为单位去计算的数据长度等参数 */
+
+    struct hal_srng_src_batch batch;
+    uint32_t *desc;
+
+    int ret = 0;
+
+    // printf("%s : hal src ring tp thread \n", WIRELESS_SIMU_DEVICE_NAME);
+
+    // 对srng加锁, ring 只归属于一个处理线程, 这里只会和 ce 等模块的访问竞争
+    qemu_mutex_lock(&srng->lock);
 
-        /* 对 desc 进行处理
-         * 正常的思路是为每一个srng挂上一个desc处理函数，直接拉起处理函数进行处理；但是那样需要的辅助 static 太多了
-         * 这里暂时根据desc的size选择拉起的desc处理函数
-         */
-        switch (srng->ring_id)
+    if (srng->wd != wd)
+    {
+        printf("%s : src ring tp update err \n", WIRELESS_SIMU_DEVICE_NAME);
+        qemu_mutex_unlock(&srng->lock);
+        return;
+    }
+
+    /* 每一轮把 tp 到最新 hp 之间的 desc 全部取出之后再统一处理，
+     * 处理完毕后只回写一次 tp、只拉起一次中断 */
+    while (wireless_hal_srng_src_batch_fill(wd, srng, &batch) > 0)
+    {
+        for (uint32_t i = 0; i < batch.count; i++)
         {
-        case HAL_SRNG_RING_ID_TEST_SW2HW:
-            ret = desc_hal_test_sw2hw_handle(wd, desc);
-            if (ret)
+            desc = batch.desc[i];
+
+            /* 对 desc 进行处理
+             * 正常的思路是为每一个srng挂上一个desc处理函数，直接拉起处理函数进行处理；但是那样需要的辅助 static 太多了
+             * 这里暂时根据desc的size选择拉起的desc处理函数
+             */
+            switch (srng->ring_id)
             {
-                printf("%s : %d ring read err \n", WIRELESS_SIMU_DEVICE_NAME, srng->ring_id);
+            case HAL_SRNG_RING_ID_TEST_SW2HW:
+                ret = desc_hal_test_sw2hw_handle(wd, desc);
+                if (ret)
+                {
+                    printf("%s : %d ring read err \n", WIRELESS_SIMU_DEVICE_NAME, srng->ring_id);
+                }
+                break;
+            case HAL_SRNG_RING_ID_TEST_DST:
+                // ret = desc_hal_test_dst_handle(wd, desc);
+                break;
+            case HAL_SRNG_RING_ID_CE0_SRC ... HAL_SRNG_RING_ID_CE0_SRC + 11:
+                // 这里暂时应该只会发送一些mgmt数据, 所以简单把数据抽出来
+                hal_srng_ring_ce_src_handler(wd, srng, desc, srng->ring_id - HAL_SRNG_RING_ID_CE0_SRC);
+                break;
+            default:
+                break;
             }
-            pci_dma_write(&wd->parent_obj, srng->u.src_ring.tp_paddr, &srng->u.src_ring.tp, sizeof(srng->u.src_ring.tp));
-            break;
-        case HAL_SRNG_RING_ID_TEST_DST:
-            // ret = desc_hal_test_dst_handle(wd, desc);
-            break;
-        case HAL_SRNG_RING_ID_CE0_SRC ... HAL_SRNG_RING_ID_CE0_SRC + 11:
-            // 这里暂时应该只会发送一些mgmt数据, 所以简单把数据抽出来
-            hal_srng_ring_ce_src_handler(wd, desc, srng->ring_id - HAL_SRNG_RING_ID_CE0_SRC);
-            // 把写ring_buffer的 tp 放在前面, 就能保证中断发出去之前就已经写好数据了
-            pci_dma_write(&wd->parent_obj, srng->u.src_ring.tp_paddr, &srng->u.src_ring.tp, sizeof(srng->u.src_ring.tp));
-            /* send 完毕, 该使用中断去通知驱动 */
-            wireless_simu_irq_raise(&wd->ws_irq, WIRELESS_SIMU_IRQ_STATUS_MGMT_TX_END + srng->ring_id - HAL_SRNG_RING_ID_CE0_SRC);
-            break;
-        default:
-            break;
         }
 
-        // for (int count = 0; count < srng->entry_size; count++)
-        // {
-        //     printf("%s : src tp update desc data %d : %08x \n", WIRELESS_SIMU_DEVICE_NAME, count, *(uint32_t *)(desc + (count)));
-        // }
-
-        // if (srng->entry_size == (sizeof(struct hal_test_sw2hw) >> 2))
-        // { // 上方传过来的entrysize以4char为单位
-        //     ret = desc_hal_test_sw2hw_handle(wd, desc);
-        //     if (ret)
-        //     {
-        //         printf("%s : %d ring read err \n", WIRELESS_SIMU_DEVICE_NAME, srng->ring_id);
-        //     }
-        //     pci_dma_write(&wd->parent_obj, srng->u.src_ring.tp_paddr, &srng->u.src_ring.tp, sizeof(srng->u.src_ring.tp));
-        //     continue;
-        // }
+        /* 整批一起交还, 驱动设定的中断阈值只由中断合并处理 */
+        hal_srng_src_batch_complete(wd, srng, batch.tp[batch.count - 1], batch.count);
     }
 
     qemu_mutex_unlock(&srng->lock); // todo : 删除锁还没有做
@@ -486,7 +1311,7 @@ int wireless_hal_srng_read_src_ring(struct wireless_simu_device_state *wd, struc
     uint32_t *desc;
     if (srng->u.src_ring.tp != srng->u.src_ring.hp)
     {
-        desc = get_desc_from_mem(&wd->parent_obj, srng->ring_base_paddr + (srng->u.src_ring.tp << 2), srng->entry_size << 2);
+        desc = wireless_hal_srng_desc_get(wd, srng, srng->u.src_ring.tp);
         if (desc == NULL)
         {
             printf("%s : src srng read from mem err \n", WIRELESS_SIMU_DEVICE_NAME);
@@ -495,7 +1320,7 @@ int wireless_hal_srng_read_src_ring(struct wireless_simu_device_state *wd, struc
         }
         *ans = desc;
         srng->u.src_ring.tp = (srng->u.src_ring.tp + srng->entry_size) % srng->ring_size;
-        pci_dma_write(&wd->parent_obj, srng->u.src_ring.tp_paddr, &srng->u.src_ring.tp, sizeof(srng->u.src_ring.tp));
+        wireless_hal_srng_shadow_update(wd, srng, srng->u.src_ring.tp);
     }
     else
     {
@@ -60,18 +60,18 @@ enum hal_ring_type
     HAL_CE_SRC,
     HAL_CE_DST,
     HAL_CE_DST_STATUS,
-    // HAL_REO_DST,
+    HAL_REO_DST,
     // HAL_REO_EXCEPTION,
     // HAL_REO_REINJECT,
     // HAL_REO_CMD,
     // HAL_REO_STATUS,
-    // HAL_TCL_DATA,
+    HAL_TCL_DATA,
     // HAL_TCL_CMD,
     // HAL_TCL_STATUS,
     // HAL_WBM_IDLE_LINK,
     // HAL_SW2WBM_RELEASE,
-    // HAL_WBM2SW_RELEASE,
-    // HAL_RXDMA_BUF,
+    HAL_WBM2SW_RELEASE,
+    HAL_RXDMA_BUF,
     // HAL_RXDMA_DST,
     // HAL_RXDMA_MONITOR_BUF,
     // HAL_RXDMA_MONITOR_STATUS,
@@ -120,10 +120,10 @@ enum hal_srng_ring_id
     // HAL_SRNG_RING_ID_REO_CMD = 8,
     // HAL_SRNG_RING_ID_REO_STATUS,
 
-    // HAL_SRNG_RING_ID_SW2TCL1 = 16,
-    // HAL_SRNG_RING_ID_SW2TCL2,
-    // HAL_SRNG_RING_ID_SW2TCL3,
-    // HAL_SRNG_RING_ID_SW2TCL4,
+    HAL_SRNG_RING_ID_SW2TCL1 = 16,
+    HAL_SRNG_RING_ID_SW2TCL2,
+    HAL_SRNG_RING_ID_SW2TCL3,
+    HAL_SRNG_RING_ID_SW2TCL4,
 
     // HAL_SRNG_RING_ID_SW2TCL_CMD = 24,
     // HAL_SRNG_RING_ID_TCL_STATUS,
@@ -168,12 +168,12 @@ enum hal_srng_ring_id
     HAL_SRNG_RING_ID_CE11_DST_STATUS,
 
     HAL_SRNG_RING_ID_WBM_IDLE_LINK = 104,
-    // HAL_SRNG_RING_ID_WBM_SW_RELEASE,
-    // HAL_SRNG_RING_ID_WBM2SW0_RELEASE,
-    // HAL_SRNG_RING_ID_WBM2SW1_RELEASE,
-    // HAL_SRNG_RING_ID_WBM2SW2_RELEASE,
-    // HAL_SRNG_RING_ID_WBM2SW3_RELEASE,
-    // HAL_SRNG_RING_ID_WBM2SW4_RELEASE,
+    HAL_SRNG_RING_ID_WBM_SW_RELEASE,
+    HAL_SRNG_RING_ID_WBM2SW0_RELEASE,
+    HAL_SRNG_RING_ID_WBM2SW1_RELEASE,
+    HAL_SRNG_RING_ID_WBM2SW2_RELEASE,
+    HAL_SRNG_RING_ID_WBM2SW3_RELEASE,
+    HAL_SRNG_RING_ID_WBM2SW4_RELEASE,
 
     HAL_SRNG_RING_ID_TEST_SW2HW = 125,
 
@@ -208,6 +208,65 @@ enum hal_srng_ring_id
 
 #define HAL_SHADOW_NUM_REGS 36
 
+/* 单个 desc 的最大长度, 单位 32 bit; 映射不可用时 desc 会被拷贝到 hal_srng.desc_buf 中 */
+#define HAL_SRNG_DESC_MAX_WORDS 16
+
+/* 对 guest 内存的持久映射
+ *
+ * ring 内存和 hp / tp 的 shadow 地址在驱动配置完 R0 寄存器之后第一次被访问时映射，
+ * 之后对 desc 和指针的读写直接在映射上完成，避免每次都 malloc + pci_dma_read;
+ * 映射失败、只映射了一部分、或者拿到的是 bounce buffer (非 RAM 区域) 时置 fallback，
+ * 改为走 pci_dma_read / pci_dma_write;
+ * 映射会长期持有, 设备每次通过映射写入时都要自己标记脏页, 否则迁移时会漏掉这些写入 */
+struct hal_srng_dma_map
+{
+    void *vaddr;
+    dma_addr_t paddr;
+    dma_addr_t len;
+    DMADirection dir;
+
+    /* 映射所在的 RAM 区域和在其中的偏移, 用于标记脏页 */
+    MemoryRegion *mr;
+    ram_addr_t offset;
+
+    /* 建立映射时 wireless_simu_hal.map_gen 的值, 不一致代表映射已经失效 */
+    uint32_t gen;
+
+    /* 该区域无法直接映射 */
+    bool fallback;
+};
+
+/* ring 的中断合并
+ *
+ * 挂起的 entry 数量达到 intr_batch_cntr_thres_entries, 或者距第一个挂起的 entry
+ * 超过 intr_timer_thres_us (虚拟时钟) 时才真正拉起中断 */
+struct hal_srng_intr_mod
+{
+    QemuMutex lock;
+    QEMUTimer *timer;
+
+    /* 已完成但还没有通知驱动的 entry 数量 */
+    uint32_t pending;
+
+    /* 待拉起的中断状态 */
+    uint32_t statu;
+
+    /* 统计: 真正拉起的中断数量, 被合并掉的完成事件数量 */
+    Stat64 fired;
+    Stat64 coalesced;
+};
+
+/* ce src ring 上由 gather 位串起来的多个 desc, 拼成一帧之后再处理 */
+struct hal_srng_gather
+{
+    /* 按需申请, 大小为 WIRELESS_TXRX_FRAME_MAX */
+    uint8_t *buf;
+    size_t len;
+
+    /* 拼接过程中出错或超长, 丢弃到这一帧的最后一个 desc */
+    bool drop;
+};
+
 /* Common SRNG ring structure for source and destination rings */
 struct hal_srng
 {
@@ -279,6 +338,28 @@ struct hal_srng
     /* Source or Destination ring */
     enum hal_srng_dir ring_dir;
 
+    /* ring 内存 ring_base_paddr ~ ring_base_paddr + ring_size 的映射 */
+    struct hal_srng_dma_map ring_map;
+
+    /* src ring 的 tp_paddr 或 dst ring 的 hp_paddr 的映射 */
+    struct hal_srng_dma_map shadow_map;
+
+    /* 映射不可用时承接 desc 的缓冲 */
+    uint32_t desc_buf[HAL_SRNG_DESC_MAX_WORDS];
+
+    /* src ring 的 hp shadow 的映射 */
+    struct hal_srng_dma_map hp_shadow_map;
+
+    /* 中断合并 */
+    struct hal_srng_intr_mod intr_mod;
+
+    /* R2 hp 寄存器对应的 ioeventfd */
+    EventNotifier doorbell;
+    bool doorbell_registered;
+
+    /* ce src ring 的多 desc 帧 */
+    struct hal_srng_gather gather;
+
     union
     {
         struct
@@ -335,10 +416,41 @@ struct hal_srng
 
             /* tail pointer at access end */
             uint32_t last_tp;
+
+            /* 驱动维护的 hp shadow 地址 (R0 8/9 号寄存器)
+             * 配置之后 R2 的 hp 门铃通过 ioeventfd 送达, 设备从这里读取最新的 hp */
+            dma_addr_t hp_shadow_paddr;
         } src_ring;
     } u;
 };
 
+/* srng 处理线程的最大数量, 和 CE 的数量保持一致 */
+#define HAL_SRNG_WORKER_MAX 12
+
+/* srng 处理线程
+ *
+ * 每个 srng 按 ring_id 固定归属于一个线程, 同一个 ring 永远只有一个线程在处理;
+ * mmio 中 hp 的更新只在 pending 中置位并唤醒线程, 线程处理到 tp == hp 为止 */
+struct hal_srng_worker
+{
+    struct wireless_simu_device_state *wd;
+
+    int id;
+
+    QemuThread thread;
+
+    /* 门铃 */
+    QemuEvent doorbell;
+
+    /* iothread 模式下代替线程, 在 AioContext 中处理 ring */
+    QEMUBH *bh;
+
+    /* 待处理的 ring, 以 ring_id 为下标 */
+    unsigned long pending[BITS_TO_LONGS(HAL_SRNG_RING_ID_MAX)];
+
+    bool stop;
+};
+
 /*
  * 名为hal的srng子模块
  */
@@ -377,6 +489,22 @@ struct wireless_simu_hal
     int num_shadow_reg_configured;
 
     // QemuMutex srng_key[HAL_SRNG_RING_ID_MAX];
+
+    /* 监听 dma 地址空间的变化, 变化后所有 srng 的映射都需要重新建立 */
+    MemoryListener map_listener;
+
+    /* 映射代数, 地址空间变化或 R0 寄存器被改写时加一 */
+    uint32_t map_gen;
+
+    /* srng 处理线程 */
+    struct hal_srng_worker workers[HAL_SRNG_WORKER_MAX];
+    uint32_t worker_count;
+
+    /* 处理线程已经停止, 之后的门铃直接忽略 */
+    bool stopped;
+
+    /* 配置了 iothread 时的数据面 AioContext, 否则为 NULL */
+    AioContext *ctx;
 };
 
 struct hal_test_sw2hw
@@ -394,19 +522,167 @@ struct wireless_htc_hdr
     uint32_t ctrl_info;
 } __attribute__((__packed__));
 
+/* htc_info 中的字段, payload 长度包含 trailer */
+#define WIRELESS_HTC_HDR_ENDPOINTID 0x000000ff // GENMASK(7, 0)
+#define WIRELESS_HTC_HDR_FLAGS 0x0000ff00      // GENMASK(15, 8)
+#define WIRELESS_HTC_HDR_PAYLOADLEN 0xffff0000 // GENMASK(31, 16)
+
+/* ctrl_info 中的字段, CONTROLBYTES0 为 trailer 长度, CONTROLBYTES1 为序号 */
+#define WIRELESS_HTC_HDR_CONTROLBYTES0 0x000000ff // GENMASK(7, 0)
+#define WIRELESS_HTC_HDR_CONTROLBYTES1 0x0000ff00 // GENMASK(15, 8)
+
+#define WIRELESS_HTC_FLAG_TRAILER_PRESENT 0x02
+
+/* endpoint 0 为 htc 控制消息, 其余的在 connect service 时分配 */
+#define WIRELESS_HTC_EP_0 0
+#define WIRELESS_HTC_EP_COUNT 8
+
+/* 控制消息的第一个字, 低 16 位为消息 id */
+#define WIRELESS_HTC_MSG_MESSAGEID 0x0000ffff // GENMASK(15, 0)
+#define WIRELESS_HTC_MSG_SERVICEID 0xffff0000 // GENMASK(31, 16)
+
+enum wireless_htc_msg_id
+{
+    WIRELESS_HTC_MSG_READY_ID = 1,
+    WIRELESS_HTC_MSG_CONNECT_SERVICE_ID = 2,
+    WIRELESS_HTC_MSG_CONNECT_SERVICE_RESP_ID = 3,
+    WIRELESS_HTC_MSG_SETUP_COMPLETE_ID = 4,
+    WIRELESS_HTC_MSG_SETUP_COMPLETE_EX_ID = 5,
+};
+
+/* wmi 控制服务, 事件从它分配到的 endpoint 发出 */
+#define WIRELESS_HTC_SVC_ID_WMI_CONTROL 0x100
+
+#define WIRELESS_HTC_READY_MSG_CREDITCOUNT 0xffff0000 // GENMASK(31, 16)
+#define WIRELESS_HTC_READY_MSG_CREDITSIZE 0x0000ffff  // GENMASK(15, 0)
+#define WIRELESS_HTC_READY_MSG_MAXENDPOINTS 0x00ff0000 // GENMASK(23, 16)
+
+struct wireless_htc_ready
+{
+    uint32_t id_credit_count;
+    uint32_t size_ep;
+} __attribute__((__packed__));
+
+struct wireless_htc_conn_svc
+{
+    uint32_t msg_svc_id;
+    uint32_t flags_len;
+} __attribute__((__packed__));
+
+#define WIRELESS_HTC_SVC_RESP_MSG_STATUS 0x000000ff     // GENMASK(7, 0)
+#define WIRELESS_HTC_SVC_RESP_MSG_ENDPOINTID 0x0000ff00 // GENMASK(15, 8)
+#define WIRELESS_HTC_SVC_RESP_MSG_MAXMSGSIZE 0xffff0000 // GENMASK(31, 16)
+
+#define WIRELESS_HTC_CONN_SVC_STATUS_SUCCESS 0
+#define WIRELESS_HTC_CONN_SVC_STATUS_NO_RESOURCES 3
+
+struct wireless_htc_conn_svc_resp
+{
+    uint32_t msg_svc_id;
+    uint32_t flags_len;
+    uint32_t svc_meta_pad;
+} __attribute__((__packed__));
+
+/* trailer 由若干 record 组成, 设备只发 credit report */
+#define WIRELESS_HTC_RECORD_ID 0x000000ff  // GENMASK(7, 0)
+#define WIRELESS_HTC_RECORD_LEN 0x0000ff00 // GENMASK(15, 8)
+#define WIRELESS_HTC_RECORD_CREDITS 1
+
+struct wireless_htc_credit_report
+{
+    uint8_t eid;
+    uint8_t credits;
+    uint8_t pad1;
+    uint8_t pad2;
+} __attribute__((__packed__));
+
 struct wmi_cmd_hdr
 {
 	uint32_t cmd_id;
 } __attribute__((__packed__));
 
+/* 初始化 hal, 注册地址空间监听, 启动 worker_count 个 srng 处理线程
+ *
+ * ctx 不为 NULL 时不创建线程, ring 的处理全部在 ctx 中完成 */
+void wireless_hal_init(struct wireless_simu_device_state *wd, uint32_t worker_count, AioContext *ctx);
+
+/* 停止处理线程, 返回之后不会再有 ring 的 handler 在运行, 映射和中断合并保留到 deinit */
+void wireless_hal_stop(struct wireless_simu_device_state *wd);
+
+/* 停止处理线程 (如果还没有停止), 释放所有 srng 的映射 */
+void wireless_hal_deinit(struct wireless_simu_device_state *wd);
+
+/* 通知 srng 所属的处理线程该 ring 有新的数据 */
+void wireless_hal_srng_kick(struct wireless_simu_device_state *wd, struct hal_srng *srng);
+
 int wireless_hal_reg_handler(struct wireless_simu_device_state *wd, hwaddr addr, uint32_t val);
 
-void wireless_hal_src_ring_tp(gpointer data, gpointer user_data);
+/* 一次从 src ring 中最多取出的 desc 数量 */
+#define HAL_SRNG_BATCH_MAX 64
+
+/* 从 src ring 中批量取出的 desc */
+struct hal_srng_src_batch
+{
+    uint32_t count;
+
+    /* 处理完第 i 个 desc 之后应该回写的 tp */
+    uint32_t tp[HAL_SRNG_BATCH_MAX];
+
+    uint32_t desc[HAL_SRNG_BATCH_MAX][HAL_SRNG_DESC_MAX_WORDS];
+};
+
+/* 处理 src ring 中 tp 到 hp 之间的 desc, 由 srng 所属的处理线程调用 */
+void wireless_hal_src_ring_tp(struct wireless_simu_device_state *wd, struct hal_srng *srng);
+
+/* 取出 tp 到当前 hp 之间的 desc, 最多取 HAL_SRNG_BATCH_MAX 个, 需持有 srng->lock
+ *
+ * 只推进本地的 tp, 回写由调用者在整批处理完之后完成, 返回取出的数量 */
+int wireless_hal_srng_src_batch_fill(struct wireless_simu_device_state *wd, struct hal_srng *srng,
+                                     struct hal_srng_src_batch *batch);
+
+/* 同上, 额外限制最多取 max 个, 用于下游 ring 空间有限的场景 */
+int wireless_hal_srng_src_batch_fill_max(struct wireless_simu_device_state *wd, struct hal_srng *srng,
+                                         struct hal_srng_src_batch *batch, uint32_t max);
+
+/* dst ring 在 hp 之后还能写入的 entry 数量, 保留一个空位用于区分满和空 */
+uint32_t wireless_hal_srng_dst_space(struct hal_srng *srng, uint32_t hp);
 
 /* 为对应type的ring分配id号 */
 int wireless_hal_srng_setup(struct wireless_simu_device_state *wd, enum hal_ring_type type, int ring_num, int mac_id, struct hal_srng_params *params);
 
-/* 读取src ring的一项entry并存如desc */
+/* 读取src ring的一项entry并存如desc
+ *
+ * ans 指向 ring 的映射或 srng->desc_buf, 无需 free, 仅在持有 srng->lock 且下一次读取之前有效 */
 int wireless_hal_srng_read_src_ring(struct wireless_simu_device_state *wd, struct hal_srng *srng, uint32_t **ans);
 
+/* 获取 ring 中偏移为 offset (单位 32 bit) 的 desc, 规则同上 */
+uint32_t *wireless_hal_srng_desc_get(struct wireless_simu_device_state *wd, struct hal_srng *srng, uint32_t offset);
+
+/* 向 dst ring 中偏移为 offset (单位 32 bit) 的位置写入 desc */
+int wireless_hal_srng_desc_put(struct wireless_simu_device_state *wd, struct hal_srng *srng, uint32_t offset,
+                               const void *desc, size_t size);
+
+/* 拉起 ring 的中断, 按 statu 走 msi-x / msi / intx
+ * 驱动通过 R0 10/11/12 号寄存器配置的 msi 地址只做记录, 不会被设备直接写入 */
+void wireless_hal_srng_irq_raise(struct wireless_simu_device_state *wd, struct hal_srng *srng, uint32_t statu);
+
+/* ring 上有 entries 个 entry 完成, 经过中断合并之后拉起 statu 中断 */
+void wireless_hal_srng_intr_event(struct wireless_simu_device_state *wd, struct hal_srng *srng,
+                                  uint32_t entries, uint32_t statu);
+
+/* 所有 ring 的中断合并统计 */
+void wireless_hal_intr_stats(struct wireless_simu_device_state *wd, uint64_t *fired, uint64_t *coalesced);
+
+/* 把 guest 中 paddr 开始的 len 长度区域映射为最多 max 段 iovec, 返回段数
+ * 映射不完整 (区域不是内存, bounce buffer 已被占用, 段数不够) 时返回 0, 调用者回退到 dma 读写 */
+int wireless_simu_dma_map_iov(struct wireless_simu_device_state *wd, dma_addr_t paddr, dma_addr_t len,
+                              DMADirection dir, struct iovec *iov, int max);
+
+/* 解除 wireless_simu_dma_map_iov 建立的映射 */
+void wireless_simu_dma_unmap_iov(struct wireless_simu_device_state *wd, const struct iovec *iov, int iovcnt,
+                                 DMADirection dir);
+
+/* 将 src ring 的 tp 或 dst ring 的 hp 写回驱动提供的 shadow 地址 */
+void wireless_hal_srng_shadow_update(struct wireless_simu_device_state *wd, struct hal_srng *srng, uint32_t val);
+
 #endif
\ No newline at end of file
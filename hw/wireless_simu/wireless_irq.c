@@ -1,25 +1,465 @@
 #include "wireless_simu.h"
 
-int wireless_simu_irq_init(struct wireless_simu_irq *ws_irq, PCIDevice *pdev, uint32_t irq_addr)
+/* 持有 bql, 没有正在呈现的中断时取出一个挂起的状态拉高 intx */
+static void wireless_simu_irq_deliver(struct wireless_simu_irq *ws_irq)
 {
+    uint32_t statu = 0;
+
+    qemu_mutex_lock(&ws_irq->irq_intx_mutex);
+    if (ws_irq->irq_status_val == 0 && ws_irq->irq_pending)
+    {
+        statu = ctz64(ws_irq->irq_pending);
+        ws_irq->irq_pending &= ~(1ULL << statu);
+        qatomic_set(&ws_irq->irq_status_val, statu);
+    }
+    qemu_mutex_unlock(&ws_irq->irq_intx_mutex);
+
+    if (statu && ws_irq->irq_enable)
+    {
+        pci_set_irq(ws_irq->pci_dev, 1);
+    }
+}
+
+/* 持有 bql, 发送挂起的 msi-x / msi vector
+ * msix_notify 在 vector 被屏蔽时只置位 PBA, 由 msi-x 在解除屏蔽时补发 */
+static void wireless_simu_irq_msi_deliver(struct wireless_simu_irq *ws_irq)
+{
+    uint64_t pending = qatomic_xchg(&ws_irq->msi_pending, 0);
+    PCIDevice *pdev = ws_irq->pci_dev;
+    unsigned int nr;
+
+    if (!pending)
+    {
+        return;
+    }
+
+    if (ws_irq->msix_enable && msix_enabled(pdev))
+    {
+        while (pending)
+        {
+            uint32_t vector = ctz64(pending);
+            pending &= pending - 1;
+
+            msix_notify(pdev, vector);
+        }
+        return;
+    }
+
+    if (ws_irq->msi_enable && msi_enabled(pdev))
+    {
+        nr = msi_nr_vectors_allocated(pdev);
+        while (pending)
+        {
+            uint32_t vector = ctz64(pending);
+            pending &= pending - 1;
+
+            /* guest 分配的 vector 不够时, 多出来的状态共用最后一个 vector */
+            msi_notify(pdev, MIN(vector, nr - 1));
+        }
+        return;
+    }
+
+    /* 发送之前 guest 关掉了 msi-x / msi, 改走 intx */
+    qemu_mutex_lock(&ws_irq->irq_intx_mutex);
+    ws_irq->irq_pending |= pending;
+    qemu_mutex_unlock(&ws_irq->irq_intx_mutex);
+}
+
+static void wireless_simu_irq_bh(void *opaque)
+{
+    struct wireless_simu_irq *ws_irq = (struct wireless_simu_irq *)opaque;
+
+    wireless_simu_irq_msi_deliver(ws_irq);
+    wireless_simu_irq_deliver(ws_irq);
+}
+
+/* 持有 bql, 把 vector 的 eventfd 绑定到 kvm 路由 */
+static int wireless_simu_irqfd_attach(struct wireless_simu_irq_vector *v)
+{
+    int ret;
+
+    if (v->attached)
+    {
+        return 0;
+    }
+
+    ret = kvm_irqchip_add_irqfd_notifier_gsi(kvm_state, &v->notifier, NULL, v->virq);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    v->attached = true;
+    return 0;
+}
+
+/* 持有 bql, 之后写入的事件留在 eventfd 中 */
+static void wireless_simu_irqfd_detach(struct wireless_simu_irq_vector *v)
+{
+    if (!v->attached)
+    {
+        return;
+    }
+
+    if (kvm_irqchip_remove_irqfd_notifier_gsi(kvm_state, &v->notifier, v->virq) < 0)
+    {
+        error_report("%s: failed to remove irqfd", WIRELESS_SIMU_DEVICE_NAME);
+        return;
+    }
+    v->attached = false;
+}
+
+/* msi-x vector 解除屏蔽, 更新路由并绑定 eventfd, 屏蔽期间写入的事件在绑定后由 kvm 注入 */
+static int wireless_simu_irqfd_vector_unmask(PCIDevice *pdev, unsigned int vector, MSIMessage msg)
+{
+    struct wireless_simu_irq *ws_irq = &WIRELESS_SIMU_OBJ(pdev)->ws_irq;
+    struct wireless_simu_irq_vector *v = &ws_irq->vectors[vector];
+    int ret;
+
+    if (vector >= ws_irq->irqfd_nr || v->virq < 0)
+    {
+        return -EINVAL;
+    }
+
+    if (v->msg.address != msg.address || v->msg.data != msg.data)
+    {
+        ret = kvm_irqchip_update_msi_route(kvm_state, v->virq, msg, pdev);
+        if (ret < 0)
+        {
+            return ret;
+        }
+        kvm_irqchip_commit_routes(kvm_state);
+        v->msg = msg;
+    }
+
+    return wireless_simu_irqfd_attach(v);
+}
+
+static void wireless_simu_irqfd_vector_mask(PCIDevice *pdev, unsigned int vector)
+{
+    struct wireless_simu_irq *ws_irq = &WIRELESS_SIMU_OBJ(pdev)->ws_irq;
+
+    if (vector < ws_irq->irqfd_nr)
+    {
+        wireless_simu_irqfd_detach(&ws_irq->vectors[vector]);
+    }
+}
+
+/* guest 读 PBA 时, 被屏蔽的 vector 上留在 eventfd 中的事件记入 PBA */
+static void wireless_simu_irqfd_vector_poll(PCIDevice *pdev, unsigned int vector_start, unsigned int vector_end)
+{
+    struct wireless_simu_irq *ws_irq = &WIRELESS_SIMU_OBJ(pdev)->ws_irq;
+
+    vector_end = MIN(vector_end, ws_irq->irqfd_nr);
+    for (unsigned int vector = vector_start; vector < vector_end; vector++)
+    {
+        if (!msix_is_masked(pdev, vector))
+        {
+            continue;
+        }
+
+        if (event_notifier_test_and_clear(&ws_irq->vectors[vector].notifier))
+        {
+            msix_set_pending(pdev, vector);
+        }
+    }
+}
+
+/* 持有 bql, 拆除 irqfd, 留在 eventfd 中的事件改由 msi_pending 发送 */
+static void wireless_simu_irqfd_disable(struct wireless_simu_irq *ws_irq)
+{
+    uint32_t mode = ws_irq->irqfd_mode;
+    uint64_t pending = 0;
+
+    if (mode == WIRELESS_SIMU_IRQFD_NONE)
+    {
+        return;
+    }
+
+    /* 数据面线程之后不再写 eventfd, 与 wireless_simu_irqfd_notify 中的屏障配对 */
+    qatomic_set(&ws_irq->irqfd_mode, WIRELESS_SIMU_IRQFD_NONE);
+    smp_mb();
+
+    if (mode == WIRELESS_SIMU_IRQFD_MSIX)
+    {
+        msix_unset_vector_notifiers(ws_irq->pci_dev);
+    }
+
+    for (uint32_t i = 0; i < ws_irq->irqfd_nr; i++)
+    {
+        struct wireless_simu_irq_vector *v = &ws_irq->vectors[i];
+
+        /* msi-x 已经关闭时 msix_unset_vector_notifiers 不会调用 mask, 这里补上 */
+        wireless_simu_irqfd_detach(v);
+        kvm_irqchip_release_virq(kvm_state, v->virq);
+        v->virq = -1;
+
+        if (event_notifier_test_and_clear(&v->notifier))
+        {
+            pending |= 1ULL << i;
+        }
+    }
+    ws_irq->irqfd_nr = 0;
+
+    if (pending)
+    {
+        qatomic_or(&ws_irq->msi_pending, pending);
+        wireless_simu_irq_msi_deliver(ws_irq);
+    }
+}
+
+/* 持有 bql, 为 guest 当前打开的 msi-x / msi 的每个 vector 建立路由和 irqfd */
+static int wireless_simu_irqfd_enable(struct wireless_simu_irq *ws_irq, uint32_t mode)
+{
+    PCIDevice *pdev = ws_irq->pci_dev;
+    KVMRouteChange c;
+    uint32_t nr;
+    uint32_t i;
+    int ret = 0;
+
+    nr = mode == WIRELESS_SIMU_IRQFD_MSIX ? WIRELESS_SIMU_MSIX_VECTORS
+                                          : MIN(msi_nr_vectors_allocated(pdev), WIRELESS_SIMU_MSIX_VECTORS);
+
+    c = kvm_irqchip_begin_route_changes(kvm_state);
+    for (i = 0; i < nr; i++)
+    {
+        ret = kvm_irqchip_add_msi_route(&c, i, pdev);
+        if (ret < 0)
+        {
+            break;
+        }
+        ws_irq->vectors[i].virq = ret;
+        ws_irq->vectors[i].msg = (MSIMessage){0};
+        ret = 0;
+    }
+    kvm_irqchip_commit_route_changes(&c);
+    ws_irq->irqfd_nr = i;
+
+    if (ret == 0 && mode == WIRELESS_SIMU_IRQFD_MSIX)
+    {
+        /* 会对没有被屏蔽的 vector 调用 unmask */
+        ret = msix_set_vector_notifiers(pdev, wireless_simu_irqfd_vector_unmask, wireless_simu_irqfd_vector_mask,
+                                        wireless_simu_irqfd_vector_poll);
+    }
+    else if (ret == 0)
+    {
+        /* msi 没有按 vector 的屏蔽, 路由建立时已经使用当前的 message */
+        for (i = 0; i < nr && ret == 0; i++)
+        {
+            ws_irq->vectors[i].msg = msi_get_message(pdev, i);
+            ret = wireless_simu_irqfd_attach(&ws_irq->vectors[i]);
+        }
+    }
+
+    if (ret < 0)
+    {
+        /* 回退到 irq_bh 发送 */
+        for (i = 0; i < ws_irq->irqfd_nr; i++)
+        {
+            wireless_simu_irqfd_detach(&ws_irq->vectors[i]);
+            kvm_irqchip_release_virq(kvm_state, ws_irq->vectors[i].virq);
+            ws_irq->vectors[i].virq = -1;
+        }
+        ws_irq->irqfd_nr = 0;
+        warn_report("%s: irqfd unavailable (%d), interrupts go through the main loop", WIRELESS_SIMU_DEVICE_NAME,
+                    ret);
+        return ret;
+    }
+
+    qatomic_store_release(&ws_irq->irqfd_mode, mode);
+    return 0;
+}
+
+/* 持有 bql, guest 在 msi 打开期间修改了 address / data 时更新路由 */
+static void wireless_simu_irqfd_msi_update(struct wireless_simu_irq *ws_irq)
+{
+    PCIDevice *pdev = ws_irq->pci_dev;
+    bool changed = false;
+
+    for (uint32_t i = 0; i < ws_irq->irqfd_nr; i++)
+    {
+        struct wireless_simu_irq_vector *v = &ws_irq->vectors[i];
+        MSIMessage msg = msi_get_message(pdev, i);
+
+        if (v->msg.address == msg.address && v->msg.data == msg.data)
+        {
+            continue;
+        }
+
+        if (kvm_irqchip_update_msi_route(kvm_state, v->virq, msg, pdev) < 0)
+        {
+            continue;
+        }
+        v->msg = msg;
+        changed = true;
+    }
+
+    if (changed)
+    {
+        kvm_irqchip_commit_routes(kvm_state);
+    }
+}
+
+/* guest 当前打开的中断类型能否走 irqfd */
+static uint32_t wireless_simu_irqfd_wanted(struct wireless_simu_irq *ws_irq)
+{
+    if (!ws_irq->irqfd_capable || !ws_irq->irq_enable)
+    {
+        return WIRELESS_SIMU_IRQFD_NONE;
+    }
+
+    if (ws_irq->msix_enable && msix_enabled(ws_irq->pci_dev))
+    {
+        return WIRELESS_SIMU_IRQFD_MSIX;
+    }
+
+    if (ws_irq->msi_enable && msi_enabled(ws_irq->pci_dev))
+    {
+        return WIRELESS_SIMU_IRQFD_MSI;
+    }
+
+    return WIRELESS_SIMU_IRQFD_NONE;
+}
+
+/* 任意线程, 通过 irqfd 发送 statu 对应的 vector, 没有 irqfd 时返回 false */
+static bool wireless_simu_irqfd_notify(struct wireless_simu_irq *ws_irq, uint32_t statu)
+{
+    uint32_t mode = qatomic_load_acquire(&ws_irq->irqfd_mode);
+    uint32_t vector = statu;
+
+    if (mode == WIRELESS_SIMU_IRQFD_NONE)
+    {
+        return false;
+    }
+
+    /* guest 分配的 msi vector 不够时, 多出来的状态共用最后一个 vector */
+    if (mode == WIRELESS_SIMU_IRQFD_MSI)
+    {
+        vector = MIN(statu, ws_irq->irqfd_nr - 1);
+    }
+
+    event_notifier_set(&ws_irq->vectors[vector].notifier);
+
+    /* 期间 irqfd 被拆除时, eventfd 中的事件可能已经取走, 再经过 irq_bh 发送一次 */
+    smp_mb();
+    return qatomic_read(&ws_irq->irqfd_mode) == mode;
+}
+
+void wireless_simu_irq_config_write(struct wireless_simu_irq *ws_irq)
+{
+    uint32_t mode = wireless_simu_irqfd_wanted(ws_irq);
+
+    if (mode == ws_irq->irqfd_mode &&
+        (mode != WIRELESS_SIMU_IRQFD_MSI || ws_irq->irqfd_nr == msi_nr_vectors_allocated(ws_irq->pci_dev)))
+    {
+        if (mode == WIRELESS_SIMU_IRQFD_MSI)
+        {
+            wireless_simu_irqfd_msi_update(ws_irq);
+        }
+        return;
+    }
+
+    wireless_simu_irqfd_disable(ws_irq);
+    if (mode != WIRELESS_SIMU_IRQFD_NONE)
+    {
+        wireless_simu_irqfd_enable(ws_irq, mode);
+    }
+}
+
+void wireless_simu_irq_reset(struct wireless_simu_irq *ws_irq)
+{
+    /* 复位时 msi-x / msi 被直接关闭, 不经过配置空间写入 */
+    wireless_simu_irqfd_disable(ws_irq);
+}
+
+int wireless_simu_irq_init(struct wireless_simu_irq *ws_irq, PCIDevice *pdev, uint32_t irq_addr,
+                           bool msi, bool msix, Error **errp)
+{
+    Error *err = NULL;
+
     if (irq_addr == 0 ||
-        pdev == NULL ||
-        ws_irq->msi_enable)
+        pdev == NULL)
     {
-        printf("%s : irq init err \n", WIRELESS_SIMU_DEVICE_NAME);
+        error_setg(errp, "%s: invalid irq status register", WIRELESS_SIMU_DEVICE_NAME);
         return -EINVAL;
     }
 
     ws_irq->pci_dev = pdev;
     ws_irq->irq_addr = irq_addr;
     ws_irq->irq_status_val = 0;
+    ws_irq->irq_pending = 0;
+    ws_irq->msi_pending = 0;
 
     pci_config_set_interrupt_pin(ws_irq->pci_dev->config, 1);
 
     qemu_mutex_init(&ws_irq->irq_intx_mutex);
 
-    // 不对msi进行配置
+    /* 主线程中执行, 持有 bql */
+    ws_irq->irq_bh = qemu_bh_new(wireless_simu_irq_bh, ws_irq);
+
+    /* 有内核 irqchip 时每个 vector 准备一个 eventfd, guest 打开 msi-x / msi 后再绑定路由 */
+    ws_irq->irqfd_capable = false;
+    ws_irq->irqfd_mode = WIRELESS_SIMU_IRQFD_NONE;
+    ws_irq->irqfd_nr = 0;
+    if ((msi || msix) && kvm_msi_via_irqfd_enabled())
+    {
+        int i;
+
+        for (i = 0; i < WIRELESS_SIMU_MSIX_VECTORS; i++)
+        {
+            ws_irq->vectors[i].virq = -1;
+            ws_irq->vectors[i].attached = false;
+            if (event_notifier_init(&ws_irq->vectors[i].notifier, 0))
+            {
+                break;
+            }
+        }
+
+        if (i == WIRELESS_SIMU_MSIX_VECTORS)
+        {
+            ws_irq->irqfd_capable = true;
+        }
+        else
+        {
+            while (--i >= 0)
+            {
+                event_notifier_cleanup(&ws_irq->vectors[i].notifier);
+            }
+            warn_report("%s: failed to create irqfd eventfds", WIRELESS_SIMU_DEVICE_NAME);
+        }
+    }
+
+    ws_irq->msix_enable = false;
+    if (msix)
+    {
+        if (msix_init_exclusive_bar(pdev, WIRELESS_SIMU_MSIX_VECTORS, WIRELESS_SIMU_MSIX_BAR, &err))
+        {
+            /* 没有 msi-x 依旧可以使用 msi 和 intx */
+            warn_report_err(err);
+            err = NULL;
+        }
+        else
+        {
+            for (int i = 0; i < WIRELESS_SIMU_MSIX_VECTORS; i++)
+            {
+                msix_vector_use(pdev, i);
+            }
+            ws_irq->msix_enable = true;
+        }
+    }
+
     ws_irq->msi_enable = false;
+    if (msi)
+    {
+        if (msi_init(pdev, 0, WIRELESS_SIMU_MSI_VECTORS, true, false, &err))
+        {
+            warn_report_err(err);
+            err = NULL;
+        }
+        else
+        {
+            ws_irq->msi_enable = true;
+        }
+    }
 
     ws_irq->irq_enable = true;
 
@@ -28,17 +468,35 @@ int wireless_simu_irq_init(struct wireless_simu_irq *ws_irq, PCIDevice *pdev, ui
 
 void wireless_simu_irq_deinit(struct wireless_simu_irq *ws_irq)
 {
+    wireless_simu_irqfd_disable(ws_irq);
+    if (ws_irq->irqfd_capable)
+    {
+        for (int i = 0; i < WIRELESS_SIMU_MSIX_VECTORS; i++)
+        {
+            event_notifier_cleanup(&ws_irq->vectors[i].notifier);
+        }
+        ws_irq->irqfd_capable = false;
+    }
+
     ws_irq->irq_enable = false;
 
-    /* 这里这几个mutex设计的比较迷惑 */
-    qemu_mutex_unlock(&ws_irq->irq_intx_mutex);
-    qemu_mutex_lock(&ws_irq->irq_intx_mutex);
-    qemu_mutex_unlock(&ws_irq->irq_intx_mutex);
+    qemu_bh_delete(ws_irq->irq_bh);
+    ws_irq->irq_bh = NULL;
+
     qemu_mutex_destroy(&ws_irq->irq_intx_mutex);
 
     ws_irq->irq_addr = 0;
 
     ws_irq->irq_status_val = 0;
+    ws_irq->irq_pending = 0;
+    ws_irq->msi_pending = 0;
+
+    if (ws_irq->msix_enable)
+    {
+        msix_unuse_all_vectors(ws_irq->pci_dev);
+        msix_uninit_exclusive_bar(ws_irq->pci_dev);
+        ws_irq->msix_enable = false;
+    }
 
     if (ws_irq->msi_enable)
     {
@@ -49,4 +507,63 @@ void wireless_simu_irq_deinit(struct wireless_simu_irq *ws_irq)
     ws_irq->pci_dev = NULL;
 
     return;
-}
\ No newline at end of file
+}
+
+void wireless_simu_irq_raise(struct wireless_simu_irq *ws_irq, uint32_t statu)
+{
+    if (!ws_irq->irq_enable || statu == 0 || statu >= WIRELESS_SIMU_IRQ_STATUS_MAX)
+    {
+        return;
+    }
+
+    if ((ws_irq->msix_enable && msix_enabled(ws_irq->pci_dev)) ||
+        (ws_irq->msi_enable && msi_enabled(ws_irq->pci_dev)))
+    {
+        /* 每个 vector 有自己的 irqfd, 不同 ring 的中断并发发送, 不经过 bql */
+        if (wireless_simu_irqfd_notify(ws_irq, statu))
+        {
+            return;
+        }
+
+        /* 没有 irqfd 时 msi-x 的 table / PBA 和 msi 的 message 都需要 bql, 同一 vector 多次挂起只发送一次 */
+        qatomic_or(&ws_irq->msi_pending, 1ULL << statu);
+        if (bql_locked())
+        {
+            wireless_simu_irq_msi_deliver(ws_irq);
+        }
+        else
+        {
+            qemu_bh_schedule(ws_irq->irq_bh);
+        }
+        return;
+    }
+
+    qemu_mutex_lock(&ws_irq->irq_intx_mutex);
+    ws_irq->irq_pending |= 1ULL << statu;
+    qemu_mutex_unlock(&ws_irq->irq_intx_mutex);
+
+    /* 数据面线程不去拿 bql */
+    if (bql_locked())
+    {
+        wireless_simu_irq_deliver(ws_irq);
+    }
+    else
+    {
+        qemu_bh_schedule(ws_irq->irq_bh);
+    }
+}
+
+void wireless_simu_irq_lower(struct wireless_simu_irq *ws_irq)
+{
+    qemu_mutex_lock(&ws_irq->irq_intx_mutex);
+    qatomic_set(&ws_irq->irq_status_val, 0);
+    qemu_mutex_unlock(&ws_irq->irq_intx_mutex);
+
+    if (ws_irq->irq_enable)
+    {
+        pci_set_irq(ws_irq->pci_dev, 0);
+    }
+
+    /* 呈现下一个挂起的中断 */
+    wireless_simu_irq_deliver(ws_irq);
+}
@@ -3,59 +3,120 @@
 
 #include "wireless_simu.h"
 
+enum WIRELESS_SIMU_ENUM_IRQ_STATUS
+{
+    WIRELESS_SIMU_IRQ_STATU_START = 0,
+    WIRELESS_SIMU_IRQ_STATU_SRNG_DST_DMA_TEST_RING_0,
+    WIRELESS_SIMU_IRQ_STATUS_MGMT_TX_END,
+    WIRELESS_SIMU_IRQ_STATUS_MGMT_TX_END_TAIL = WIRELESS_SIMU_IRQ_STATUS_MGMT_TX_END + 12,
+    /* CE0 ~ CE11 dst status ring 的接收中断 */
+    WIRELESS_SIMU_IRQ_STATUS_CE_DST = WIRELESS_SIMU_IRQ_STATUS_MGMT_TX_END_TAIL,
+    WIRELESS_SIMU_IRQ_STATUS_CE_DST_TAIL = WIRELESS_SIMU_IRQ_STATUS_CE_DST + 12,
+    /* WBM2SW0 ~ WBM2SW3 release ring 的 tx 完成中断 */
+    WIRELESS_SIMU_IRQ_STATUS_WBM_RELEASE = WIRELESS_SIMU_IRQ_STATUS_CE_DST_TAIL,
+    WIRELESS_SIMU_IRQ_STATUS_WBM_RELEASE_TAIL = WIRELESS_SIMU_IRQ_STATUS_WBM_RELEASE + 4,
+    /* REO dst ring 的接收中断 */
+    WIRELESS_SIMU_IRQ_STATUS_REO_DST = WIRELESS_SIMU_IRQ_STATUS_WBM_RELEASE_TAIL,
+    WIRELESS_SIMU_IRQ_STATUS_MAX,
+};
+
+/* msi-x 的 vector 号与中断状态值一一对应, 每个 srng 组一个 vector */
+#define WIRELESS_SIMU_MSIX_VECTORS WIRELESS_SIMU_IRQ_STATUS_MAX
+#define WIRELESS_SIMU_MSIX_BAR 2
+
+/* msi 的 vector 数量必须是 2 的幂 */
+#define WIRELESS_SIMU_MSI_VECTORS 32
+
+/* 当前通过 irqfd 发送的中断类型 */
+enum WIRELESS_SIMU_ENUM_IRQFD_MODE
+{
+    WIRELESS_SIMU_IRQFD_NONE = 0,
+    WIRELESS_SIMU_IRQFD_MSIX,
+    WIRELESS_SIMU_IRQFD_MSI,
+};
+
+/* 每个 vector 一个 irqfd, 数据面线程写 eventfd 后由 kvm 直接注入中断, 不经过 bql 和主线程 */
+struct wireless_simu_irq_vector
+{
+    EventNotifier notifier;
+
+    /* kvm 中的 msi 路由, 没有时为 -1 */
+    int virq;
+
+    /* 路由当前使用的 msi message */
+    MSIMessage msg;
+
+    /* eventfd 已经绑定到 virq, msi-x vector 被屏蔽时解除绑定, 事件留在 eventfd 中 */
+    bool attached;
+};
+
 struct wireless_simu_irq
 {
     uint32_t irq_addr;
+
+    /* 当前呈现给驱动的中断状态, 驱动写 0 清除之后才会呈现下一个 */
     uint32_t irq_status_val;
+
+    /* 还没有呈现给驱动的中断状态, 以状态值为下标 */
+    uint64_t irq_pending;
+
+    /* 保护 irq_status_val 和 irq_pending, 不会在持有期间去拿 bql */
     QemuMutex irq_intx_mutex;
+
+    /* 在不持有 bql 的线程中拉起中断时, 交给主线程去设置 intx 电平;
+     * 没有内核 irqchip 时 msi-x / msi 也由它发送 */
+    QEMUBH *irq_bh;
+
+    /* 等待主线程发送的 msi-x / msi vector */
+    uint64_t msi_pending;
+
+    /* kvm 支持 msi irqfd 时才初始化 vectors 中的 eventfd */
+    bool irqfd_capable;
+
+    /* enum WIRELESS_SIMU_ENUM_IRQFD_MODE, 数据面线程无锁读取, 只在持有 bql 时修改 */
+    uint32_t irqfd_mode;
+
+    /* 建立了路由的 vector 数量 */
+    uint32_t irqfd_nr;
+
+    struct wireless_simu_irq_vector vectors[WIRELESS_SIMU_MSIX_VECTORS];
+
     PCIDevice *pci_dev;
     bool msi_enable;
+    bool msix_enable;
     bool irq_enable;
 };
 
-enum WIRELESS_SIMU_ENUM_IRQ_STATUS
-{
-    WIRELESS_SIMU_IRQ_STATU_START = 0,
-    WIRELESS_SIMU_IRQ_STATU_SRNG_DST_DMA_TEST_RING_0,
-    WIRELESS_SIMU_IRQ_STATUS_MGMT_TX_END,
-    WIRELESS_SIMU_IRQ_STATUS_MGMT_TX_END_TAIL = WIRELESS_SIMU_IRQ_STATUS_MGMT_TX_END + 12,
-};
-
-// 仅支持intx中断初始化
-int wireless_simu_irq_init(struct wireless_simu_irq *ws_irq, PCIDevice *pdev, uint32_t irq_addr);
+/* 中断初始化, intx 总是可用, msi / msix 为 true 时额外提供对应的 capability */
+int wireless_simu_irq_init(struct wireless_simu_irq *ws_irq, PCIDevice *pdev, uint32_t irq_addr,
+                           bool msi, bool msix, Error **errp);
 
 // 删除中断
 void wireless_simu_irq_deinit(struct wireless_simu_irq *ws_irq);
 
-// 拉起中断
-static inline void wireless_simu_irq_raise(struct wireless_simu_irq *ws_irq, uint32_t statu)
-{
-    
-    if (ws_irq->irq_enable)
-    {
-        qemu_mutex_lock(&ws_irq->irq_intx_mutex);
-        ws_irq->irq_status_val = statu;
-        bql_lock();
-        pci_set_irq(ws_irq->pci_dev, 1);
-        bql_unlock();
-    }
-}
+/* 配置空间写入之后调用, 持有 bql, msi-x / msi 打开或关闭时建立或拆除 irqfd */
+void wireless_simu_irq_config_write(struct wireless_simu_irq *ws_irq);
 
-// 清中断
-static inline void wireless_simu_irq_lower(struct wireless_simu_irq *ws_irq)
-{
-    if (ws_irq->irq_enable)
-    {
-        ws_irq->irq_status_val = 0;
-        pci_set_irq(ws_irq->pci_dev, 0);
-    }
-    qemu_mutex_unlock(&ws_irq->irq_intx_mutex);
-}
+/* 设备复位, 持有 bql, 拆除 irqfd */
+void wireless_simu_irq_reset(struct wireless_simu_irq *ws_irq);
+
+/* 拉起中断
+ *
+ * 可以在任意线程中调用且不会阻塞;
+ * msi-x / msi 打开时发送 statu 对应的 vector, 有 irqfd 时直接写 eventfd,
+ * 否则需要 bql, 不持有 bql 时交给 irq_bh 发送;
+ * msi-x vector 被屏蔽时记入 PBA, 解除屏蔽时补发;
+ * 否则走 intx: 前一个中断还没有被驱动清除时, 该状态会被挂起，
+ * 等驱动清除后再呈现, 同一状态多次挂起只会呈现一次 */
+void wireless_simu_irq_raise(struct wireless_simu_irq *ws_irq, uint32_t statu);
+
+// 清中断, 由驱动写状态寄存器触发, 持有 bql
+void wireless_simu_irq_lower(struct wireless_simu_irq *ws_irq);
 
 // host读中断信息
-static inline uint32_t wireless_simu_irq_statu(struct wireless_simu_irq ws_irq)
+static inline uint32_t wireless_simu_irq_statu(struct wireless_simu_irq *ws_irq)
 {
-    return ws_irq.irq_status_val;
+    return qatomic_read(&ws_irq->irq_status_val);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,771 @@
+#include "wireless_simu.h"
+#include "qemu/cutils.h"
+
+/* 802.11 帧头中 addr1 (接收方) 的位置 */
+#define WIRELESS_MEDIUM_ADDR1_OFFSET 4
+#define WIRELESS_MEDIUM_ADDR_LEN 6
+
+static uint64_t wireless_medium_mac_key(const uint8_t *mac)
+{
+    uint64_t key = 0;
+
+    for (int i = 0; i < WIRELESS_MEDIUM_ADDR_LEN; i++)
+    {
+        key = (key << 8) | mac[i];
+    }
+
+    return key;
+}
+
+static int wireless_medium_parse_mac(const char *str, uint8_t *mac)
+{
+    unsigned int b[WIRELESS_MEDIUM_ADDR_LEN];
+    int n = 0;
+
+    if (sscanf(str, "%2x:%2x:%2x:%2x:%2x:%2x%n", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &n) != 6)
+        return -EINVAL;
+
+    for (int i = 0; i < WIRELESS_MEDIUM_ADDR_LEN; i++)
+    {
+        mac[i] = b[i];
+    }
+
+    return n;
+}
+
+static void wireless_medium_frame_unref(struct wireless_medium_frame *frame)
+{
+    if (qatomic_fetch_dec(&frame->refcnt) == 1)
+        g_free(frame);
+}
+
+/* 两个设备之间是否连通, 调用时持有 medium->lock */
+static bool wireless_medium_link_up(struct wireless_medium *medium, struct wireless_medium_port *a,
+                                    struct wireless_medium_port *b)
+{
+    return a->enabled && b->enabled &&
+           !test_bit(a->index * WIRELESS_MEDIUM_STATIONS_MAX + b->index, medium->blocked);
+}
+
+/* 只放入引用, 不拷贝数据 */
+static void wireless_medium_port_enqueue(struct wireless_medium_port *port, struct wireless_medium_frame *frame)
+{
+    struct wireless_medium *medium = port->medium;
+
+    qemu_mutex_lock(&port->lock);
+    if (port->head - port->tail >= WIRELESS_MEDIUM_RX_QUEUE)
+    {
+        qemu_mutex_unlock(&port->lock);
+        stat64_add(&medium->drops, 1);
+        return;
+    }
+
+    qatomic_inc(&frame->refcnt);
+    port->queue[port->head % WIRELESS_MEDIUM_RX_QUEUE] = frame;
+    port->head++;
+    qemu_mutex_unlock(&port->lock);
+
+    stat64_add(&medium->deliveries, 1);
+    qemu_bh_schedule(port->bh);
+}
+
+/* 在设备的 AioContext 中按到达顺序交给设备 */
+static void wireless_medium_port_bh(void *opaque)
+{
+    struct wireless_medium_port *port = opaque;
+    struct wireless_medium_frame *frame;
+
+    for (;;)
+    {
+        qemu_mutex_lock(&port->lock);
+        if (port->tail == port->head)
+        {
+            qemu_mutex_unlock(&port->lock);
+            break;
+        }
+        frame = port->queue[port->tail % WIRELESS_MEDIUM_RX_QUEUE];
+        port->tail++;
+        qemu_mutex_unlock(&port->lock);
+
+        port->rx_handler(frame->data, frame->len, port->device);
+        wireless_medium_frame_unref(frame);
+    }
+}
+
+/* 经过信道到达, 调用时持有 medium->lock */
+static void wireless_medium_channel_deliver(void *dst, void *frame)
+{
+    wireless_medium_port_enqueue(dst, frame);
+    wireless_medium_frame_unref(frame);
+}
+
+static void wireless_medium_channel_release(void *frame)
+{
+    wireless_medium_frame_unref(frame);
+}
+
+/* 按链路参数决定丢弃, 立即投递或者放入时间轮 */
+static void wireless_medium_channel_send(struct wireless_medium *medium, struct wireless_medium_port *src,
+                                         struct wireless_medium_port *dst, struct wireless_medium_frame *frame,
+                                         int64_t now, int64_t end)
+{
+    struct wireless_channel *ch = &medium->channel;
+    const struct wireless_channel_params *params = wireless_channel_link(ch, src->index, dst->index);
+    int64_t when = end + params->delay;
+
+    if (wireless_channel_lost(ch, params, frame->len))
+        return;
+
+    if (when <= now)
+    {
+        wireless_medium_port_enqueue(dst, frame);
+        return;
+    }
+
+    qatomic_inc(&frame->refcnt);
+    wireless_channel_schedule(ch, when, dst, frame);
+}
+
+/* 经过信道发送, 空口时间只计算一次, 各接收方按自己的链路参数到达 */
+static void wireless_medium_hub_send_channel(struct wireless_medium *medium, struct wireless_medium_port *src,
+                                             struct wireless_medium_frame *frame)
+{
+    const uint8_t *addr1 = frame->data + WIRELESS_MEDIUM_ADDR1_OFFSET;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    struct wireless_medium_port *dst;
+    int64_t end;
+    uint64_t key;
+
+    if (addr1[0] & 0x01)
+    {
+        /* 组播 / 广播按默认速率发送 */
+        end = wireless_channel_transmit(&medium->channel, &medium->channel.base, frame->len, now,
+                                        &src->tx_busy_until);
+        for (int i = 0; i < WIRELESS_MEDIUM_STATIONS_MAX; i++)
+        {
+            dst = medium->ports[i];
+            if (dst && dst != src && wireless_medium_link_up(medium, src, dst))
+                wireless_medium_channel_send(medium, src, dst, frame, now, end);
+        }
+        return;
+    }
+
+    key = wireless_medium_mac_key(addr1);
+    dst = g_hash_table_lookup(medium->by_mac, &key);
+    if (!dst || dst == src || !wireless_medium_link_up(medium, src, dst))
+        return;
+
+    end = wireless_channel_transmit(&medium->channel, wireless_channel_link(&medium->channel, src->index, dst->index),
+                                    frame->len, now, &src->tx_busy_until);
+    wireless_medium_channel_send(medium, src, dst, frame, now, end);
+}
+
+int wireless_medium_hub_send(struct wireless_medium_port *src, const void *data, size_t len)
+{
+    struct wireless_medium *medium = src->medium;
+    struct wireless_medium_frame *frame;
+    struct wireless_medium_port *dst;
+    const uint8_t *addr1;
+    uint64_t key;
+
+    if (len < WIRELESS_MEDIUM_ADDR1_OFFSET + WIRELESS_MEDIUM_ADDR_LEN)
+        return -EINVAL;
+
+    /* 发送方持有一个引用, 投递完再释放 */
+    frame = g_malloc(sizeof(*frame) + len);
+    frame->refcnt = 1;
+    frame->len = len;
+    memcpy(frame->data, data, len);
+    stat64_add(&medium->frames, 1);
+
+    addr1 = frame->data + WIRELESS_MEDIUM_ADDR1_OFFSET;
+
+    qemu_mutex_lock(&medium->lock);
+    if (src->enabled && wireless_channel_active(&medium->channel))
+    {
+        wireless_medium_hub_send_channel(medium, src, frame);
+    }
+    else if (addr1[0] & 0x01)
+    {
+        /* 组播 / 广播 */
+        for (int i = 0; i < WIRELESS_MEDIUM_STATIONS_MAX; i++)
+        {
+            dst = medium->ports[i];
+            if (dst && dst != src && wireless_medium_link_up(medium, src, dst))
+                wireless_medium_port_enqueue(dst, frame);
+        }
+    }
+    else
+    {
+        key = wireless_medium_mac_key(addr1);
+        dst = g_hash_table_lookup(medium->by_mac, &key);
+        if (dst && dst != src && wireless_medium_link_up(medium, src, dst))
+            wireless_medium_port_enqueue(dst, frame);
+    }
+    qemu_mutex_unlock(&medium->lock);
+
+    wireless_medium_frame_unref(frame);
+
+    return 0;
+}
+
+static int wireless_medium_hub_attach(struct wireless_medium *medium, struct wireless_txrx_config *config,
+                                      const uint8_t *mac, void (*rx_handler)(void *data, size_t len, void *device),
+                                      void *device, AioContext *ctx, Error **errp)
+{
+    struct wireless_medium_port *port;
+    uint64_t key = wireless_medium_mac_key(mac);
+    int index = -1;
+
+    qemu_mutex_lock(&medium->lock);
+    if (g_hash_table_contains(medium->by_mac, &key))
+    {
+        qemu_mutex_unlock(&medium->lock);
+        error_setg(errp, "%s: mac %02x:%02x:%02x:%02x:%02x:%02x already on medium '%s'", WIRELESS_SIMU_DEVICE_NAME,
+                   mac[0], mac[1], mac[2], mac[3], mac[4], mac[5],
+                   object_get_canonical_path_component(OBJECT(medium)));
+        return -EADDRINUSE;
+    }
+
+    for (int i = 0; i < WIRELESS_MEDIUM_STATIONS_MAX; i++)
+    {
+        if (!medium->ports[i])
+        {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0)
+    {
+        qemu_mutex_unlock(&medium->lock);
+        error_setg(errp, "%s: medium '%s' is full", WIRELESS_SIMU_DEVICE_NAME,
+                   object_get_canonical_path_component(OBJECT(medium)));
+        return -ENOSPC;
+    }
+
+    port = g_new0(struct wireless_medium_port, 1);
+    port->medium = medium;
+    port->index = index;
+    memcpy(port->mac, mac, sizeof(port->mac));
+    port->key = key;
+    port->enabled = true;
+    qemu_mutex_init(&port->lock);
+    port->ctx = ctx;
+    port->bh = aio_bh_new(ctx ? ctx : qemu_get_aio_context(), wireless_medium_port_bh, port);
+    port->rx_handler = rx_handler;
+    port->device = device;
+
+    /* 新设备和所有设备之间都是连通的 */
+    for (int i = 0; i < WIRELESS_MEDIUM_STATIONS_MAX; i++)
+    {
+        clear_bit(index * WIRELESS_MEDIUM_STATIONS_MAX + i, medium->blocked);
+        clear_bit(i * WIRELESS_MEDIUM_STATIONS_MAX + index, medium->blocked);
+    }
+
+    medium->ports[index] = port;
+    g_hash_table_insert(medium->by_mac, &port->key, port);
+    qemu_mutex_unlock(&medium->lock);
+
+    config->hub = port;
+    return 0;
+}
+
+/* 在设备的 AioContext 中删除 bh, 之后不会再调用 rx_handler */
+static void wireless_medium_port_release(void *opaque)
+{
+    struct wireless_medium_port *port = opaque;
+
+    qemu_bh_delete(port->bh);
+    port->bh = NULL;
+}
+
+static void wireless_medium_hub_detach(struct wireless_medium *medium, struct wireless_medium_port *port)
+{
+    qemu_mutex_lock(&medium->lock);
+    medium->ports[port->index] = NULL;
+    g_hash_table_remove(medium->by_mac, &port->key);
+    wireless_channel_purge(&medium->channel, port);
+    wireless_channel_forget(&medium->channel, port->index);
+    qemu_mutex_unlock(&medium->lock);
+
+    /* 从 hub 上摘下之后不会再有新帧入队 */
+    if (port->ctx)
+    {
+        aio_wait_bh_oneshot(port->ctx, wireless_medium_port_release, port);
+    }
+    else
+    {
+        wireless_medium_port_release(port);
+    }
+
+    while (port->tail != port->head)
+    {
+        wireless_medium_frame_unref(port->queue[port->tail % WIRELESS_MEDIUM_RX_QUEUE]);
+        port->tail++;
+    }
+
+    qemu_mutex_destroy(&port->lock);
+    g_free(port);
+}
+
+int wireless_medium_attach(struct wireless_medium *medium, struct wireless_txrx *txrx, const uint8_t *mac,
+                           void (*rx_handler)(void *data, size_t len, void *device),
+                           void (*rx_batch_handler)(void *device, struct iovec *frames, int n), void *device,
+                           AioContext *ctx, Error **errp)
+{
+    struct wireless_txrx_config config = {0};
+    int ret;
+
+    if (medium && medium->transport == WIRELESS_MEDIUM_TRANSPORT_HUB)
+    {
+        ret = wireless_medium_hub_attach(medium, &config, mac, rx_handler, device, ctx, errp);
+        if (ret)
+            return ret;
+    }
+    else if (medium)
+    {
+        if (medium->station)
+        {
+            error_setg(errp, "%s: medium '%s' already has a station attached", WIRELESS_SIMU_DEVICE_NAME,
+                       object_get_canonical_path_component(OBJECT(medium)));
+            return -EBUSY;
+        }
+
+        config.shm = medium->transport == WIRELESS_MEDIUM_TRANSPORT_SHM;
+        config.path = medium->path;
+        config.peer = medium->peer;
+        config.port = medium->port;
+        config.peer_port = medium->peer_port;
+        config.uring = medium->uring;
+    }
+
+    if (wireless_txrx_init(txrx, rx_handler, rx_batch_handler, device, ctx, &config))
+    {
+        error_setg(errp, "%s: failed to open %s medium", WIRELESS_SIMU_DEVICE_NAME,
+                   config.shm ? "shm" : config.uring ? "io_uring udp" : "udp");
+        return -EIO;
+    }
+
+    if (medium && !config.hub)
+        medium->station = txrx;
+
+    return 0;
+}
+
+void wireless_medium_detach(struct wireless_medium *medium, struct wireless_txrx *txrx)
+{
+    struct wireless_medium_port *port = txrx->hub;
+
+    wireless_txrx_deinit(txrx);
+
+    if (port)
+    {
+        wireless_medium_hub_detach(medium, port);
+    }
+    else if (medium && medium->station == txrx)
+    {
+        medium->station = NULL;
+    }
+}
+
+static struct wireless_medium_port *wireless_medium_find_port(struct wireless_medium *medium, const char *str,
+                                                              int *len, Error **errp)
+{
+    struct wireless_medium_port *port;
+    uint8_t mac[WIRELESS_MEDIUM_ADDR_LEN];
+    uint64_t key;
+
+    *len = wireless_medium_parse_mac(str, mac);
+    if (*len < 0)
+    {
+        error_setg(errp, "'%s' is not a mac address", str);
+        return NULL;
+    }
+
+    key = wireless_medium_mac_key(mac);
+    port = g_hash_table_lookup(medium->by_mac, &key);
+    if (!port)
+    {
+        error_setg(errp, "no station with mac %.17s on this medium", str);
+    }
+
+    return port;
+}
+
+/* "mac" 断开 / 恢复一个设备, "mac,mac" 断开 / 恢复两个设备之间的链路 */
+static void wireless_medium_set_link(struct wireless_medium *medium, const char *value, bool up, Error **errp)
+{
+    struct wireless_medium_port *a, *b;
+    int len;
+
+    if (medium->transport != WIRELESS_MEDIUM_TRANSPORT_HUB)
+    {
+        error_setg(errp, "links can only be changed on a hub medium");
+        return;
+    }
+
+    qemu_mutex_lock(&medium->lock);
+    a = wireless_medium_find_port(medium, value, &len, errp);
+    if (!a)
+        goto out;
+
+    if (value[len] == '\0')
+    {
+        a->enabled = up;
+        goto out;
+    }
+
+    if (value[len] != ',')
+    {
+        error_setg(errp, "expected 'mac' or 'mac,mac', got '%s'", value);
+        goto out;
+    }
+
+    b = wireless_medium_find_port(medium, value + len + 1, &len, errp);
+    if (!b)
+        goto out;
+
+    if (up)
+    {
+        clear_bit(a->index * WIRELESS_MEDIUM_STATIONS_MAX + b->index, medium->blocked);
+        clear_bit(b->index * WIRELESS_MEDIUM_STATIONS_MAX + a->index, medium->blocked);
+    }
+    else
+    {
+        set_bit(a->index * WIRELESS_MEDIUM_STATIONS_MAX + b->index, medium->blocked);
+        set_bit(b->index * WIRELESS_MEDIUM_STATIONS_MAX + a->index, medium->blocked);
+    }
+
+out:
+    qemu_mutex_unlock(&medium->lock);
+}
+
+/* "mac,mac,delay=ns,loss=ppm,ber=ppb,mcs=n", 没有给出的参数使用介质的默认值 */
+static void wireless_medium_set_link_config(Object *obj, const char *value, Error **errp)
+{
+    struct wireless_medium *medium = WIRELESS_MEDIUM(obj);
+    struct wireless_channel_params params;
+    struct wireless_medium_port *a, *b;
+    g_auto(GStrv) opts = NULL;
+    const char *rest;
+    uint64_t num;
+    int len;
+
+    if (medium->transport != WIRELESS_MEDIUM_TRANSPORT_HUB)
+    {
+        error_setg(errp, "links can only be configured on a hub medium");
+        return;
+    }
+
+    qemu_mutex_lock(&medium->lock);
+    params = medium->channel.base;
+
+    a = wireless_medium_find_port(medium, value, &len, errp);
+    if (!a)
+        goto out;
+    rest = value + len;
+    if (*rest != ',')
+    {
+        error_setg(errp, "expected 'mac,mac[,param=value...]', got '%s'", value);
+        goto out;
+    }
+
+    b = wireless_medium_find_port(medium, rest + 1, &len, errp);
+    if (!b)
+        goto out;
+    rest += 1 + len;
+
+    if (*rest == ',')
+        opts = g_strsplit(rest + 1, ",", -1);
+
+    for (int i = 0; opts && opts[i]; i++)
+    {
+        char *eq = strchr(opts[i], '=');
+
+        if (!eq || qemu_strtou64(eq + 1, NULL, 0, &num))
+        {
+            error_setg(errp, "bad link parameter '%s'", opts[i]);
+            goto out;
+        }
+        *eq = '\0';
+
+        if (strcmp(opts[i], "delay") == 0)
+        {
+            params.delay = num;
+        }
+        else if (strcmp(opts[i], "loss") == 0 && num <= 1000000)
+        {
+            params.loss = num;
+        }
+        else if (strcmp(opts[i], "ber") == 0 && num <= 1000000000)
+        {
+            params.ber = num;
+        }
+        else if (strcmp(opts[i], "mcs") == 0 && (num <= WIRELESS_CHANNEL_MCS_MAX || num == WIRELESS_CHANNEL_MCS_NONE))
+        {
+            params.mcs = num;
+        }
+        else
+        {
+            error_setg(errp, "bad link parameter '%s=%" PRIu64 "'", opts[i], num);
+            goto out;
+        }
+    }
+
+    wireless_channel_set_link(&medium->channel, a->index, b->index, &params);
+
+out:
+    qemu_mutex_unlock(&medium->lock);
+}
+
+static bool wireless_medium_get_io_uring(Object *obj, Error **errp)
+{
+    return WIRELESS_MEDIUM(obj)->uring;
+}
+
+static void wireless_medium_set_io_uring(Object *obj, bool value, Error **errp)
+{
+    WIRELESS_MEDIUM(obj)->uring = value;
+}
+
+static bool wireless_medium_get_airtime(Object *obj, Error **errp)
+{
+    return WIRELESS_MEDIUM(obj)->channel.airtime;
+}
+
+static void wireless_medium_set_airtime(Object *obj, bool value, Error **errp)
+{
+    struct wireless_medium *medium = WIRELESS_MEDIUM(obj);
+
+    qemu_mutex_lock(&medium->lock);
+    medium->channel.airtime = value;
+    qemu_mutex_unlock(&medium->lock);
+}
+
+static void wireless_medium_get_seed(Object *obj, Visitor *v, const char *name, void *opaque, Error **errp)
+{
+    uint32_t value = WIRELESS_MEDIUM(obj)->channel.seed;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+/* 修改种子之后重新开始随机序列 */
+static void wireless_medium_set_seed(Object *obj, Visitor *v, const char *name, void *opaque, Error **errp)
+{
+    struct wireless_medium *medium = WIRELESS_MEDIUM(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp))
+        return;
+
+    qemu_mutex_lock(&medium->lock);
+    medium->channel.seed = value;
+    if (medium->channel.rand)
+    {
+        g_rand_free(medium->channel.rand);
+        medium->channel.rand = NULL;
+    }
+    qemu_mutex_unlock(&medium->lock);
+}
+
+static void wireless_medium_set_link_down(Object *obj, const char *value, Error **errp)
+{
+    wireless_medium_set_link(WIRELESS_MEDIUM(obj), value, false, errp);
+}
+
+static void wireless_medium_set_link_up(Object *obj, const char *value, Error **errp)
+{
+    wireless_medium_set_link(WIRELESS_MEDIUM(obj), value, true, errp);
+}
+
+static int wireless_medium_get_transport(Object *obj, Error **errp)
+{
+    return WIRELESS_MEDIUM(obj)->transport;
+}
+
+static void wireless_medium_set_transport(Object *obj, int value, Error **errp)
+{
+    WIRELESS_MEDIUM(obj)->transport = value;
+}
+
+static char *wireless_medium_get_path(Object *obj, Error **errp)
+{
+    return g_strdup(WIRELESS_MEDIUM(obj)->path);
+}
+
+static void wireless_medium_set_path(Object *obj, const char *value, Error **errp)
+{
+    struct wireless_medium *medium = WIRELESS_MEDIUM(obj);
+
+    g_free(medium->path);
+    medium->path = g_strdup(value);
+}
+
+static char *wireless_medium_get_peer(Object *obj, Error **errp)
+{
+    return g_strdup(WIRELESS_MEDIUM(obj)->peer);
+}
+
+static void wireless_medium_set_peer(Object *obj, const char *value, Error **errp)
+{
+    struct wireless_medium *medium = WIRELESS_MEDIUM(obj);
+
+    g_free(medium->peer);
+    medium->peer = g_strdup(value);
+}
+
+/* opaque 为统计项在 medium 结构体中的偏移 */
+static void wireless_medium_get_stat(Object *obj, Visitor *v, const char *name, void *opaque, Error **errp)
+{
+    Stat64 *stat = (Stat64 *)((char *)obj + (uintptr_t)opaque);
+    uint64_t value = stat64_get(stat);
+
+    visit_type_uint64(v, name, &value, errp);
+}
+
+#define WIRELESS_MEDIUM_STAT(class, name, field)                                     \
+    object_class_property_add(class, name, "uint64", wireless_medium_get_stat,       \
+                              NULL, NULL,                                            \
+                              (void *)offsetof(struct wireless_medium, field))
+
+static void wireless_medium_complete(UserCreatable *uc, Error **errp)
+{
+    struct wireless_medium *medium = WIRELESS_MEDIUM(uc);
+
+    if (medium->transport != WIRELESS_MEDIUM_TRANSPORT_HUB && wireless_channel_active(&medium->channel))
+    {
+        error_setg(errp, "%s: the channel model is only available on a hub medium", TYPE_WIRELESS_MEDIUM);
+        return;
+    }
+
+    if (medium->channel.base.loss > 1000000 || medium->channel.base.ber > 1000000000 ||
+        (medium->channel.base.mcs > WIRELESS_CHANNEL_MCS_MAX && medium->channel.base.mcs != WIRELESS_CHANNEL_MCS_NONE))
+    {
+        error_setg(errp, "%s: loss, ber or mcs out of range", TYPE_WIRELESS_MEDIUM);
+        return;
+    }
+
+    if (medium->uring && medium->transport != WIRELESS_MEDIUM_TRANSPORT_UDP)
+    {
+        error_setg(errp, "%s: io-uring is only available on an udp medium", TYPE_WIRELESS_MEDIUM);
+        return;
+    }
+
+    if (medium->transport == WIRELESS_MEDIUM_TRANSPORT_SHM)
+    {
+        /* /tmp 下固定的路径可以被其他用户抢先监听, 只在私有的运行目录中使用默认路径 */
+        if (!medium->path)
+        {
+            const char *dir = g_getenv("XDG_RUNTIME_DIR");
+
+            if (!dir || !*dir)
+            {
+                error_setg(errp, "%s: path must be set for a shm medium when XDG_RUNTIME_DIR is unset",
+                           TYPE_WIRELESS_MEDIUM);
+                return;
+            }
+            medium->path = g_build_filename(dir, WIRELESS_SHM_DEFAULT_NAME, NULL);
+        }
+        return;
+    }
+
+    /* 两个端口要么都指定, 要么都自动选择 */
+    if (medium->transport == WIRELESS_MEDIUM_TRANSPORT_UDP && !medium->port != !medium->peer_port)
+    {
+        error_setg(errp, "%s: port and peer-port must be set together", TYPE_WIRELESS_MEDIUM);
+    }
+}
+
+/* 还有设备连接时不能删除 */
+static bool wireless_medium_can_be_deleted(UserCreatable *uc)
+{
+    struct wireless_medium *medium = WIRELESS_MEDIUM(uc);
+
+    return !medium->station && g_hash_table_size(medium->by_mac) == 0;
+}
+
+static void wireless_medium_instance_init(Object *obj)
+{
+    struct wireless_medium *medium = WIRELESS_MEDIUM(obj);
+
+    qemu_mutex_init(&medium->lock);
+    medium->by_mac = g_hash_table_new(g_int64_hash, g_int64_equal);
+    medium->blocked = bitmap_new(WIRELESS_MEDIUM_STATIONS_MAX * WIRELESS_MEDIUM_STATIONS_MAX);
+    stat64_init(&medium->frames, 0);
+    stat64_init(&medium->deliveries, 0);
+    stat64_init(&medium->drops, 0);
+    wireless_channel_init(&medium->channel, &medium->lock, wireless_medium_channel_deliver,
+                          wireless_medium_channel_release);
+
+    object_property_add_uint16_ptr(obj, "port", &medium->port, OBJ_PROP_FLAG_READWRITE);
+    object_property_add_uint16_ptr(obj, "peer-port", &medium->peer_port, OBJ_PROP_FLAG_READWRITE);
+
+    /* 信道模型的默认参数 */
+    object_property_add_uint64_ptr(obj, "delay", &medium->channel.base.delay, OBJ_PROP_FLAG_READWRITE);
+    object_property_add_uint32_ptr(obj, "loss", &medium->channel.base.loss, OBJ_PROP_FLAG_READWRITE);
+    object_property_add_uint32_ptr(obj, "ber", &medium->channel.base.ber, OBJ_PROP_FLAG_READWRITE);
+    object_property_add_uint8_ptr(obj, "mcs", &medium->channel.base.mcs, OBJ_PROP_FLAG_READWRITE);
+}
+
+static void wireless_medium_instance_finalize(Object *obj)
+{
+    struct wireless_medium *medium = WIRELESS_MEDIUM(obj);
+
+    g_free(medium->path);
+    g_free(medium->peer);
+    wireless_channel_destroy(&medium->channel);
+    g_hash_table_destroy(medium->by_mac);
+    g_free(medium->blocked);
+    qemu_mutex_destroy(&medium->lock);
+}
+
+static void wireless_medium_class_init(ObjectClass *oc, void *data)
+{
+    UserCreatableClass *ucc = USER_CREATABLE_CLASS(oc);
+
+    ucc->complete = wireless_medium_complete;
+    ucc->can_be_deleted = wireless_medium_can_be_deleted;
+
+    object_class_property_add_enum(oc, "transport", "WirelessMediumTransport", &WirelessMediumTransport_lookup,
+                                   wireless_medium_get_transport, wireless_medium_set_transport);
+    object_class_property_add_str(oc, "path", wireless_medium_get_path, wireless_medium_set_path);
+    object_class_property_add_str(oc, "peer", wireless_medium_get_peer, wireless_medium_set_peer);
+    object_class_property_add_bool(oc, "io-uring", wireless_medium_get_io_uring, wireless_medium_set_io_uring);
+
+    /* hub 链路控制, 通过 qom-set 写入 */
+    object_class_property_add_str(oc, "link-down", NULL, wireless_medium_set_link_down);
+    object_class_property_add_str(oc, "link-up", NULL, wireless_medium_set_link_up);
+    object_class_property_add_str(oc, "link-config", NULL, wireless_medium_set_link_config);
+
+    /* 信道模型 */
+    object_class_property_add_bool(oc, "airtime", wireless_medium_get_airtime, wireless_medium_set_airtime);
+    object_class_property_add(oc, "seed", "uint32", wireless_medium_get_seed, wireless_medium_set_seed, NULL, NULL);
+
+    /* hub 统计 */
+    WIRELESS_MEDIUM_STAT(oc, "frames", frames);
+    WIRELESS_MEDIUM_STAT(oc, "deliveries", deliveries);
+    WIRELESS_MEDIUM_STAT(oc, "drops", drops);
+    WIRELESS_MEDIUM_STAT(oc, "lost", channel.lost);
+    WIRELESS_MEDIUM_STAT(oc, "delayed", channel.delayed);
+    WIRELESS_MEDIUM_STAT(oc, "overflow", channel.overflow);
+}
+
+static const TypeInfo wireless_medium_type_info = {
+    .name = TYPE_WIRELESS_MEDIUM,
+    .parent = TYPE_OBJECT,
+    .instance_size = sizeof(struct wireless_medium),
+    .instance_init = wireless_medium_instance_init,
+    .instance_finalize = wireless_medium_instance_finalize,
+    .class_init = wireless_medium_class_init,
+    .interfaces = (InterfaceInfo[]){
+        {TYPE_USER_CREATABLE},
+        {},
+    },
+};
+
+static void wireless_medium_register_types(void)
+{
+    type_register_static(&wireless_medium_type_info);
+}
+
+type_init(wireless_medium_register_types);
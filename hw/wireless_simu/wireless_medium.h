@@ -0,0 +1,118 @@
+#ifndef WIRELESS_SIMU_MEDIUM
+#define WIRELESS_SIMU_MEDIUM
+
+#include "wireless_simu.h"
+#include "qom/object_interfaces.h"
+
+/* 无线介质
+ *
+ * -object wireless-medium,id=m0,transport=udp,port=12800,peer-port=12801
+ * -object wireless-medium,id=m1,transport=shm,path=/tmp/m1.sock
+ * -object wireless-medium,id=m4,transport=udp,port=12900,peer-port=12901,io-uring=on
+ * -device wirelesssimu,medium=m0
+ *
+ * -object wireless-medium,id=m2,transport=hub
+ * -device wirelesssimu,medium=m2,mac=02:00:00:00:00:01
+ * -device wirelesssimu,medium=m2,mac=02:00:00:00:00:02
+ *
+ * udp / shm 介质是一条点对点的链路, 一端为本进程中连接到它的设备, 另一端为同一 udp 端口对
+ * 或 shm path 上的另一个 qemu 进程. 每个设备使用自己的介质, 不再受全局端口的限制.
+ * 没有指定介质的设备沿用自动选择端口的 udp
+ *
+ * hub 介质在进程内连接任意多个设备, 按 802.11 帧的 addr1 投递: 组播 / 广播地址投递给其他所有设备,
+ * 单播地址按 mac 查找目的设备. 帧只拷贝一次, 各接收方的队列中只保存引用
+ *
+ * -object wireless-medium,id=m3,transport=hub,delay=100000,mcs=7,airtime=on
+ * hub 上可以配置信道模型, 见 wireless_channel.h */
+
+#define TYPE_WIRELESS_MEDIUM "wireless-medium"
+
+/* hub 上最多连接的设备数量 */
+#define WIRELESS_MEDIUM_STATIONS_MAX 256
+
+/* 每个设备的接收队列长度, 满了之后丢帧 */
+#define WIRELESS_MEDIUM_RX_QUEUE 256
+
+/* 所有接收方共享的帧, 最后一个引用释放时 free */
+struct wireless_medium_frame
+{
+    uint32_t refcnt;
+    uint32_t len;
+    uint8_t data[];
+};
+
+/* 设备在 hub 上的端口 */
+struct wireless_medium_port
+{
+    struct wireless_medium *medium;
+    uint32_t index;
+    uint8_t mac[6];
+    uint64_t key;
+
+    /* link-down 之后不再收发 */
+    bool enabled;
+
+    /* 不共享空口时, 本设备发送完上一帧的时刻 */
+    int64_t tx_busy_until;
+
+    /* 接收队列, 由其他设备的发送线程写入, 在设备的 AioContext 中取出 */
+    QemuMutex lock;
+    struct wireless_medium_frame *queue[WIRELESS_MEDIUM_RX_QUEUE];
+    uint32_t head;
+    uint32_t tail;
+    QEMUBH *bh;
+    AioContext *ctx;
+
+    void (*rx_handler)(void *data, size_t len, void *device);
+    void *device;
+};
+
+struct wireless_medium
+{
+    Object parent_obj;
+
+    /* 传输方式的配置, 由属性设置 */
+    WirelessMediumTransport transport;
+    char *path;
+    char *peer;
+    uint16_t port;
+    uint16_t peer_port;
+    bool uring;
+
+    /* udp / shm 时已连接的设备 */
+    struct wireless_txrx *station;
+
+    /* hub 时已连接的设备, lock 保护 ports / by_mac / blocked */
+    QemuMutex lock;
+    struct wireless_medium_port *ports[WIRELESS_MEDIUM_STATIONS_MAX];
+    GHashTable *by_mac;
+
+    /* 断开的设备对, 第 a * WIRELESS_MEDIUM_STATIONS_MAX + b 位, 对称设置 */
+    unsigned long *blocked;
+
+    /* 信道模型, 和 hub 共用 lock */
+    struct wireless_channel channel;
+
+    /* hub 发出的帧 / 投递的次数 / 接收队列满丢弃的次数 */
+    Stat64 frames;
+    Stat64 deliveries;
+    Stat64 drops;
+};
+
+DECLARE_INSTANCE_CHECKER(struct wireless_medium,
+                         WIRELESS_MEDIUM,
+                         TYPE_WIRELESS_MEDIUM);
+
+/* 把设备连接到介质上, 之后收发都在 txrx 中完成
+ * medium 为 NULL 时使用自动选择端口的 udp, mac 只在 hub 上使用 */
+int wireless_medium_attach(struct wireless_medium *medium, struct wireless_txrx *txrx, const uint8_t *mac,
+                           void (*rx_handler)(void *data, size_t len, void *device),
+                           void (*rx_batch_handler)(void *device, struct iovec *frames, int n), void *device,
+                           AioContext *ctx, Error **errp);
+
+void wireless_medium_detach(struct wireless_medium *medium, struct wireless_txrx *txrx);
+
+/* 从 hub 发出一帧, 由 wireless_tx_data 调用 */
+int wireless_medium_hub_send(struct wireless_medium_port *src, const void *data, size_t len);
+
+#endif /* WIRELESS_SIMU_MEDIUM */
@@ -0,0 +1,325 @@
+#include "wireless_simu.h"
+
+struct wireless_simu_pool_obj
+{
+    QSLIST_ENTRY(wireless_simu_pool_obj) next;
+    uint32_t class_id;
+
+    uint8_t data[] QEMU_ALIGNED(16);
+};
+
+/* 线程对某一个 pool 的缓存
+ *
+ * free / count / 统计只由所属线程修改, 绑定和解绑在 pool_caches_lock 中进行;
+ * 统计在读取时和 pool 中已经合并的部分相加, 超过 POOL_CACHE_FLUSH 时合并一次 */
+struct wireless_simu_pool_cache
+{
+    /* 0 表示没有绑定 */
+    uint32_t pool_id;
+    struct wireless_simu_pool *pool;
+    QLIST_ENTRY(wireless_simu_pool_cache) link;
+
+    QSLIST_HEAD(, wireless_simu_pool_obj) free[WIRELESS_SIMU_POOL_CLASSES];
+    uint32_t count[WIRELESS_SIMU_POOL_CLASSES];
+
+    uint32_t allocs[WIRELESS_SIMU_POOL_CLASSES];
+    uint32_t cache_hits[WIRELESS_SIMU_POOL_CLASSES];
+};
+
+/* 每个线程同时缓存的 pool 数量, 超过时轮流换出 */
+#define POOL_THREAD_CACHES 4
+
+#define POOL_CACHE_FLUSH (1U << 20)
+
+struct wireless_simu_pool_thread
+{
+    struct wireless_simu_pool_cache caches[POOL_THREAD_CACHES];
+    uint32_t victim;
+};
+
+/* 数据面在帧前面加的头部 */
+QEMU_BUILD_BUG_ON(sizeof(struct sk_buff) > WIRELESS_SIMU_POOL_FRAME_HDR_MAX);
+QEMU_BUILD_BUG_ON(sizeof(struct wireless_simu_ce_frame) > WIRELESS_SIMU_POOL_FRAME_HDR_MAX);
+QEMU_BUILD_BUG_ON(sizeof(struct wireless_dp_frame) > WIRELESS_SIMU_POOL_FRAME_HDR_MAX);
+
+static const size_t pool_class_size[WIRELESS_SIMU_POOL_CLASSES] = {
+    [WIRELESS_SIMU_POOL_DESC] = WIRELESS_SIMU_POOL_DESC_SIZE,
+    [WIRELESS_SIMU_POOL_FRAME] = WIRELESS_SIMU_POOL_FRAME_SIZE,
+    [WIRELESS_SIMU_POOL_JUMBO] = WIRELESS_SIMU_POOL_JUMBO_SIZE,
+};
+
+/* pool id 从 1 开始, 0 表示线程缓存未绑定 */
+static uint32_t pool_next_id = 1;
+
+/* 保护所有 pool 的 caches 链表和缓存的绑定关系 */
+static GMutex pool_caches_lock;
+
+static void pool_thread_free(gpointer opaque);
+
+/* 任何线程退出时都会释放, 不要求是 QemuThread */
+static GPrivate pool_thread_key = G_PRIVATE_INIT(pool_thread_free);
+
+/* 持有 pool_caches_lock, 把线程中的统计合并到 pool */
+static void pool_cache_flush_stats(struct wireless_simu_pool_cache *cache)
+{
+    struct wireless_simu_pool *pool = cache->pool;
+
+    for (int i = 0; i < WIRELESS_SIMU_POOL_CLASSES; i++)
+    {
+        stat64_add(&pool->classes[i].allocs, qatomic_read(&cache->allocs[i]));
+        stat64_add(&pool->classes[i].cache_hits, qatomic_read(&cache->cache_hits[i]));
+        qatomic_set(&cache->allocs[i], 0);
+        qatomic_set(&cache->cache_hits[i], 0);
+    }
+}
+
+/* 持有 pool_caches_lock, 解除缓存和 pool 的绑定
+ * give_back 为 true 时缓存的对象还给 pool 的共享链表, 否则直接释放 */
+static void pool_cache_unbind(struct wireless_simu_pool_cache *cache, bool give_back)
+{
+    struct wireless_simu_pool_obj *obj;
+
+    if (!cache->pool_id)
+        return;
+
+    pool_cache_flush_stats(cache);
+
+    for (int i = 0; i < WIRELESS_SIMU_POOL_CLASSES; i++)
+    {
+        while ((obj = QSLIST_FIRST(&cache->free[i])) != NULL)
+        {
+            QSLIST_REMOVE_HEAD(&cache->free[i], next);
+            if (give_back)
+                QSLIST_INSERT_HEAD_ATOMIC(&cache->pool->classes[i].shared, obj, next);
+            else
+                free(obj);
+        }
+        cache->count[i] = 0;
+    }
+
+    QLIST_REMOVE(cache, link);
+    qatomic_set(&cache->pool_id, 0);
+    cache->pool = NULL;
+}
+
+static void pool_thread_free(gpointer opaque)
+{
+    struct wireless_simu_pool_thread *thread = opaque;
+
+    g_mutex_lock(&pool_caches_lock);
+    for (int i = 0; i < POOL_THREAD_CACHES; i++)
+    {
+        pool_cache_unbind(&thread->caches[i], true);
+    }
+    g_mutex_unlock(&pool_caches_lock);
+
+    g_free(thread);
+}
+
+static struct wireless_simu_pool_cache *pool_cache_get(struct wireless_simu_pool *pool)
+{
+    struct wireless_simu_pool_thread *thread = g_private_get(&pool_thread_key);
+    struct wireless_simu_pool_cache *cache = NULL;
+
+    if (!thread)
+    {
+        thread = g_new0(struct wireless_simu_pool_thread, 1);
+        g_private_set(&pool_thread_key, thread);
+    }
+
+    for (int i = 0; i < POOL_THREAD_CACHES; i++)
+    {
+        uint32_t id = qatomic_read(&thread->caches[i].pool_id);
+
+        if (id == pool->id)
+            return &thread->caches[i];
+        if (!cache && !id)
+            cache = &thread->caches[i];
+    }
+
+    g_mutex_lock(&pool_caches_lock);
+    if (!cache)
+    {
+        cache = &thread->caches[thread->victim++ % POOL_THREAD_CACHES];
+        pool_cache_unbind(cache, true);
+    }
+    cache->pool = pool;
+    QLIST_INSERT_HEAD(&pool->caches, cache, link);
+    qatomic_set(&cache->pool_id, pool->id);
+    g_mutex_unlock(&pool_caches_lock);
+
+    return cache;
+}
+
+/* 只由所属线程调用 */
+static inline void pool_cache_count(struct wireless_simu_pool_cache *cache, uint32_t *counter)
+{
+    qatomic_set(counter, *counter + 1);
+    if (*counter >= POOL_CACHE_FLUSH)
+    {
+        g_mutex_lock(&pool_caches_lock);
+        pool_cache_flush_stats(cache);
+        g_mutex_unlock(&pool_caches_lock);
+    }
+}
+
+static int pool_class_of(size_t size)
+{
+    for (int i = 0; i < WIRELESS_SIMU_POOL_CLASSES; i++)
+    {
+        if (size <= pool_class_size[i])
+            return i;
+    }
+
+    return WIRELESS_SIMU_POOL_LARGE;
+}
+
+void wireless_simu_pool_init(struct wireless_simu_pool *pool)
+{
+    pool->id = qatomic_fetch_inc(&pool_next_id);
+    QLIST_INIT(&pool->caches);
+
+    for (int i = 0; i < WIRELESS_SIMU_POOL_CLASSES; i++)
+    {
+        pool->classes[i].size = pool_class_size[i];
+        QSLIST_INIT(&pool->classes[i].shared);
+        stat64_init(&pool->classes[i].allocs, 0);
+        stat64_init(&pool->classes[i].cache_hits, 0);
+        stat64_init(&pool->classes[i].refills, 0);
+        stat64_init(&pool->classes[i].mallocs, 0);
+    }
+    stat64_init(&pool->oversize, 0);
+}
+
+void wireless_simu_pool_destroy(struct wireless_simu_pool *pool)
+{
+    QSLIST_HEAD(, wireless_simu_pool_obj) list;
+    struct wireless_simu_pool_obj *obj;
+    struct wireless_simu_pool_cache *cache;
+
+    /* 所有线程中这个 pool 的缓存一起释放, 调用时已经没有线程在使用这个 pool */
+    g_mutex_lock(&pool_caches_lock);
+    while ((cache = QLIST_FIRST(&pool->caches)) != NULL)
+    {
+        pool_cache_unbind(cache, false);
+    }
+    g_mutex_unlock(&pool_caches_lock);
+
+    for (int i = 0; i < WIRELESS_SIMU_POOL_CLASSES; i++)
+    {
+        QSLIST_MOVE_ATOMIC(&list, &pool->classes[i].shared);
+        while ((obj = QSLIST_FIRST(&list)) != NULL)
+        {
+            QSLIST_REMOVE_HEAD(&list, next);
+            free(obj);
+        }
+    }
+}
+
+void *wireless_simu_pool_alloc(struct wireless_simu_pool *pool, size_t size)
+{
+    struct wireless_simu_pool_cache *cache;
+    struct wireless_simu_pool_class *cls;
+    struct wireless_simu_pool_obj *obj;
+    int id = pool_class_of(size);
+
+    if (id == WIRELESS_SIMU_POOL_LARGE)
+    {
+        stat64_add(&pool->oversize, 1);
+        obj = malloc(sizeof(*obj) + size);
+        if (!obj)
+            return NULL;
+        obj->class_id = WIRELESS_SIMU_POOL_LARGE;
+        return obj->data;
+    }
+
+    cls = &pool->classes[id];
+    cache = pool_cache_get(pool);
+    pool_cache_count(cache, &cache->allocs[id]);
+
+    obj = QSLIST_FIRST(&cache->free[id]);
+    if (obj)
+    {
+        pool_cache_count(cache, &cache->cache_hits[id]);
+    }
+    else if (qatomic_read(&cls->shared.slh_first))
+    {
+        /* 一次取走整个共享链表, 只有取走整条链表才不会有 ABA 问题 */
+        QSLIST_MOVE_ATOMIC(&cache->free[id], &cls->shared);
+        QSLIST_FOREACH(obj, &cache->free[id], next)
+        {
+            cache->count[id]++;
+        }
+
+        obj = QSLIST_FIRST(&cache->free[id]);
+        if (obj)
+        {
+            stat64_add(&cls->refills, 1);
+        }
+    }
+
+    if (obj)
+    {
+        QSLIST_REMOVE_HEAD(&cache->free[id], next);
+        cache->count[id]--;
+        return obj->data;
+    }
+
+    stat64_add(&cls->mallocs, 1);
+    obj = malloc(sizeof(*obj) + cls->size);
+    if (!obj)
+        return NULL;
+    obj->class_id = id;
+
+    return obj->data;
+}
+
+void wireless_simu_pool_free(struct wireless_simu_pool *pool, void *ptr)
+{
+    struct wireless_simu_pool_cache *cache;
+    struct wireless_simu_pool_obj *obj;
+
+    if (!ptr)
+        return;
+
+    obj = container_of(ptr, struct wireless_simu_pool_obj, data);
+    if (obj->class_id == WIRELESS_SIMU_POOL_LARGE)
+    {
+        free(obj);
+        return;
+    }
+
+    cache = pool_cache_get(pool);
+    if (cache->count[obj->class_id] < WIRELESS_SIMU_POOL_CACHE_MAX)
+    {
+        QSLIST_INSERT_HEAD(&cache->free[obj->class_id], obj, next);
+        cache->count[obj->class_id]++;
+        return;
+    }
+
+    QSLIST_INSERT_HEAD_ATOMIC(&pool->classes[obj->class_id].shared, obj, next);
+}
+
+void wireless_simu_pool_stats(struct wireless_simu_pool *pool, struct wireless_simu_pool_stats *stats)
+{
+    struct wireless_simu_pool_cache *cache;
+
+    memset(stats, 0, sizeof(*stats));
+
+    g_mutex_lock(&pool_caches_lock);
+    for (int i = 0; i < WIRELESS_SIMU_POOL_CLASSES; i++)
+    {
+        stats->allocs += stat64_get(&pool->classes[i].allocs);
+        stats->cache_hits += stat64_get(&pool->classes[i].cache_hits);
+        stats->refills += stat64_get(&pool->classes[i].refills);
+        stats->mallocs += stat64_get(&pool->classes[i].mallocs);
+
+        QLIST_FOREACH(cache, &pool->caches, link)
+        {
+            stats->allocs += qatomic_read(&cache->allocs[i]);
+            stats->cache_hits += qatomic_read(&cache->cache_hits[i]);
+        }
+    }
+    g_mutex_unlock(&pool_caches_lock);
+    stats->oversize = stat64_get(&pool->oversize);
+}
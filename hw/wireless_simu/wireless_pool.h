@@ -0,0 +1,94 @@
+#ifndef WIRELESS_SIMU_POOL
+#define WIRELESS_SIMU_POOL
+
+#include "wireless_simu.h"
+
+/* 数据面使用的对象池
+ *
+ * 按大小分为几个固定的类, 每个线程为最近使用的几个 pool 各缓存一小批空闲对象, 分配和释放大多不需要任何原子操作;
+ * 线程缓存空了之后一次性取走 pool 共享链表上的全部对象, 缓存满了之后释放到共享链表, 共享链表无锁.
+ * 分配次数和命中次数记在线程缓存中, 读取统计时再求和.
+ * 超过最大类大小的请求直接使用 malloc */
+
+enum wireless_simu_pool_class_id
+{
+    /* desc 和 wmi 命令 */
+    WIRELESS_SIMU_POOL_DESC,
+    /* 普通大小的帧 */
+    WIRELESS_SIMU_POOL_FRAME,
+    /* A-MSDU / jumbo 帧 */
+    WIRELESS_SIMU_POOL_JUMBO,
+    WIRELESS_SIMU_POOL_CLASSES,
+
+    /* 不属于任何类, 直接 malloc */
+    WIRELESS_SIMU_POOL_LARGE = WIRELESS_SIMU_POOL_CLASSES,
+};
+
+#define WIRELESS_SIMU_POOL_DESC_SIZE 256
+
+/* 帧总是和 sk_buff / 暂存队列 / 重排序队列的头部一起分配, 2 KB 的帧加上头部也要落在 FRAME 类中
+ * 各个头部的大小在 wireless_pool.c 中检查 */
+#define WIRELESS_SIMU_POOL_FRAME_HDR_MAX 256
+#define WIRELESS_SIMU_POOL_FRAME_SIZE (2048 + WIRELESS_SIMU_POOL_FRAME_HDR_MAX)
+#define WIRELESS_SIMU_POOL_JUMBO_SIZE (WIRELESS_TXRX_FRAME_MAX + WIRELESS_SIMU_POOL_FRAME_HDR_MAX)
+
+/* 每个线程每个类最多缓存的空闲对象数量 */
+#define WIRELESS_SIMU_POOL_CACHE_MAX 64
+
+struct wireless_simu_pool_obj;
+struct wireless_simu_pool_cache;
+
+struct wireless_simu_pool_class
+{
+    size_t size;
+
+    /* 各线程释放的对象, 通过 QSLIST_INSERT_HEAD_ATOMIC / QSLIST_MOVE_ATOMIC 访问 */
+    QSLIST_HEAD(, wireless_simu_pool_obj) shared;
+
+    /* 分配次数 / 命中线程缓存 / 从共享链表补充 / 新 malloc 的次数
+     * 前两项只包含已经从线程缓存合并过来的部分 */
+    Stat64 allocs;
+    Stat64 cache_hits;
+    Stat64 refills;
+    Stat64 mallocs;
+};
+
+struct wireless_simu_pool
+{
+    /* 全局唯一, 线程缓存用它判断缓存属于哪个 pool */
+    uint32_t id;
+
+    /* 绑定到这个 pool 的线程缓存 */
+    QLIST_HEAD(, wireless_simu_pool_cache) caches;
+
+    struct wireless_simu_pool_class classes[WIRELESS_SIMU_POOL_CLASSES];
+
+    /* 超过最大类大小的分配次数 */
+    Stat64 oversize;
+};
+
+void wireless_simu_pool_init(struct wireless_simu_pool *pool);
+
+/* 释放共享链表和所有线程缓存中的对象, 调用时不能再有线程使用这个 pool
+ * 线程退出或换出缓存时对象还给共享链表 */
+void wireless_simu_pool_destroy(struct wireless_simu_pool *pool);
+
+/* 分配至少 size 字节, 不会清零 */
+void *wireless_simu_pool_alloc(struct wireless_simu_pool *pool, size_t size);
+
+/* 释放 wireless_simu_pool_alloc 分配的内存, ptr 可以为 NULL */
+void wireless_simu_pool_free(struct wireless_simu_pool *pool, void *ptr);
+
+/* 所有类的统计之和, 供 qom 属性读取 */
+struct wireless_simu_pool_stats
+{
+    uint64_t allocs;
+    uint64_t cache_hits;
+    uint64_t refills;
+    uint64_t mallocs;
+    uint64_t oversize;
+};
+
+void wireless_simu_pool_stats(struct wireless_simu_pool *pool, struct wireless_simu_pool_stats *stats);
+
+#endif /* WIRELESS_SIMU_POOL */
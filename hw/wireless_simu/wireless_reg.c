@@ -20,6 +20,11 @@ void wireless_simu_write32(struct wireless_simu_device_state *wd, hwaddr addr, u
             wireless_simu_irq_lower(&wd->ws_irq);
     }
 
+    if (addr >= HAL_BASIC_REG(WIRELESS_REG_BASIC_RSS_CTRL) && addr < HAL_BASIC_REG(WIRELESS_REG_BASIC_RSS_END))
+    {
+        wireless_simu_rss_write(&wd->rss, addr >> 2, val);
+    }
+
     if (addr == HAL_BASIC_REG(WIRELESS_REG_BASIC_IRQ_ENABLE))
     {
         if (val)
@@ -34,6 +39,8 @@ void wireless_simu_write32(struct wireless_simu_device_state *wd, hwaddr addr, u
 uint32_t wireless_simu_read32(struct wireless_simu_device_state *wd, hwaddr addr)
 {
     if (addr == HAL_BASIC_REG(WIRELESS_REG_BASIC_IRQ_STATUS))
-        return wireless_simu_irq_statu(wd->ws_irq);
+        return wireless_simu_irq_statu(&wd->ws_irq);
+    if (addr >= HAL_BASIC_REG(WIRELESS_REG_BASIC_RSS_CTRL) && addr < HAL_BASIC_REG(WIRELESS_REG_BASIC_RSS_END))
+        return wireless_simu_rss_read(&wd->rss, addr >> 2);
     return 0;
 }
\ No newline at end of file
@@ -10,6 +10,9 @@
 /*
 * |-------- 16bit --------|---- 8 bit ----|- 1 bit -|--- 5 bit ---|- 2 bit -|
 * |          0001         |    ring_id    |  grp    |    reg      | 4 char  |*/
+/* R0 10/11/12 号寄存器为该 ring 的 msi 地址和数据, 只做记录, 中断由该 ring 所在组的 msi-x vector 发送 */
+/* R0 8/9 号寄存器为 src ring 的 hp shadow 地址, 配置之后 R2 0 号寄存器 (hp) 注册为 ioeventfd，
+ * 写入的值被忽略, 设备从 shadow 中读取 hp */
 
 /* 硬件基础地址，基础寄存器的高16bit为全零 */
 #define HAL_BASIC_BASE_REG 0x00000000
@@ -17,7 +20,12 @@
 enum HAL_ENUM_REG_BASIC{
     WIRELESS_REG_BASIC_IRQ_ENABLE = 1,
     WIRELESS_REG_BASIC_IRQ_STATUS,
-    
+
+    /* rss, 见 wireless_rss.h */
+    WIRELESS_REG_BASIC_RSS_CTRL = 16,
+    WIRELESS_REG_BASIC_RSS_KEY = 32,   /* 10 个寄存器 */
+    WIRELESS_REG_BASIC_RSS_INDIR = 64, /* 32 个寄存器 */
+    WIRELESS_REG_BASIC_RSS_END = WIRELESS_REG_BASIC_RSS_INDIR + 32,
 };
 
 void wireless_simu_write32(struct wireless_simu_device_state *wd, hwaddr addr, u_int32_t val);
@@ -0,0 +1,429 @@
+#include "wireless_simu.h"
+
+/* 802.11 帧头中发送地址 (addr2) 的位置 */
+#define IEEE80211_ADDR2_OFFSET 10
+#define IEEE80211_ADDR_LEN 6
+
+/* TID 到 AC 的映射, AC 的顺序和 WMI_PDEV_SET_REORDER_TIMEOUT_VAL_CMDID 一致: BE, BK, VI, VO */
+static const uint8_t reo_tid_to_ac[8] = {0, 1, 1, 0, 2, 2, 3, 3};
+
+static uint16_t reo_seq_sub(uint16_t a, uint16_t b)
+{
+    return (a - b) & WIRELESS_REO_SEQ_MASK;
+}
+
+static uint32_t reo_slot(struct wireless_reo_queue *queue, uint16_t seq)
+{
+    return seq & (queue->nslots - 1);
+}
+
+/* 把槽位中的帧交给数据通路, 带上之前累计的空洞 */
+static void reo_release_slot(struct wireless_simu_device_state *wd, struct wireless_reo_queue *queue, uint32_t slot)
+{
+    struct wireless_dp_frame *frame = queue->slots[slot];
+
+    clear_bit(slot, queue->bitmap);
+    queue->slots[slot] = NULL;
+    queue->held--;
+
+    frame->holes = MIN(queue->holes, HAL_REO_DST_INFO1_HOLES >> 16);
+    queue->holes = 0;
+
+    stat64_add(&wd->dp.reo.stats.released, 1);
+    wireless_dp_rx_release(wd, frame);
+}
+
+/* 从 ssn 开始交付连续的一段 */
+static void reo_release_run(struct wireless_simu_device_state *wd, struct wireless_reo_queue *queue)
+{
+    uint32_t slot;
+
+    while (queue->held && test_bit((slot = reo_slot(queue, queue->ssn)), queue->bitmap))
+    {
+        reo_release_slot(wd, queue, slot);
+        queue->ssn = (queue->ssn + 1) & WIRELESS_REO_SEQ_MASK;
+    }
+}
+
+/* 把窗口起点推到 ssn, 途中暂存的帧按序交付, 没有帧的序号记为空洞 */
+static void reo_advance(struct wireless_simu_device_state *wd, struct wireless_reo_queue *queue, uint16_t ssn)
+{
+    uint16_t n = reo_seq_sub(ssn, queue->ssn);
+    uint32_t slot;
+
+    while (n && queue->held)
+    {
+        slot = reo_slot(queue, queue->ssn);
+        if (test_bit(slot, queue->bitmap))
+        {
+            reo_release_slot(wd, queue, slot);
+        }
+        else
+        {
+            queue->holes++;
+            stat64_add(&wd->dp.reo.stats.holes, 1);
+        }
+        queue->ssn = (queue->ssn + 1) & WIRELESS_REO_SEQ_MASK;
+        n--;
+    }
+
+    /* 剩下的部分没有暂存的帧, 一次跳过 */
+    queue->holes += n;
+    stat64_add(&wd->dp.reo.stats.holes, n);
+    queue->ssn = ssn;
+}
+
+/* 放弃 ssn 处的空洞, 跳到下一个暂存的帧并继续交付 */
+static void reo_flush_hole(struct wireless_simu_device_state *wd, struct wireless_reo_queue *queue)
+{
+    for (uint16_t i = 1; i < queue->win_size; i++)
+    {
+        uint16_t seq = (queue->ssn + i) & WIRELESS_REO_SEQ_MASK;
+
+        if (test_bit(reo_slot(queue, seq), queue->bitmap))
+        {
+            reo_advance(wd, queue, seq);
+            break;
+        }
+    }
+
+    reo_release_run(wd, queue);
+}
+
+static void reo_timer_arm(struct wireless_simu_reo *reo, int64_t deadline_ms)
+{
+    if (reo->timer && !reo->stopped)
+    {
+        timer_mod_anticipate(reo->timer, deadline_ms);
+    }
+}
+
+static void reo_timer(void *opaque)
+{
+    struct wireless_simu_device_state *wd = opaque;
+    struct wireless_simu_reo *reo = &wd->dp.reo;
+    struct wireless_reo_queue *queue;
+    int64_t now = qemu_clock_get_ms(QEMU_CLOCK_VIRTUAL);
+    int64_t next = INT64_MAX;
+    int64_t deadline;
+    bool flushed = false;
+
+    qemu_mutex_lock(&wd->dp.rx_lock);
+    if (reo->stopped)
+    {
+        qemu_mutex_unlock(&wd->dp.rx_lock);
+        return;
+    }
+
+    for (int i = 0; i < WIRELESS_REO_PEER_MAX; i++)
+    {
+        if (!reo->peers[i].used)
+            continue;
+
+        for (int tid = 0; tid < WIRELESS_REO_TID_MAX; tid++)
+        {
+            queue = reo->peers[i].tids[tid];
+            if (!queue || !queue->held)
+                continue;
+
+            deadline = queue->hold_start_ms + reo->timeout_ms[queue->ac];
+            if (deadline <= now)
+            {
+                reo_flush_hole(wd, queue);
+                stat64_add(&reo->stats.timeouts, 1);
+                flushed = true;
+
+                /* 后面还有空洞, 重新计时 */
+                queue->hold_start_ms = now;
+                deadline = now + reo->timeout_ms[queue->ac];
+            }
+
+            if (queue->held)
+                next = MIN(next, deadline);
+        }
+    }
+
+    if (next != INT64_MAX)
+        timer_mod(reo->timer, next);
+    qemu_mutex_unlock(&wd->dp.rx_lock);
+
+    /* 交付的帧在 TID 队列中, 一次写入 REO dst ring */
+    if (flushed)
+        wireless_dp_rx_ring_handler(&wd->dp);
+}
+
+struct wireless_reo_queue *wireless_simu_reo_lookup(struct wireless_simu_device_state *wd, const uint8_t *frame,
+                                                     size_t len, uint8_t tid)
+{
+    struct wireless_simu_reo *reo = &wd->dp.reo;
+    const uint8_t *ta = frame + IEEE80211_ADDR2_OFFSET;
+
+    if (reo->npeers == 0 || tid >= WIRELESS_REO_TID_MAX || len < IEEE80211_ADDR2_OFFSET + IEEE80211_ADDR_LEN)
+        return NULL;
+
+    for (int i = 0; i < WIRELESS_REO_PEER_MAX; i++)
+    {
+        if (reo->peers[i].used && memcmp(reo->peers[i].mac, ta, IEEE80211_ADDR_LEN) == 0)
+            return reo->peers[i].tids[tid];
+    }
+
+    return NULL;
+}
+
+bool wireless_simu_reo_in_order(struct wireless_reo_queue *queue, uint16_t seq)
+{
+    if (!queue->synced)
+    {
+        queue->synced = true;
+        queue->ssn = seq;
+    }
+
+    if (queue->held || queue->holes || seq != queue->ssn)
+        return false;
+
+    queue->ssn = (queue->ssn + 1) & WIRELESS_REO_SEQ_MASK;
+    return true;
+}
+
+void wireless_simu_reo_rx(struct wireless_simu_device_state *wd, struct wireless_reo_queue *queue,
+                          struct wireless_dp_frame *frame)
+{
+    struct wireless_simu_reo *reo = &wd->dp.reo;
+    uint16_t delta = reo_seq_sub(frame->seq, queue->ssn);
+    uint16_t ssn = queue->ssn;
+    uint32_t slot;
+
+    /* 窗口之前的半个序号空间: 重传的或者过期的帧 */
+    if (delta >= WIRELESS_REO_SEQ_MODULO / 2)
+    {
+        stat64_add(&reo->stats.stale, 1);
+        wireless_simu_pool_free(&wd->pool, frame);
+        return;
+    }
+
+    /* 窗口之后: 窗口向前推到以这一帧结尾 */
+    if (delta >= queue->win_size)
+    {
+        reo_advance(wd, queue, (frame->seq - queue->win_size + 1) & WIRELESS_REO_SEQ_MASK);
+    }
+
+    slot = reo_slot(queue, frame->seq);
+    if (test_bit(slot, queue->bitmap))
+    {
+        stat64_add(&reo->stats.duplicate, 1);
+        wireless_simu_pool_free(&wd->pool, frame);
+        return;
+    }
+
+    queue->slots[slot] = frame;
+    set_bit(slot, queue->bitmap);
+    queue->held++;
+    if (frame->seq != queue->ssn)
+        stat64_add(&reo->stats.held, 1);
+
+    reo_release_run(wd, queue);
+
+    /* 开始等待新的空洞时计时 */
+    if (queue->held && (queue->held == 1 || queue->ssn != ssn))
+    {
+        queue->hold_start_ms = qemu_clock_get_ms(QEMU_CLOCK_VIRTUAL);
+        reo_timer_arm(reo, queue->hold_start_ms + reo->timeout_ms[queue->ac]);
+    }
+}
+
+/* 交付所有暂存的帧, 之后 ssn 停在最后一个交付的帧之后 */
+static void reo_release_all(struct wireless_simu_device_state *wd, struct wireless_reo_queue *queue)
+{
+    while (queue->held)
+    {
+        reo_flush_hole(wd, queue);
+    }
+}
+
+static struct wireless_reo_peer *reo_peer_get(struct wireless_simu_reo *reo, const uint8_t *mac, bool create)
+{
+    struct wireless_reo_peer *free_peer = NULL;
+
+    for (int i = 0; i < WIRELESS_REO_PEER_MAX; i++)
+    {
+        if (!reo->peers[i].used)
+        {
+            free_peer = free_peer ? free_peer : &reo->peers[i];
+            continue;
+        }
+        if (memcmp(reo->peers[i].mac, mac, IEEE80211_ADDR_LEN) == 0)
+            return &reo->peers[i];
+    }
+
+    if (!create || !free_peer)
+        return NULL;
+
+    memset(free_peer, 0, sizeof(*free_peer));
+    free_peer->used = true;
+    memcpy(free_peer->mac, mac, IEEE80211_ADDR_LEN);
+    reo->npeers++;
+    return free_peer;
+}
+
+int wireless_simu_reo_setup(struct wireless_simu_device_state *wd, const uint8_t *mac, uint32_t tid,
+                            uint32_t win_size)
+{
+    struct wireless_simu_reo *reo = &wd->dp.reo;
+    struct wireless_reo_peer *peer;
+    struct wireless_reo_queue *queue;
+    uint32_t nslots;
+    int ret = 0;
+
+    if (tid >= WIRELESS_REO_TID_MAX || win_size > WIRELESS_REO_WINDOW_MAX)
+        return -EINVAL;
+
+    win_size = win_size ? win_size : WIRELESS_REO_WINDOW_DEFAULT;
+    nslots = pow2ceil(win_size);
+    queue = calloc(1, sizeof(*queue) + nslots * sizeof(queue->slots[0]));
+    if (!queue)
+        return -ENOMEM;
+    queue->win_size = win_size;
+    queue->nslots = nslots;
+    queue->ac = reo_tid_to_ac[tid & 7];
+
+    qemu_mutex_lock(&wd->dp.rx_lock);
+
+    peer = reo->stopped ? NULL : reo_peer_get(reo, mac, true);
+    if (!peer)
+    {
+        ret = -ENOSPC;
+        free(queue);
+        goto out;
+    }
+
+    /* 窗口大小变化 (addba 重新协商) 时接着旧窗口的位置继续 */
+    if (peer->tids[tid])
+    {
+        reo_release_all(wd, peer->tids[tid]);
+        queue->synced = peer->tids[tid]->synced;
+        queue->ssn = peer->tids[tid]->ssn;
+        free(peer->tids[tid]);
+    }
+    peer->tids[tid] = queue;
+
+    printf("%s : reo setup peer %02x:%02x:%02x:%02x:%02x:%02x tid %u win %u \n", WIRELESS_SIMU_DEVICE_NAME,
+           mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], tid, win_size);
+
+out:
+    qemu_mutex_unlock(&wd->dp.rx_lock);
+    return ret;
+}
+
+/* 删除 peer 的部分队列, 全部删除之后释放 peer, 需持有 rx_lock */
+static void reo_peer_remove(struct wireless_simu_device_state *wd, struct wireless_reo_peer *peer, uint32_t tid_mask)
+{
+    bool empty = true;
+
+    for (int tid = 0; tid < WIRELESS_REO_TID_MAX; tid++)
+    {
+        if ((tid_mask & BIT(tid)) && peer->tids[tid])
+        {
+            reo_release_all(wd, peer->tids[tid]);
+            free(peer->tids[tid]);
+            peer->tids[tid] = NULL;
+        }
+        empty &= peer->tids[tid] == NULL;
+    }
+
+    if (empty)
+    {
+        peer->used = false;
+        wd->dp.reo.npeers--;
+    }
+}
+
+void wireless_simu_reo_remove(struct wireless_simu_device_state *wd, const uint8_t *mac, uint32_t tid_mask)
+{
+    struct wireless_simu_reo *reo = &wd->dp.reo;
+    struct wireless_reo_peer *peer;
+
+    qemu_mutex_lock(&wd->dp.rx_lock);
+    if (reo->stopped)
+    {
+        qemu_mutex_unlock(&wd->dp.rx_lock);
+        return;
+    }
+
+    if (mac)
+    {
+        peer = reo_peer_get(reo, mac, false);
+        if (peer)
+            reo_peer_remove(wd, peer, tid_mask);
+    }
+    else
+    {
+        for (int i = 0; i < WIRELESS_REO_PEER_MAX; i++)
+        {
+            if (reo->peers[i].used)
+                reo_peer_remove(wd, &reo->peers[i], tid_mask);
+        }
+    }
+    qemu_mutex_unlock(&wd->dp.rx_lock);
+}
+
+void wireless_simu_reo_set_timeout(struct wireless_simu_device_state *wd, uint32_t ac, uint32_t timeout_ms)
+{
+    if (ac >= WIRELESS_REO_AC_MAX)
+        return;
+
+    qemu_mutex_lock(&wd->dp.rx_lock);
+    wd->dp.reo.timeout_ms[ac] = timeout_ms;
+    qemu_mutex_unlock(&wd->dp.rx_lock);
+}
+
+void wireless_simu_reo_init(struct wireless_simu_device_state *wd, uint32_t timeout_ms, AioContext *ctx)
+{
+    struct wireless_simu_reo *reo = &wd->dp.reo;
+
+    memset(reo->peers, 0, sizeof(reo->peers));
+    reo->npeers = 0;
+    reo->stopped = false;
+    for (int ac = 0; ac < WIRELESS_REO_AC_MAX; ac++)
+    {
+        reo->timeout_ms[ac] = timeout_ms;
+    }
+
+    /* 和 srng 的中断合并定时器一样放在数据面的 AioContext 中 */
+    reo->timer = ctx ? aio_timer_new(ctx, QEMU_CLOCK_VIRTUAL, SCALE_MS, reo_timer, wd)
+                     : timer_new_ms(QEMU_CLOCK_VIRTUAL, reo_timer, wd);
+}
+
+void wireless_simu_reo_deinit(struct wireless_simu_device_state *wd)
+{
+    struct wireless_simu_reo *reo = &wd->dp.reo;
+    struct wireless_reo_queue *queue;
+
+    if (!reo->timer)
+        return;
+
+    qemu_mutex_lock(&wd->dp.rx_lock);
+    reo->stopped = true;
+    for (int i = 0; i < WIRELESS_REO_PEER_MAX; i++)
+    {
+        for (int tid = 0; reo->peers[i].used && tid < WIRELESS_REO_TID_MAX; tid++)
+        {
+            queue = reo->peers[i].tids[tid];
+            if (!queue)
+                continue;
+
+            for (uint32_t slot = 0; slot < queue->nslots; slot++)
+            {
+                wireless_simu_pool_free(&wd->pool, queue->slots[slot]);
+            }
+            free(queue);
+            reo->peers[i].tids[tid] = NULL;
+        }
+        reo->peers[i].used = false;
+    }
+    reo->npeers = 0;
+    qemu_mutex_unlock(&wd->dp.rx_lock);
+
+    /* stopped 之后定时器的回调不会再做任何事情 */
+    timer_free(reo->timer);
+    reo->timer = NULL;
+}
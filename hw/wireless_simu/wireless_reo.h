@@ -0,0 +1,125 @@
+#ifndef WIRELESS_SIMU_REO
+#define WIRELESS_SIMU_REO
+
+#include "wireless_simu.h"
+
+/* 接收重排序 (REO)
+ *
+ * 驱动通过 WMI_PEER_REORDER_QUEUE_SETUP_CMDID 为 peer (按发送地址 addr2 区分) 的每个 QoS TID 建立重排序队列,
+ * 队列维护 BlockAck 窗口: 窗口内提前到达的帧暂存在槽位中, 按序号连续的一段一次性交给数据通路的 TID 队列;
+ * 窗口之后的帧把窗口向前推, 跳过的序号作为空洞; 窗口之前的帧是重复或过期的, 丢弃.
+ * 暂存的帧超过所属 AC 的超时时间仍没有补齐时, 放弃空洞, 从下一个暂存的帧开始继续交付.
+ *
+ * 没有建立队列的 TID 和非 QoS 数据不做重排序 */
+
+/* 序号空间和最大窗口 (HE 256) */
+#define WIRELESS_REO_SEQ_MODULO 4096
+#define WIRELESS_REO_SEQ_MASK (WIRELESS_REO_SEQ_MODULO - 1)
+#define WIRELESS_REO_WINDOW_MAX 256
+
+/* 命令没有给出窗口时的大小, 等同于不聚合 */
+#define WIRELESS_REO_WINDOW_DEFAULT 1
+
+#define WIRELESS_REO_PEER_MAX WIRELESS_SIMU_WMI_PEERS_MAX
+#define WIRELESS_REO_TID_MAX 16
+
+/* 4 个 AC 的超时, 可以通过 WMI_PDEV_SET_REORDER_TIMEOUT_VAL_CMDID 修改 */
+#define WIRELESS_REO_AC_MAX 4
+#define WIRELESS_REO_TIMEOUT_MS 100
+
+/* 一个 (peer, TID) 的重排序窗口
+ *
+ * 槽位数量为窗口向上取整的 2 的幂, 序号 seq 的帧放在 seq & (nslots - 1);
+ * bitmap 中置位的槽位有帧, 窗口从 ssn 开始, 长度为 win_size */
+struct wireless_reo_queue
+{
+    /* 命令中没有起始序号, 窗口从收到的第一帧开始, 之前 synced 为 false */
+    bool synced;
+    uint16_t ssn;
+    uint16_t win_size;
+    uint16_t nslots;
+    uint8_t ac;
+
+    /* 暂存的帧数量, 以及最早一次开始等待空洞的时间 */
+    uint16_t held;
+    int64_t hold_start_ms;
+
+    /* 下一个交付的帧之前累计跳过的序号数量 */
+    uint32_t holes;
+
+    unsigned long bitmap[BITS_TO_LONGS(WIRELESS_REO_WINDOW_MAX)];
+    struct wireless_dp_frame *slots[];
+};
+
+struct wireless_reo_peer
+{
+    bool used;
+    uint8_t mac[6];
+    struct wireless_reo_queue *tids[WIRELESS_REO_TID_MAX];
+};
+
+/* 重排序统计, 通过 qom-get 读取 */
+struct wireless_reo_stats
+{
+    /* 进入窗口暂存的帧, 按序交付的帧 */
+    Stat64 held;
+    Stat64 released;
+
+    /* 窗口之前的帧 / 窗口内重复的帧 */
+    Stat64 stale;
+    Stat64 duplicate;
+
+    /* 跳过的序号总数, 以及因超时而放弃等待的次数 */
+    Stat64 holes;
+    Stat64 timeouts;
+};
+
+struct wireless_simu_reo
+{
+    struct wireless_reo_peer peers[WIRELESS_REO_PEER_MAX];
+
+    /* 建立了队列的 peer 数量, 为 0 时不需要查表 */
+    uint32_t npeers;
+
+    uint32_t timeout_ms[WIRELESS_REO_AC_MAX];
+
+    /* 超时定时器, 只在有暂存的帧时运行 */
+    QEMUTimer *timer;
+    bool stopped;
+
+    struct wireless_reo_stats stats;
+};
+
+/* realize 时调用, timeout_ms 为各个 AC 的默认超时 */
+void wireless_simu_reo_init(struct wireless_simu_device_state *wd, uint32_t timeout_ms, AioContext *ctx);
+
+/* 丢弃所有暂存的帧并释放定时器, 内部持有 dp->rx_lock */
+void wireless_simu_reo_deinit(struct wireless_simu_device_state *wd);
+
+/* 以下三个由 wmi 命令调用, 内部持有 dp->rx_lock, 交付的帧由调用者通过 wireless_dp_rx_ring_handler 发出 */
+
+/* 建立或重新建立 (peer, tid) 的队列, 重新建立时先按序交付暂存的帧 */
+int wireless_simu_reo_setup(struct wireless_simu_device_state *wd, const uint8_t *mac, uint32_t tid,
+                            uint32_t win_size);
+
+/* 删除 peer 的 tid_mask 中的队列, 暂存的帧按序交付; mac 为 NULL 时删除所有 peer */
+void wireless_simu_reo_remove(struct wireless_simu_device_state *wd, const uint8_t *mac, uint32_t tid_mask);
+
+/* 修改 ac 的超时时间 */
+void wireless_simu_reo_set_timeout(struct wireless_simu_device_state *wd, uint32_t ac, uint32_t timeout_ms);
+
+/* 以下在 dp->rx_lock 下调用 */
+
+/* 查找帧所属的队列, 没有建立队列时返回 NULL */
+struct wireless_reo_queue *wireless_simu_reo_lookup(struct wireless_simu_device_state *wd, const uint8_t *frame,
+                                                     size_t len, uint8_t tid);
+
+/* 队列中没有暂存的帧并且 seq 正好是窗口起点 (或者是队列收到的第一帧), 可以不经过窗口直接交付,
+ * 此时推进窗口并返回 true */
+bool wireless_simu_reo_in_order(struct wireless_reo_queue *queue, uint16_t seq);
+
+/* 帧进入窗口, 之后 frame 归重排序所有, 可交付的帧通过 wireless_dp_rx_release 交给数据通路 */
+void wireless_simu_reo_rx(struct wireless_simu_device_state *wd, struct wireless_reo_queue *queue,
+                          struct wireless_dp_frame *frame);
+
+#endif /* WIRELESS_SIMU_REO */
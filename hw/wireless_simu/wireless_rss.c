@@ -0,0 +1,196 @@
+#include "wireless_simu.h"
+#include "net/checksum.h"
+#include "net/eth.h"
+
+/* 802.11 帧头中用到的字段 */
+#define IEEE80211_FCTL_FTYPE 0x000c
+#define IEEE80211_FTYPE_DATA 0x0008
+#define IEEE80211_STYPE_QOS_DATA 0x0080
+#define IEEE80211_FCTL_TODS 0x0100
+#define IEEE80211_FCTL_FROMDS 0x0200
+#define IEEE80211_FCTL_PROTECTED 0x4000
+#define IEEE80211_FCTL_ORDER 0x8000
+
+#define IEEE80211_HDR_LEN 24
+#define IEEE80211_ADDR_LEN 6
+
+/* LLC/SNAP 头, 最后 2 byte 为 ethertype */
+#define WIRELESS_SIMU_LLC_SNAP_LEN 8
+static const uint8_t rfc1042_header[] = {0xaa, 0xaa, 0x03, 0x00, 0x00, 0x00};
+
+/* 常用的默认 Toeplitz key */
+static const uint8_t rss_default_key[WIRELESS_SIMU_RSS_KEY_SIZE] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+    0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+    0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+    0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+    0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+
+void wireless_simu_rss_init(struct wireless_simu_rss *rss)
+{
+    rss->ctrl = 0;
+    memcpy(rss->key, rss_default_key, sizeof(rss->key));
+
+    /* 和寄存器写入一样按 le32 保存, entry i 在第 i / 4 个字的第 (i % 4) * 8 位 */
+    for (uint32_t w = 0; w < WIRELESS_SIMU_RSS_INDIR_WORDS; w++)
+    {
+        uint32_t i = w * 4;
+
+        rss->indir[w] = cpu_to_le32(i | (i + 1) << 8 | (i + 2) << 16 | (i + 3) << 24);
+    }
+}
+
+void wireless_simu_rss_write(struct wireless_simu_rss *rss, uint32_t reg, uint32_t val)
+{
+    if (reg == WIRELESS_REG_BASIC_RSS_CTRL)
+    {
+        qatomic_set(&rss->ctrl, val);
+    }
+    else if (reg >= WIRELESS_REG_BASIC_RSS_KEY && reg < WIRELESS_REG_BASIC_RSS_KEY + WIRELESS_SIMU_RSS_KEY_WORDS)
+    {
+        qatomic_set(&rss->key[reg - WIRELESS_REG_BASIC_RSS_KEY], cpu_to_le32(val));
+    }
+    else if (reg >= WIRELESS_REG_BASIC_RSS_INDIR && reg < WIRELESS_REG_BASIC_RSS_INDIR + WIRELESS_SIMU_RSS_INDIR_WORDS)
+    {
+        qatomic_set(&rss->indir[reg - WIRELESS_REG_BASIC_RSS_INDIR], cpu_to_le32(val));
+    }
+}
+
+uint32_t wireless_simu_rss_read(struct wireless_simu_rss *rss, uint32_t reg)
+{
+    if (reg == WIRELESS_REG_BASIC_RSS_CTRL)
+    {
+        return qatomic_read(&rss->ctrl);
+    }
+    else if (reg >= WIRELESS_REG_BASIC_RSS_KEY && reg < WIRELESS_REG_BASIC_RSS_KEY + WIRELESS_SIMU_RSS_KEY_WORDS)
+    {
+        return le32_to_cpu(qatomic_read(&rss->key[reg - WIRELESS_REG_BASIC_RSS_KEY]));
+    }
+    else if (reg >= WIRELESS_REG_BASIC_RSS_INDIR && reg < WIRELESS_REG_BASIC_RSS_INDIR + WIRELESS_SIMU_RSS_INDIR_WORDS)
+    {
+        return le32_to_cpu(qatomic_read(&rss->indir[reg - WIRELESS_REG_BASIC_RSS_INDIR]));
+    }
+
+    return 0;
+}
+
+/* 从 802.11 数据帧中取出 hash 的输入, 返回输入长度, 无法解析时返回 0
+ *
+ * 输入的顺序为 源地址, 目的地址, 源端口, 目的端口 */
+static size_t rss_parse_frame(uint32_t ctrl, const uint8_t *frame, size_t len, uint8_t *input)
+{
+    uint16_t fc;
+    size_t hdr_len = IEEE80211_HDR_LEN;
+    const uint8_t *payload;
+    size_t payload_len;
+    uint16_t ethertype;
+    size_t ip_len = 0, l4_off = 0;
+    uint8_t l4_proto = 0;
+    size_t n = 0;
+
+    if (len < IEEE80211_HDR_LEN)
+        return 0;
+
+    fc = lduw_le_p(frame);
+    if ((fc & IEEE80211_FCTL_FTYPE) != IEEE80211_FTYPE_DATA)
+        return 0;
+
+    if ((fc & (IEEE80211_FCTL_TODS | IEEE80211_FCTL_FROMDS)) == (IEEE80211_FCTL_TODS | IEEE80211_FCTL_FROMDS))
+        hdr_len += IEEE80211_ADDR_LEN;
+    if (fc & IEEE80211_STYPE_QOS_DATA)
+    {
+        hdr_len += 2;
+        if (fc & IEEE80211_FCTL_ORDER)
+            hdr_len += 4;
+    }
+
+    /* 加密帧看不到 LLC 之后的内容 */
+    if ((fc & IEEE80211_FCTL_PROTECTED) || len < hdr_len + WIRELESS_SIMU_LLC_SNAP_LEN ||
+        memcmp(frame + hdr_len, rfc1042_header, sizeof(rfc1042_header)))
+        goto mac;
+
+    ethertype = lduw_be_p(frame + hdr_len + sizeof(rfc1042_header));
+    payload = frame + hdr_len + WIRELESS_SIMU_LLC_SNAP_LEN;
+    payload_len = len - hdr_len - WIRELESS_SIMU_LLC_SNAP_LEN;
+
+    switch (ethertype)
+    {
+    case ETH_P_IP:
+        if (payload_len < 20 || (payload[0] >> 4) != 4)
+            goto mac;
+        ip_len = (payload[0] & 0xf) << 2;
+        memcpy(input, payload + 12, 8);
+        n = 8;
+        /* 分片之后的报文没有 L4 头 */
+        if ((lduw_be_p(payload + 6) & 0x3fff) == 0)
+        {
+            l4_proto = payload[9];
+            l4_off = ip_len;
+        }
+        break;
+    case ETH_P_IPV6:
+        if (payload_len < 40 || (payload[0] >> 4) != 6)
+            goto mac;
+        memcpy(input, payload + 8, 32);
+        n = 32;
+        /* 不展开扩展头 */
+        l4_proto = payload[6];
+        l4_off = 40;
+        break;
+    default:
+        goto mac;
+    }
+
+    if ((ctrl & WIRELESS_SIMU_RSS_CTRL_L4) && (l4_proto == IP_PROTO_TCP || l4_proto == IP_PROTO_UDP) &&
+        payload_len >= l4_off + 4)
+    {
+        memcpy(input + n, payload + l4_off, 4);
+        n += 4;
+    }
+
+    return n;
+
+mac:
+    if (!(ctrl & WIRELESS_SIMU_RSS_CTRL_MAC))
+        return 0;
+
+    /* addr2 为发送方, addr3 为 bssid 或源地址 */
+    memcpy(input, frame + 10, IEEE80211_ADDR_LEN * 2);
+    return IEEE80211_ADDR_LEN * 2;
+}
+
+bool wireless_simu_rss_hash(struct wireless_simu_rss *rss, const uint8_t *frame, size_t len, uint32_t *hash)
+{
+    uint32_t ctrl = qatomic_read(&rss->ctrl);
+    uint32_t key[WIRELESS_SIMU_RSS_KEY_WORDS];
+    uint8_t input[WIRELESS_SIMU_RSS_KEY_SIZE - 4];
+    net_toeplitz_key toeplitz_key;
+    size_t n;
+
+    if (!(ctrl & WIRELESS_SIMU_RSS_CTRL_EN))
+        return false;
+
+    *hash = 0;
+    n = rss_parse_frame(ctrl, frame, len, input);
+    if (n == 0)
+        return true;
+
+    for (int i = 0; i < WIRELESS_SIMU_RSS_KEY_WORDS; i++)
+    {
+        key[i] = qatomic_read(&rss->key[i]);
+    }
+
+    net_toeplitz_key_init(&toeplitz_key, (uint8_t *)key);
+    net_toeplitz_add(hash, input, n, &toeplitz_key);
+
+    return true;
+}
+
+uint32_t wireless_simu_rss_queue(struct wireless_simu_rss *rss, uint32_t hash, uint32_t queues)
+{
+    uint32_t index = hash % WIRELESS_SIMU_RSS_INDIR_SIZE;
+    uint32_t word = le32_to_cpu(qatomic_read(&rss->indir[index / 4]));
+
+    return ((word >> ((index % 4) * 8)) & 0xff) % queues;
+}
@@ -0,0 +1,48 @@
+#ifndef WIRELESS_SIMU_RSS
+#define WIRELESS_SIMU_RSS
+
+#include "wireless_simu.h"
+
+/* 接收方向的 rss
+ *
+ * 对收到的 802.11 帧按 LLC/SNAP 之后的 IP / L4 元组计算 Toeplitz hash,
+ * 再通过驱动配置的间接表选出接收的 pipe, hash 同时写入 ce dst status 的 toeplitz_hash0 */
+
+/* Toeplitz key 长度, 足够覆盖 ipv6 4 元组 (36 byte) */
+#define WIRELESS_SIMU_RSS_KEY_SIZE 40
+#define WIRELESS_SIMU_RSS_KEY_WORDS (WIRELESS_SIMU_RSS_KEY_SIZE / 4)
+
+/* 间接表, 每个 entry 一个 byte, 一个寄存器存放 4 个 entry */
+#define WIRELESS_SIMU_RSS_INDIR_SIZE 128
+#define WIRELESS_SIMU_RSS_INDIR_WORDS (WIRELESS_SIMU_RSS_INDIR_SIZE / 4)
+
+/* WIRELESS_REG_BASIC_RSS_CTRL 中的位 */
+#define WIRELESS_SIMU_RSS_CTRL_EN BIT(0)
+/* hash 中加入 tcp / udp 端口 */
+#define WIRELESS_SIMU_RSS_CTRL_L4 BIT(1)
+/* 非 ip 帧按 802.11 地址 (addr2 / addr3) 计算 hash, 否则 hash 为 0 */
+#define WIRELESS_SIMU_RSS_CTRL_MAC BIT(2)
+
+struct wireless_simu_rss
+{
+    uint32_t ctrl;
+
+    /* 按寄存器写入的原样保存, 以 byte 顺序使用 */
+    uint32_t key[WIRELESS_SIMU_RSS_KEY_WORDS];
+    uint32_t indir[WIRELESS_SIMU_RSS_INDIR_WORDS];
+};
+
+/* 默认 key 和间接表, 驱动不配置时也能分散 */
+void wireless_simu_rss_init(struct wireless_simu_rss *rss);
+
+/* rss 寄存器的读写, reg 为基础寄存器的编号 */
+void wireless_simu_rss_write(struct wireless_simu_rss *rss, uint32_t reg, uint32_t val);
+uint32_t wireless_simu_rss_read(struct wireless_simu_rss *rss, uint32_t reg);
+
+/* 计算一帧的 hash, rss 未开启时返回 false */
+bool wireless_simu_rss_hash(struct wireless_simu_rss *rss, const uint8_t *frame, size_t len, uint32_t *hash);
+
+/* 按 hash 查间接表, 返回 0 ~ queues - 1 的 pipe 编号 */
+uint32_t wireless_simu_rss_queue(struct wireless_simu_rss *rss, uint32_t hash, uint32_t queues);
+
+#endif /* WIRELESS_SIMU_RSS */
@@ -0,0 +1,399 @@
+#include "wireless_simu.h"
+
+#define WIRELESS_SHM_MAGIC 0x57534d31 /* "WSM1" */
+
+/* 共享内存布局变化时加一 */
+#define WIRELESS_SHM_VERSION 1
+
+/* 取出 rx ring 中所有的帧, 直接在共享内存中交给上层, 处理完才归还 slot */
+static bool shm_ring_drain(struct wireless_shm_medium *m)
+{
+    struct wireless_shm_ring *ring = m->rx;
+    struct wireless_shm_slot *slot;
+    uint32_t tail = ring->hdr.tail;
+    uint32_t head = qatomic_load_acquire(&ring->hdr.head);
+    uint32_t len;
+
+    if (tail == head)
+        return false;
+
+    /* 对端写入的 head 不可信, 超过一圈说明共享内存已经损坏, 丢弃这些 slot */
+    if (head - tail > WIRELESS_SHM_RING_SLOTS)
+    {
+        printf("%s : shm medium rx ring corrupted head %u tail %u \n", WIRELESS_SIMU_DEVICE_NAME, head, tail);
+        qatomic_store_release(&ring->hdr.tail, head);
+        return false;
+    }
+
+    while (tail != head)
+    {
+        slot = &ring->slots[tail % WIRELESS_SHM_RING_SLOTS];
+
+        /* 对端可以随意改写共享内存, 长度需要检查 */
+        len = qatomic_read(&slot->len);
+        if (len <= sizeof(slot->data) && m->rx_handler)
+        {
+            m->rx_handler(slot->data, len, m->opaque);
+        }
+        else
+        {
+            printf("%s : shm medium rx bad len %u \n", WIRELESS_SIMU_DEVICE_NAME, len);
+        }
+
+        tail++;
+        qatomic_store_release(&ring->hdr.tail, tail);
+    }
+
+    return true;
+}
+
+static void shm_medium_rx_ready(EventNotifier *e)
+{
+    struct wireless_shm_medium *m = container_of(e, struct wireless_shm_medium, rx_notify);
+    struct wireless_shm_ring *ring = m->rx;
+
+    event_notifier_test_and_clear(e);
+
+    for (;;)
+    {
+        while (shm_ring_drain(m))
+        {
+        }
+
+        /* 先声明进入等待再检查一次, 和生产者的 smp_mb 配对, 不会漏掉唤醒 */
+        qatomic_set(&ring->hdr.need_wakeup, 1);
+        smp_mb();
+        if (ring->hdr.tail == qatomic_read(&ring->hdr.head))
+            break;
+        qatomic_set(&ring->hdr.need_wakeup, 0);
+    }
+}
+
+int wireless_shm_medium_send(struct wireless_shm_medium *m, const void *data, size_t len)
+{
+    struct wireless_shm_ring *ring = m->tx;
+    struct wireless_shm_slot *slot;
+    uint32_t head;
+
+    if (len > sizeof(slot->data))
+        return -EMSGSIZE;
+
+    qemu_mutex_lock(&m->tx_lock);
+
+    head = ring->hdr.head;
+    if (head - qatomic_load_acquire(&ring->hdr.tail) >= WIRELESS_SHM_RING_SLOTS)
+    {
+        qemu_mutex_unlock(&m->tx_lock);
+        return -ENOBUFS;
+    }
+
+    slot = &ring->slots[head % WIRELESS_SHM_RING_SLOTS];
+    memcpy(slot->data, data, len);
+    qatomic_set(&slot->len, len);
+    qatomic_store_release(&ring->hdr.head, head + 1);
+
+    qemu_mutex_unlock(&m->tx_lock);
+
+    /* 对端在等待时才需要系统调用 */
+    smp_mb();
+    if (qatomic_read(&ring->hdr.need_wakeup) && qatomic_xchg(&ring->hdr.need_wakeup, 0))
+    {
+        event_notifier_set(&m->tx_notify);
+    }
+
+    return 0;
+}
+
+static void shm_medium_stop_listen(struct wireless_shm_medium *m)
+{
+    if (!m->listener)
+        return;
+
+    qemu_set_fd_handler(m->listener->fd, NULL, NULL, NULL);
+    object_unref(OBJECT(m->listener));
+    m->listener = NULL;
+    unlink(m->path);
+}
+
+/* 主循环中处理对端的连接, 把 memfd 和两个 eventfd 交给对端, 之后不再需要这个连接
+ * socket 都是非阻塞的, 握手只有一个 magic, 一次发送不完说明对端有问题, 直接断开 */
+static void shm_medium_accept(void *opaque)
+{
+    struct wireless_shm_medium *m = opaque;
+    QIOChannelSocket *cioc;
+    Error *err = NULL;
+    ssize_t ret;
+    uint32_t magic = WIRELESS_SHM_MAGIC;
+    struct iovec iov = {.iov_base = &magic, .iov_len = sizeof(magic)};
+    int fds[3] = {
+        m->memfd,
+        /* 对端的 tx 唤醒本端的 rx, 反之亦然 */
+        event_notifier_get_fd(&m->rx_notify),
+        event_notifier_get_fd(&m->tx_notify),
+    };
+
+    cioc = qio_channel_socket_accept(m->listener, &err);
+    if (!cioc)
+    {
+        warn_report_err(err);
+        return;
+    }
+
+    qio_channel_set_blocking(QIO_CHANNEL(cioc), false, NULL);
+    ret = qio_channel_writev_full(QIO_CHANNEL(cioc), &iov, 1, fds, ARRAY_SIZE(fds), 0, &err);
+    object_unref(OBJECT(cioc));
+    if (ret != sizeof(magic))
+    {
+        if (ret < 0 && err)
+            warn_report_err(err);
+        else
+            warn_report("%s: shm medium handshake to peer on %s failed", WIRELESS_SIMU_DEVICE_NAME, m->path);
+        return;
+    }
+
+    printf("%s : shm medium peer attached on %s \n", WIRELESS_SIMU_DEVICE_NAME, m->path);
+
+    /* 介质是点对点的, 之后的设备重新组成一对 */
+    shm_medium_stop_listen(m);
+}
+
+static int shm_medium_listen(struct wireless_shm_medium *m, SocketAddress *addr, Error **errp)
+{
+    m->region = qemu_memfd_alloc("wirelesssimu-medium", sizeof(*m->region), 0, &m->memfd, errp);
+    if (!m->region)
+        return -ENOMEM;
+    memset(m->region, 0, sizeof(*m->region));
+    m->region->magic = WIRELESS_SHM_MAGIC;
+    m->region->version = WIRELESS_SHM_VERSION;
+
+    if (event_notifier_init(&m->tx_notify, 0) || event_notifier_init(&m->rx_notify, 0))
+    {
+        error_setg(errp, "failed to create shm medium eventfd");
+        return -EIO;
+    }
+
+    m->tx = &m->region->rings[0];
+    m->rx = &m->region->rings[1];
+
+    m->listener = qio_channel_socket_new();
+    if (qio_channel_socket_listen_sync(m->listener, addr, 1, errp) < 0)
+    {
+        object_unref(OBJECT(m->listener));
+        m->listener = NULL;
+        return -EIO;
+    }
+    qio_channel_set_blocking(QIO_CHANNEL(m->listener), false, NULL);
+    qemu_set_fd_handler(m->listener->fd, shm_medium_accept, NULL, m);
+
+    printf("%s : shm medium listen on %s \n", WIRELESS_SIMU_DEVICE_NAME, m->path);
+    return 0;
+}
+
+static int shm_medium_connect(struct wireless_shm_medium *m, QIOChannelSocket *sioc, Error **errp)
+{
+    uint32_t magic = 0;
+    struct iovec iov = {.iov_base = &magic, .iov_len = sizeof(magic)};
+    int *fds = NULL;
+    size_t nfds = 0;
+    struct wireless_shm_region *region;
+    struct stat st;
+    int ret = -EIO;
+
+    if (qio_channel_readv_full_all(QIO_CHANNEL(sioc), &iov, 1, &fds, &nfds, errp) < 0)
+        return -EIO;
+
+    if (magic != WIRELESS_SHM_MAGIC || nfds != 3)
+    {
+        error_setg(errp, "bad shm medium handshake from %s", m->path);
+        goto out;
+    }
+
+    /* memfd 比布局小时访问超出的部分会 SIGBUS */
+    if (fstat(fds[0], &st) < 0 || st.st_size < sizeof(*region))
+    {
+        error_setg(errp, "shm medium from %s is too small", m->path);
+        goto out;
+    }
+
+    region = mmap(NULL, sizeof(*region), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    if (region == MAP_FAILED)
+    {
+        error_setg_errno(errp, errno, "failed to map shm medium");
+        goto out;
+    }
+
+    if (region->magic != WIRELESS_SHM_MAGIC || region->version != WIRELESS_SHM_VERSION)
+    {
+        error_setg(errp, "shm medium from %s has magic %08x version %u, expected %08x version %u", m->path,
+                   region->magic, region->version, WIRELESS_SHM_MAGIC, WIRELESS_SHM_VERSION);
+        munmap(region, sizeof(*region));
+        goto out;
+    }
+
+    m->region = region;
+    m->memfd = fds[0];
+    event_notifier_init_fd(&m->tx_notify, fds[1]);
+    event_notifier_init_fd(&m->rx_notify, fds[2]);
+    nfds = 0;
+
+    m->tx = &m->region->rings[1];
+    m->rx = &m->region->rings[0];
+
+    printf("%s : shm medium connected to %s \n", WIRELESS_SIMU_DEVICE_NAME, m->path);
+    ret = 0;
+
+out:
+    for (size_t i = 0; i < nfds; i++)
+    {
+        close(fds[i]);
+    }
+    g_free(fds);
+    return ret;
+}
+
+/* 连接对端监听的 socket, 返回 fd 或者负的 errno */
+static int shm_medium_try_connect(const char *path)
+{
+    struct sockaddr_un un = {.sun_family = AF_UNIX};
+    int fd, ret;
+
+    if (strlen(path) >= sizeof(un.sun_path))
+        return -ENAMETOOLONG;
+    pstrcpy(un.sun_path, sizeof(un.sun_path), path);
+
+    fd = qemu_socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -errno;
+
+    do
+    {
+        ret = connect(fd, (struct sockaddr *)&un, sizeof(un)) < 0 ? -errno : 0;
+    } while (ret == -EINTR);
+
+    if (ret)
+    {
+        close(fd);
+        return ret;
+    }
+
+    return fd;
+}
+
+int wireless_shm_medium_open(struct wireless_shm_medium *m, const char *path, AioContext *ctx,
+                             void (*rx_handler)(void *data, size_t len, void *opaque), void *opaque,
+                             Error **errp)
+{
+    SocketAddress addr = {
+        .type = SOCKET_ADDRESS_TYPE_UNIX,
+        .u.q_unix.path = (char *)path,
+    };
+    QIOChannelSocket *sioc;
+    int fd, ret;
+
+    memset(m, 0, sizeof(*m));
+    m->memfd = -1;
+    m->path = g_strdup(path);
+    m->ctx = ctx;
+    m->rx_handler = rx_handler;
+    m->opaque = opaque;
+    qemu_mutex_init(&m->tx_lock);
+
+    /* 能连上说明对端已经在监听, 否则自己监听 */
+    fd = shm_medium_try_connect(path);
+    if (fd >= 0)
+    {
+        sioc = qio_channel_socket_new_fd(fd, errp);
+        if (sioc)
+        {
+            ret = shm_medium_connect(m, sioc, errp);
+            object_unref(OBJECT(sioc));
+        }
+        else
+        {
+            close(fd);
+            ret = -EIO;
+        }
+    }
+    else if (fd == -ENOENT || fd == -ECONNREFUSED)
+    {
+        /* 文件还在但没有人监听, 是崩溃的 QEMU 留下的, 删除之后再监听 */
+        if (fd == -ECONNREFUSED && unlink(path) < 0 && errno != ENOENT)
+        {
+            error_setg_errno(errp, errno, "failed to remove stale shm medium socket %s", path);
+            ret = -EIO;
+        }
+        else
+        {
+            ret = shm_medium_listen(m, &addr, errp);
+        }
+    }
+    else
+    {
+        error_setg_errno(errp, -fd, "failed to connect to shm medium %s", path);
+        ret = -EIO;
+    }
+
+    if (ret)
+    {
+        wireless_shm_medium_close(m);
+        return ret;
+    }
+
+    /* 初始时认为对端在等待, 第一帧一定会唤醒 */
+    qatomic_set(&m->tx->hdr.need_wakeup, 1);
+
+    if (ctx)
+    {
+        aio_set_event_notifier(ctx, &m->rx_notify, shm_medium_rx_ready, NULL, NULL);
+    }
+    else
+    {
+        event_notifier_set_handler(&m->rx_notify, shm_medium_rx_ready);
+    }
+    m->attached = true;
+
+    /* 打开之前对端可能已经写入了数据 */
+    event_notifier_set(&m->rx_notify);
+
+    return 0;
+}
+
+static void shm_medium_detach(void *opaque)
+{
+    struct wireless_shm_medium *m = opaque;
+
+    aio_set_event_notifier(m->ctx, &m->rx_notify, NULL, NULL, NULL);
+}
+
+void wireless_shm_medium_close(struct wireless_shm_medium *m)
+{
+    shm_medium_stop_listen(m);
+
+    if (m->attached && m->ctx)
+    {
+        aio_wait_bh_oneshot(m->ctx, shm_medium_detach, m);
+    }
+    else if (m->attached)
+    {
+        event_notifier_set_handler(&m->rx_notify, NULL);
+    }
+    m->attached = false;
+
+    event_notifier_cleanup(&m->tx_notify);
+    event_notifier_cleanup(&m->rx_notify);
+
+    if (m->region)
+    {
+        munmap(m->region, sizeof(*m->region));
+        m->region = NULL;
+    }
+    if (m->memfd >= 0)
+    {
+        close(m->memfd);
+        m->memfd = -1;
+    }
+
+    qemu_mutex_destroy(&m->tx_lock);
+    g_free(m->path);
+    m->path = NULL;
+}
@@ -0,0 +1,87 @@
+#ifndef WIRELESS_SIMU_SHM
+#define WIRELESS_SIMU_SHM
+
+#include "wireless_simu.h"
+
+/* 共享内存介质
+ *
+ * 同一台机器上的两个设备通过一块 memfd 交换帧, 每个方向一个单生产者单消费者的 ring,
+ * 每个 ring 配一个 eventfd. 消费者处理完所有帧之后才置位 need_wakeup 进入等待, 生产者只在
+ * need_wakeup 置位时写 eventfd, 所以持续收发时没有任何系统调用.
+ *
+ * 先启动的设备在 path 上监听, 创建 memfd 和 eventfd; 后启动的设备连接 path,
+ * 通过 unix socket 的 SCM_RIGHTS 拿到这三个 fd. */
+
+#define WIRELESS_SHM_RING_SLOTS 64
+
+/* 未指定 path 时使用 $XDG_RUNTIME_DIR 下的这个文件, 没有 $XDG_RUNTIME_DIR 时必须指定 path */
+#define WIRELESS_SHM_DEFAULT_NAME "wirelesssimu-medium.sock"
+
+struct wireless_shm_ring_hdr
+{
+    /* 生产者写入的序号 */
+    uint32_t head QEMU_ALIGNED(64);
+
+    /* 消费者处理完的序号 */
+    uint32_t tail QEMU_ALIGNED(64);
+
+    /* 消费者进入等待, 需要 eventfd 唤醒 */
+    uint32_t need_wakeup QEMU_ALIGNED(64);
+};
+
+struct wireless_shm_slot
+{
+    uint32_t len;
+    uint8_t data[WIRELESS_TXRX_FRAME_MAX];
+};
+
+struct wireless_shm_ring
+{
+    struct wireless_shm_ring_hdr hdr;
+    struct wireless_shm_slot slots[WIRELESS_SHM_RING_SLOTS];
+};
+
+/* memfd 中的布局, 监听方发送使用 rings[0], 连接方发送使用 rings[1] */
+struct wireless_shm_region
+{
+    uint32_t magic;
+    uint32_t version;
+    struct wireless_shm_ring rings[2] QEMU_ALIGNED(64);
+};
+
+struct wireless_shm_medium
+{
+    struct wireless_shm_region *region;
+    int memfd;
+
+    struct wireless_shm_ring *tx;
+    struct wireless_shm_ring *rx;
+
+    /* tx_notify 唤醒对端, rx_notify 由对端唤醒本端 */
+    EventNotifier tx_notify;
+    EventNotifier rx_notify;
+
+    /* 监听方等待对端连接 */
+    QIOChannelSocket *listener;
+    char *path;
+
+    /* 多个 srng 线程会同时发送, ring 只有一个生产者 */
+    QemuMutex tx_lock;
+
+    AioContext *ctx;
+    bool attached;
+    void (*rx_handler)(void *data, size_t len, void *opaque);
+    void *opaque;
+};
+
+/* 打开介质, ctx 为 NULL 时在主循环中接收 */
+int wireless_shm_medium_open(struct wireless_shm_medium *m, const char *path, AioContext *ctx,
+                             void (*rx_handler)(void *data, size_t len, void *opaque), void *opaque,
+                             Error **errp);
+
+/* 发送一帧, ring 已满时返回 -ENOBUFS */
+int wireless_shm_medium_send(struct wireless_shm_medium *m, const void *data, size_t len);
+
+void wireless_shm_medium_close(struct wireless_shm_medium *m);
+
+#endif /* WIRELESS_SIMU_SHM */
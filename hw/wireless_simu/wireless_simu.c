@@ -19,22 +19,66 @@ static const struct MemoryRegionOps wireless_simu_mmio_ops = {
     .endianness = DEVICE_LITTLE_ENDIAN,
 };
 
+/* 未设置 mac 时按创建顺序生成本地管理地址 02:57:53:00:xx:xx */
+static void wireless_simu_mac_default(struct wireless_simu_device_state *wd)
+{
+    static const MACAddr zero = {0};
+    static uint32_t index;
+    uint32_t n;
+
+    if (memcmp(&wd->mac, &zero, sizeof(zero)))
+        return;
+
+    n = qatomic_fetch_inc(&index);
+    wd->mac.a[0] = 0x02;
+    wd->mac.a[1] = 0x57;
+    wd->mac.a[2] = 0x53;
+    wd->mac.a[3] = 0x00;
+    wd->mac.a[4] = n >> 8;
+    wd->mac.a[5] = n;
+}
+
 static void wireless_simu_realize(struct PCIDevice *pci_dev, struct Error **errp)
 {
     struct wireless_simu_device_state *wd = WIRELESS_SIMU_OBJ(pci_dev);
 
-    /* irq */
-    wireless_simu_irq_init(&wd->ws_irq, &wd->parent_obj, HAL_BASIC_REG(WIRELESS_REG_BASIC_IRQ_STATUS));
+    if (!wireless_simu_ce_topology_check(wd, errp) || !wireless_simu_dp_check(wd, errp))
+        return;
+
+    /* 数据面 */
+    wd->ctx = wd->iothread ? iothread_get_aio_context(wd->iothread) : NULL;
+    wireless_simu_pool_init(&wd->pool);
+
+    /* irq, hal 的中断合并定时器会拉起中断, 需要在 hal 之前, 释放时在 hal 之后 */
+    if (wireless_simu_irq_init(&wd->ws_irq, &wd->parent_obj, HAL_BASIC_REG(WIRELESS_REG_BASIC_IRQ_STATUS),
+                               wd->msi, wd->msix, errp))
+        goto fail_irq;
+
+    /* hal, 需要在 mmio 之前完成 */
+    wireless_hal_init(wd, wd->srng_worker_count, wd->ctx);
 
-    /* srng_handler init */
-    wd->hal_srng_handle_pool = g_thread_pool_new(wireless_hal_src_ring_tp, (void *)wd, 20, FALSE, &wd->hal_srng_handle_err);
-    if(!wd->hal_srng_handle_pool){
-        printf("%s : srng thread pool init err \n", WIRELESS_SIMU_DEVICE_NAME);
-        exit(-1);
+    /* ce, 按拓扑分配 pipe 并绑定到 hal 中的 ring */
+    if (wireless_simu_ce_init(wd))
+    {
+        error_setg(errp, "%s: failed to allocate copy engines", WIRELESS_SIMU_DEVICE_NAME);
+        goto fail_ce;
     }
 
-    // txrx 初始化
-    wireless_txrx_init(wireless_simu_openwifi_mgmt_receive, wd);
+    /* 数据通路, 绑定 TCL / WBM / RXDMA / REO ring */
+    if (wireless_simu_dp_init(wd))
+    {
+        error_setg(errp, "%s: failed to allocate data path", WIRELESS_SIMU_DEVICE_NAME);
+        goto fail_dp;
+    }
+
+    /* wmi 事件通道, 需要在 ce 之后 */
+    wireless_simu_wmi_event_init(wd, wd->ctx);
+
+    // 连接到介质, txrx 初始化
+    wireless_simu_mac_default(wd);
+    if (wireless_medium_attach(wd->medium, &wd->txrx, wd->mac.a, wireless_simu_openwifi_mgmt_receive,
+                               wireless_simu_openwifi_mgmt_receive_batch, wd, wd->ctx, errp))
+        goto fail_medium;
 
     /* mmio reg 初始化 */
     memory_region_init_io(&wd->mmio,
@@ -43,11 +87,22 @@ static void wireless_simu_realize(struct PCIDevice *pci_dev, struct Error **errp
                           pci_dev,
                           "wireless_simu_mmio",
                           (256 * MiB));
-    
-    /* ce dst */
-    wireless_simu_ce_init(wd);
 
     pci_register_bar(pci_dev, 0, PCI_BASE_ADDRESS_SPACE_MEMORY, &wd->mmio);
+    return;
+
+    /* 按初始化的逆序释放, 顺序与 wireless_simu_exit 相同 */
+fail_medium:
+    wireless_hal_stop(wd);
+    wireless_simu_wmi_event_deinit(wd);
+fail_dp:
+    wireless_simu_dp_deinit(wd);
+fail_ce:
+    wireless_simu_ce_deinit(wd);
+    wireless_hal_deinit(wd);
+    wireless_simu_irq_deinit(&wd->ws_irq);
+fail_irq:
+    wireless_simu_pool_destroy(&wd->pool);
 }
 
 static void wireless_simu_exit(struct PCIDevice *pci_dev)
@@ -55,14 +110,130 @@ static void wireless_simu_exit(struct PCIDevice *pci_dev)
     struct wireless_simu_device_state *wd = WIRELESS_SIMU_OBJ(pci_dev);
     wd->dma_mask = 0;
 
-    wireless_txrx_deinit();
+    wireless_medium_detach(wd->medium, &wd->txrx);
+
+    /* 先停 srng 处理线程, 之后不会再有 wmi 命令和 ring 的 handler 在运行 */
+    wireless_hal_stop(wd);
+
+    /* 停止扫描定时器和事件的 flush */
+    wireless_simu_wmi_event_deinit(wd);
+
+    /* 停止重排序定时器, 释放 TID 队列 */
+    wireless_simu_dp_deinit(wd);
+
+    /* 不再有新的数据, 清空暂存队列 */
+    wireless_simu_ce_deinit(wd);
+
+    /* 中断合并的定时器会拉起中断, 需要先于 irq 释放 */
+    wireless_hal_deinit(wd);
 
     // deinit irq
     wireless_simu_irq_deinit(&wd->ws_irq);
 
-    g_thread_pool_free(wd->hal_srng_handle_pool, FALSE, TRUE);
+    /* 数据面全部停止之后才能释放对象池 */
+    wireless_simu_pool_destroy(&wd->pool);
+}
+
+static void wireless_simu_write_config(struct PCIDevice *pci_dev, uint32_t addr, uint32_t val, int len)
+{
+    struct wireless_simu_device_state *wd = WIRELESS_SIMU_OBJ(pci_dev);
+
+    pci_default_write_config(pci_dev, addr, val, len);
+
+    /* msi-x / msi 的打开, 关闭和 message 修改都经过这里, 同步 irqfd */
+    wireless_simu_irq_config_write(&wd->ws_irq);
+}
+
+static void wireless_simu_reset(struct DeviceState *dev)
+{
+    struct wireless_simu_device_state *wd = WIRELESS_SIMU_OBJ(dev);
+
+    wireless_simu_irq_reset(&wd->ws_irq);
+}
+
+static Property wireless_simu_properties[] = {
+    DEFINE_PROP_UINT32("srng-workers", struct wireless_simu_device_state, srng_worker_count, 4),
+    DEFINE_PROP_BOOL("msi", struct wireless_simu_device_state, msi, true),
+    DEFINE_PROP_BOOL("msix", struct wireless_simu_device_state, msix, true),
+    DEFINE_PROP_UINT32("ce-count", struct wireless_simu_device_state, ce_topo.ce_count, WIRELESS_SIMU_CE_COUNT),
+    DEFINE_PROP_UINT32("ce-pipes", struct wireless_simu_device_state, ce_topo.pipes_per_ce, SRNG_TEST_PIPE_COUNT_MAX),
+    DEFINE_PROP_UINT32("ce-dst-entries", struct wireless_simu_device_state, ce_topo.dst_entries, WIRELESS_SIMU_CE_DST_ENTRIES),
+    DEFINE_PROP_UINT32("ce-buf-size", struct wireless_simu_device_state, ce_topo.buf_size, WIRELESS_SIMU_CE_BUF_SIZE),
+    DEFINE_PROP_UINT32("rx-backlog", struct wireless_simu_device_state, rx_backlog.max, 64),
+    DEFINE_PROP_UINT32("wmi-pipe", struct wireless_simu_device_state, ce_topo.wmi_pipe, WIRELESS_SIMU_CE_PIPE_NONE),
+    DEFINE_PROP_UINT32("wmi-backlog", struct wireless_simu_device_state, evt_backlog.max, 256),
+    DEFINE_PROP_UINT32("dp-rx-buf-size", struct wireless_simu_device_state, dp.buf_size, WIRELESS_DP_RX_BUF_SIZE),
+    DEFINE_PROP_UINT32("dp-rx-queue", struct wireless_simu_device_state, dp.queue_max, WIRELESS_DP_RX_QUEUE),
+    DEFINE_PROP_UINT32("reo-timeout-ms", struct wireless_simu_device_state, dp.reo_timeout_ms, WIRELESS_REO_TIMEOUT_MS),
+    DEFINE_PROP_MACADDR("mac", struct wireless_simu_device_state, mac),
+    DEFINE_PROP_LINK("medium", struct wireless_simu_device_state, medium, TYPE_WIRELESS_MEDIUM,
+                     struct wireless_medium *),
+    DEFINE_PROP_LINK("iothread", struct wireless_simu_device_state, iothread, TYPE_IOTHREAD, IOThread *),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void wireless_simu_get_irq_stats(Object *obj, Visitor *v, const char *name, void *opaque, Error **errp)
+{
+    struct wireless_simu_device_state *wd = WIRELESS_SIMU_OBJ(obj);
+    uint64_t fired, coalesced;
+    uint64_t value;
+
+    wireless_hal_intr_stats(wd, &fired, &coalesced);
+    value = strcmp(name, "irq-fired") == 0 ? fired : coalesced;
+    visit_type_uint64(v, name, &value, errp);
 }
 
+static void wireless_simu_get_pool_stats(Object *obj, Visitor *v, const char *name, void *opaque, Error **errp)
+{
+    struct wireless_simu_device_state *wd = WIRELESS_SIMU_OBJ(obj);
+    struct wireless_simu_pool_stats stats;
+    uint64_t value;
+
+    wireless_simu_pool_stats(&wd->pool, &stats);
+    value = *(uint64_t *)((char *)&stats + (uintptr_t)opaque);
+    visit_type_uint64(v, name, &value, errp);
+}
+
+#define WIRELESS_SIMU_POOL_STAT(class, name, field)                                  \
+    object_class_property_add(class, name, "uint64", wireless_simu_get_pool_stats,   \
+                              NULL, NULL,                                            \
+                              (void *)offsetof(struct wireless_simu_pool_stats, field))
+
+/* opaque 为统计项在设备结构体中的偏移 */
+static void wireless_simu_get_rx_stats(Object *obj, Visitor *v, const char *name, void *opaque, Error **errp)
+{
+    struct wireless_simu_device_state *wd = WIRELESS_SIMU_OBJ(obj);
+    Stat64 *stat = (Stat64 *)((char *)wd + (uintptr_t)opaque);
+    uint64_t value = stat64_get(stat);
+
+    visit_type_uint64(v, name, &value, errp);
+}
+
+#define WIRELESS_SIMU_RX_STAT(class, name, field)                                    \
+    object_class_property_add(class, name, "uint64", wireless_simu_get_rx_stats,     \
+                              NULL, NULL,                                            \
+                              (void *)offsetof(struct wireless_simu_device_state, rx_stats.field))
+
+#define WIRELESS_SIMU_EVT_STAT(class, name, field)                                   \
+    object_class_property_add(class, name, "uint64", wireless_simu_get_rx_stats,     \
+                              NULL, NULL,                                            \
+                              (void *)offsetof(struct wireless_simu_device_state, evt_stats.field))
+
+#define WIRELESS_SIMU_WMI_STAT(class, name, field)                                   \
+    object_class_property_add(class, name, "uint64", wireless_simu_get_rx_stats,     \
+                              NULL, NULL,                                            \
+                              (void *)offsetof(struct wireless_simu_device_state, wmi.field))
+
+#define WIRELESS_SIMU_DP_STAT(class, name, field)                                    \
+    object_class_property_add(class, name, "uint64", wireless_simu_get_rx_stats,     \
+                              NULL, NULL,                                            \
+                              (void *)offsetof(struct wireless_simu_device_state, dp.stats.field))
+
+#define WIRELESS_SIMU_REO_STAT(class, name, field)                                   \
+    object_class_property_add(class, name, "uint64", wireless_simu_get_rx_stats,     \
+                              NULL, NULL,                                            \
+                              (void *)offsetof(struct wireless_simu_device_state, dp.reo.stats.field))
+
 static void wireless_simu_class_init(struct ObjectClass *class, void *data)
 {
     printf("%s : class init start \n", WIRELESS_SIMU_DEVICE_NAME);
@@ -71,12 +242,66 @@ static void wireless_simu_class_init(struct ObjectClass *class, void *data)
 
     pci->realize = wireless_simu_realize;
     pci->exit = wireless_simu_exit;
+    pci->config_write = wireless_simu_write_config;
     pci->vendor_id = PCI_VENDOR_ID_QEMU;
     pci->device_id = WIRELESS_SIMU_DEVICE_ID;
     pci->revision = WIRELESS_SIMU_REVISION;
     pci->class_id = PCI_CLASS_OTHERS;
 
     dc->desc = "wireless simu qemu device";
+    dc->reset = wireless_simu_reset;
+    device_class_set_props(dc, wireless_simu_properties);
+
+    /* 中断合并统计, 通过 qom-get 读取 */
+    object_class_property_add(class, "irq-fired", "uint64", wireless_simu_get_irq_stats, NULL, NULL, NULL);
+    object_class_property_add(class, "irq-coalesced", "uint64", wireless_simu_get_irq_stats, NULL, NULL, NULL);
+
+    /* rx 背压统计 */
+    WIRELESS_SIMU_RX_STAT(class, "rx-posted", posted);
+    WIRELESS_SIMU_RX_STAT(class, "rx-no-buffer", no_buffer);
+    WIRELESS_SIMU_RX_STAT(class, "rx-overrun", overrun);
+    WIRELESS_SIMU_RX_STAT(class, "rx-backlogged", backlogged);
+    WIRELESS_SIMU_RX_STAT(class, "rx-replayed", replayed);
+    WIRELESS_SIMU_RX_STAT(class, "rx-dropped", dropped);
+
+    /* WMI 命令统计 */
+    WIRELESS_SIMU_WMI_STAT(class, "wmi-cmds", cmds);
+    WIRELESS_SIMU_WMI_STAT(class, "wmi-unknown", unknown);
+    WIRELESS_SIMU_WMI_STAT(class, "wmi-malformed", malformed);
+    WIRELESS_SIMU_WMI_STAT(class, "wmi-rejected", rejected);
+
+    /* WMI 事件统计, 事件暂存队列和 rx 的含义相同 */
+    WIRELESS_SIMU_WMI_STAT(class, "wmi-events", events);
+    WIRELESS_SIMU_WMI_STAT(class, "wmi-tx-compl-events", tx_compl_events);
+    WIRELESS_SIMU_WMI_STAT(class, "wmi-tx-compl-reports", tx_compl_reports);
+    WIRELESS_SIMU_WMI_STAT(class, "wmi-credit-reports", credit_reports);
+    WIRELESS_SIMU_EVT_STAT(class, "wmi-event-posted", posted);
+    WIRELESS_SIMU_EVT_STAT(class, "wmi-event-backlogged", backlogged);
+    WIRELESS_SIMU_EVT_STAT(class, "wmi-event-dropped", dropped);
+
+    /* 数据通路统计 */
+    WIRELESS_SIMU_DP_STAT(class, "dp-tx-frames", tx_frames);
+    WIRELESS_SIMU_DP_STAT(class, "dp-tx-dropped", tx_dropped);
+    WIRELESS_SIMU_DP_STAT(class, "dp-tx-stalled", tx_stalled);
+    WIRELESS_SIMU_DP_STAT(class, "dp-rx-frames", rx_frames);
+    WIRELESS_SIMU_DP_STAT(class, "dp-rx-batches", rx_batches);
+    WIRELESS_SIMU_DP_STAT(class, "dp-rx-queued", rx_queued);
+    WIRELESS_SIMU_DP_STAT(class, "dp-rx-dropped", rx_dropped);
+
+    /* 重排序统计 */
+    WIRELESS_SIMU_REO_STAT(class, "reo-held", held);
+    WIRELESS_SIMU_REO_STAT(class, "reo-released", released);
+    WIRELESS_SIMU_REO_STAT(class, "reo-stale", stale);
+    WIRELESS_SIMU_REO_STAT(class, "reo-duplicate", duplicate);
+    WIRELESS_SIMU_REO_STAT(class, "reo-holes", holes);
+    WIRELESS_SIMU_REO_STAT(class, "reo-timeouts", timeouts);
+
+    /* 对象池统计 */
+    WIRELESS_SIMU_POOL_STAT(class, "pool-allocs", allocs);
+    WIRELESS_SIMU_POOL_STAT(class, "pool-cache-hits", cache_hits);
+    WIRELESS_SIMU_POOL_STAT(class, "pool-refills", refills);
+    WIRELESS_SIMU_POOL_STAT(class, "pool-mallocs", mallocs);
+    WIRELESS_SIMU_POOL_STAT(class, "pool-oversize", oversize);
     set_bit(DEVICE_CATEGORY_MISC, dc->categories);
     printf("%s : class init end \n", WIRELESS_SIMU_DEVICE_NAME);
 }
@@ -86,6 +311,7 @@ static void wireless_simu_instance_init(struct Object *obj)
     printf("%s : intance start \n", WIRELESS_SIMU_DEVICE_NAME);
     struct wireless_simu_device_state *wd = WIRELESS_SIMU_OBJ(obj);
     wd->dma_mask = (1UL << WIRELESS_SIMU_DEVICE_DMA_MASK) - 1;
+    wireless_simu_rss_init(&wd->rss);
     printf("%s : intance end \n", WIRELESS_SIMU_DEVICE_NAME);
 }
 
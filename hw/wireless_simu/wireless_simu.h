@@ -15,20 +15,48 @@
 #include "hw/pci/pci.h"
 #include "hw/hw.h"
 #include "hw/pci/msi.h"
+#include "hw/pci/msix.h"
+#include "qapi/error.h"
+#include "qemu/error-report.h"
 #include "qemu/timer.h"
+#include "qemu/thread.h"
+#include "qemu/bitops.h"
+#include "qemu/host-utils.h"
+#include "qemu/processor.h"
+#include "qemu/queue.h"
+#include "qemu/iov.h"
+#include "qemu/stats64.h"
 #include "qom/object.h"
 #include "qemu/main-loop.h" /* iothread mutex */
 #include "qemu/module.h"
 #include "qapi/visitor.h"
+#include "hw/qdev-properties.h"
+#include "sysemu/iothread.h"
+#include "sysemu/kvm.h"
+#include "block/aio-wait.h"
+#include "qemu/sockets.h"
+#include "qemu/memfd.h"
+#include "qemu/event_notifier.h"
+#include "io/channel-socket.h"
+#include "net/net.h"
+#include "hw/qdev-properties-system.h"
 
+#include "wireless_pool.h"
 #include "wireless_hal.h"
 #include "wireless_reg.h"
 #include "wireless_irq.h"
 #include "wireless_ce.h"
+#include "wireless_rss.h"
 #include "wireless_sk_buff.h"
 #include "wireless_num.h"
 #include "wireless_wmi.h"
+#include "wireless_reo.h"
+#include "wireless_dp.h"
 #include "wireless_txrx.h"
+#include "wireless_shm.h"
+#include "wireless_uring.h"
+#include "wireless_channel.h"
+#include "wireless_medium.h"
 
 #define WIRELESS_SIMU_DEVICE_NAME "wirelesssimu"
 #define WIRELESS_SIMU_DEVICE_DMA_MASK 32
@@ -45,13 +73,49 @@ struct wireless_simu_device_state
 
     struct wireless_simu_hal hal;
     int ce_count_num;
-    struct copy_engine ce_group[WIRELESS_SIMU_CE_COUNT];
+    struct copy_engine *ce_group;
+    struct wireless_simu_ce_topology ce_topo;
 
-    GThreadPool *hal_srng_handle_pool;
-    GError *hal_srng_handle_err;
+    /* 数据面的对象池 */
+    struct wireless_simu_pool pool;
+
+    /* 接收方向的 pipe 选择 */
+    struct wireless_simu_rss rss;
+
+    /* rx 暂存队列及统计 */
+    struct wireless_simu_ce_backlog rx_backlog;
+    struct wireless_simu_ce_stats rx_stats;
+
+    /* htc / wmi 事件的暂存队列及统计 */
+    struct wireless_simu_ce_backlog evt_backlog;
+    struct wireless_simu_ce_stats evt_stats;
+
+    /* TCL / WBM / RXDMA / REO 数据通路 */
+    struct wireless_simu_dp dp;
+
+    /* srng 处理线程数量 */
+    uint32_t srng_worker_count;
+
+    /* 是否提供 msi / msi-x capability */
+    bool msi;
+    bool msix;
+
+    /* 连接的介质, 为空时使用自动选择端口的 udp */
+    struct wireless_medium *medium;
+    struct wireless_txrx txrx;
+
+    /* hub 介质按这个地址投递单播帧, 未设置时自动生成 */
+    MACAddr mac;
+
+    /* 数据面所在的 iothread, 为空时使用独立的处理线程 */
+    IOThread *iothread;
+    AioContext *ctx;
 
     // irq module
     struct wireless_simu_irq ws_irq;
+
+    /* 固件状态, 由 WMI 命令维护 */
+    struct wireless_simu_wmi wmi;
 };
 
 DECLARE_INSTANCE_CHECKER(struct wireless_simu_device_state,
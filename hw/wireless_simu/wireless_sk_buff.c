@@ -1,11 +1,12 @@
 #include "wireless_simu.h"
 
-struct sk_buff *alloc_skb(unsigned int size)
+/* skb 和数据区一次分配 */
+struct sk_buff *alloc_skb(struct wireless_simu_pool *pool, unsigned int size)
 {
     unsigned int len = QEMU_ALIGN_UP(size, 8);
     struct sk_buff *skb;
 
-    skb = malloc(sizeof(struct sk_buff));
+    skb = wireless_simu_pool_alloc(pool, sizeof(struct sk_buff) + len);
     if (!skb)
     {
         return NULL;
@@ -13,18 +14,13 @@ struct sk_buff *alloc_skb(unsigned int size)
     memset(skb, 0, sizeof(struct sk_buff));
 
     skb->truesize = len;
-    skb->data = malloc(len);
+    skb->data = (unsigned char *)skb + sizeof(struct sk_buff);
     skb->data_len = 0;
 
     return skb;
 }
 
-void free_skb(struct sk_buff *skb)
+void free_skb(struct wireless_simu_pool *pool, struct sk_buff *skb)
 {
-    if(skb){
-        if(skb->data){
-            free(skb->data);
-        }
-        free(skb);
-    }
+    wireless_simu_pool_free(pool, skb);
 }
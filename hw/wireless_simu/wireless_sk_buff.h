@@ -66,8 +66,8 @@ static inline struct wireless_simu_skb_cb *WIRELESS_SIMU_SKB_CB(struct sk_buff *
 	return (struct wireless_simu_skb_cb *)skb->cb;
 }
 
-struct sk_buff *alloc_skb(unsigned int size);
+struct sk_buff *alloc_skb(struct wireless_simu_pool *pool, unsigned int size);
 
-void free_skb(struct sk_buff *skb);
+void free_skb(struct wireless_simu_pool *pool, struct sk_buff *skb);
 
 #endif /*WIRELESS_SIMU_SK_BUFF*/
\ No newline at end of file
@@ -1,4 +1,3 @@
-
 #ifdef DEBUG
 #include "wireless_txrx.h"
 static int pid = 0;
@@ -7,21 +6,8 @@ static int pid = 0;
 #endif /* DEBUG */
 
 #define SERVER_ADDR "127.0.0.1"
-#define SERVER_PORT_1 12700
-#define SERVER_PORT_2 12701
-
-static int sockfd_tx = 0;
-static bool tx_stop = false;
-static GMutex tx_lock;
-static struct sockaddr_in server_addr_tx = {0};
-
-static int sockfd_rx = 0;
-static bool rx_stop = false;
-static pthread_t rx_thread;
-GThreadPool *rx_thread_pool = NULL;
-#define RX_BUFFER_SIZE 2048
-static char rx_buffer[RX_BUFFER_SIZE];
-static void (*rx_handler)(void *data, size_t len, void* device) = NULL;
+
+#define RX_BUFFER_SIZE WIRELESS_TXRX_FRAME_MAX
 
 static int bind_rx_port(int port, int *sock_fd)
 {
@@ -45,57 +31,188 @@ static int bind_tx_port(const char *addr, int port, struct sockaddr_in *server_a
     memset(server_addr, 0, sizeof(struct sockaddr_in));
     server_addr->sin_family = AF_INET;
     server_addr->sin_port = htons(port);
-    inet_pton(AF_INET, addr, &server_addr->sin_addr);
+    if (inet_pton(AF_INET, addr, &server_addr->sin_addr) != 1)
+        return -1;
 
     return 0;
 }
 
-static int init_txrx_fd(void)
+static void close_txrx_fd(struct wireless_txrx *txrx)
 {
-    sockfd_tx = socket(AF_INET, SOCK_DGRAM, 0);
-    sockfd_rx = socket(AF_INET, SOCK_DGRAM, 0);
+    if (txrx->sockfd_tx >= 0)
+        close(txrx->sockfd_tx);
+    if (txrx->sockfd_rx >= 0)
+        close(txrx->sockfd_rx);
+    txrx->sockfd_tx = -1;
+    txrx->sockfd_rx = -1;
+}
+
+static int init_txrx_fd(struct wireless_txrx *txrx, const struct wireless_txrx_config *config)
+{
+    const char *peer = config && config->peer ? config->peer : SERVER_ADDR;
+
+    txrx->sockfd_tx = socket(AF_INET, SOCK_DGRAM, 0);
+    txrx->sockfd_rx = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (txrx->sockfd_tx < 0 || txrx->sockfd_rx < 0)
+    {
+        printf("%s : init fd tx %d rx %d err \n", WIRELESS_SIMU_DEVICE_NAME, txrx->sockfd_tx, txrx->sockfd_rx);
+        goto err;
+    }
 
-    if (sockfd_tx < 0 || sockfd_rx < 0)
+    /* 指定了端口就只用这一对端口 */
+    if (config && config->port)
     {
-        printf("%s : init fd tx %d rx %d err \n", WIRELESS_SIMU_DEVICE_NAME, sockfd_tx, sockfd_rx);
-        exit(1);
+        if (bind_rx_port(config->port, &txrx->sockfd_rx) ||
+            bind_tx_port(peer, config->peer_port, &txrx->server_addr_tx))
+        {
+            printf("%s : init fd bind %d -> %s:%d err \n", WIRELESS_SIMU_DEVICE_NAME,
+                   config->port, peer, config->peer_port);
+            goto err;
+        }
+        printf("%s : tx rx port %d %d \n", WIRELESS_SIMU_DEVICE_NAME, config->peer_port, config->port);
+        return 0;
     }
-    
-    if (bind_rx_port(SERVER_PORT_1, &sockfd_rx) == 0)
+
+    if (bind_rx_port(WIRELESS_TXRX_PORT_1, &txrx->sockfd_rx) == 0)
     {
-        if (bind_tx_port(SERVER_ADDR, SERVER_PORT_2, &server_addr_tx))
+        if (bind_tx_port(peer, WIRELESS_TXRX_PORT_2, &txrx->server_addr_tx))
         {
             printf("%s : init fd bind err \n", WIRELESS_SIMU_DEVICE_NAME);
-            exit(1);
+            goto err;
         }
-        printf("%s : tx rx port %d %d \n", WIRELESS_SIMU_DEVICE_NAME, SERVER_PORT_2, SERVER_PORT_1);
+        printf("%s : tx rx port %d %d \n", WIRELESS_SIMU_DEVICE_NAME, WIRELESS_TXRX_PORT_2, WIRELESS_TXRX_PORT_1);
     }
     else
     {
-        if (bind_rx_port(SERVER_PORT_2, &sockfd_rx) || bind_tx_port(SERVER_ADDR, SERVER_PORT_1, &server_addr_tx))
+        if (bind_rx_port(WIRELESS_TXRX_PORT_2, &txrx->sockfd_rx) ||
+            bind_tx_port(peer, WIRELESS_TXRX_PORT_1, &txrx->server_addr_tx))
         {
             printf("%s : init fd bind this device num overflow 2 \n", WIRELESS_SIMU_DEVICE_NAME);
-            exit(1);
+            goto err;
         }
-        printf("%s : tx rx port %d %d \n", WIRELESS_SIMU_DEVICE_NAME, SERVER_PORT_1, SERVER_PORT_2);
+        printf("%s : tx rx port %d %d \n", WIRELESS_SIMU_DEVICE_NAME, WIRELESS_TXRX_PORT_1, WIRELESS_TXRX_PORT_2);
+    }
+
+    return 0;
+
+err:
+    close_txrx_fd(txrx);
+    return -1;
+}
+
+/* 准备 sendmmsg / recvmmsg 的描述, 每帧一个固定的缓冲区 */
+static int init_txrx_batch(struct wireless_txrx *txrx)
+{
+    txrx->tx_bufs = malloc(WIRELESS_TXRX_BATCH * WIRELESS_TXRX_FRAME_MAX);
+    txrx->rx_bufs = malloc(WIRELESS_TXRX_BATCH * WIRELESS_TXRX_FRAME_MAX);
+    if (!txrx->tx_bufs || !txrx->rx_bufs)
+    {
+        free(txrx->tx_bufs);
+        free(txrx->rx_bufs);
+        txrx->tx_bufs = NULL;
+        txrx->rx_bufs = NULL;
+        return -1;
     }
 
+    memset(txrx->tx_msgs, 0, sizeof(txrx->tx_msgs));
+    memset(txrx->rx_msgs, 0, sizeof(txrx->rx_msgs));
+    for (int i = 0; i < WIRELESS_TXRX_BATCH; i++)
+    {
+        txrx->tx_iov[i].iov_base = txrx->tx_bufs + i * WIRELESS_TXRX_FRAME_MAX;
+        txrx->tx_msgs[i].msg_hdr.msg_name = &txrx->server_addr_tx;
+        txrx->tx_msgs[i].msg_hdr.msg_namelen = sizeof(txrx->server_addr_tx);
+        txrx->tx_msgs[i].msg_hdr.msg_iov = &txrx->tx_iov[i];
+        txrx->tx_msgs[i].msg_hdr.msg_iovlen = 1;
+
+        txrx->rx_iov[i].iov_base = txrx->rx_bufs + i * WIRELESS_TXRX_FRAME_MAX;
+        txrx->rx_iov[i].iov_len = WIRELESS_TXRX_FRAME_MAX;
+        txrx->rx_msgs[i].msg_hdr.msg_iov = &txrx->rx_iov[i];
+        txrx->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    txrx->tx_count = 0;
+
     return 0;
 }
 
-int wireless_tx_data(void *data, size_t data_size)
+/* 发出 tx 队列中的所有帧, 调用时持有 tx_lock */
+static void wireless_tx_flush_locked(struct wireless_txrx *txrx)
+{
+    uint32_t sent = 0;
+    int ret;
+
+    while (sent < txrx->tx_count)
+    {
+        ret = sendmmsg(txrx->sockfd_tx, txrx->tx_msgs + sent, txrx->tx_count - sent, 0);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            printf("%s : wireless tx socket send err %d, drop %u \n", WIRELESS_SIMU_DEVICE_NAME, errno,
+                   txrx->tx_count - sent);
+            break;
+        }
+        sent += ret;
+    }
+
+    txrx->tx_count = 0;
+}
+
+/* udp: 拷贝到 tx 队列中, 队列满了立即发出, 否则等到 tx_bh 运行时把这一段时间内的帧一起发出 */
+static int wireless_tx_queue(struct wireless_txrx *txrx, const struct iovec *iov, int iovcnt, size_t data_size)
+{
+    uint8_t *buf;
+    int ret = 0;
+
+    g_mutex_lock(&txrx->tx_lock);
+    if (txrx->server_addr_tx.sin_port == 0 || txrx->server_addr_tx.sin_family == 0)
+    {
+        printf("%s : wireless tx server addr struct nor init \n", WIRELESS_SIMU_DEVICE_NAME);
+        ret = -1;
+        goto END;
+    }
+
+    buf = txrx->tx_bufs + txrx->tx_count * WIRELESS_TXRX_FRAME_MAX;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        memcpy(buf, iov[i].iov_base, iov[i].iov_len);
+        buf += iov[i].iov_len;
+    }
+    txrx->tx_iov[txrx->tx_count].iov_len = data_size;
+    txrx->tx_count++;
+    ret = data_size;
+
+#ifndef DEBUG
+    if (txrx->tx_count == WIRELESS_TXRX_BATCH)
+    {
+        wireless_tx_flush_locked(txrx);
+    }
+    else if (txrx->tx_count == 1)
+    {
+        qemu_bh_schedule(txrx->tx_bh);
+    }
+#else
+    wireless_tx_flush_locked(txrx);
+#endif /* DEBUG */
+
+END:
+    g_mutex_unlock(&txrx->tx_lock);
+    return ret;
+}
+
+int wireless_tx_data(struct wireless_txrx *txrx, void *data, size_t data_size)
 {
     int ret = 0;
 
-    if (tx_stop)
+    if (txrx->tx_stop)
     {
         printf("%s : wireless tx stop \n", WIRELESS_SIMU_DEVICE_NAME);
         return -2;
     }
 
-    if(data_size >= RX_BUFFER_SIZE){
+    if(data_size > RX_BUFFER_SIZE){
         printf("%s : wireless tx cant send so big data %ld \n", WIRELESS_SIMU_DEVICE_NAME, data_size);
-        
+
         #ifndef DEBUG
         return -3;
         #else
@@ -103,119 +220,301 @@ int wireless_tx_data(void *data, size_t data_size)
         #endif
     }
 
-    g_mutex_lock(&tx_lock);
-    if (server_addr_tx.sin_port == 0 || server_addr_tx.sin_family == 0)
+#ifndef DEBUG
+    if (txrx->hub)
     {
-        printf("%s : wireless tx server addr struct nor init \n", WIRELESS_SIMU_DEVICE_NAME);
-        goto END;
+        return wireless_medium_hub_send(txrx->hub, data, data_size);
     }
 
-    ret = sendto(sockfd_tx, data, data_size, 0, (struct sockaddr *)&server_addr_tx, sizeof(server_addr_tx));
-    if (ret == -1)
+    if (txrx->shm_enabled)
     {
-        printf("%s : wireless tx socket send err \n", WIRELESS_SIMU_DEVICE_NAME);
-        goto END;
+        ret = wireless_shm_medium_send(&txrx->shm, data, data_size);
+        if (ret)
+        {
+            printf("%s : wireless tx shm send err %d \n", WIRELESS_SIMU_DEVICE_NAME, ret);
+        }
+        return ret;
+    }
+
+    if (txrx->uring_enabled)
+    {
+        ret = wireless_uring_medium_send(&txrx->uring, data, data_size);
+        if (ret)
+        {
+            printf("%s : wireless tx uring send err %d \n", WIRELESS_SIMU_DEVICE_NAME, ret);
+        }
+        return ret;
     }
+#endif /* DEBUG */
 
-    printf("%s : send success \n", WIRELESS_SIMU_DEVICE_NAME);
+    struct iovec iov = {.iov_base = data, .iov_len = data_size};
 
-END:
-    g_mutex_unlock(&tx_lock);
-    return ret;
+    return wireless_tx_queue(txrx, &iov, 1, data_size);
 }
 
-typedef struct rx_data_packet_define
+/* 只有 udp 可以直接从多段中拷贝, 其他方式先拼成连续的一帧 */
+int wireless_tx_datav(struct wireless_txrx *txrx, const struct iovec *iov, int iovcnt)
 {
-    size_t len;
-    void *data;
-} rx_data_packet;
+    size_t data_size = 0;
 
-/* 单开一个线程去监听, 所以不需要去考虑阻塞的问题 */
-static void *wireless_rx_data(void *p_data)
-{
-    while (!rx_stop)
+    if (iovcnt == 1)
+        return wireless_tx_data(txrx, iov[0].iov_base, iov[0].iov_len);
+
+    for (int i = 0; i < iovcnt; i++)
     {
-        // memset(rx_buffer, 0, RX_BUFFER_SIZE);
-        struct sockaddr_in sender_addr = {0};
-        socklen_t sender_len = sizeof(sender_addr);
+        data_size += iov[i].iov_len;
+    }
+
+    if (txrx->tx_stop)
+    {
+        printf("%s : wireless tx stop \n", WIRELESS_SIMU_DEVICE_NAME);
+        return -2;
+    }
+
+    if (data_size > RX_BUFFER_SIZE)
+    {
+        printf("%s : wireless tx cant send so big data %ld \n", WIRELESS_SIMU_DEVICE_NAME, data_size);
+        return -3;
+    }
+
+#ifndef DEBUG
+    if (txrx->hub || txrx->shm_enabled || txrx->uring_enabled)
+    {
+        uint8_t *buf = g_malloc(data_size);
+        int ret;
+
+        iov_to_buf(iov, iovcnt, 0, buf, data_size);
+        ret = wireless_tx_data(txrx, buf, data_size);
+        g_free(buf);
+        return ret;
+    }
+#endif /* DEBUG */
+
+    return wireless_tx_queue(txrx, iov, iovcnt, data_size);
+}
 
-        size_t received = recvfrom(sockfd_rx, rx_buffer, sizeof(rx_buffer), 0, (struct sockaddr *)&sender_addr, &sender_len);
+/* 在 AioContext (iothread 或主循环) 中读到 EAGAIN 为止, 每次 recvmmsg 一批, 按到达顺序直接交给上层 */
+static void wireless_rx_data_ready(void *opaque)
+{
+    struct wireless_txrx *txrx = opaque;
+    struct iovec frames[WIRELESS_TXRX_BATCH];
+    int received;
 
-        if (received <= 0)
+    while (!txrx->rx_stop)
+    {
+        received = recvmmsg(txrx->sockfd_rx, txrx->rx_msgs, WIRELESS_TXRX_BATCH, MSG_DONTWAIT, NULL);
+        if (received < 0)
         {
-            printf("%s : wireless rx err \n", WIRELESS_SIMU_DEVICE_NAME);
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                printf("%s : wireless rx err %d \n", WIRELESS_SIMU_DEVICE_NAME, errno);
+            }
+            if (errno != EINTR)
+            {
+                break;
+            }
             continue;
         }
 
-        void *data = malloc(received);
-        if (!data)
+        if (txrx->rx_batch_handler)
         {
-            printf("%s : wireless rx memory fuull \n", WIRELESS_SIMU_DEVICE_NAME);
+            for (int i = 0; i < received; i++)
+            {
+                frames[i].iov_base = txrx->rx_bufs + i * WIRELESS_TXRX_FRAME_MAX;
+                frames[i].iov_len = txrx->rx_msgs[i].msg_len;
+            }
+            if (received)
+                txrx->rx_batch_handler(txrx->device, frames, received);
         }
-        memcpy(data, rx_buffer, received);
-
-        rx_data_packet *skb = (rx_data_packet *)malloc(sizeof(rx_data_packet));
-        if (!skb)
+        else
         {
-            printf("%s : wireless rx memory packet fuull \n", WIRELESS_SIMU_DEVICE_NAME);
+            for (int i = 0; i < received && txrx->rx_handler; i++)
+            {
+                txrx->rx_handler(txrx->rx_bufs + i * WIRELESS_TXRX_FRAME_MAX, txrx->rx_msgs[i].msg_len,
+                                 txrx->device);
+            }
         }
 
-        skb->data = data;
-        skb->len = received;
-
-        g_thread_pool_push(rx_thread_pool, (void *)skb, NULL);
+        if (received < WIRELESS_TXRX_BATCH)
+            break;
     }
-
-    return NULL;
 }
 
-static void wireless_rx_data_handler_task(gpointer data, gpointer user_data)
+#ifndef DEBUG
+static void wireless_tx_flush_bh(void *opaque)
 {
-    rx_data_packet *skb = (rx_data_packet *)data;
+    struct wireless_txrx *txrx = opaque;
 
-    // 对接收到的数据进行处理 这里选择打印一下
-    if(rx_handler){
-        rx_handler(skb->data, skb->len, user_data);
-    }
+    g_mutex_lock(&txrx->tx_lock);
+    wireless_tx_flush_locked(txrx);
+    g_mutex_unlock(&txrx->tx_lock);
+}
 
-    free(skb->data);
-    skb->data = NULL;
+static void wireless_rx_detach(void *opaque)
+{
+    struct wireless_txrx *txrx = opaque;
 
-    free(skb);
+    aio_set_fd_handler(txrx->rx_ctx, txrx->sockfd_rx, NULL, NULL, NULL, NULL, NULL);
+    qemu_bh_delete(txrx->tx_bh);
+    txrx->tx_bh = NULL;
 }
+#endif /* DEBUG */
 
-int wireless_txrx_init(void (*rx_data_handler)(void* data, size_t len, void* device), void* device)
+int wireless_txrx_init(struct wireless_txrx *txrx, void (*rx_data_handler)(void *data, size_t len, void *device),
+                       void (*rx_batch_handler)(void *device, struct iovec *frames, int n),
+                       void *device, AioContext *ctx, const struct wireless_txrx_config *config)
 {
-    g_mutex_init(&tx_lock);
+    txrx->sockfd_tx = -1;
+    txrx->sockfd_rx = -1;
+    txrx->tx_stop = false;
+    txrx->rx_stop = false;
+    txrx->rx_handler = rx_data_handler;
+    txrx->rx_batch_handler = rx_batch_handler;
+    txrx->device = device;
+    txrx->rx_ctx = NULL;
+    txrx->tx_bufs = NULL;
+    txrx->rx_bufs = NULL;
+    txrx->tx_count = 0;
+    g_mutex_init(&txrx->tx_lock);
+
+#ifndef DEBUG
+    txrx->shm_enabled = false;
+    txrx->uring_enabled = false;
+    txrx->hub = config ? config->hub : NULL;
+    if (txrx->hub)
+    {
+        return 0;
+    }
+
+    if (config && config->shm)
+    {
+        Error *err = NULL;
+
+        if (wireless_shm_medium_open(&txrx->shm, config->path, ctx, rx_data_handler, device, &err))
+        {
+            error_report_err(err);
+            g_mutex_clear(&txrx->tx_lock);
+            return -1;
+        }
+        txrx->shm_enabled = true;
+        return 0;
+    }
+#endif /* DEBUG */
 
-    if (init_txrx_fd())
+    if (init_txrx_fd(txrx, config))
+    {
         printf("%s : fd init err \n", WIRELESS_SIMU_DEVICE_NAME);
+        g_mutex_clear(&txrx->tx_lock);
+        return -1;
+    }
+
+#ifndef DEBUG
+    if (config && config->uring)
+    {
+        Error *err = NULL;
 
-    rx_stop = false;
-    rx_handler = rx_data_handler;
+        if (wireless_uring_medium_open(&txrx->uring, txrx->sockfd_rx, txrx->sockfd_tx, &txrx->server_addr_tx, ctx,
+                                       rx_data_handler, device, &err))
+        {
+            error_report_err(err);
+            close_txrx_fd(txrx);
+            g_mutex_clear(&txrx->tx_lock);
+            return -1;
+        }
+        txrx->uring_enabled = true;
+        return 0;
+    }
+#endif /* DEBUG */
 
-    // rx 单独一个线程去处理
-    rx_thread_pool = g_thread_pool_new(wireless_rx_data_handler_task, device, 20, FALSE, NULL);
+    if (init_txrx_batch(txrx))
+    {
+        printf("%s : batch buffer init err \n", WIRELESS_SIMU_DEVICE_NAME);
+        close_txrx_fd(txrx);
+        g_mutex_clear(&txrx->tx_lock);
+        return -1;
+    }
 
-    rx_stop = false;
-    pthread_create(&rx_thread, NULL, &wireless_rx_data, NULL);
+#ifndef DEBUG
+    /* rx 和 tx 队列都在同一个 AioContext 中处理, 没有 iothread 时使用主循环 */
+    txrx->rx_ctx = ctx ? ctx : qemu_get_aio_context();
+    txrx->tx_bh = aio_bh_new(txrx->rx_ctx, wireless_tx_flush_bh, txrx);
+    qemu_socket_set_nonblock(txrx->sockfd_rx);
+    aio_set_fd_handler(txrx->rx_ctx, txrx->sockfd_rx, wireless_rx_data_ready, NULL, NULL, NULL, txrx);
+#else
+    /* DEBUG 时由 main 中的 poll 循环调用 wireless_rx_data_ready */
+    fcntl(txrx->sockfd_rx, F_SETFL, fcntl(txrx->sockfd_rx, F_GETFL) | O_NONBLOCK);
+#endif /* DEBUG */
 
     return 0;
 }
 
-void wireless_txrx_deinit(void)
+void wireless_txrx_deinit(struct wireless_txrx *txrx)
 {
-    tx_stop = true;
-    rx_stop = true;
+    txrx->tx_stop = true;
+    txrx->rx_stop = true;
+
+#ifndef DEBUG
+    if (txrx->hub)
+    {
+        txrx->hub = NULL;
+        txrx->rx_handler = NULL;
+        txrx->rx_batch_handler = NULL;
+        g_mutex_clear(&txrx->tx_lock);
+        return;
+    }
+
+    if (txrx->shm_enabled)
+    {
+        wireless_shm_medium_close(&txrx->shm);
+        txrx->shm_enabled = false;
+        txrx->rx_handler = NULL;
+        txrx->rx_batch_handler = NULL;
+        g_mutex_clear(&txrx->tx_lock);
+        return;
+    }
+
+    if (txrx->uring_enabled)
+    {
+        wireless_uring_medium_close(&txrx->uring);
+        txrx->uring_enabled = false;
+        txrx->rx_handler = NULL;
+        txrx->rx_batch_handler = NULL;
+        close_txrx_fd(txrx);
+        g_mutex_clear(&txrx->tx_lock);
+        return;
+    }
+
+    /* 在 rx 所在的 AioContext 中摘掉 fd handler 和 tx_bh, 之后不会再有回调, 不需要等待任何线程 */
+    if (txrx->rx_ctx == qemu_get_aio_context())
+    {
+        wireless_rx_detach(txrx);
+    }
+    else
+    {
+        aio_wait_bh_oneshot(txrx->rx_ctx, wireless_rx_detach, txrx);
+    }
+    txrx->rx_ctx = NULL;
+#endif /* DEBUG */
 
-    pthread_join(rx_thread, NULL);
+    /* 发出还在队列中的帧 */
+    g_mutex_lock(&txrx->tx_lock);
+    wireless_tx_flush_locked(txrx);
+    g_mutex_unlock(&txrx->tx_lock);
 
-    g_thread_pool_free(rx_thread_pool, FALSE, TRUE);
+    txrx->rx_handler = NULL;
+    txrx->rx_batch_handler = NULL;
+    close_txrx_fd(txrx);
+    g_mutex_clear(&txrx->tx_lock);
 
-    rx_handler = NULL;
+    free(txrx->tx_bufs);
+    free(txrx->rx_bufs);
+    txrx->tx_bufs = NULL;
+    txrx->rx_bufs = NULL;
 }
 
 #ifdef DEBUG
+static struct wireless_txrx test_txrx;
+
 void test_rx_handler(void *data, size_t len, void* device)
 {
     fprintf(stdout, "%s : from %d : tail 3 char %c %c %c len %ld \n", WIRELESS_SIMU_DEVICE_NAME,
@@ -225,7 +524,7 @@ void test_rx_handler(void *data, size_t len, void* device)
 }
 
 void handle_sigint(int sig) {
-    wireless_txrx_deinit();
+    wireless_txrx_deinit(&test_txrx);
     exit(0);
 }
 
@@ -235,7 +534,7 @@ int main()
     WIRELESS_SIMU_DEVICE_NAME = (char *)malloc(30);
     sprintf(WIRELESS_SIMU_DEVICE_NAME, "%s %d", "wireless_txrx_test", getpid());
 
-    wireless_txrx_init(test_rx_handler, NULL);
+    wireless_txrx_init(&test_txrx, test_rx_handler, NULL, NULL, NULL, NULL);
 
     // for (int i = 0; i < 65535; i++)
     // {
@@ -243,19 +542,24 @@ int main()
     //     int *data = (int *)malloc(len);
     //     memset(data, 0x12345678, len);
     //     *data = getpid();
-    //     wireless_tx_data((void *)data, len);
+    //     wireless_tx_data(&test_txrx, (void *)data, len);
     //     // sleep(1);
     //     free(data);
     // }
 
     if(signal(SIGINT, handle_sigint) == SIG_ERR) {
         perror("signal");
-        wireless_txrx_deinit();
+        wireless_txrx_deinit(&test_txrx);
         return 1;
     }
 
-    while(1){}
-    
+    struct pollfd pfd = {.fd = test_txrx.sockfd_rx, .events = POLLIN};
+
+    while (poll(&pfd, 1, -1) >= 0)
+    {
+        wireless_rx_data_ready(&test_txrx);
+    }
+
     return 0;
 }
-#endif /* DEBUG */
\ No newline at end of file
+#endif /* DEBUG */
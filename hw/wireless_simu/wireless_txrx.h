@@ -1,8 +1,15 @@
 #ifndef WIRELESS_SIMU_TX
 #define WIRELESS_SIMU_TX
 
+// 设备收发的最大帧长, 覆盖 A-MSDU 大小的帧
+#define WIRELESS_TXRX_FRAME_MAX (12 * 1024)
+
+// 一次 sendmmsg / recvmmsg 最多处理的帧数
+#define WIRELESS_TXRX_BATCH 32
+
 #ifdef DEBUG
 // gcc wireless_txrx.c -DDEBUG -o wireless_txrx.out $(pkg-config --cflags --libs glib-2.0)
+#define _GNU_SOURCE
 typedef int bool;
 #define false 0
 #define true 1
@@ -14,20 +21,100 @@ static char *WIRELESS_SIMU_DEVICE_NAME;
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <arpa/inet.h>
-#include <pthread.h>
+#include <poll.h>
+#include <fcntl.h>
 #include <glib-2.0/glib.h>
 #include <unistd.h>
+typedef struct AioContext AioContext;
 #else
 #include "wireless_simu.h"
+#include "wireless_shm.h"
+#include "wireless_uring.h"
+#endif /* DEBUG */
+
+// udp 未指定端口时, 两个设备按先后顺序占用这一对端口
+#define WIRELESS_TXRX_PORT_1 12700
+#define WIRELESS_TXRX_PORT_2 12701
+
+// 传输方式的配置, 由 wireless-medium 对象给出
+struct wireless_txrx_config
+{
+    // 为 true 时使用 path 上的共享内存介质, 否则使用 udp
+    bool shm;
+    const char *path;
+
+    // udp 对端地址, port 为 0 时自动选择 WIRELESS_TXRX_PORT_1/2
+    const char *peer;
+    uint16_t port;
+    uint16_t peer_port;
+
+    // udp 使用 io_uring 收发, 见 wireless_uring.h
+    bool uring;
+
+    // 不为 NULL 时通过进程内的 hub 收发, 不使用 socket
+    struct wireless_medium_port *hub;
+};
+
+// 每个设备一份的收发状态
+struct wireless_txrx
+{
+    int sockfd_tx;
+    bool tx_stop;
+    GMutex tx_lock;
+    struct sockaddr_in server_addr_tx;
+
+    // tx 队列, 满了或者 tx_bh 运行时一次 sendmmsg 发出, tx_lock 保护
+    struct mmsghdr tx_msgs[WIRELESS_TXRX_BATCH];
+    struct iovec tx_iov[WIRELESS_TXRX_BATCH];
+    uint8_t *tx_bufs;
+    uint32_t tx_count;
+
+    int sockfd_rx;
+    bool rx_stop;
+
+    // rx 一次 recvmmsg 收到的帧, 每帧 WIRELESS_TXRX_FRAME_MAX 字节
+    struct mmsghdr rx_msgs[WIRELESS_TXRX_BATCH];
+    struct iovec rx_iov[WIRELESS_TXRX_BATCH];
+    uint8_t *rx_bufs;
+
+    void (*rx_handler)(void *data, size_t len, void *device);
+    /* 不为 NULL 时 recvmmsg 收到的一批帧一次交给上层 */
+    void (*rx_batch_handler)(void *device, struct iovec *frames, int n);
+    void *device;
+    AioContext *rx_ctx;
+
+#ifndef DEBUG
+    // 在 rx 所在的 AioContext 中发出 tx 队列
+    QEMUBH *tx_bh;
+
+    // 共享内存介质, 开启之后不再使用 udp
+    struct wireless_shm_medium shm;
+    bool shm_enabled;
+
+    // io_uring 收发, 开启之后 socket 只由 io_uring 使用
+    struct wireless_uring_medium uring;
+    bool uring_enabled;
+
+    // hub 上的端口, 接收由 hub 完成
+    struct wireless_medium_port *hub;
 #endif /* DEBUG */
+};
 
 // 发送数据报文
-int wireless_tx_data(void *data, size_t data_size);
+int wireless_tx_data(struct wireless_txrx *txrx, void *data, size_t data_size);
+
+// 发送由多段组成的一帧, 如映射出来的 guest 内存
+int wireless_tx_datav(struct wireless_txrx *txrx, const struct iovec *iov, int iovcnt);
 
-// 初始化函数, 仅接受 rx 数据后的处理函数指针
-int wireless_txrx_init(void (*rx_data_handler)(void* data, size_t len, void* device), void* device);
+// 初始化函数, 接受 rx 数据后的处理函数指针
+// rx 在 ctx 中完成, ctx 为 NULL 时在主循环中完成, 都按到达顺序交给处理函数
+// config 为 NULL 时使用自动选择端口的 udp
+// rx_batch_handler 可以为 NULL, 只在 udp 上使用, 其他介质逐帧调用 rx_data_handler
+int wireless_txrx_init(struct wireless_txrx *txrx, void (*rx_data_handler)(void *data, size_t len, void *device),
+                       void (*rx_batch_handler)(void *device, struct iovec *frames, int n),
+                       void *device, AioContext *ctx, const struct wireless_txrx_config *config);
 
 // 删除函数
-void wireless_txrx_deinit(void);
+void wireless_txrx_deinit(struct wireless_txrx *txrx);
 
-#endif /*WIRELESS_SIMU_TX*/
\ No newline at end of file
+#endif /*WIRELESS_SIMU_TX*/
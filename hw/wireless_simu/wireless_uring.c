@@ -0,0 +1,383 @@
+#include "wireless_simu.h"
+
+#ifdef WIRELESS_URING_SUPPORTED
+
+/* cqe 的 user_data, tx 为 slot 序号 */
+#define URING_RX_TAG UINT64_MAX
+#define URING_CANCEL_TAG (UINT64_MAX - 1)
+
+/* 接收缓冲区的 buffer group */
+#define URING_RX_BGID 0
+
+/* sq 长度, 足够放下 rx, 所有 tx slot 和 cancel */
+#define URING_ENTRIES 256
+
+/* 关闭时等待内核归还缓冲区的最长时间 */
+#define URING_CLOSE_TIMEOUT_MS 1000
+
+/* 提交所有准备好的 sqe, 调用时持有 lock, 失败时返回负的错误码 */
+static int uring_submit_locked(struct wireless_uring_medium *u)
+{
+    int ret;
+
+    if (!u->submit_pending)
+        return 0;
+
+    do
+    {
+        ret = io_uring_submit(&u->ring);
+    } while (ret == -EINTR);
+
+    if (ret < 0)
+    {
+        printf("%s : uring medium submit err %d \n", WIRELESS_SIMU_DEVICE_NAME, ret);
+        return ret;
+    }
+    u->submit_pending = 0;
+    return 0;
+}
+
+/* sq 满时先提交一次 */
+static struct io_uring_sqe *uring_get_sqe_locked(struct wireless_uring_medium *u)
+{
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&u->ring);
+
+    if (!sqe)
+    {
+        uring_submit_locked(u);
+        sqe = io_uring_get_sqe(&u->ring);
+    }
+
+    return sqe;
+}
+
+/* 在 rx socket 上挂一个 multishot recv, 每收到一帧由内核从 rx_ring 中取一个缓冲区 */
+static void uring_arm_rx_locked(struct wireless_uring_medium *u)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe_locked(u);
+
+    if (!sqe)
+    {
+        printf("%s : uring medium no sqe for rx \n", WIRELESS_SIMU_DEVICE_NAME);
+        return;
+    }
+
+    io_uring_prep_recv_multishot(sqe, u->rx_fd, NULL, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_RX_BGID;
+    io_uring_sqe_set_data64(sqe, URING_RX_TAG);
+    u->submit_pending++;
+    u->rx_armed = true;
+}
+
+/* 处理 cq 中所有的完成, 接收的帧直接在缓冲区中交给上层, 整批处理完再归还缓冲区和 tx slot */
+static void uring_medium_reap(struct wireless_uring_medium *u)
+{
+    struct io_uring_cqe *cqe;
+    uint16_t freed[WIRELESS_URING_TX_SLOTS];
+    uint32_t nfreed = 0;
+    unsigned int head, count = 0;
+    int recycled = 0;
+    int mask = io_uring_buf_ring_mask(WIRELESS_URING_RX_BUFS);
+    bool rearm = false;
+
+    io_uring_for_each_cqe(&u->ring, head, cqe)
+    {
+        uint64_t tag = io_uring_cqe_get_data64(cqe);
+
+        count++;
+
+        if (tag == URING_RX_TAG)
+        {
+            if (cqe->flags & IORING_CQE_F_BUFFER)
+            {
+                uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                uint8_t *buf = u->rx_bufs + bid * WIRELESS_TXRX_FRAME_MAX;
+
+                if (cqe->res > 0 && u->rx_handler)
+                {
+                    u->rx_handler(buf, cqe->res, u->opaque);
+                }
+                io_uring_buf_ring_add(u->rx_ring, buf, WIRELESS_TXRX_FRAME_MAX, bid, mask, recycled++);
+            }
+
+            /* multishot 结束: 缓冲区用完时重新挂上, 其他错误 (如内核不支持) 不再接收 */
+            if (!(cqe->flags & IORING_CQE_F_MORE))
+            {
+                u->rx_armed = false;
+                if (cqe->res >= 0 || cqe->res == -ENOBUFS)
+                {
+                    rearm = true;
+                }
+                else if (cqe->res != -ECANCELED)
+                {
+                    printf("%s : uring medium rx stopped err %d \n", WIRELESS_SIMU_DEVICE_NAME, cqe->res);
+                }
+            }
+            continue;
+        }
+
+        if (tag == URING_CANCEL_TAG)
+            continue;
+
+        /* 对端没有启动时 udp 会返回 ECONNREFUSED, 和 sendmmsg 一样丢掉这一帧 */
+        if (cqe->res < 0 && cqe->res != -ECONNREFUSED)
+        {
+            printf("%s : uring medium tx err %d \n", WIRELESS_SIMU_DEVICE_NAME, cqe->res);
+        }
+        freed[nfreed++] = tag;
+    }
+
+    io_uring_cq_advance(&u->ring, count);
+    if (recycled)
+    {
+        io_uring_buf_ring_advance(u->rx_ring, recycled);
+    }
+
+    if (!nfreed && !(rearm && u->attached))
+        return;
+
+    qemu_mutex_lock(&u->lock);
+    for (uint32_t i = 0; i < nfreed; i++)
+    {
+        u->tx_free[u->tx_free_count++] = freed[i];
+    }
+    if (rearm && u->attached)
+    {
+        uring_arm_rx_locked(u);
+        uring_submit_locked(u);
+    }
+    qemu_mutex_unlock(&u->lock);
+}
+
+static void uring_medium_cq_ready(void *opaque)
+{
+    uring_medium_reap(opaque);
+}
+
+static void uring_medium_submit_bh(void *opaque)
+{
+    struct wireless_uring_medium *u = opaque;
+
+    qemu_mutex_lock(&u->lock);
+    uring_submit_locked(u);
+    qemu_mutex_unlock(&u->lock);
+}
+
+int wireless_uring_medium_send(struct wireless_uring_medium *u, const void *data, size_t len)
+{
+    struct io_uring_sqe *sqe;
+    uint16_t slot;
+    uint8_t *buf;
+
+    if (len > WIRELESS_TXRX_FRAME_MAX)
+        return -EMSGSIZE;
+
+    qemu_mutex_lock(&u->lock);
+    if (!u->tx_free_count)
+    {
+        qemu_mutex_unlock(&u->lock);
+        return -ENOBUFS;
+    }
+
+    sqe = uring_get_sqe_locked(u);
+    if (!sqe)
+    {
+        qemu_mutex_unlock(&u->lock);
+        return -EBUSY;
+    }
+
+    slot = u->tx_free[--u->tx_free_count];
+    buf = u->tx_bufs + slot * WIRELESS_TXRX_FRAME_MAX;
+    memcpy(buf, data, len);
+    io_uring_prep_send(sqe, u->tx_fd, buf, len, 0);
+    io_uring_sqe_set_data64(sqe, slot);
+
+    /* 攒够一批直接提交, 否则由 submit_bh 把这一段时间内的帧一起提交 */
+    if (++u->submit_pending >= WIRELESS_URING_SUBMIT_BATCH)
+    {
+        uring_submit_locked(u);
+    }
+    else if (u->submit_pending == 1)
+    {
+        qemu_bh_schedule(u->submit_bh);
+    }
+    qemu_mutex_unlock(&u->lock);
+
+    return 0;
+}
+
+int wireless_uring_medium_open(struct wireless_uring_medium *u, int rx_fd, int tx_fd,
+                               const struct sockaddr_in *peer, AioContext *ctx,
+                               void (*rx_handler)(void *data, size_t len, void *opaque), void *opaque,
+                               Error **errp)
+{
+    int mask = io_uring_buf_ring_mask(WIRELESS_URING_RX_BUFS);
+    int ret;
+
+    memset(u, 0, sizeof(*u));
+    u->rx_fd = rx_fd;
+    u->tx_fd = tx_fd;
+    u->rx_handler = rx_handler;
+    u->opaque = opaque;
+    qemu_mutex_init(&u->lock);
+
+    u->tx_bufs = g_malloc(WIRELESS_URING_TX_SLOTS * WIRELESS_TXRX_FRAME_MAX);
+    for (int i = 0; i < WIRELESS_URING_TX_SLOTS; i++)
+    {
+        u->tx_free[i] = WIRELESS_URING_TX_SLOTS - 1 - i;
+    }
+    u->tx_free_count = WIRELESS_URING_TX_SLOTS;
+
+    /* 发送使用 IORING_OP_SEND, 不需要为每一帧准备 msghdr */
+    if (connect(tx_fd, (const struct sockaddr *)peer, sizeof(*peer)) < 0)
+    {
+        ret = -errno;
+        error_setg_errno(errp, -ret, "%s: failed to connect uring medium tx socket", WIRELESS_SIMU_DEVICE_NAME);
+        goto fail;
+    }
+
+    ret = io_uring_queue_init(URING_ENTRIES, &u->ring, 0);
+    if (ret < 0)
+    {
+        error_setg_errno(errp, -ret, "%s: failed to create io_uring", WIRELESS_SIMU_DEVICE_NAME);
+        goto fail;
+    }
+    u->ring_ready = true;
+
+    u->rx_ring = io_uring_setup_buf_ring(&u->ring, WIRELESS_URING_RX_BUFS, URING_RX_BGID, 0, &ret);
+    if (!u->rx_ring)
+    {
+        error_setg_errno(errp, -ret, "%s: io_uring provided buffer ring is not supported",
+                         WIRELESS_SIMU_DEVICE_NAME);
+        goto fail;
+    }
+
+    u->rx_bufs = g_malloc(WIRELESS_URING_RX_BUFS * WIRELESS_TXRX_FRAME_MAX);
+    for (int i = 0; i < WIRELESS_URING_RX_BUFS; i++)
+    {
+        io_uring_buf_ring_add(u->rx_ring, u->rx_bufs + i * WIRELESS_TXRX_FRAME_MAX, WIRELESS_TXRX_FRAME_MAX, i,
+                              mask, i);
+    }
+    io_uring_buf_ring_advance(u->rx_ring, WIRELESS_URING_RX_BUFS);
+
+    u->ctx = ctx ? ctx : qemu_get_aio_context();
+    u->submit_bh = aio_bh_new(u->ctx, uring_medium_submit_bh, u);
+    u->attached = true;
+
+    qemu_mutex_lock(&u->lock);
+    uring_arm_rx_locked(u);
+    uring_submit_locked(u);
+    qemu_mutex_unlock(&u->lock);
+
+    aio_set_fd_handler(u->ctx, u->ring.ring_fd, uring_medium_cq_ready, NULL, NULL, NULL, u);
+
+    printf("%s : uring medium ready \n", WIRELESS_SIMU_DEVICE_NAME);
+    return 0;
+
+fail:
+    wireless_uring_medium_close(u);
+    return ret;
+}
+
+static void uring_medium_detach(void *opaque)
+{
+    struct wireless_uring_medium *u = opaque;
+
+    aio_set_fd_handler(u->ctx, u->ring.ring_fd, NULL, NULL, NULL, NULL, NULL);
+    qemu_bh_delete(u->submit_bh);
+    u->submit_bh = NULL;
+}
+
+void wireless_uring_medium_close(struct wireless_uring_medium *u)
+{
+    struct io_uring_cqe *cqe;
+    struct io_uring_sqe *sqe;
+    struct __kernel_timespec ts;
+    bool wait_rx = false;
+    bool idle = true;
+    int64_t deadline, left;
+    int ret;
+
+    if (u->attached)
+    {
+        if (u->ctx == qemu_get_aio_context())
+        {
+            uring_medium_detach(u);
+        }
+        else
+        {
+            aio_wait_bh_oneshot(u->ctx, uring_medium_detach, u);
+        }
+        u->attached = false;
+    }
+
+    if (u->ring_ready)
+    {
+        u->rx_handler = NULL;
+
+        /* 取消 rx 并提交剩下的发送, 等到内核不再使用任何缓冲区 */
+        qemu_mutex_lock(&u->lock);
+        if (u->rx_armed)
+        {
+            sqe = uring_get_sqe_locked(u);
+            if (sqe)
+            {
+                io_uring_prep_cancel64(sqe, URING_RX_TAG, 0);
+                io_uring_sqe_set_data64(sqe, URING_CANCEL_TAG);
+                u->submit_pending++;
+                wait_rx = true;
+            }
+        }
+        ret = uring_submit_locked(u);
+        qemu_mutex_unlock(&u->lock);
+
+        /* cancel 没有放进 sq 时 rx 不会结束, 提交失败时发送也不会完成, 都不能一直等下去 */
+        if (ret == 0)
+        {
+            deadline = qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + URING_CLOSE_TIMEOUT_MS;
+            while ((wait_rx && u->rx_armed) || u->tx_free_count < WIRELESS_URING_TX_SLOTS)
+            {
+                left = deadline - qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+                if (left <= 0)
+                    break;
+
+                ts.tv_sec = left / 1000;
+                ts.tv_nsec = (left % 1000) * 1000000;
+                ret = io_uring_wait_cqe_timeout(&u->ring, &cqe, &ts);
+                if (ret == -EINTR)
+                    continue;
+                if (ret < 0)
+                    break;
+                uring_medium_reap(u);
+            }
+        }
+
+        if (u->rx_armed || u->tx_free_count < WIRELESS_URING_TX_SLOTS)
+        {
+            printf("%s : uring medium close timed out, rx %d tx inflight %u \n", WIRELESS_SIMU_DEVICE_NAME,
+                   u->rx_armed, WIRELESS_URING_TX_SLOTS - u->tx_free_count);
+            idle = false;
+        }
+
+        if (u->rx_ring)
+        {
+            io_uring_free_buf_ring(&u->ring, u->rx_ring, WIRELESS_URING_RX_BUFS, URING_RX_BGID);
+            u->rx_ring = NULL;
+        }
+        io_uring_queue_exit(&u->ring);
+        u->ring_ready = false;
+    }
+
+    /* 内核可能还在异步取消没有完成的请求, 宁可泄漏缓冲区也不能释放 */
+    if (idle)
+    {
+        g_free(u->rx_bufs);
+        g_free(u->tx_bufs);
+    }
+    u->rx_bufs = NULL;
+    u->tx_bufs = NULL;
+    qemu_mutex_destroy(&u->lock);
+}
+
+#endif /* WIRELESS_URING_SUPPORTED */
@@ -0,0 +1,103 @@
+#ifndef WIRELESS_SIMU_URING
+#define WIRELESS_SIMU_URING
+
+#include "wireless_simu.h"
+
+/* io_uring 介质
+ *
+ * udp 介质的另一种收发方式, 每个设备一个 io_uring. rx socket 上一直挂着一个 multishot recv,
+ * 内核把帧直接收进 provided buffer ring 中的缓冲区, 处理完再把缓冲区还给 ring;
+ * tx 把帧拷贝到空闲的 slot 后只准备 sqe, 由 submit_bh 在设备的 AioContext 中一次提交.
+ * ring fd 注册在设备的 AioContext 中, 所有 cqe 都在这里处理, 没有额外的线程.
+ *
+ * 需要 liburing 2.4 和 6.0 以上的内核 */
+
+#ifdef CONFIG_LINUX_IO_URING
+#include <liburing.h>
+#if defined(IO_URING_VERSION_MAJOR) && \
+    (IO_URING_VERSION_MAJOR > 2 || (IO_URING_VERSION_MAJOR == 2 && IO_URING_VERSION_MINOR >= 4))
+#define WIRELESS_URING_SUPPORTED
+#endif
+#endif /* CONFIG_LINUX_IO_URING */
+
+/* provided buffer ring 中的接收缓冲区数量, 必须是 2 的幂 */
+#define WIRELESS_URING_RX_BUFS 256
+
+/* 同时在发送中的帧数量, 用完之后发送返回 -ENOBUFS */
+#define WIRELESS_URING_TX_SLOTS 128
+
+/* 累积这么多 sqe 之后不再等 submit_bh, 直接提交 */
+#define WIRELESS_URING_SUBMIT_BATCH 32
+
+#ifdef WIRELESS_URING_SUPPORTED
+
+struct wireless_uring_medium
+{
+    struct io_uring ring;
+    bool ring_ready;
+
+    int rx_fd;
+    int tx_fd;
+
+    /* 接收缓冲区, 第 i 个缓冲区的 bid 为 i */
+    struct io_uring_buf_ring *rx_ring;
+    uint8_t *rx_bufs;
+    bool rx_armed;
+
+    /* 发送 slot 和空闲 slot 的栈, lock 保护 */
+    uint8_t *tx_bufs;
+    uint16_t tx_free[WIRELESS_URING_TX_SLOTS];
+    uint32_t tx_free_count;
+
+    /* 多个 srng 线程会同时发送, sq 只能有一个生产者
+     * lock 保护 sq, tx slot 和 submit_pending, cq 只在 ctx 中处理 */
+    QemuMutex lock;
+    uint32_t submit_pending;
+    QEMUBH *submit_bh;
+
+    AioContext *ctx;
+    bool attached;
+    void (*rx_handler)(void *data, size_t len, void *opaque);
+    void *opaque;
+};
+
+/* 打开介质, 之后 rx_fd / tx_fd 由 io_uring 使用, 关闭仍由调用者负责
+ * tx_fd 会 connect 到 peer, ctx 为 NULL 时在主循环中处理 */
+int wireless_uring_medium_open(struct wireless_uring_medium *u, int rx_fd, int tx_fd,
+                               const struct sockaddr_in *peer, AioContext *ctx,
+                               void (*rx_handler)(void *data, size_t len, void *opaque), void *opaque,
+                               Error **errp);
+
+/* 发送一帧, 没有空闲的 slot 时返回 -ENOBUFS */
+int wireless_uring_medium_send(struct wireless_uring_medium *u, const void *data, size_t len);
+
+/* 取消 rx, 等待所有发送完成后释放 */
+void wireless_uring_medium_close(struct wireless_uring_medium *u);
+
+#else
+
+struct wireless_uring_medium
+{
+};
+
+static inline int wireless_uring_medium_open(struct wireless_uring_medium *u, int rx_fd, int tx_fd,
+                                             const struct sockaddr_in *peer, AioContext *ctx,
+                                             void (*rx_handler)(void *data, size_t len, void *opaque),
+                                             void *opaque, Error **errp)
+{
+    error_setg(errp, "%s: io_uring support is not available in this build", WIRELESS_SIMU_DEVICE_NAME);
+    return -ENOTSUP;
+}
+
+static inline int wireless_uring_medium_send(struct wireless_uring_medium *u, const void *data, size_t len)
+{
+    return -ENOTSUP;
+}
+
+static inline void wireless_uring_medium_close(struct wireless_uring_medium *u)
+{
+}
+
+#endif /* WIRELESS_URING_SUPPORTED */
+
+#endif /* WIRELESS_SIMU_URING */
@@ -1,68 +1,124 @@
 #include "wireless_wmi.h"
 
-static void print_hex_dump(const char *prefix_str, const void *buf, size_t len)
+/* skb 在 guest 中最多映射成的段数 */
+#define WMI_MGMT_TX_IOV_MAX 4
+
+int wireless_simu_wmi_mgmt_send(struct wireless_simu_device_state *wd, const struct wmi_mgmt_send_cmd *cmd,
+                                size_t len)
 {
-    const uint8_t *ptr = buf;
-    size_t i;
+    /* cmd 在 guest 映射的内存中, 按小端读取 */
+    dma_addr_t mgmt_skb_paddr = ldl_le_p(&cmd->paddr_lo) | ((uint64_t)ldl_le_p(&cmd->paddr_hi) << 32);
+    uint32_t mgmt_skb_len = ldl_le_p(&cmd->frame_len);
+    uint32_t mgmt_skb_buf_len = ldl_le_p(&cmd->buf_len);
+
+    const struct wmi_tlv *frame_tlv = (const struct wmi_tlv *)((const uint8_t *)cmd +
+                                                              sizeof(struct wmi_mgmt_send_cmd));
+    struct iovec iov[WMI_MGMT_TX_IOV_MAX];
+    int iovcnt;
+    void *skb_data;
+    int ret;
+
+    if (mgmt_skb_len == 0 || mgmt_skb_len > WIRELESS_TXRX_FRAME_MAX)
+    {
+        printf("%s : wmi mgmt send bad frame len %u \n", WIRELESS_SIMU_DEVICE_NAME, mgmt_skb_len);
+        return -EINVAL;
+    }
 
-    printf("%s : %p : %zu \n", prefix_str, buf, len);
-    for (i = 0; i < len; i++)
+    /* 整帧都在 TLV 中, 直接发送 */
+    if (mgmt_skb_len == mgmt_skb_buf_len)
     {
-        if (i % 16 == 0)
+        if (sizeof(struct wmi_mgmt_send_cmd) + sizeof(struct wmi_tlv) + mgmt_skb_len > len)
         {
-            printf("\n %s : ", prefix_str);
+            printf("%s : wmi mgmt send frame out of cmd %u \n", WIRELESS_SIMU_DEVICE_NAME, mgmt_skb_len);
+            return -EINVAL;
         }
-        printf("%02x ", ptr[i]);
+
+        ret = wireless_tx_data(&wd->txrx, (void *)frame_tlv->value, mgmt_skb_len);
+        return ret < 0 ? ret : 0;
     }
-    printf("\n");
-}
 
-int wireless_simu_wmi_mgmt_send(struct wireless_simu_device_state *wd, struct wmi_mgmt_send_cmd *cmd)
-{
-    dma_addr_t mgmt_skb_paddr = cmd->paddr_lo | ((uint64_t)cmd->paddr_hi << 32);
-    uint32_t mgmt_skb_len = cmd->frame_len;
-    uint32_t mgmt_skb_buf_len = cmd->buf_len;
+    /* 映射 guest 的 skb, 把 iovec 直接交给介质 */
+    iovcnt = wireless_simu_dma_map_iov(wd, mgmt_skb_paddr, mgmt_skb_len, DMA_DIRECTION_TO_DEVICE, iov,
+                                       WMI_MGMT_TX_IOV_MAX);
+    if (iovcnt)
+    {
+        ret = wireless_tx_datav(&wd->txrx, iov, iovcnt);
+        wireless_simu_dma_unmap_iov(wd, iov, iovcnt, DMA_DIRECTION_TO_DEVICE);
+        return ret < 0 ? ret : 0;
+    }
 
-    struct wmi_tlv *frame_tlv = (struct wmi_tlv *)((void *)cmd + sizeof(struct wmi_mgmt_send_cmd));
-    void* skb_data;
-    int ret = 0;
+    /* 映射失败才读出一份 */
+    skb_data = wireless_simu_pool_alloc(&wd->pool, mgmt_skb_len);
+    if (!skb_data)
+    {
+        printf("%s : wmi mgmt send malloc err \n", WIRELESS_SIMU_DEVICE_NAME);
+        return -ENOMEM;
+    }
 
-    if(mgmt_skb_len == mgmt_skb_buf_len){
-        skb_data = (void*)frame_tlv->value;
-    } else {
-        skb_data = malloc(mgmt_skb_len);
-        if(!skb_data){
-            printf("%s : wmi mgmt send malloc err \n", WIRELESS_SIMU_DEVICE_NAME);
-            return -ENOMEM;
-        }
-        ret = pci_dma_read(&wd->parent_obj, mgmt_skb_paddr, skb_data, mgmt_skb_len);
-        if(ret){
-            printf("%s : wmi mgmt send dma read err \n", WIRELESS_SIMU_DEVICE_NAME);
-            free(skb_data);
-            return ret;
-        }
+    ret = pci_dma_read(&wd->parent_obj, mgmt_skb_paddr, skb_data, mgmt_skb_len);
+    if (ret)
+    {
+        printf("%s : wmi mgmt send dma read err \n", WIRELESS_SIMU_DEVICE_NAME);
+        wireless_simu_pool_free(&wd->pool, skb_data);
+        return ret;
     }
 
-    /* 到这里应该就拿到了所有的 skb 数据, 可以进行 send 操作 这里选择直接从高到低打印到控制台 */
-    print_hex_dump("wmi mgmt skb", skb_data, mgmt_skb_len);
+    ret = wireless_tx_data(&wd->txrx, skb_data, mgmt_skb_len);
+    wireless_simu_pool_free(&wd->pool, skb_data);
 
-    return 0;
+    return ret < 0 ? ret : 0;
 }
 
 int wireless_simu_openwifi_mgmt_send(struct wireless_simu_device_state *wd, void* data, size_t len){
     int ret = 0;
 
     // 帧发送
-    wireless_tx_data(data, len);
-    // print_hex_dump("openwifi skb", data, len);
+    wireless_tx_data(&wd->txrx, data, len);
 
     return ret;
 }
 
+/* 数据通路没有接管的帧 */
+static void wireless_simu_openwifi_mgmt_deliver(struct wireless_simu_device_state *wd, void *data, size_t len)
+{
+    /* 固件初始化之后管理帧 (frame control 中 type 为 0) 通过 WMI_MGMT_RX_EVENTID 上报, 其余的照旧 */
+    if (qatomic_read(&wd->wmi.initialized) && len >= 2 && (((uint8_t *)data)[0] & 0x0c) == 0)
+    {
+        wireless_simu_wmi_event_mgmt_rx(wd, data, len);
+        return;
+    }
+
+    wireless_simu_ce_post_data(wd, data, len);
+}
+
 void wireless_simu_openwifi_mgmt_receive(void* data, size_t len, void* device){
     struct wireless_simu_device_state *wd = (struct wireless_simu_device_state *)device;
 
-    printf("%s : socket reveive handler \n", WIRELESS_SIMU_DEVICE_NAME);
+    /* 驱动配置了 REO dst ring 之后数据帧走数据通路 */
+    if (wireless_simu_dp_rx(wd, data, len) == 0)
+    {
+        return;
+    }
 
-    wireless_simu_ce_post_data(wd, data, len);
+    wireless_simu_openwifi_mgmt_deliver(wd, data, len);
+}
+
+void wireless_simu_openwifi_mgmt_receive_batch(void *device, struct iovec *frames, int n)
+{
+    struct wireless_simu_device_state *wd = (struct wireless_simu_device_state *)device;
+    bool taken[WIRELESS_TXRX_BATCH];
+    int count;
+
+    for (int start = 0; start < n; start += count)
+    {
+        count = MIN(n - start, WIRELESS_TXRX_BATCH);
+
+        /* 数据帧一批交给数据通路, 其余的按到达顺序逐帧处理 */
+        wireless_simu_dp_rx_batch(wd, frames + start, count, taken);
+        for (int i = 0; i < count; i++)
+        {
+            if (!taken[i])
+                wireless_simu_openwifi_mgmt_deliver(wd, frames[start + i].iov_base, frames[start + i].iov_len);
+        }
+    }
 }
\ No newline at end of file
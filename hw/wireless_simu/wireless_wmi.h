@@ -33,11 +33,353 @@ struct wmi_tlv
 	uint8_t value[];
 } __attribute__((__packed__));
 
-#define WMI_TLV_LEN GENMASK(15, 0)
-#define WMI_TLV_TAG GENMASK(31, 16)
+#define WMI_TLV_LEN 0x0000ffff // GENMASK(15, 0)
+#define WMI_TLV_TAG 0xffff0000 // GENMASK(31, 16)
 #define TLV_HDR_SIZE sizeof_field(struct wmi_tlv, header)
 
-#define WMI_CMD_HDR_CMD_ID GENMASK(23, 0)
+#define WMI_CMD_HDR_CMD_ID 0x00ffffff // GENMASK(23, 0)
+
+/* cmd id 的高位为 group, 低 12 位为 group 内的序号 */
+#define WMI_CMD_GRP(cmd_id) ((cmd_id) >> 12)
+#define WMI_CMD_GRP_IDX(cmd_id) ((cmd_id) & 0xfff)
+
+struct wmi_mac_addr
+{
+	uint8_t addr[6];
+	uint8_t pad[2];
+} __attribute__((__packed__));
+
+struct wmi_abi_version
+{
+	uint32_t abi_version_0;
+	uint32_t abi_version_1;
+	uint32_t abi_version_ns_0;
+	uint32_t abi_version_ns_1;
+	uint32_t abi_version_ns_2;
+	uint32_t abi_version_ns_3;
+} __attribute__((__packed__));
+
+struct wmi_init_cmd
+{
+	uint32_t tlv_header;
+	struct wmi_abi_version fw_abi_vers;
+	uint32_t num_host_mem_chunks;
+
+	/* Followed by struct wmi_resource_config, host mem chunks and hw mode */
+} __attribute__((__packed__));
+
+/* 只用到开头的字段, 后面还有很多资源配置 */
+struct wmi_resource_config
+{
+	uint32_t tlv_header;
+	uint32_t num_vdevs;
+	uint32_t num_peers;
+	uint32_t num_offload_peers;
+	uint32_t num_offload_reorder_buffs;
+	uint32_t num_peer_keys;
+	uint32_t num_tids;
+} __attribute__((__packed__));
+
+struct wmi_vdev_create_cmd
+{
+	uint32_t tlv_header;
+	uint32_t vdev_id;
+	uint32_t vdev_type;
+	uint32_t vdev_subtype;
+	struct wmi_mac_addr vdev_macaddr;
+	uint32_t num_cfg_txrx_streams;
+	uint32_t pdev_id;
+} __attribute__((__packed__));
+
+struct wmi_vdev_delete_cmd
+{
+	uint32_t tlv_header;
+	uint32_t vdev_id;
+} __attribute__((__packed__));
+
+struct wmi_ssid
+{
+	uint32_t ssid_len;
+	uint32_t ssid[8];
+} __attribute__((__packed__));
+
+struct wmi_vdev_start_request_cmd
+{
+	uint32_t tlv_header;
+	uint32_t vdev_id;
+	uint32_t requestor_id;
+	uint32_t beacon_interval;
+	uint32_t dtim_period;
+	uint32_t flags;
+	struct wmi_ssid ssid;
+	uint32_t bcn_tx_rate;
+	uint32_t bcn_txpower;
+	uint32_t num_noa_descriptors;
+	uint32_t disable_hw_ack;
+	uint32_t preferred_tx_streams;
+	uint32_t preferred_rx_streams;
+	uint32_t he_ops;
+	uint32_t cac_duration_ms;
+	uint32_t regdomain;
+
+	/* Followed by struct wmi_channel and noa descriptors */
+} __attribute__((__packed__));
+
+struct wmi_channel
+{
+	uint32_t tlv_header;
+	uint32_t mhz;
+	uint32_t band_center_freq1;
+	uint32_t band_center_freq2;
+	uint32_t info;
+	uint32_t reg_info_1;
+	uint32_t reg_info_2;
+} __attribute__((__packed__));
+
+struct wmi_vdev_stop_cmd
+{
+	uint32_t tlv_header;
+	uint32_t vdev_id;
+} __attribute__((__packed__));
+
+struct wmi_peer_create_cmd
+{
+	uint32_t tlv_header;
+	uint32_t vdev_id;
+	struct wmi_mac_addr peer_macaddr;
+	uint32_t peer_type;
+} __attribute__((__packed__));
+
+struct wmi_peer_delete_cmd
+{
+	uint32_t tlv_header;
+	uint32_t vdev_id;
+	struct wmi_mac_addr peer_macaddr;
+} __attribute__((__packed__));
+
+/* queue_ptr / queue_no 是驱动给硬件 REO 准备的队列描述, 设备不使用 */
+struct wmi_peer_reorder_queue_setup_cmd
+{
+	uint32_t tlv_header;
+	uint32_t vdev_id;
+	struct wmi_mac_addr peer_macaddr;
+	uint32_t tid;
+	uint32_t queue_ptr_lo;
+	uint32_t queue_ptr_hi;
+	uint32_t queue_no;
+	uint32_t ba_window_size_valid;
+	uint32_t ba_window_size;
+} __attribute__((__packed__));
+
+struct wmi_peer_reorder_queue_remove_cmd
+{
+	uint32_t tlv_header;
+	uint32_t vdev_id;
+	struct wmi_mac_addr peer_macaddr;
+	uint32_t tid_mask;
+} __attribute__((__packed__));
+
+/* 按 AC (BE, BK, VI, VO) 给出的超时, 单位 ms */
+struct wmi_pdev_set_reorder_timeout_val_cmd
+{
+	uint32_t tlv_header;
+	uint32_t rx_timeout_pri[4];
+} __attribute__((__packed__));
+
+struct wmi_start_scan_cmd
+{
+	uint32_t tlv_header;
+	uint32_t scan_id;
+	uint32_t scan_req_id;
+	uint32_t vdev_id;
+	uint32_t scan_priority;
+	uint32_t notify_scan_events;
+	uint32_t dwell_time_active;
+	uint32_t dwell_time_passive;
+	uint32_t min_rest_time;
+	uint32_t max_rest_time;
+	uint32_t repeat_probe_time;
+	uint32_t probe_spacing_time;
+	uint32_t idle_time;
+	uint32_t max_scan_time;
+	uint32_t probe_delay;
+	uint32_t scan_ctrl_flags;
+	uint32_t burst_duration;
+	uint32_t num_chan;
+	uint32_t num_bssid;
+	uint32_t num_ssids;
+	uint32_t ie_len;
+	uint32_t n_probes;
+	struct wmi_mac_addr mac_addr;
+	struct wmi_mac_addr mac_mask;
+
+	/* Followed by the channel list (WMI_TAG_ARRAY_UINT32), ssids, bssids and ies */
+} __attribute__((__packed__));
+
+struct wmi_stop_scan_cmd
+{
+	uint32_t tlv_header;
+	uint32_t requestor;
+	uint32_t scan_id;
+	uint32_t req_type;
+	uint32_t vdev_id;
+	uint32_t pdev_id;
+} __attribute__((__packed__));
+
+/* 事件的 TLV, 和命令一样以 tlv_header 开始 */
+struct wmi_service_ready_event
+{
+	uint32_t tlv_header;
+	uint32_t fw_build_vers;
+	struct wmi_abi_version fw_abi_vers;
+	uint32_t phy_capability;
+	uint32_t max_frag_entry;
+	uint32_t num_rf_chains;
+	uint32_t ht_cap_info;
+	uint32_t vht_cap_info;
+	uint32_t vht_supp_mcs;
+	uint32_t hw_min_tx_power;
+	uint32_t hw_max_tx_power;
+	uint32_t sys_cap_info;
+	uint32_t min_pkt_size_enable;
+	uint32_t max_bcn_ie_size;
+	uint32_t num_mem_reqs;
+	uint32_t max_num_scan_channels;
+	uint32_t hw_bd_id;
+	uint32_t hw_bd_info[5];
+	uint32_t max_supported_macs;
+	uint32_t wmi_fw_sub_feat_caps;
+	uint32_t num_dbs_hw_modes;
+	uint32_t txrx_chainmask;
+	uint32_t default_dbs_hw_mode_index;
+	uint32_t num_msdu_desc;
+
+	/* Followed by the service bitmap (WMI_TAG_ARRAY_UINT32) */
+} __attribute__((__packed__));
+
+#define WMI_SERVICE_BM_SIZE 4
+
+struct wmi_ready_event
+{
+	uint32_t tlv_header;
+	struct wmi_abi_version fw_abi_vers;
+	struct wmi_mac_addr mac_addr;
+	uint32_t status;
+	uint32_t num_dscp_table;
+	uint32_t num_extra_mac_addr;
+	uint32_t num_total_peers;
+	uint32_t num_extra_peers;
+} __attribute__((__packed__));
+
+enum wmi_scan_event_type
+{
+	WMI_SCAN_EVENT_STARTED = BIT(0),
+	WMI_SCAN_EVENT_COMPLETED = BIT(1),
+	WMI_SCAN_EVENT_BSS_CHANNEL = BIT(2),
+	WMI_SCAN_EVENT_FOREIGN_CHAN = BIT(3),
+	WMI_SCAN_EVENT_DEQUEUED = BIT(4),
+	WMI_SCAN_EVENT_PREEMPTED = BIT(5),
+	WMI_SCAN_EVENT_START_FAILED = BIT(6),
+};
+
+enum wmi_scan_completion_reason
+{
+	WMI_SCAN_REASON_COMPLETED,
+	WMI_SCAN_REASON_CANCELLED,
+	WMI_SCAN_REASON_PREEMPTED,
+	WMI_SCAN_REASON_TIMEDOUT,
+	WMI_SCAN_REASON_INTERNAL_FAILURE,
+};
+
+struct wmi_scan_event
+{
+	uint32_t tlv_header;
+	uint32_t event_type;
+	uint32_t reason;
+	uint32_t channel_freq;
+	uint32_t scan_req_id;
+	uint32_t scan_id;
+	uint32_t vdev_id;
+	uint32_t tsf_timestamp;
+} __attribute__((__packed__));
+
+enum wmi_vdev_start_resp_status
+{
+	WMI_VDEV_START_RESPONSE_STATUS_SUCCESS,
+	WMI_VDEV_START_RESPONSE_INVALID_VDEVID,
+	WMI_VDEV_START_RESPONSE_NOT_SUPPORTED,
+};
+
+struct wmi_vdev_start_resp_event
+{
+	uint32_t tlv_header;
+	uint32_t vdev_id;
+	uint32_t requestor_id;
+	uint32_t resp_type;
+	uint32_t status;
+	uint32_t chain_mask;
+	uint32_t smps_mode;
+	uint32_t pdev_id;
+	uint32_t cfgd_tx_streams;
+	uint32_t cfgd_rx_streams;
+} __attribute__((__packed__));
+
+/* vdev stopped / vdev delete resp 只有 vdev_id */
+struct wmi_vdev_event
+{
+	uint32_t tlv_header;
+	uint32_t vdev_id;
+} __attribute__((__packed__));
+
+struct wmi_peer_delete_resp_event
+{
+	uint32_t tlv_header;
+	uint32_t vdev_id;
+	struct wmi_mac_addr peer_macaddr;
+} __attribute__((__packed__));
+
+struct wmi_mgmt_rx_hdr
+{
+	uint32_t tlv_header;
+	uint32_t channel;
+	uint32_t snr;
+	uint32_t rate;
+	uint32_t phy_mode;
+	uint32_t buf_len;
+	uint32_t status;
+	uint32_t flags;
+	int32_t rssi;
+	uint32_t tsf_delta;
+	uint32_t pdev_id;
+
+	/* Followed by the frame (WMI_TAG_ARRAY_BYTE) */
+} __attribute__((__packed__));
+
+enum wmi_mgmt_tx_comp_status_type
+{
+	WMI_MGMT_TX_COMP_TYPE_COMPLETE_OK,
+	WMI_MGMT_TX_COMP_TYPE_DISCARD,
+	WMI_MGMT_TX_COMP_TYPE_INSPECT,
+	WMI_MGMT_TX_COMP_TYPE_COMPLETE_NO_ACK,
+};
+
+struct wmi_mgmt_tx_compl_event
+{
+	uint32_t tlv_header;
+	uint32_t desc_id;
+	uint32_t status;
+	uint32_t pdev_id;
+	uint32_t ppdu_id;
+	int32_t ack_rssi;
+} __attribute__((__packed__));
+
+struct wmi_mgmt_tx_compl_bundle_event
+{
+	uint32_t tlv_header;
+	uint32_t num_reports;
+
+	/* Followed by desc_id, status and ppdu_id arrays (WMI_TAG_ARRAY_UINT32) */
+} __attribute__((__packed__));
 
 /*
  * wmi command groups.
@@ -515,6 +857,37 @@ enum wmi_tlv_cmd_id
 	WMI_PDEV_OBSS_PD_SPATIAL_REUSE_SET_DEF_OBSS_THRESH_CMDID,
 };
 
+#define WMI_EVT_GRP_START_ID(grp_id) (((grp_id) << 12) | 0x1)
+
+/* 设备发出的事件, 只列出到用到的那一项为止 */
+enum wmi_tlv_event_id
+{
+	WMI_SERVICE_READY_EVENTID = 0x1,
+	WMI_READY_EVENTID,
+	WMI_SERVICE_AVAILABLE_EVENTID,
+	WMI_SCAN_EVENTID = WMI_EVT_GRP_START_ID(WMI_GRP_SCAN),
+	WMI_VDEV_START_RESP_EVENTID = WMI_TLV_CMD(WMI_GRP_VDEV),
+	WMI_VDEV_STOPPED_EVENTID,
+	WMI_VDEV_INSTALL_KEY_COMPLETE_EVENTID,
+	WMI_VDEV_MCC_BCN_INTERVAL_CHANGE_REQ_EVENTID,
+	WMI_VDEV_TSF_REPORT_EVENTID,
+	WMI_VDEV_DELETE_RESP_EVENTID,
+	WMI_PEER_STA_KICKOUT_EVENTID = WMI_TLV_CMD(WMI_GRP_PEER),
+	WMI_PEER_INFO_EVENTID,
+	WMI_PEER_TX_FAIL_CNT_THR_EVENTID,
+	WMI_PEER_ESTIMATED_LINKSPEED_EVENTID,
+	WMI_PEER_STATE_EVENTID,
+	WMI_PEER_ASSOC_CONF_EVENTID,
+	WMI_PEER_DELETE_RESP_EVENTID,
+	WMI_MGMT_RX_EVENTID = WMI_TLV_CMD(WMI_GRP_MGMT),
+	WMI_HOST_SWBA_EVENTID,
+	WMI_TBTTOFFSET_UPDATE_EVENTID,
+	WMI_OFFLOAD_BCN_TX_STATUS_EVENTID,
+	WMI_OFFLOAD_PROB_RESP_TX_STATUS_EVENTID,
+	WMI_MGMT_TX_COMPLETION_EVENTID,
+	WMI_MGMT_TX_BUNDLE_COMPLETION_EVENTID,
+};
+
 /** Enum list of TLV Tags for each parameter structure type. */
 enum wmi_tlv_tag
 {
@@ -1304,10 +1677,152 @@ enum wmi_vdev_subtype
 	WMI_VDEV_SUBTYPE_MESH_11S,
 };
 
+/* 设备侧的固件状态, 由 WMI 命令维护 */
+#define WIRELESS_SIMU_WMI_VDEVS_MAX 16
+#define WIRELESS_SIMU_WMI_PEERS_MAX 64
+#define WIRELESS_SIMU_WMI_SCAN_CHANS_MAX 64
+
+/* 一个 tx 完成事件最多确认的帧数, 攒满之后立即发出 */
+#define WIRELESS_SIMU_WMI_TX_COMPL_BATCH 32
+
+/* READY 中给驱动的 credit 数量和每个 credit 对应的消息大小 */
+#define WIRELESS_SIMU_HTC_CREDITS 32
+#define WIRELESS_SIMU_HTC_CREDIT_SIZE 2048
+
+/* 没有指定 dwell time 时每个信道停留的时间, 毫秒 */
+#define WIRELESS_SIMU_WMI_SCAN_DWELL_MS 50
+
+struct wireless_simu_wmi_vdev
+{
+	bool created;
+	bool started;
+	uint32_t type;
+	uint32_t subtype;
+	uint32_t pdev_id;
+	uint8_t mac[6];
+
+	/* vdev start 时的信道和信标间隔 */
+	uint32_t freq;
+	uint32_t beacon_interval;
+};
+
+struct wireless_simu_wmi_peer
+{
+	bool used;
+	uint32_t vdev_id;
+	uint8_t mac[6];
+};
+
+struct wireless_simu_wmi_scan
+{
+	bool running;
+
+	/* 下一个要上报的信道 */
+	uint32_t chan_idx;
+	uint32_t scan_id;
+	uint32_t requestor;
+	uint32_t vdev_id;
+	uint32_t dwell_time_active;
+	uint32_t dwell_time_passive;
+	uint32_t num_chan;
+	uint32_t chans[WIRELESS_SIMU_WMI_SCAN_CHANS_MAX];
+};
+
+struct wireless_simu_wmi
+{
+	/* 收到 WMI_INIT_CMDID 之后才接受其他命令 */
+	bool initialized;
+	uint32_t num_vdevs;
+	uint32_t num_peers;
+
+	struct wireless_simu_wmi_vdev vdevs[WIRELESS_SIMU_WMI_VDEVS_MAX];
+	struct wireless_simu_wmi_peer peers[WIRELESS_SIMU_WMI_PEERS_MAX];
+	struct wireless_simu_wmi_scan scan;
+
+	/* 处理的命令 / 没有处理函数的命令 / TLV 不合法的命令 / 状态不允许而拒绝的命令 */
+	Stat64 cmds;
+	Stat64 unknown;
+	Stat64 malformed;
+	Stat64 rejected;
+
+	/* 以下为事件通道, 见 wireless_wmi_event.c */
+
+	/* 保护 vdev / peer 表, scan 和 tx_compl, 扫描定时器和 flush_bh 不在 srng 线程中运行
+	 * stopped 之后命令处理不再访问定时器和 bh */
+	QemuMutex lock;
+	QEMUTimer *scan_timer;
+	QEMUBH *flush_bh;
+	bool stopped;
+
+	/* wmi 控制服务的 endpoint 和下一个可分配的 endpoint */
+	uint8_t wmi_eid;
+	uint8_t next_eid;
+	uint8_t seq;
+
+	/* 每个 endpoint 上已经处理完, 还没有还给驱动的 credit */
+	uint32_t credits[WIRELESS_HTC_EP_COUNT];
+
+	/* 等待合并上报的 mgmt tx 完成 */
+	uint32_t tx_compl_count;
+	uint32_t tx_compl_desc[WIRELESS_SIMU_WMI_TX_COMPL_BATCH];
+	uint32_t tx_compl_status[WIRELESS_SIMU_WMI_TX_COMPL_BATCH];
+
+	/* 发出的事件 / tx 完成事件 / 其中确认的帧 / 单独发出的 credit report */
+	Stat64 events;
+	Stat64 tx_compl_events;
+	Stat64 tx_compl_reports;
+	Stat64 credit_reports;
+};
+
+/* 处理一条 WMI 命令, data 从 struct wmi_cmd_hdr 开始, 命令由 ce 0 所属的 srng 线程依次处理 */
+int wireless_simu_wmi_cmd(struct wireless_simu_device_state *wd, const void *data, size_t len);
+
+/* 事件通道
+ *
+ * 事件在对象池中组装成 htc 头 + wmi 头 + TLV, 通过 wireless_simu_ce_post_event 交给驱动.
+ * 驱动每发一条 htc 消息用掉一个 credit, 设备处理完之后记下, 放在下一个事件的 trailer 中还给驱动,
+ * 没有事件要发时由 flush_bh 单独发一个只有 trailer 的控制消息.
+ * mgmt tx 完成先攒起来, 由 flush_bh 或者攒满 WIRELESS_SIMU_WMI_TX_COMPL_BATCH 时合并成一个事件 */
+
+/* realize 时调用, 之后 htc READY 在驱动配置好 ring 之后发出 */
+void wireless_simu_wmi_event_init(struct wireless_simu_device_state *wd, AioContext *ctx);
+
+/* 停止定时器和 flush_bh, 之后不再发出事件, 需要在 wireless_hal_stop 之后调用 */
+void wireless_simu_wmi_event_deinit(struct wireless_simu_device_state *wd);
+
+/* 处理 endpoint 0 上的 htc 控制消息, data 从 htc 头之后开始 */
+int wireless_simu_htc_ctrl(struct wireless_simu_device_state *wd, const void *data, size_t len);
+
+/* eid 上的一条消息处理完毕, 记下要还给驱动的 credit */
+void wireless_simu_htc_credit_return(struct wireless_simu_device_state *wd, uint8_t eid);
+
+void wireless_simu_wmi_event_ready(struct wireless_simu_device_state *wd);
+void wireless_simu_wmi_event_vdev_start_resp(struct wireless_simu_device_state *wd, uint32_t vdev_id,
+                                             uint32_t requestor_id, bool restart, uint32_t status);
+void wireless_simu_wmi_event_vdev(struct wireless_simu_device_state *wd, uint32_t event_id, uint32_t vdev_id);
+void wireless_simu_wmi_event_peer_delete_resp(struct wireless_simu_device_state *wd, uint32_t vdev_id,
+                                              const uint8_t *mac);
+
+/* 扫描开始之后按 dwell time 逐个信道上报, 最后上报完成; stop 时上报取消 */
+void wireless_simu_wmi_scan_start(struct wireless_simu_device_state *wd);
+void wireless_simu_wmi_scan_stop(struct wireless_simu_device_state *wd);
+
+/* 记录一帧 mgmt tx 的结果, 稍后合并上报 */
+void wireless_simu_wmi_tx_compl(struct wireless_simu_device_state *wd, uint32_t desc_id, uint32_t status);
+
+/* 把收到的管理帧作为 WMI_MGMT_RX_EVENTID 交给驱动 */
+void wireless_simu_wmi_event_mgmt_rx(struct wireless_simu_device_state *wd, const void *frame, size_t len);
+
 /* 利用 wmi 通道承接的 mgmt 发送函数 */
-int wireless_simu_wmi_mgmt_send(struct wireless_simu_device_state *wd, struct wmi_mgmt_send_cmd *cmd);
+/* 发送 WMI_MGMT_TX_SEND_CMDID 中的管理帧, len 为 cmd 开始的剩余长度
+ * 帧在 TLV 中时直接发送, 否则映射 guest 的 skb 发送, 映射失败时才读出一份 */
+int wireless_simu_wmi_mgmt_send(struct wireless_simu_device_state *wd, const struct wmi_mgmt_send_cmd *cmd,
+                                size_t len);
 
 int wireless_simu_openwifi_mgmt_send(struct wireless_simu_device_state *wd, void* data, size_t len);
 
 void wireless_simu_openwifi_mgmt_receive(void* data, size_t len, void* device);
+
+/* 一次收到多帧时使用, 数据帧一起交给数据通路 */
+void wireless_simu_openwifi_mgmt_receive_batch(void *device, struct iovec *frames, int n);
 #endif /* WIRELESS_SIMU_WMI */
\ No newline at end of file
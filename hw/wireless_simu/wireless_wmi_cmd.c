@@ -0,0 +1,628 @@
+#include "wireless_simu.h"
+
+/* WMI 命令分发
+ *
+ * 每条命令的第一个 TLV 是命令本身的结构体, 后面跟着若干 TLV. 分发表按 group / 序号直接索引,
+ * 表项为 wmi_cmd_descs 中的下标, 0 为没有处理函数. 处理函数拿到的是原始缓冲区中的指针,
+ * 其余的 TLV 通过 wmi_tlv_iter 按需取出, 不做拷贝 */
+
+/* 每个 group 中可以分发的序号范围, 超出的按未知命令处理 */
+#define WMI_CMD_GRP_MAX WMI_GRP_SPATIAL_REUSE
+#define WMI_CMD_GRP_IDX_MAX 128
+
+struct wmi_tlv_iter
+{
+    const uint8_t *pos;
+    const uint8_t *end;
+};
+
+typedef int (*wmi_cmd_handler)(struct wireless_simu_device_state *wd, const void *cmd, size_t len,
+                               struct wmi_tlv_iter *it);
+
+struct wmi_cmd_desc
+{
+    const char *name;
+
+    /* 第一个 TLV 的 tag 和最小长度, 不含 TLV 头 */
+    uint16_t tag;
+    uint16_t min_len;
+
+    /* 初始化之前也可以处理 */
+    bool before_init;
+
+    wmi_cmd_handler handler;
+};
+
+static void wmi_tlv_iter_init(struct wmi_tlv_iter *it, const void *data, size_t len)
+{
+    it->pos = data;
+    it->end = (const uint8_t *)data + len;
+}
+
+/* 取出下一个 TLV, 返回 TLV 头的位置, len 为 value 的长度
+ * 主机按 4 字节对齐放置 TLV, 头中的长度不含填充 */
+static const struct wmi_tlv *wmi_tlv_next(struct wmi_tlv_iter *it, uint16_t *tag, uint16_t *len)
+{
+    const struct wmi_tlv *tlv = (const struct wmi_tlv *)it->pos;
+    size_t left = it->end - it->pos;
+    uint32_t header;
+
+    if (left < TLV_HDR_SIZE)
+        return NULL;
+
+    header = ldl_le_p(&tlv->header);
+    *tag = (header & WMI_TLV_TAG) >> 16;
+    *len = header & WMI_TLV_LEN;
+
+    if (*len > left - TLV_HDR_SIZE)
+        return NULL;
+
+    it->pos += MIN(TLV_HDR_SIZE + ROUND_UP(*len, 4), left);
+    return tlv;
+}
+
+/* 找到下一个 tag 匹配且长度足够的 TLV */
+static const void *wmi_tlv_find(struct wmi_tlv_iter *it, uint16_t tag, size_t min_len, uint16_t *len)
+{
+    const struct wmi_tlv *tlv;
+    uint16_t cur_tag, cur_len;
+
+    while ((tlv = wmi_tlv_next(it, &cur_tag, &cur_len)) != NULL)
+    {
+        if (cur_tag != tag)
+            continue;
+        if (cur_len < min_len)
+            return NULL;
+        if (len)
+            *len = cur_len;
+        return tlv;
+    }
+
+    return NULL;
+}
+
+/* 取得 wmi->lock, 设备已经停止时不持有锁并返回 false
+ * 命令处理中 vdev / peer 表, 扫描状态和定时器都只在持有锁时访问 */
+static bool wmi_lock(struct wireless_simu_wmi *wmi)
+{
+    qemu_mutex_lock(&wmi->lock);
+    if (wmi->stopped)
+    {
+        qemu_mutex_unlock(&wmi->lock);
+        return false;
+    }
+    return true;
+}
+
+/* 调用时持有 wmi->lock */
+static struct wireless_simu_wmi_vdev *wmi_vdev_get(struct wireless_simu_wmi *wmi, uint32_t vdev_id)
+{
+    if (vdev_id >= wmi->num_vdevs || !wmi->vdevs[vdev_id].created)
+        return NULL;
+
+    return &wmi->vdevs[vdev_id];
+}
+
+/* 调用时持有 wmi->lock */
+static struct wireless_simu_wmi_peer *wmi_peer_find(struct wireless_simu_wmi *wmi, uint32_t vdev_id,
+                                                    const uint8_t *mac)
+{
+    for (uint32_t i = 0; i < wmi->num_peers; i++)
+    {
+        struct wireless_simu_wmi_peer *peer = &wmi->peers[i];
+
+        if (peer->used && peer->vdev_id == vdev_id && memcmp(peer->mac, mac, 6) == 0)
+            return peer;
+    }
+
+    return NULL;
+}
+
+static int wmi_cmd_init(struct wireless_simu_device_state *wd, const void *cmd, size_t len, struct wmi_tlv_iter *it)
+{
+    const struct wmi_init_cmd *init = cmd;
+    const struct wmi_resource_config *res;
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+    uint32_t num_vdevs = WIRELESS_SIMU_WMI_VDEVS_MAX;
+    uint32_t num_peers = WIRELESS_SIMU_WMI_PEERS_MAX;
+
+    res = wmi_tlv_find(it, WMI_TAG_RESOURCE_CONFIG, sizeof(*res) - TLV_HDR_SIZE, NULL);
+    if (res)
+    {
+        num_vdevs = MIN(ldl_le_p(&res->num_vdevs), WIRELESS_SIMU_WMI_VDEVS_MAX);
+        num_peers = MIN(ldl_le_p(&res->num_peers), WIRELESS_SIMU_WMI_PEERS_MAX);
+    }
+
+    if (!wmi_lock(wmi))
+        return -ESHUTDOWN;
+
+    /* 驱动重新加载时会再次 init, 丢弃之前的 vdev / peer / scan */
+    memset(wmi->vdevs, 0, sizeof(wmi->vdevs));
+    memset(wmi->peers, 0, sizeof(wmi->peers));
+    timer_del(wmi->scan_timer);
+    memset(&wmi->scan, 0, sizeof(wmi->scan));
+    wmi->num_vdevs = num_vdevs;
+    wmi->num_peers = num_peers;
+    qemu_mutex_unlock(&wmi->lock);
+
+    wireless_simu_reo_remove(wd, NULL, UINT32_MAX);
+    wireless_dp_rx_ring_handler(&wd->dp);
+
+    qatomic_set(&wmi->initialized, true);
+    printf("%s : wmi init abi %u vdevs %u peers %u host mem chunks %u \n", WIRELESS_SIMU_DEVICE_NAME,
+           ldl_le_p(&init->fw_abi_vers.abi_version_0), num_vdevs, num_peers,
+           ldl_le_p(&init->num_host_mem_chunks));
+
+    wireless_simu_wmi_event_ready(wd);
+    return 0;
+}
+
+static int wmi_cmd_vdev_create(struct wireless_simu_device_state *wd, const void *cmd, size_t len,
+                               struct wmi_tlv_iter *it)
+{
+    const struct wmi_vdev_create_cmd *create = cmd;
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+    uint32_t vdev_id = ldl_le_p(&create->vdev_id);
+    struct wireless_simu_wmi_vdev *vdev;
+
+    if (!wmi_lock(wmi))
+        return -ESHUTDOWN;
+
+    if (vdev_id >= wmi->num_vdevs || wmi->vdevs[vdev_id].created)
+    {
+        qemu_mutex_unlock(&wmi->lock);
+        printf("%s : wmi vdev create %u rejected \n", WIRELESS_SIMU_DEVICE_NAME, vdev_id);
+        return -EINVAL;
+    }
+
+    vdev = &wmi->vdevs[vdev_id];
+    memset(vdev, 0, sizeof(*vdev));
+    vdev->created = true;
+    vdev->type = ldl_le_p(&create->vdev_type);
+    vdev->subtype = ldl_le_p(&create->vdev_subtype);
+    vdev->pdev_id = ldl_le_p(&create->pdev_id);
+    memcpy(vdev->mac, create->vdev_macaddr.addr, sizeof(vdev->mac));
+    qemu_mutex_unlock(&wmi->lock);
+
+    printf("%s : wmi vdev create %u type %u subtype %u \n", WIRELESS_SIMU_DEVICE_NAME, vdev_id,
+           ldl_le_p(&create->vdev_type), ldl_le_p(&create->vdev_subtype));
+    return 0;
+}
+
+static int wmi_cmd_vdev_delete(struct wireless_simu_device_state *wd, const void *cmd, size_t len,
+                               struct wmi_tlv_iter *it)
+{
+    const struct wmi_vdev_delete_cmd *del = cmd;
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+    uint32_t vdev_id = ldl_le_p(&del->vdev_id);
+    struct wireless_simu_wmi_vdev *vdev;
+
+    if (!wmi_lock(wmi))
+        return -ESHUTDOWN;
+
+    vdev = wmi_vdev_get(wmi, vdev_id);
+    if (!vdev)
+    {
+        qemu_mutex_unlock(&wmi->lock);
+        return -ENOENT;
+    }
+
+    /* vdev 上的 peer 一起删除 */
+    for (uint32_t i = 0; i < wmi->num_peers; i++)
+    {
+        if (wmi->peers[i].used && wmi->peers[i].vdev_id == vdev_id)
+            wmi->peers[i].used = false;
+    }
+    memset(vdev, 0, sizeof(*vdev));
+    qemu_mutex_unlock(&wmi->lock);
+
+    wireless_simu_wmi_event_vdev(wd, WMI_VDEV_DELETE_RESP_EVENTID, vdev_id);
+    return 0;
+}
+
+/* start 和 restart 的格式相同, 驱动等待 start response, 失败时也要回复 */
+static int wmi_vdev_start(struct wireless_simu_device_state *wd, const void *cmd, struct wmi_tlv_iter *it,
+                          bool restart)
+{
+    const struct wmi_vdev_start_request_cmd *start = cmd;
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+    const struct wmi_channel *chan;
+    uint32_t vdev_id = ldl_le_p(&start->vdev_id);
+    uint32_t requestor_id = ldl_le_p(&start->requestor_id);
+    struct wireless_simu_wmi_vdev *vdev;
+    uint32_t status = WMI_VDEV_START_RESPONSE_STATUS_SUCCESS;
+    uint32_t freq = 0;
+    int ret = 0;
+
+    chan = wmi_tlv_find(it, WMI_TAG_CHANNEL, sizeof(*chan) - TLV_HDR_SIZE, NULL);
+
+    if (!wmi_lock(wmi))
+        return -ESHUTDOWN;
+
+    vdev = wmi_vdev_get(wmi, vdev_id);
+    if (!vdev)
+    {
+        status = WMI_VDEV_START_RESPONSE_INVALID_VDEVID;
+        ret = -ENOENT;
+    }
+    else if (!chan)
+    {
+        status = WMI_VDEV_START_RESPONSE_NOT_SUPPORTED;
+        ret = -EINVAL;
+    }
+    else
+    {
+        freq = ldl_le_p(&chan->mhz);
+        vdev->freq = freq;
+        vdev->started = true;
+        vdev->beacon_interval = ldl_le_p(&start->beacon_interval);
+    }
+    qemu_mutex_unlock(&wmi->lock);
+
+    if (!ret)
+        printf("%s : wmi vdev %s %u freq %u \n", WIRELESS_SIMU_DEVICE_NAME, restart ? "restart" : "start",
+               vdev_id, freq);
+    wireless_simu_wmi_event_vdev_start_resp(wd, vdev_id, requestor_id, restart, status);
+    return ret;
+}
+
+static int wmi_cmd_vdev_start(struct wireless_simu_device_state *wd, const void *cmd, size_t len,
+                              struct wmi_tlv_iter *it)
+{
+    return wmi_vdev_start(wd, cmd, it, false);
+}
+
+static int wmi_cmd_vdev_restart(struct wireless_simu_device_state *wd, const void *cmd, size_t len,
+                                struct wmi_tlv_iter *it)
+{
+    return wmi_vdev_start(wd, cmd, it, true);
+}
+
+static int wmi_cmd_vdev_stop(struct wireless_simu_device_state *wd, const void *cmd, size_t len,
+                             struct wmi_tlv_iter *it)
+{
+    const struct wmi_vdev_stop_cmd *stop = cmd;
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+    uint32_t vdev_id = ldl_le_p(&stop->vdev_id);
+    struct wireless_simu_wmi_vdev *vdev;
+
+    if (!wmi_lock(wmi))
+        return -ESHUTDOWN;
+
+    vdev = wmi_vdev_get(wmi, vdev_id);
+    if (!vdev)
+    {
+        qemu_mutex_unlock(&wmi->lock);
+        return -ENOENT;
+    }
+
+    vdev->started = false;
+    qemu_mutex_unlock(&wmi->lock);
+
+    wireless_simu_wmi_event_vdev(wd, WMI_VDEV_STOPPED_EVENTID, vdev_id);
+    return 0;
+}
+
+static int wmi_cmd_peer_create(struct wireless_simu_device_state *wd, const void *cmd, size_t len,
+                               struct wmi_tlv_iter *it)
+{
+    const struct wmi_peer_create_cmd *create = cmd;
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+    uint32_t vdev_id = ldl_le_p(&create->vdev_id);
+    const uint8_t *mac = create->peer_macaddr.addr;
+    struct wireless_simu_wmi_peer *peer = NULL;
+
+    if (!wmi_lock(wmi))
+        return -ESHUTDOWN;
+
+    if (!wmi_vdev_get(wmi, vdev_id) || wmi_peer_find(wmi, vdev_id, mac))
+    {
+        qemu_mutex_unlock(&wmi->lock);
+        return -EINVAL;
+    }
+
+    for (uint32_t i = 0; i < wmi->num_peers && !peer; i++)
+    {
+        if (wmi->peers[i].used)
+            continue;
+
+        peer = &wmi->peers[i];
+        peer->used = true;
+        peer->vdev_id = vdev_id;
+        memcpy(peer->mac, mac, sizeof(peer->mac));
+    }
+    qemu_mutex_unlock(&wmi->lock);
+
+    if (!peer)
+    {
+        printf("%s : wmi peer table full \n", WIRELESS_SIMU_DEVICE_NAME);
+        return -ENOSPC;
+    }
+
+    printf("%s : wmi peer create vdev %u %02x:%02x:%02x:%02x:%02x:%02x \n", WIRELESS_SIMU_DEVICE_NAME,
+           vdev_id, mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    return 0;
+}
+
+static int wmi_cmd_peer_delete(struct wireless_simu_device_state *wd, const void *cmd, size_t len,
+                               struct wmi_tlv_iter *it)
+{
+    const struct wmi_peer_delete_cmd *del = cmd;
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+    uint32_t vdev_id = ldl_le_p(&del->vdev_id);
+    const uint8_t *mac = del->peer_macaddr.addr;
+    struct wireless_simu_wmi_peer *peer;
+
+    if (!wmi_lock(wmi))
+        return -ESHUTDOWN;
+
+    peer = wmi_peer_find(wmi, vdev_id, mac);
+    if (peer)
+        peer->used = false;
+    qemu_mutex_unlock(&wmi->lock);
+
+    if (!peer)
+        return -ENOENT;
+
+    /* 暂存的帧先交给驱动, 之后不再对这个 peer 重排序 */
+    wireless_simu_reo_remove(wd, mac, UINT32_MAX);
+    wireless_dp_rx_ring_handler(&wd->dp);
+
+    wireless_simu_wmi_event_peer_delete_resp(wd, vdev_id, mac);
+    return 0;
+}
+
+static int wmi_cmd_reorder_queue_setup(struct wireless_simu_device_state *wd, const void *cmd, size_t len,
+                                       struct wmi_tlv_iter *it)
+{
+    const struct wmi_peer_reorder_queue_setup_cmd *setup = cmd;
+    uint32_t win_size = 0;
+    int ret;
+
+    if (ldl_le_p(&setup->ba_window_size_valid))
+        win_size = ldl_le_p(&setup->ba_window_size);
+
+    ret = wireless_simu_reo_setup(wd, setup->peer_macaddr.addr, ldl_le_p(&setup->tid), win_size);
+
+    /* 重新建立时交付的帧 */
+    wireless_dp_rx_ring_handler(&wd->dp);
+    return ret;
+}
+
+static int wmi_cmd_reorder_queue_remove(struct wireless_simu_device_state *wd, const void *cmd, size_t len,
+                                        struct wmi_tlv_iter *it)
+{
+    const struct wmi_peer_reorder_queue_remove_cmd *remove = cmd;
+
+    wireless_simu_reo_remove(wd, remove->peer_macaddr.addr, ldl_le_p(&remove->tid_mask));
+    wireless_dp_rx_ring_handler(&wd->dp);
+    return 0;
+}
+
+static int wmi_cmd_set_reorder_timeout(struct wireless_simu_device_state *wd, const void *cmd, size_t len,
+                                       struct wmi_tlv_iter *it)
+{
+    const struct wmi_pdev_set_reorder_timeout_val_cmd *timeout = cmd;
+
+    for (uint32_t ac = 0; ac < WIRELESS_REO_AC_MAX; ac++)
+    {
+        wireless_simu_reo_set_timeout(wd, ac, ldl_le_p(&timeout->rx_timeout_pri[ac]));
+    }
+    return 0;
+}
+
+static int wmi_cmd_start_scan(struct wireless_simu_device_state *wd, const void *cmd, size_t len,
+                              struct wmi_tlv_iter *it)
+{
+    const struct wmi_start_scan_cmd *start = cmd;
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+    struct wireless_simu_wmi_scan *scan = &wmi->scan;
+    uint32_t vdev_id = ldl_le_p(&start->vdev_id);
+    const struct wmi_tlv *chans;
+    uint16_t chans_len = 0;
+
+    if (!wmi_lock(wmi))
+        return -ESHUTDOWN;
+
+    /* 同一时间只有一次扫描 */
+    if (!wmi_vdev_get(wmi, vdev_id) || scan->running)
+    {
+        qemu_mutex_unlock(&wmi->lock);
+        return -EBUSY;
+    }
+
+    memset(scan, 0, sizeof(*scan));
+    scan->running = true;
+    scan->scan_id = ldl_le_p(&start->scan_id);
+    scan->requestor = ldl_le_p(&start->scan_req_id);
+    scan->vdev_id = vdev_id;
+    scan->dwell_time_active = ldl_le_p(&start->dwell_time_active);
+    scan->dwell_time_passive = ldl_le_p(&start->dwell_time_passive);
+
+    /* 信道列表紧跟在命令之后 */
+    chans = wmi_tlv_find(it, WMI_TAG_ARRAY_UINT32, 0, &chans_len);
+    if (chans)
+    {
+        scan->num_chan = MIN(chans_len / sizeof(uint32_t), WIRELESS_SIMU_WMI_SCAN_CHANS_MAX);
+        for (uint32_t i = 0; i < scan->num_chan; i++)
+        {
+            scan->chans[i] = ldl_le_p(chans->value + i * sizeof(uint32_t));
+        }
+    }
+
+    printf("%s : wmi start scan %u vdev %u chans %u \n", WIRELESS_SIMU_DEVICE_NAME, scan->scan_id, vdev_id,
+           scan->num_chan);
+    wireless_simu_wmi_scan_start(wd);
+    qemu_mutex_unlock(&wmi->lock);
+    return 0;
+}
+
+static int wmi_cmd_stop_scan(struct wireless_simu_device_state *wd, const void *cmd, size_t len,
+                             struct wmi_tlv_iter *it)
+{
+    const struct wmi_stop_scan_cmd *stop = cmd;
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+
+    if (!wmi_lock(wmi))
+        return -ESHUTDOWN;
+
+    if (!wmi->scan.running)
+    {
+        qemu_mutex_unlock(&wmi->lock);
+        return -ENOENT;
+    }
+
+    printf("%s : wmi stop scan %u \n", WIRELESS_SIMU_DEVICE_NAME, ldl_le_p(&stop->scan_id));
+    wireless_simu_wmi_scan_stop(wd);
+    qemu_mutex_unlock(&wmi->lock);
+    return 0;
+}
+
+static int wmi_cmd_mgmt_tx_send(struct wireless_simu_device_state *wd, const void *cmd, size_t len,
+                                struct wmi_tlv_iter *it)
+{
+    const struct wmi_mgmt_send_cmd *send = cmd;
+    int ret = wireless_simu_wmi_mgmt_send(wd, send, len);
+
+    /* 发出或者丢弃都要让驱动释放 skb, 完成合并之后上报 */
+    wireless_simu_wmi_tx_compl(wd, ldl_le_p(&send->desc_id),
+                               ret ? WMI_MGMT_TX_COMP_TYPE_DISCARD : WMI_MGMT_TX_COMP_TYPE_COMPLETE_OK);
+    return ret;
+}
+
+/* 驱动 bring-up 时下发, 设备不需要做任何事情的配置命令 */
+static int wmi_cmd_accept(struct wireless_simu_device_state *wd, const void *cmd, size_t len,
+                          struct wmi_tlv_iter *it)
+{
+    return 0;
+}
+
+/* 分发表的来源: 命令 id, 第一个 TLV 的 tag, 命令结构体, 是否可以在 init 之前处理, 处理函数 */
+#define WMI_CMD_LIST(X)                                                                            \
+    X(WMI_INIT_CMDID, WMI_TAG_INIT_CMD, struct wmi_init_cmd, true, wmi_cmd_init)                    \
+    X(WMI_START_SCAN_CMDID, WMI_TAG_START_SCAN_CMD, struct wmi_start_scan_cmd, false,               \
+      wmi_cmd_start_scan)                                                                          \
+    X(WMI_STOP_SCAN_CMDID, WMI_TAG_STOP_SCAN_CMD, struct wmi_stop_scan_cmd, false, wmi_cmd_stop_scan) \
+    X(WMI_SCAN_CHAN_LIST_CMDID, WMI_TAG_SCAN_CHAN_LIST_CMD, struct wmi_tlv, false, wmi_cmd_accept)   \
+    X(WMI_PDEV_SET_REGDOMAIN_CMDID, WMI_TAG_PDEV_SET_REGDOMAIN_CMD, struct wmi_tlv, false,          \
+      wmi_cmd_accept)                                                                              \
+    X(WMI_PDEV_SET_PARAM_CMDID, WMI_TAG_PDEV_SET_PARAM_CMD, struct wmi_tlv, false, wmi_cmd_accept)  \
+    X(WMI_VDEV_CREATE_CMDID, WMI_TAG_VDEV_CREATE_CMD, struct wmi_vdev_create_cmd, false,            \
+      wmi_cmd_vdev_create)                                                                         \
+    X(WMI_VDEV_DELETE_CMDID, WMI_TAG_VDEV_DELETE_CMD, struct wmi_vdev_delete_cmd, false,            \
+      wmi_cmd_vdev_delete)                                                                         \
+    X(WMI_VDEV_START_REQUEST_CMDID, WMI_TAG_VDEV_START_REQUEST_CMD, struct wmi_vdev_start_request_cmd, \
+      false, wmi_cmd_vdev_start)                                                                   \
+    X(WMI_VDEV_RESTART_REQUEST_CMDID, WMI_TAG_VDEV_START_REQUEST_CMD,                               \
+      struct wmi_vdev_start_request_cmd, false, wmi_cmd_vdev_restart)                              \
+    X(WMI_VDEV_UP_CMDID, WMI_TAG_VDEV_UP_CMD, struct wmi_tlv, false, wmi_cmd_accept)                \
+    X(WMI_VDEV_STOP_CMDID, WMI_TAG_VDEV_STOP_CMD, struct wmi_vdev_stop_cmd, false, wmi_cmd_vdev_stop) \
+    X(WMI_VDEV_DOWN_CMDID, WMI_TAG_VDEV_DOWN_CMD, struct wmi_tlv, false, wmi_cmd_accept)            \
+    X(WMI_VDEV_SET_PARAM_CMDID, WMI_TAG_VDEV_SET_PARAM_CMD, struct wmi_tlv, false, wmi_cmd_accept)  \
+    X(WMI_PEER_CREATE_CMDID, WMI_TAG_PEER_CREATE_CMD, struct wmi_peer_create_cmd, false,            \
+      wmi_cmd_peer_create)                                                                         \
+    X(WMI_PEER_DELETE_CMDID, WMI_TAG_PEER_DELETE_CMD, struct wmi_peer_delete_cmd, false,            \
+      wmi_cmd_peer_delete)                                                                         \
+    X(WMI_PEER_SET_PARAM_CMDID, WMI_TAG_PEER_SET_PARAM_CMD, struct wmi_tlv, false, wmi_cmd_accept)  \
+    X(WMI_PEER_REORDER_QUEUE_SETUP_CMDID, WMI_TAG_REORDER_QUEUE_SETUP_CMD,                          \
+      struct wmi_peer_reorder_queue_setup_cmd, false, wmi_cmd_reorder_queue_setup)                 \
+    X(WMI_PEER_REORDER_QUEUE_REMOVE_CMDID, WMI_TAG_REORDER_QUEUE_REMOVE_CMD,                        \
+      struct wmi_peer_reorder_queue_remove_cmd, false, wmi_cmd_reorder_queue_remove)               \
+    X(WMI_PDEV_SET_REORDER_TIMEOUT_VAL_CMDID, WMI_TAG_PDEV_SET_REORDER_TIMEOUT_VAL_CMD,             \
+      struct wmi_pdev_set_reorder_timeout_val_cmd, false, wmi_cmd_set_reorder_timeout)             \
+    X(WMI_MGMT_TX_SEND_CMDID, WMI_TAG_MGMT_TX_SEND_CMD, struct wmi_mgmt_send_cmd, false,            \
+      wmi_cmd_mgmt_tx_send)
+
+/* 表项序号, 0 为没有处理函数 */
+enum wmi_cmd_slot
+{
+    WMI_CMD_SLOT_NONE,
+#define WMI_CMD_SLOT(id, tag, type, before_init, fn) WMI_CMD_SLOT_##id,
+    WMI_CMD_LIST(WMI_CMD_SLOT)
+#undef WMI_CMD_SLOT
+    WMI_CMD_SLOT_COUNT,
+};
+
+QEMU_BUILD_BUG_ON(WMI_CMD_SLOT_COUNT > UINT8_MAX);
+
+static const struct wmi_cmd_desc wmi_cmd_descs[WMI_CMD_SLOT_COUNT] = {
+#define WMI_CMD_DESC(id, tag_, type, before_init_, fn) \
+    [WMI_CMD_SLOT_##id] = {                            \
+        .name = #id,                                   \
+        .tag = tag_,                                   \
+        .min_len = sizeof(type) - TLV_HDR_SIZE,        \
+        .before_init = before_init_,                   \
+        .handler = fn,                                 \
+    },
+    WMI_CMD_LIST(WMI_CMD_DESC)
+#undef WMI_CMD_DESC
+};
+
+static const uint8_t wmi_cmd_table[WMI_CMD_GRP_MAX + 1][WMI_CMD_GRP_IDX_MAX] = {
+#define WMI_CMD_ENTRY(id, tag, type, before_init, fn) \
+    [WMI_CMD_GRP(id)][WMI_CMD_GRP_IDX(id)] = WMI_CMD_SLOT_##id,
+    WMI_CMD_LIST(WMI_CMD_ENTRY)
+#undef WMI_CMD_ENTRY
+};
+
+static const struct wmi_cmd_desc *wmi_cmd_lookup(uint32_t cmd_id)
+{
+    uint32_t grp = WMI_CMD_GRP(cmd_id);
+    uint32_t idx = WMI_CMD_GRP_IDX(cmd_id);
+    uint8_t slot;
+
+    if (grp > WMI_CMD_GRP_MAX || idx >= WMI_CMD_GRP_IDX_MAX)
+        return NULL;
+
+    slot = wmi_cmd_table[grp][idx];
+    return slot ? &wmi_cmd_descs[slot] : NULL;
+}
+
+int wireless_simu_wmi_cmd(struct wireless_simu_device_state *wd, const void *data, size_t len)
+{
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+    const struct wmi_cmd_desc *desc;
+    const struct wmi_tlv *tlv;
+    struct wmi_tlv_iter it;
+    uint32_t cmd_id;
+    uint16_t tag, tlv_len;
+    int ret;
+
+    if (len < sizeof(struct wmi_cmd_hdr))
+    {
+        stat64_add(&wmi->malformed, 1);
+        return -EINVAL;
+    }
+
+    cmd_id = ldl_le_p(data) & WMI_CMD_HDR_CMD_ID;
+    desc = wmi_cmd_lookup(cmd_id);
+    if (!desc)
+    {
+        stat64_add(&wmi->unknown, 1);
+        printf("%s : wmi unknown cmd %06x grp %02x \n", WIRELESS_SIMU_DEVICE_NAME, cmd_id, WMI_CMD_GRP(cmd_id));
+        return -ENOSYS;
+    }
+
+    /* 第一个 TLV 是命令本身 */
+    wmi_tlv_iter_init(&it, (const uint8_t *)data + sizeof(struct wmi_cmd_hdr), len - sizeof(struct wmi_cmd_hdr));
+    tlv = wmi_tlv_next(&it, &tag, &tlv_len);
+    if (!tlv || tag != desc->tag || tlv_len < desc->min_len)
+    {
+        stat64_add(&wmi->malformed, 1);
+        printf("%s : wmi %s malformed tag %u len %u \n", WIRELESS_SIMU_DEVICE_NAME, desc->name, tlv ? tag : 0,
+               tlv ? tlv_len : 0);
+        return -EINVAL;
+    }
+
+    if (!wmi->initialized && !desc->before_init)
+    {
+        stat64_add(&wmi->rejected, 1);
+        printf("%s : wmi %s before init \n", WIRELESS_SIMU_DEVICE_NAME, desc->name);
+        return -EAGAIN;
+    }
+
+    ret = desc->handler(wd, tlv, len - sizeof(struct wmi_cmd_hdr), &it);
+    stat64_add(ret ? &wmi->rejected : &wmi->cmds, 1);
+
+    return ret;
+}
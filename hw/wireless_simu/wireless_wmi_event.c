@@ -0,0 +1,618 @@
+#include "wireless_wmi.h"
+
+/* HTC / WMI 事件的组装和发送
+ *
+ * 缓冲区从对象池中分配, 开头预留 htc 头, 结尾预留 credit trailer, 组装好之后一次交给 ce,
+ * ce 拷贝进驱动的 buffer 或者暂存队列之后就释放 */
+
+/* trailer 最长为一个 record 头加上每个 endpoint 一个 report */
+#define HTC_TRAILER_MAX (sizeof(uint32_t) + WIRELESS_HTC_EP_COUNT * sizeof(struct wireless_htc_credit_report))
+
+/* 设备固定的能力 */
+#define WMI_EVENT_FW_BUILD_VERS 1
+#define WMI_EVENT_ABI_VERSION 1
+#define WMI_EVENT_SNR 50
+#define WMI_EVENT_NOISE_FLOOR (-96)
+
+struct wmi_event_buf
+{
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+};
+
+static bool wmi_event_alloc(struct wireless_simu_device_state *wd, struct wmi_event_buf *buf, size_t payload)
+{
+    buf->cap = sizeof(struct wireless_htc_hdr) + payload + HTC_TRAILER_MAX;
+    buf->data = wireless_simu_pool_alloc(&wd->pool, buf->cap);
+    if (!buf->data)
+    {
+        printf("%s : wmi event malloc err size %016lx \n", WIRELESS_SIMU_DEVICE_NAME, (uint64_t)buf->cap);
+        return false;
+    }
+
+    memset(buf->data, 0, buf->cap);
+    buf->len = sizeof(struct wireless_htc_hdr);
+    return true;
+}
+
+/* 追加 len 字节, 返回起始位置, 内容已经清零 */
+static void *wmi_event_put(struct wmi_event_buf *buf, size_t len)
+{
+    void *p = buf->data + buf->len;
+
+    assert(buf->len + len <= buf->cap);
+    buf->len += len;
+    return p;
+}
+
+/* 追加一个 TLV, len 为 value 的长度, 返回值指向 tlv_header, 可以直接当作事件结构体使用 */
+static void *wmi_event_put_tlv(struct wmi_event_buf *buf, uint16_t tag, size_t len)
+{
+    uint32_t *hdr;
+
+    len = ROUND_UP(len, 4);
+    hdr = wmi_event_put(buf, TLV_HDR_SIZE + len);
+    stl_le_p(hdr, ((uint32_t)tag << 16) | len);
+    return hdr;
+}
+
+/* 追加一个 WMI_TAG_ARRAY_UINT32, values 为 NULL 时全部为 0 */
+static void wmi_event_put_array(struct wmi_event_buf *buf, const uint32_t *values, uint32_t count)
+{
+    uint32_t *array = wmi_event_put_tlv(buf, WMI_TAG_ARRAY_UINT32, count * sizeof(uint32_t));
+
+    for (uint32_t i = 0; values && i < count; i++)
+    {
+        stl_le_p(&array[1 + i], values[i]);
+    }
+}
+
+/* 分配事件并写好 wmi 头, payload 为 wmi 头之后所有 TLV 的长度 */
+static bool wmi_event_start(struct wireless_simu_device_state *wd, struct wmi_event_buf *buf, uint32_t event_id,
+                            size_t payload)
+{
+    if (!wmi_event_alloc(wd, buf, sizeof(struct wmi_cmd_hdr) + payload))
+        return false;
+
+    stl_le_p(wmi_event_put(buf, sizeof(struct wmi_cmd_hdr)), event_id & WMI_CMD_HDR_CMD_ID);
+    return true;
+}
+
+/* 把所有 endpoint 上待还的 credit 写成 trailer, 返回 trailer 长度 */
+static size_t htc_put_credits(struct wireless_simu_wmi *wmi, struct wmi_event_buf *buf)
+{
+    uint32_t *record = (uint32_t *)(buf->data + buf->len);
+    struct wireless_htc_credit_report *report = (struct wireless_htc_credit_report *)(record + 1);
+    uint32_t len = 0;
+    uint32_t credits;
+
+    for (int eid = WIRELESS_HTC_EP_0 + 1; eid < WIRELESS_HTC_EP_COUNT; eid++)
+    {
+        if (!qatomic_read(&wmi->credits[eid]))
+            continue;
+
+        /* report 中只有 8 位, 多出来的留给下一次 */
+        credits = qatomic_xchg(&wmi->credits[eid], 0);
+        if (credits > UINT8_MAX)
+        {
+            qatomic_add(&wmi->credits[eid], credits - UINT8_MAX);
+            credits = UINT8_MAX;
+        }
+        if (!credits)
+            continue;
+
+        report->eid = eid;
+        report->credits = credits;
+        report++;
+        len += sizeof(*report);
+    }
+
+    if (!len)
+        return 0;
+
+    stl_le_p(record, WIRELESS_HTC_RECORD_CREDITS | len << 8);
+    wmi_event_put(buf, sizeof(*record) + len);
+    return sizeof(*record) + len;
+}
+
+/* 填写 htc 头, 捎带待还的 credit 之后交给 ce, 缓冲区在这里释放 */
+static void htc_send(struct wireless_simu_device_state *wd, struct wmi_event_buf *buf, uint8_t eid)
+{
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+    struct wireless_htc_hdr *hdr = (struct wireless_htc_hdr *)buf->data;
+    size_t trailer;
+    uint32_t flags;
+
+    if (qatomic_read(&wmi->stopped))
+    {
+        wireless_simu_pool_free(&wd->pool, buf->data);
+        return;
+    }
+
+    trailer = htc_put_credits(wmi, buf);
+    flags = trailer ? WIRELESS_HTC_FLAG_TRAILER_PRESENT : 0;
+
+    stl_le_p(&hdr->htc_info, eid | flags << 8 | (uint32_t)(buf->len - sizeof(*hdr)) << 16);
+    stl_le_p(&hdr->ctrl_info, trailer | (uint32_t)qatomic_fetch_inc(&wmi->seq) << 8);
+
+    wireless_simu_ce_post_event(wd, buf->data, buf->len);
+    wireless_simu_pool_free(&wd->pool, buf->data);
+}
+
+static void wmi_event_send(struct wireless_simu_device_state *wd, struct wmi_event_buf *buf)
+{
+    stat64_add(&wd->wmi.events, 1);
+    htc_send(wd, buf, qatomic_read(&wd->wmi.wmi_eid));
+}
+
+/* 没有事件可以捎带时, 在 endpoint 0 上单独发一个只有 trailer 的消息 */
+static void htc_send_credits(struct wireless_simu_device_state *wd)
+{
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+    struct wmi_event_buf buf;
+    bool pending = false;
+
+    for (int eid = WIRELESS_HTC_EP_0 + 1; eid < WIRELESS_HTC_EP_COUNT; eid++)
+    {
+        pending |= qatomic_read(&wmi->credits[eid]) != 0;
+    }
+    if (!pending || !wmi_event_alloc(wd, &buf, 0))
+        return;
+
+    stat64_add(&wmi->credit_reports, 1);
+    htc_send(wd, &buf, WIRELESS_HTC_EP_0);
+}
+
+static void htc_send_ready(struct wireless_simu_device_state *wd)
+{
+    struct wireless_htc_ready *ready;
+    struct wmi_event_buf buf;
+
+    if (!wmi_event_alloc(wd, &buf, sizeof(*ready)))
+        return;
+
+    ready = wmi_event_put(&buf, sizeof(*ready));
+    stl_le_p(&ready->id_credit_count, WIRELESS_HTC_MSG_READY_ID | WIRELESS_SIMU_HTC_CREDITS << 16);
+    stl_le_p(&ready->size_ep, WIRELESS_SIMU_HTC_CREDIT_SIZE | WIRELESS_HTC_EP_COUNT << 16);
+    htc_send(wd, &buf, WIRELESS_HTC_EP_0);
+}
+
+/* 按连接顺序分配 endpoint, wmi 控制服务重新连接说明驱动重新加载了, 从头分配 */
+static int htc_connect_service(struct wireless_simu_device_state *wd, const struct wireless_htc_conn_svc *conn)
+{
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+    struct wireless_htc_conn_svc_resp *resp;
+    struct wmi_event_buf buf;
+    uint32_t svc_id = (ldl_le_p(&conn->msg_svc_id) & WIRELESS_HTC_MSG_SERVICEID) >> 16;
+    uint32_t status = WIRELESS_HTC_CONN_SVC_STATUS_SUCCESS;
+    uint8_t eid;
+
+    if (svc_id == WIRELESS_HTC_SVC_ID_WMI_CONTROL)
+        wmi->next_eid = WIRELESS_HTC_EP_0 + 1;
+
+    eid = wmi->next_eid;
+    if (eid >= WIRELESS_HTC_EP_COUNT)
+    {
+        status = WIRELESS_HTC_CONN_SVC_STATUS_NO_RESOURCES;
+        eid = WIRELESS_HTC_EP_0;
+    }
+    else
+    {
+        wmi->next_eid++;
+        if (svc_id == WIRELESS_HTC_SVC_ID_WMI_CONTROL)
+            qatomic_set(&wmi->wmi_eid, eid);
+    }
+
+    printf("%s : htc connect service %04x eid %u status %u \n", WIRELESS_SIMU_DEVICE_NAME, svc_id, eid, status);
+
+    if (!wmi_event_alloc(wd, &buf, sizeof(*resp)))
+        return -ENOMEM;
+
+    resp = wmi_event_put(&buf, sizeof(*resp));
+    stl_le_p(&resp->msg_svc_id, WIRELESS_HTC_MSG_CONNECT_SERVICE_RESP_ID | svc_id << 16);
+    stl_le_p(&resp->flags_len, status | (uint32_t)eid << 8 | WIRELESS_SIMU_HTC_CREDIT_SIZE << 16);
+    htc_send(wd, &buf, WIRELESS_HTC_EP_0);
+
+    return status == WIRELESS_HTC_CONN_SVC_STATUS_SUCCESS ? 0 : -ENOSPC;
+}
+
+static void wmi_event_service_ready(struct wireless_simu_device_state *wd)
+{
+    struct wmi_service_ready_event *ev;
+    struct wmi_event_buf buf;
+
+    if (!wmi_event_start(wd, &buf, WMI_SERVICE_READY_EVENTID,
+                         sizeof(*ev) + TLV_HDR_SIZE + WMI_SERVICE_BM_SIZE * sizeof(uint32_t)))
+        return;
+
+    ev = wmi_event_put_tlv(&buf, WMI_TAG_SERVICE_READY_EVENT, sizeof(*ev) - TLV_HDR_SIZE);
+    stl_le_p(&ev->fw_build_vers, WMI_EVENT_FW_BUILD_VERS);
+    stl_le_p(&ev->fw_abi_vers.abi_version_0, WMI_EVENT_ABI_VERSION);
+    stl_le_p(&ev->num_rf_chains, 1);
+    stl_le_p(&ev->hw_max_tx_power, 30);
+    stl_le_p(&ev->max_num_scan_channels, WIRELESS_SIMU_WMI_SCAN_CHANS_MAX);
+    stl_le_p(&ev->max_supported_macs, 1);
+    stl_le_p(&ev->txrx_chainmask, 0x01010101);
+    stl_le_p(&ev->num_msdu_desc, WIRELESS_SIMU_WMI_PEERS_MAX);
+
+    /* 不声明任何可选服务 */
+    wmi_event_put_array(&buf, NULL, WMI_SERVICE_BM_SIZE);
+
+    wmi_event_send(wd, &buf);
+}
+
+int wireless_simu_htc_ctrl(struct wireless_simu_device_state *wd, const void *data, size_t len)
+{
+    uint32_t msg_id;
+
+    if (len < sizeof(uint32_t))
+        return -EINVAL;
+
+    msg_id = ldl_le_p(data) & WIRELESS_HTC_MSG_MESSAGEID;
+    switch (msg_id)
+    {
+    case WIRELESS_HTC_MSG_CONNECT_SERVICE_ID:
+        if (len < sizeof(struct wireless_htc_conn_svc))
+            return -EINVAL;
+        return htc_connect_service(wd, data);
+    case WIRELESS_HTC_MSG_SETUP_COMPLETE_ID:
+    case WIRELESS_HTC_MSG_SETUP_COMPLETE_EX_ID:
+        /* htc 启动完成, 固件开始上报 wmi 服务 */
+        printf("%s : htc setup complete \n", WIRELESS_SIMU_DEVICE_NAME);
+        wmi_event_service_ready(wd);
+        return 0;
+    default:
+        printf("%s : htc unknown ctrl msg %04x \n", WIRELESS_SIMU_DEVICE_NAME, msg_id);
+        return -ENOSYS;
+    }
+}
+
+/* 调用时持有 wmi->lock */
+static void wmi_event_kick_locked(struct wireless_simu_wmi *wmi)
+{
+    if (!wmi->stopped)
+        qemu_bh_schedule(wmi->flush_bh);
+}
+
+void wireless_simu_htc_credit_return(struct wireless_simu_device_state *wd, uint8_t eid)
+{
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+
+    if (eid == WIRELESS_HTC_EP_0 || eid >= WIRELESS_HTC_EP_COUNT)
+        return;
+
+    qatomic_inc(&wmi->credits[eid]);
+
+    qemu_mutex_lock(&wmi->lock);
+    wmi_event_kick_locked(wmi);
+    qemu_mutex_unlock(&wmi->lock);
+}
+
+void wireless_simu_wmi_event_ready(struct wireless_simu_device_state *wd)
+{
+    struct wmi_ready_event *ev;
+    struct wmi_event_buf buf;
+
+    if (!wmi_event_start(wd, &buf, WMI_READY_EVENTID, sizeof(*ev)))
+        return;
+
+    ev = wmi_event_put_tlv(&buf, WMI_TAG_READY_EVENT, sizeof(*ev) - TLV_HDR_SIZE);
+    stl_le_p(&ev->fw_abi_vers.abi_version_0, WMI_EVENT_ABI_VERSION);
+    memcpy(ev->mac_addr.addr, wd->mac.a, sizeof(wd->mac.a));
+    stl_le_p(&ev->num_total_peers, wd->wmi.num_peers);
+
+    wmi_event_send(wd, &buf);
+}
+
+void wireless_simu_wmi_event_vdev_start_resp(struct wireless_simu_device_state *wd, uint32_t vdev_id,
+                                             uint32_t requestor_id, bool restart, uint32_t status)
+{
+    struct wmi_vdev_start_resp_event *ev;
+    struct wmi_event_buf buf;
+
+    if (!wmi_event_start(wd, &buf, WMI_VDEV_START_RESP_EVENTID, sizeof(*ev)))
+        return;
+
+    ev = wmi_event_put_tlv(&buf, WMI_TAG_VDEV_START_RESPONSE_EVENT, sizeof(*ev) - TLV_HDR_SIZE);
+    stl_le_p(&ev->vdev_id, vdev_id);
+    stl_le_p(&ev->requestor_id, requestor_id);
+    stl_le_p(&ev->resp_type, restart);
+    stl_le_p(&ev->status, status);
+    stl_le_p(&ev->chain_mask, 1);
+    stl_le_p(&ev->cfgd_tx_streams, 1);
+    stl_le_p(&ev->cfgd_rx_streams, 1);
+    if (vdev_id < WIRELESS_SIMU_WMI_VDEVS_MAX)
+        stl_le_p(&ev->pdev_id, wd->wmi.vdevs[vdev_id].pdev_id);
+
+    wmi_event_send(wd, &buf);
+}
+
+void wireless_simu_wmi_event_vdev(struct wireless_simu_device_state *wd, uint32_t event_id, uint32_t vdev_id)
+{
+    struct wmi_vdev_event *ev;
+    struct wmi_event_buf buf;
+    uint16_t tag = event_id == WMI_VDEV_STOPPED_EVENTID ? WMI_TAG_VDEV_STOPPED_EVENT : WMI_TAG_VDEV_DELETE_RESP_EVENT;
+
+    if (!wmi_event_start(wd, &buf, event_id, sizeof(*ev)))
+        return;
+
+    ev = wmi_event_put_tlv(&buf, tag, sizeof(*ev) - TLV_HDR_SIZE);
+    stl_le_p(&ev->vdev_id, vdev_id);
+
+    wmi_event_send(wd, &buf);
+}
+
+void wireless_simu_wmi_event_peer_delete_resp(struct wireless_simu_device_state *wd, uint32_t vdev_id,
+                                              const uint8_t *mac)
+{
+    struct wmi_peer_delete_resp_event *ev;
+    struct wmi_event_buf buf;
+
+    if (!wmi_event_start(wd, &buf, WMI_PEER_DELETE_RESP_EVENTID, sizeof(*ev)))
+        return;
+
+    ev = wmi_event_put_tlv(&buf, WMI_TAG_PEER_DELETE_RESP_EVENT, sizeof(*ev) - TLV_HDR_SIZE);
+    stl_le_p(&ev->vdev_id, vdev_id);
+    memcpy(ev->peer_macaddr.addr, mac, sizeof(ev->peer_macaddr.addr));
+
+    wmi_event_send(wd, &buf);
+}
+
+static void wmi_event_scan(struct wireless_simu_device_state *wd, struct wireless_simu_wmi_scan *scan,
+                           uint32_t type, uint32_t reason, uint32_t freq)
+{
+    struct wmi_scan_event *ev;
+    struct wmi_event_buf buf;
+
+    if (!wmi_event_start(wd, &buf, WMI_SCAN_EVENTID, sizeof(*ev)))
+        return;
+
+    ev = wmi_event_put_tlv(&buf, WMI_TAG_SCAN_EVENT, sizeof(*ev) - TLV_HDR_SIZE);
+    stl_le_p(&ev->event_type, type);
+    stl_le_p(&ev->reason, reason);
+    stl_le_p(&ev->channel_freq, freq);
+    stl_le_p(&ev->scan_req_id, scan->requestor);
+    stl_le_p(&ev->scan_id, scan->scan_id);
+    stl_le_p(&ev->vdev_id, scan->vdev_id);
+    stl_le_p(&ev->tsf_timestamp, qemu_clock_get_us(QEMU_CLOCK_VIRTUAL));
+
+    wmi_event_send(wd, &buf);
+}
+
+/* 切到下一个信道, 没有信道了就上报完成, 调用时持有 wmi->lock */
+static void wmi_scan_step_locked(struct wireless_simu_device_state *wd)
+{
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+    struct wireless_simu_wmi_scan *scan = &wmi->scan;
+    uint32_t dwell;
+
+    if (scan->chan_idx >= scan->num_chan)
+    {
+        scan->running = false;
+        printf("%s : wmi scan %u completed \n", WIRELESS_SIMU_DEVICE_NAME, scan->scan_id);
+        wmi_event_scan(wd, scan, WMI_SCAN_EVENT_COMPLETED, WMI_SCAN_REASON_COMPLETED, 0);
+        return;
+    }
+
+    wmi_event_scan(wd, scan, WMI_SCAN_EVENT_FOREIGN_CHAN, WMI_SCAN_REASON_COMPLETED, scan->chans[scan->chan_idx++]);
+
+    dwell = scan->dwell_time_active ? scan->dwell_time_active : scan->dwell_time_passive;
+    if (!dwell)
+        dwell = WIRELESS_SIMU_WMI_SCAN_DWELL_MS;
+    timer_mod(wmi->scan_timer, qemu_clock_get_ms(QEMU_CLOCK_VIRTUAL) + dwell);
+}
+
+static void wmi_scan_timer(void *opaque)
+{
+    struct wireless_simu_device_state *wd = opaque;
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+
+    qemu_mutex_lock(&wmi->lock);
+    if (wmi->scan.running && !wmi->stopped)
+        wmi_scan_step_locked(wd);
+    qemu_mutex_unlock(&wmi->lock);
+}
+
+void wireless_simu_wmi_scan_start(struct wireless_simu_device_state *wd)
+{
+    struct wireless_simu_wmi_scan *scan = &wd->wmi.scan;
+
+    if (wd->wmi.stopped)
+    {
+        scan->running = false;
+        return;
+    }
+
+    scan->chan_idx = 0;
+    wmi_event_scan(wd, scan, WMI_SCAN_EVENT_STARTED, WMI_SCAN_REASON_COMPLETED, 0);
+    wmi_scan_step_locked(wd);
+}
+
+void wireless_simu_wmi_scan_stop(struct wireless_simu_device_state *wd)
+{
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+
+    timer_del(wmi->scan_timer);
+    wmi->scan.running = false;
+    wmi_event_scan(wd, &wmi->scan, WMI_SCAN_EVENT_COMPLETED, WMI_SCAN_REASON_CANCELLED, 0);
+}
+
+/* 一次确认多帧时用 bundle 事件, 三个数组分别为 desc_id / status / ppdu_id */
+static void wmi_tx_compl_send(struct wireless_simu_device_state *wd, const uint32_t *desc, const uint32_t *status,
+                              uint32_t count)
+{
+    struct wmi_mgmt_tx_compl_bundle_event *bundle;
+    struct wmi_mgmt_tx_compl_event *ev;
+    struct wmi_event_buf buf;
+
+    if (count == 1)
+    {
+        if (!wmi_event_start(wd, &buf, WMI_MGMT_TX_COMPLETION_EVENTID, sizeof(*ev)))
+            return;
+
+        ev = wmi_event_put_tlv(&buf, WMI_TAG_MGMT_TX_COMPL_EVENT, sizeof(*ev) - TLV_HDR_SIZE);
+        stl_le_p(&ev->desc_id, desc[0]);
+        stl_le_p(&ev->status, status[0]);
+        stl_le_p(&ev->ack_rssi, WMI_EVENT_SNR);
+    }
+    else
+    {
+        if (!wmi_event_start(wd, &buf, WMI_MGMT_TX_BUNDLE_COMPLETION_EVENTID,
+                             sizeof(*bundle) + 3 * (TLV_HDR_SIZE + count * sizeof(uint32_t))))
+            return;
+
+        bundle = wmi_event_put_tlv(&buf, WMI_TAG_MGMT_TX_COMPL_BUNDLE_EVENT, sizeof(*bundle) - TLV_HDR_SIZE);
+        stl_le_p(&bundle->num_reports, count);
+        wmi_event_put_array(&buf, desc, count);
+        wmi_event_put_array(&buf, status, count);
+        wmi_event_put_array(&buf, NULL, count);
+    }
+
+    stat64_add(&wd->wmi.tx_compl_events, 1);
+    stat64_add(&wd->wmi.tx_compl_reports, count);
+    wmi_event_send(wd, &buf);
+}
+
+/* 取走所有待上报的 tx 完成, 调用时持有 wmi->lock */
+static uint32_t wmi_tx_compl_take_locked(struct wireless_simu_wmi *wmi, uint32_t *desc, uint32_t *status)
+{
+    uint32_t count = wmi->tx_compl_count;
+
+    memcpy(desc, wmi->tx_compl_desc, count * sizeof(*desc));
+    memcpy(status, wmi->tx_compl_status, count * sizeof(*status));
+    wmi->tx_compl_count = 0;
+    return count;
+}
+
+void wireless_simu_wmi_tx_compl(struct wireless_simu_device_state *wd, uint32_t desc_id, uint32_t status)
+{
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+    uint32_t desc[WIRELESS_SIMU_WMI_TX_COMPL_BATCH];
+    uint32_t stat[WIRELESS_SIMU_WMI_TX_COMPL_BATCH];
+    uint32_t count = 0;
+
+    qemu_mutex_lock(&wmi->lock);
+    if (wmi->stopped)
+    {
+        qemu_mutex_unlock(&wmi->lock);
+        return;
+    }
+
+    wmi->tx_compl_desc[wmi->tx_compl_count] = desc_id;
+    wmi->tx_compl_status[wmi->tx_compl_count] = status;
+    wmi->tx_compl_count++;
+
+    /* 攒满了直接发出, 否则等这一批命令处理完之后的 flush_bh */
+    if (wmi->tx_compl_count >= WIRELESS_SIMU_WMI_TX_COMPL_BATCH)
+        count = wmi_tx_compl_take_locked(wmi, desc, stat);
+    else
+        wmi_event_kick_locked(wmi);
+    qemu_mutex_unlock(&wmi->lock);
+
+    if (count)
+        wmi_tx_compl_send(wd, desc, stat, count);
+}
+
+static void wmi_event_flush_bh(void *opaque)
+{
+    struct wireless_simu_device_state *wd = opaque;
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+    uint32_t desc[WIRELESS_SIMU_WMI_TX_COMPL_BATCH];
+    uint32_t stat[WIRELESS_SIMU_WMI_TX_COMPL_BATCH];
+    uint32_t count;
+
+    qemu_mutex_lock(&wmi->lock);
+    count = wmi_tx_compl_take_locked(wmi, desc, stat);
+    qemu_mutex_unlock(&wmi->lock);
+
+    /* credit 优先捎带在完成事件上 */
+    if (count)
+        wmi_tx_compl_send(wd, desc, stat, count);
+    htc_send_credits(wd);
+}
+
+/* 信道号只用于上报, 频率不在 2.4G / 5G 时为 0 */
+static uint32_t wmi_freq_to_chan(uint32_t freq)
+{
+    if (freq == 2484)
+        return 14;
+    if (freq >= 2412 && freq < 2484)
+        return (freq - 2407) / 5;
+    if (freq >= 5000 && freq < 5900)
+        return (freq - 5000) / 5;
+    return 0;
+}
+
+void wireless_simu_wmi_event_mgmt_rx(struct wireless_simu_device_state *wd, const void *frame, size_t len)
+{
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+    struct wmi_mgmt_rx_hdr *hdr;
+    struct wmi_event_buf buf;
+    uint8_t *payload;
+    uint32_t freq = 0;
+
+    /* 上报第一个已经启动的 vdev 所在的信道, vdev 表由命令处理在 wmi->lock 下修改 */
+    qemu_mutex_lock(&wmi->lock);
+    for (uint32_t i = 0; i < WIRELESS_SIMU_WMI_VDEVS_MAX; i++)
+    {
+        if (wmi->vdevs[i].started)
+        {
+            freq = wmi->vdevs[i].freq;
+            break;
+        }
+    }
+    qemu_mutex_unlock(&wmi->lock);
+
+    if (!wmi_event_start(wd, &buf, WMI_MGMT_RX_EVENTID, sizeof(*hdr) + TLV_HDR_SIZE + ROUND_UP(len, 4)))
+        return;
+
+    hdr = wmi_event_put_tlv(&buf, WMI_TAG_MGMT_RX_HDR, sizeof(*hdr) - TLV_HDR_SIZE);
+    stl_le_p(&hdr->channel, wmi_freq_to_chan(freq));
+    stl_le_p(&hdr->snr, WMI_EVENT_SNR);
+    stl_le_p(&hdr->buf_len, len);
+    stl_le_p(&hdr->rssi, WMI_EVENT_SNR + WMI_EVENT_NOISE_FLOOR);
+
+    payload = (uint8_t *)wmi_event_put_tlv(&buf, WMI_TAG_ARRAY_BYTE, len) + TLV_HDR_SIZE;
+    memcpy(payload, frame, len);
+
+    wmi_event_send(wd, &buf);
+}
+
+void wireless_simu_wmi_event_init(struct wireless_simu_device_state *wd, AioContext *ctx)
+{
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+
+    qemu_mutex_init(&wmi->lock);
+    wmi->stopped = false;
+    wmi->wmi_eid = WIRELESS_HTC_EP_0 + 1;
+    wmi->next_eid = WIRELESS_HTC_EP_0 + 1;
+    wmi->tx_compl_count = 0;
+    memset(wmi->credits, 0, sizeof(wmi->credits));
+
+    /* 和 srng 的中断合并定时器一样放在数据面的 AioContext 中 */
+    wmi->scan_timer = ctx ? aio_timer_new(ctx, QEMU_CLOCK_VIRTUAL, SCALE_MS, wmi_scan_timer, wd)
+                          : timer_new_ms(QEMU_CLOCK_VIRTUAL, wmi_scan_timer, wd);
+    wmi->flush_bh = aio_bh_new(ctx ? ctx : qemu_get_aio_context(), wmi_event_flush_bh, wd);
+
+    /* ring 还没有配置, READY 先进入暂存队列, 驱动补充 buffer 之后发出 */
+    htc_send_ready(wd);
+}
+
+void wireless_simu_wmi_event_deinit(struct wireless_simu_device_state *wd)
+{
+    struct wireless_simu_wmi *wmi = &wd->wmi;
+
+    qemu_mutex_lock(&wmi->lock);
+    qatomic_set(&wmi->stopped, true);
+    wmi->scan.running = false;
+    wmi->tx_compl_count = 0;
+    qemu_mutex_unlock(&wmi->lock);
+
+    /* srng 线程已经停止, 不会再有命令; 定时器的回调可能还在等锁, 锁保留到设备释放
+     * stopped 之后回调和命令处理都不会再使用定时器和 bh */
+    timer_free(wmi->scan_timer);
+    wmi->scan_timer = NULL;
+    qemu_bh_delete(wmi->flush_bh);
+    wmi->flush_bh = NULL;
+}